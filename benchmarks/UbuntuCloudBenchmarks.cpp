@@ -0,0 +1,358 @@
+/**
+ * @file UbuntuCloudBenchmarks.cpp
+ * @brief Microbenchmarks of the parse, index and query paths, built with -DBUILD_BENCHMARKS=ON.
+ *
+ * Every benchmark runs on product files read from the local disk, no network access takes place:
+ * - Synthetic catalogs, generated on the first run into the temporary directory at 1x (about the size of the released
+ *   download stream), 10x and 100x the number of releases.
+ * - Recorded catalogs, i.e. product files saved from the mirror, e.g. the `.json` files of the cache directory. Their
+ *   paths are given after the Google Benchmark options:
+ *
+ *       ubuntu-version-fetcher-benchmarks --benchmark_filter=Query ~/.cache/ubuntu-version-fetcher/6185b4fb21dbf654.json
+ *
+ * The queries go through UbuntuCloudFetcher with a file:// URL, as the command line would run them. The parse runs once
+ * per compiled-in parser backend, after checking that every backend reads each input into the same products.
+ */
+
+#include "UbuntuCloudFetcher.hpp"
+#include "UbuntuCloudParser.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Architectures of every synthetic product.
+static const std::vector<std::string> synthetic_archs { "amd64", "arm64", "armhf", "ppc64el", "riscv64", "s390x" };
+
+/// Items of every synthetic version.
+static const std::vector<std::string> synthetic_items { "disk1.img", "root.tar.xz", "lxd.tar.xz", "squashfs", "manifest", "vmdk" };
+
+/// Releases of the 1x synthetic catalog.
+constexpr static int synthetic_base_releases { 30 };
+
+/// Serials of every synthetic product.
+constexpr static int synthetic_serials { 15 };
+
+/// Releases still supported in a synthetic catalog, the most recent ones.
+constexpr static int synthetic_supported_releases { 8 };
+
+/**
+ * @struct BenchmarkInput
+ * @brief A product file to benchmark on.
+ */
+struct BenchmarkInput {
+    std::string           name;         ///< Label in the benchmark names, e.g. "synthetic-10x".
+    std::filesystem::path path;         ///< The product file.
+    std::string           sha256Query;  ///< A release with a disk image, for getSha256ForRelease().
+};
+
+/**
+ * @brief Writes a synthetic product file.
+ *
+ * Releases follow the real numbering (10.04, 10.10, 11.04, ...), every April release of an even year is an LTS and the
+ * last one carries the "lts" alias. Serials include point releases so that the serial keys are exercised.
+ * @param path The file to write.
+ * @param release_count Number of releases.
+ * @return std::string The codename of the last LTS release.
+ */
+static std::string writeSyntheticCatalog(const std::filesystem::path& path, int release_count) {
+  int last_lts { 0 };
+  for (int release = 0; release < release_count; release++) {
+    if (release % 4 == 0) {
+      last_lts = release;
+    }
+  }
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  output << R"({"content_id":"com.ubuntu.cloud:released:download","format":"products:1.0","products":{)";
+  std::uint64_t hash { 14695981039346656037ULL };  // Stand-in sha256 values, distinct and deterministic
+  bool          first_product { true };
+  for (int release = 0; release < release_count; release++) {
+    // Versions keep increasing past 99 on the larger scales, which is fine for the queries
+    std::string version { std::to_string(10 + release / 2) + (release % 2 == 0 ? ".04" : ".10") };
+    std::string codename { "codename" + std::to_string(release) };
+    bool        lts { release % 4 == 0 };
+    bool        supported { release >= release_count - synthetic_supported_releases };
+    for (const std::string& arch : synthetic_archs) {
+      output << (first_product ? "" : ",") << "\"com.ubuntu.cloud:server:" << version << ":" << arch << "\":{";
+      first_product = false;
+      output << "\"release\":\"" << codename << "\",\"release_title\":\"" << version << (lts ? " LTS" : "") << "\",\"arch\":\"" << arch
+             << "\",\"aliases\":\"" << version << "," << codename << (release == last_lts ? ",lts" : "") << "\",\"version\":\"" << version
+             << "\",\"supported\":" << (supported ? "true" : "false") << ",\"os\":\"ubuntu\",\"versions\":{";
+      for (int serial = 0; serial < synthetic_serials; serial++) {
+        std::string serial_text { std::to_string(20100101 + release * 10000 + serial * 7) + (serial % 5 == 4 ? ".1" : "") };
+        output << (serial == 0 ? "" : ",") << "\"" << serial_text << "\":{\"label\":\"release\",\"items\":{";
+        for (std::size_t item = 0; item < synthetic_items.size(); item++) {
+          hash = (hash ^ static_cast<std::uint64_t>(item + 1)) * 1099511628211ULL;
+          std::ostringstream sha256 {};
+          sha256 << std::hex << hash << hash << hash << hash;
+          output << (item == 0 ? "" : ",") << "\"" << synthetic_items[item] << "\":{\"ftype\":\"" << synthetic_items[item]
+                 << "\",\"path\":\"server/releases/" << codename << "/release-" << serial_text << "/" << synthetic_items[item]
+                 << "\",\"size\":123456789,\"md5\":\"0123456789abcdef0123456789abcdef\",\"sha256\":\"" << sha256.str() << "\"}";
+        }
+        output << "}}";
+      }
+      output << "}}";
+    }
+  }
+  output << R"(},"updated":"Thu, 01 Jan 2026 00:00:00 +0000"})";
+  return "codename" + std::to_string(last_lts);
+}
+
+/**
+ * @brief Reads a whole file.
+ * @param path The file.
+ * @return std::string Its contents, empty if it cannot be read.
+ */
+static std::string readFile(const std::filesystem::path& path) {
+  std::ifstream      input(path, std::ios::binary);
+  std::ostringstream contents {};
+  contents << input.rdbuf();
+  return contents.str();
+}
+
+/**
+ * @brief Times the parse of a product file held in memory.
+ * @param state The benchmark state.
+ * @param input The product file.
+ * @param backend The parser backend.
+ */
+static void benchmarkParse(benchmark::State& state, const BenchmarkInput& input, UbuntuCloudParserBackend backend) {
+  std::string text { readFile(input.path) };
+  for (auto _ : state) {
+    std::istringstream         stream(text);
+    std::vector<UbuntuProduct> products {};
+    std::string                error {};
+    if (!parseProductStream(stream, products, error, backend)) {
+      state.SkipWithError(error.c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(products.data());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+
+/**
+ * @brief Compares two parses of the same product file, field by field.
+ * @param first The products of one backend.
+ * @param second The products of another backend.
+ * @return bool True if both hold the same products, versions and items.
+ */
+static bool sameProducts(const std::vector<UbuntuProduct>& first, const std::vector<UbuntuProduct>& second) {
+  auto same_item = [](const UbuntuProductItem& left, const UbuntuProductItem& right) {
+    return left.name == right.name && left.sha256 == right.sha256 && left.path == right.path && left.size == right.size;
+  };
+  auto same_version = [&same_item](const UbuntuProductVersion& left, const UbuntuProductVersion& right) {
+    return left.serial == right.serial && std::equal(left.items.begin(), left.items.end(), right.items.begin(), right.items.end(), same_item);
+  };
+  auto same_product = [&same_version](const UbuntuProduct& left, const UbuntuProduct& right) {
+    return left.name == right.name && left.release == right.release && left.release_title == right.release_title && left.arch == right.arch &&
+           left.aliases == right.aliases && left.version == right.version && left.supported == right.supported &&
+           std::equal(left.versions.begin(), left.versions.end(), right.versions.begin(), right.versions.end(), same_version);
+  };
+  return std::equal(first.begin(), first.end(), second.begin(), second.end(), same_product);
+}
+
+/**
+ * @brief Checks that every parser backend reads a product file into the same products as the default one.
+ * @param input The product file.
+ * @return bool True if the backends agree, false after reporting the first one that does not.
+ */
+static bool backendsAgree(const BenchmarkInput& input) {
+  std::vector<UbuntuCloudParserBackend> backends { availableParserBackends() };
+  std::string                           text { readFile(input.path) };
+  std::vector<UbuntuProduct>            reference {};
+  std::string                           error {};
+  std::istringstream                    reference_stream(text);
+  if (!parseProductStream(reference_stream, reference, error, backends.front())) {
+    return true;  // The parse benchmarks report the error
+  }
+  for (std::size_t idx = 1; idx < backends.size(); idx++) {
+    std::istringstream         stream(text);
+    std::vector<UbuntuProduct> products {};
+    if (!parseProductStream(stream, products, error, backends[idx]) || !sameProducts(reference, products)) {
+      std::cerr << "Warning: the " << parserBackendName(backends[idx]) << " parser does not read " << input.path.string() << " as the "
+                << parserBackendName(backends.front()) << " parser does\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Times building the indexed catalog from parsed products.
+ * @param state The benchmark state.
+ * @param input The product file.
+ */
+static void benchmarkIndex(benchmark::State& state, const BenchmarkInput& input) {
+  std::ifstream              stream(input.path, std::ios::binary);
+  std::vector<UbuntuProduct> products {};
+  std::string                error {};
+  if (!parseProductStream(stream, products, error)) {
+    state.SkipWithError(error.c_str());
+    return;
+  }
+  for (auto _ : state) {
+    UbuntuCloudCatalog catalog(products);
+    benchmark::DoNotOptimize(catalog.productCount());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(products.size()));
+}
+
+/**
+ * @brief Loads a product file through the fetcher, once per input and benchmark.
+ * @param state The benchmark state, marked as failed if the file cannot be loaded.
+ * @param input The product file.
+ * @return std::unique_ptr<UbuntuCloudFetcher> The fetcher, or nullptr on failure.
+ */
+static std::unique_ptr<UbuntuCloudFetcher> loadFetcher(benchmark::State& state, const BenchmarkInput& input) {
+  auto fetcher { std::make_unique<UbuntuCloudFetcher>("file://" + std::filesystem::absolute(input.path).string()) };
+  if (!fetcher->isInitialized()) {
+    state.SkipWithError("The product file could not be loaded");
+    return nullptr;
+  }
+  return fetcher;
+}
+
+/**
+ * @brief Times getSupportedReleases().
+ * @param state The benchmark state.
+ * @param input The product file.
+ */
+static void benchmarkSupportedReleases(benchmark::State& state, const BenchmarkInput& input) {
+  std::unique_ptr<UbuntuCloudFetcher> fetcher { loadFetcher(state, input) };
+  for (auto _ : state) {
+    if (!fetcher) {
+      break;
+    }
+    benchmark::DoNotOptimize(fetcher->getSupportedReleases());
+  }
+}
+
+/**
+ * @brief Times getCurrentLTS().
+ * @param state The benchmark state.
+ * @param input The product file.
+ */
+static void benchmarkCurrentLTS(benchmark::State& state, const BenchmarkInput& input) {
+  std::unique_ptr<UbuntuCloudFetcher> fetcher { loadFetcher(state, input) };
+  for (auto _ : state) {
+    if (!fetcher) {
+      break;
+    }
+    benchmark::DoNotOptimize(fetcher->getCurrentLTS());
+  }
+}
+
+/**
+ * @brief Times getSha256ForRelease() on a release that has a disk image.
+ * @param state The benchmark state.
+ * @param input The product file.
+ */
+static void benchmarkSha256ForRelease(benchmark::State& state, const BenchmarkInput& input) {
+  std::unique_ptr<UbuntuCloudFetcher> fetcher { loadFetcher(state, input) };
+  for (auto _ : state) {
+    if (!fetcher) {
+      break;
+    }
+    benchmark::DoNotOptimize(fetcher->getSha256ForRelease(input.sha256Query));
+  }
+}
+
+/**
+ * @brief Times the serial sort keys that replaced isMoreRecentVersion(), by sorting a list of serials.
+ * @param state The benchmark state, whose range is the number of serials.
+ */
+static void benchmarkSerialOrder(benchmark::State& state) {
+  std::vector<UbuntuProductVersion> versions {};
+  for (std::int64_t serial = 0; serial < state.range(0); serial++) {
+    // Descending input, with point releases, is the worst case for the comparisons
+    versions.push_back({ std::to_string(20991231 - serial / 2) + (serial % 2 == 0 ? "" : ".1"), {} });
+  }
+  for (auto _ : state) {
+    std::vector<UbuntuProductVersion> sorted { versions };
+    std::sort(sorted.begin(), sorted.end(), versionPrecedes);
+    benchmark::DoNotOptimize(sorted.data());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(benchmarkSerialOrder)->Arg(16)->Arg(256)->Arg(4096);
+
+/**
+ * @brief Times serialSortKey() alone.
+ * @param state The benchmark state.
+ */
+static void benchmarkSerialSortKey(benchmark::State& state) {
+  const std::vector<std::string> serials { "20240423", "20240423.1", "20991231.12", "release-20240423", "" };
+  for (auto _ : state) {
+    for (const std::string& serial : serials) {
+      benchmark::DoNotOptimize(serialSortKey(serial));
+    }
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(serials.size()));
+}
+BENCHMARK(benchmarkSerialSortKey);
+
+int main(int argc, char* argv[]) {
+  benchmark::Initialize(&argc, argv);  // Removes its own options, the remaining arguments are recorded catalogs
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  std::vector<BenchmarkInput> inputs {};
+  std::filesystem::path       directory { std::filesystem::temp_directory_path() / "ubuntu-version-fetcher-benchmarks" };
+  std::filesystem::create_directories(directory);
+  for (int scale : { 1, 10, 100 }) {
+    std::string           name { "synthetic-" + std::to_string(scale) + "x" };
+    std::filesystem::path path { directory / (name + ".json") };
+    std::filesystem::path lts_path { directory / (name + ".lts") };
+    std::string           lts_codename {};
+    if (std::filesystem::exists(path) && std::filesystem::exists(lts_path)) {
+      lts_codename = readFile(lts_path);  // Generated by a previous run
+    } else {
+      std::cerr << "Generating " << path.string() << "\n";
+      lts_codename = writeSyntheticCatalog(path, synthetic_base_releases * scale);
+      std::ofstream(lts_path, std::ios::binary | std::ios::trunc) << lts_codename;
+    }
+    inputs.push_back({ name, path, lts_codename });
+  }
+  for (int idx = 1; idx < argc; idx++) {
+    std::filesystem::path path { argv[idx] };
+    // Query the current LTS, which every recorded released stream has
+    UbuntuCloudFetcher           fetcher("file://" + std::filesystem::absolute(path).string());
+    std::optional<UbuntuRelease> lts { fetcher.isInitialized() ? fetcher.getCurrentLTS() : std::nullopt };
+    if (!lts) {
+      std::cerr << "Skipping " << path.string() << ": not a product file with an LTS release\n";
+      continue;
+    }
+    // The LTS name is "<version> (<codename>)", the codename is a valid query
+    std::size_t open { lts->release_name.find('(') };
+    std::size_t close { lts->release_name.find(')', open) };
+    std::string codename { open == std::string::npos || close == std::string::npos ? lts->release_name
+                                                                                  : lts->release_name.substr(open + 1, close - open - 1) };
+    inputs.push_back({ "recorded-" + path.filename().string(), path, codename });
+  }
+
+  for (const BenchmarkInput& input : inputs) {
+    backendsAgree(input);
+    for (UbuntuCloudParserBackend backend : availableParserBackends()) {
+      benchmark::RegisterBenchmark(("Parse/" + std::string(parserBackendName(backend)) + "/" + input.name).c_str(), benchmarkParse, input, backend)
+          ->Unit(benchmark::kMillisecond);
+    }
+    benchmark::RegisterBenchmark(("Index/" + input.name).c_str(), benchmarkIndex, input)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("QuerySupportedReleases/" + input.name).c_str(), benchmarkSupportedReleases, input)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("QueryCurrentLTS/" + input.name).c_str(), benchmarkCurrentLTS, input)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark(("QuerySha256ForRelease/" + input.name).c_str(), benchmarkSha256ForRelease, input)
+        ->Unit(benchmark::kNanosecond);
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  curl_global_cleanup();
+  return 0;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file UbuntuCloudArena.cpp
+ * @brief Implementation of the UbuntuCloudArena class.
+ */
+
+#include "UbuntuCloudArena.hpp"
+
+#include <cstring>
+
+UbuntuCloudArena::UbuntuCloudArena(): _blocks(), _next(nullptr), _available(0), _capacity(0) { }
+
+std::string_view UbuntuCloudArena::store(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  if (text.size() > this->_available) {
+    if (text.size() > block_size / 4) {
+      // A large string gets an exact block, the free space of the current one stays usable. Blocks are left uninitialized
+      char* block { this->_blocks.emplace_back(std::unique_ptr<char[]>(new char[text.size()])).get() };
+      this->_capacity += text.size();
+      std::memcpy(block, text.data(), text.size());
+      return { block, text.size() };
+    }
+    this->_next      = this->_blocks.emplace_back(std::unique_ptr<char[]>(new char[block_size])).get();
+    this->_available = block_size;
+    this->_capacity += block_size;
+  }
+  char* copy { this->_next };
+  std::memcpy(copy, text.data(), text.size());
+  this->_next += text.size();
+  this->_available -= text.size();
+  return { copy, text.size() };
+}
@@ -0,0 +1,57 @@
+/**
+ * @file UbuntuCloudArena.hpp
+ * @brief Declares UbuntuCloudArena, a monotonic store for the strings of the parsed product records.
+ *
+ * A product file holds tens of thousands of short strings (item names, sha256 digests, paths). Stored as separate
+ * std::string objects, each one is its own heap allocation, freed one by one once the catalog is built. The arena
+ * copies them back to back into a few large blocks instead, which are allocated as the parse goes and released
+ * together with the arena.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class UbuntuCloudArena
+ * @brief Append-only string storage. Stored strings stay valid, and never move, for the lifetime of the arena.
+ */
+class UbuntuCloudArena {
+  private:
+    /// Blocks holding the strings, in allocation order.
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    /// First free byte of the current block.
+    char* _next;
+    /// Free bytes left in the current block.
+    std::size_t _available;
+    /// Bytes of every block.
+    std::size_t _capacity;
+
+  public:
+    /// Size of a regular block. Strings larger than a quarter of it get a block of their own.
+    static constexpr std::size_t block_size { 16 * 1024 };
+
+    /**
+     * @brief Constructs an empty arena. The first block is allocated by the first store().
+     */
+    UbuntuCloudArena();
+
+    UbuntuCloudArena(const UbuntuCloudArena&)            = delete;
+    UbuntuCloudArena& operator=(const UbuntuCloudArena&) = delete;
+
+    /**
+     * @brief Copies a string into the arena.
+     * @param text The string.
+     * @return std::string_view The copy, empty for an empty string.
+     */
+    std::string_view store(std::string_view text);
+
+    /**
+     * @brief Returns the memory held by the arena.
+     * @return std::size_t Bytes of every block, used or not.
+     */
+    std::size_t capacity() const { return this->_capacity; }
+};
@@ -0,0 +1,249 @@
+/**
+ * @file UbuntuCloudC.cpp
+ * @brief Implementation of the C interface on top of UbuntuCloudFactory.
+ *
+ * The handle owns the UbuntuCloudInterface the factory creates, with the same cache and snapshot locations as the
+ * command line tool. Queries go straight to its const methods, which only read the immutable catalog.
+ */
+
+#include "UbuntuCloudC.h"
+
+#include "UbuntuCloudFactory.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+/// A loaded catalog.
+struct ubuntu_cloud {
+    std::unique_ptr<UbuntuCloudInterface> catalog;  ///< The fetcher or snapshot answering the queries.
+};
+
+/// Releases returned by a query.
+struct ubuntu_cloud_release_list {
+    std::vector<UbuntuRelease> releases;  ///< The releases, as the query returned them.
+};
+
+/**
+ * @brief Initializes libcurl once per process, whichever thread loads first.
+ */
+static void initializeCurl() {
+  static std::once_flag curl_initialized {};
+  std::call_once(curl_initialized, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+}
+
+/**
+ * @brief Parses the comma-separated stream selectors of ubuntu_cloud_load().
+ * @param specification The selectors, may be null.
+ * @param[out] streams Receives the selectors, empty for the default stream.
+ * @return bool False if a selector is invalid.
+ */
+static bool parseStreams(const char* specification, std::vector<UbuntuCloudStreamSelector>& streams) {
+  if (specification == nullptr) {
+    return true;
+  }
+  std::string text { specification };
+  std::size_t begin { 0 };
+  while (begin < text.size()) {
+    std::size_t                              end { std::min(text.find(',', begin), text.size()) };
+    std::optional<UbuntuCloudStreamSelector> stream { UbuntuCloudFactory::createStreamSelector(text.substr(begin, end - begin)) };
+    if (!stream) {
+      return false;
+    }
+    streams.push_back(std::move(*stream));
+    begin = end + 1;
+  }
+  return true;
+}
+
+int ubuntu_cloud_api_version(void) {
+  return UBUNTU_CLOUD_API_VERSION;
+}
+
+const char* ubuntu_cloud_status_message(ubuntu_cloud_status status) {
+  switch (status) {
+    case UBUNTU_CLOUD_OK:
+      return "Success";
+    case UBUNTU_CLOUD_LOAD_FAILED:
+      return "The catalog could not be loaded";
+    case UBUNTU_CLOUD_NOT_LOADED:
+      return "The catalog is not loaded";
+    case UBUNTU_CLOUD_NOT_FOUND:
+      return "Not found in the catalog";
+    case UBUNTU_CLOUD_INVALID_ARGUMENT:
+      return "Invalid argument";
+    default:
+      return "Internal error";
+  }
+}
+
+ubuntu_cloud_status ubuntu_cloud_load(const char* cache_directory, const char* streams, long long max_age_seconds, unsigned flags,
+                                      ubuntu_cloud** handle) {
+  if (handle == nullptr) {
+    return UBUNTU_CLOUD_INVALID_ARGUMENT;
+  }
+  *handle = nullptr;
+  try {
+    std::vector<UbuntuCloudStreamSelector> selectors {};
+    if (!parseStreams(streams, selectors) || max_age_seconds < 0) {
+      return UBUNTU_CLOUD_INVALID_ARGUMENT;
+    }
+    std::optional<std::filesystem::path> directory { cache_directory != nullptr ? std::optional<std::filesystem::path>(cache_directory)
+                                                                                : UbuntuCloudCache::defaultDirectory() };
+    std::optional<std::filesystem::path> snapshot_path { std::nullopt };
+    if (directory) {
+      snapshot_path = *directory / "catalog.snapshot";
+    }
+    auto loaded { std::make_unique<ubuntu_cloud>() };
+    if ((flags & UBUNTU_CLOUD_OFFLINE) != 0) {
+      if (!snapshot_path) {
+        return UBUNTU_CLOUD_INVALID_ARGUMENT;
+      }
+      loaded->catalog = UbuntuCloudFactory::createOfflineFetcher(*snapshot_path);  // Mapped right away, there is nothing to wait for
+    } else {
+      initializeCurl();
+      std::optional<UbuntuCloudCache> cache { std::nullopt };
+      if ((flags & UBUNTU_CLOUD_NO_CACHE) == 0 && directory) {
+        cache.emplace(*directory, std::chrono::seconds(max_age_seconds));
+      }
+      UbuntuCloudLoading loading { (flags & UBUNTU_CLOUD_ASYNC) != 0 ? UbuntuCloudLoading::Lazy : UbuntuCloudLoading::Eager };
+      loaded->catalog = UbuntuCloudFactory::createUbuntuVersionFetcher(std::move(cache), snapshot_path, std::move(selectors), loading);
+      if (loading == UbuntuCloudLoading::Lazy) {
+        loaded->catalog->startLoading();
+        *handle = loaded.release();
+        return UBUNTU_CLOUD_OK;
+      }
+    }
+    bool initialized { loaded->catalog->isInitialized() };
+    *handle = loaded.release();
+    return initialized ? UBUNTU_CLOUD_OK : UBUNTU_CLOUD_LOAD_FAILED;
+  } catch (...) {
+    return UBUNTU_CLOUD_INTERNAL_ERROR;
+  }
+}
+
+ubuntu_cloud_status ubuntu_cloud_wait(ubuntu_cloud* handle) {
+  if (handle == nullptr) {
+    return UBUNTU_CLOUD_INVALID_ARGUMENT;
+  }
+  try {
+    return handle->catalog->waitUntilLoaded() ? UBUNTU_CLOUD_OK : UBUNTU_CLOUD_LOAD_FAILED;
+  } catch (...) {
+    return UBUNTU_CLOUD_INTERNAL_ERROR;
+  }
+}
+
+void ubuntu_cloud_free(ubuntu_cloud* handle) {
+  delete handle;  // The fetcher's destructor waits for a load in progress
+}
+
+/**
+ * @brief Checks that a handle can answer queries. The check is one atomic load, the read path takes no lock.
+ * @param handle The handle.
+ * @return ubuntu_cloud_status UBUNTU_CLOUD_OK if the catalog is loaded.
+ */
+static ubuntu_cloud_status checkLoaded(const ubuntu_cloud* handle) {
+  if (handle == nullptr) {
+    return UBUNTU_CLOUD_INVALID_ARGUMENT;
+  }
+  return handle->catalog->isInitialized() ? UBUNTU_CLOUD_OK : UBUNTU_CLOUD_NOT_LOADED;
+}
+
+ubuntu_cloud_status ubuntu_cloud_supported_releases(const ubuntu_cloud* handle, ubuntu_cloud_release_list** releases) {
+  if (releases == nullptr) {
+    return UBUNTU_CLOUD_INVALID_ARGUMENT;
+  }
+  *releases = nullptr;
+  if (ubuntu_cloud_status status { checkLoaded(handle) }; status != UBUNTU_CLOUD_OK) {
+    return status;
+  }
+  try {
+    auto list { std::make_unique<ubuntu_cloud_release_list>() };
+    list->releases = handle->catalog->getSupportedReleases();
+    if (list->releases.empty()) {
+      return UBUNTU_CLOUD_NOT_FOUND;
+    }
+    *releases = list.release();
+    return UBUNTU_CLOUD_OK;
+  } catch (...) {
+    return UBUNTU_CLOUD_INTERNAL_ERROR;
+  }
+}
+
+ubuntu_cloud_status ubuntu_cloud_current_lts(const ubuntu_cloud* handle, ubuntu_cloud_release_list** release) {
+  if (release == nullptr) {
+    return UBUNTU_CLOUD_INVALID_ARGUMENT;
+  }
+  *release = nullptr;
+  if (ubuntu_cloud_status status { checkLoaded(handle) }; status != UBUNTU_CLOUD_OK) {
+    return status;
+  }
+  try {
+    std::optional<UbuntuRelease> lts { handle->catalog->getCurrentLTS() };
+    if (!lts) {
+      return UBUNTU_CLOUD_NOT_FOUND;
+    }
+    auto list { std::make_unique<ubuntu_cloud_release_list>() };
+    list->releases.push_back(std::move(*lts));
+    *release = list.release();
+    return UBUNTU_CLOUD_OK;
+  } catch (...) {
+    return UBUNTU_CLOUD_INTERNAL_ERROR;
+  }
+}
+
+ubuntu_cloud_status ubuntu_cloud_sha256(const ubuntu_cloud* handle, const char* release, char sha256[UBUNTU_CLOUD_SHA256_LENGTH + 1]) {
+  if (release == nullptr || sha256 == nullptr) {
+    return UBUNTU_CLOUD_INVALID_ARGUMENT;
+  }
+  if (ubuntu_cloud_status status { checkLoaded(handle) }; status != UBUNTU_CLOUD_OK) {
+    return status;
+  }
+  try {
+    std::optional<std::string> digest { handle->catalog->getSha256ForRelease(release) };
+    if (!digest || digest->size() != UBUNTU_CLOUD_SHA256_LENGTH) {
+      return UBUNTU_CLOUD_NOT_FOUND;
+    }
+    std::memcpy(sha256, digest->c_str(), UBUNTU_CLOUD_SHA256_LENGTH + 1);
+    return UBUNTU_CLOUD_OK;
+  } catch (...) {
+    return UBUNTU_CLOUD_INTERNAL_ERROR;
+  }
+}
+
+size_t ubuntu_cloud_release_count(const ubuntu_cloud_release_list* releases) {
+  return releases == nullptr ? 0 : releases->releases.size();
+}
+
+const char* ubuntu_cloud_release_name(const ubuntu_cloud_release_list* releases, size_t release) {
+  if (release >= ubuntu_cloud_release_count(releases)) {
+    return nullptr;
+  }
+  return releases->releases[release].release_name.c_str();
+}
+
+size_t ubuntu_cloud_release_architecture_count(const ubuntu_cloud_release_list* releases, size_t release) {
+  if (release >= ubuntu_cloud_release_count(releases)) {
+    return 0;
+  }
+  return releases->releases[release].architectures.size();
+}
+
+const char* ubuntu_cloud_release_architecture(const ubuntu_cloud_release_list* releases, size_t release, size_t architecture) {
+  if (architecture >= ubuntu_cloud_release_architecture_count(releases, release)) {
+    return nullptr;
+  }
+  return releases->releases[release].architectures[architecture].c_str();
+}
+
+const char* ubuntu_cloud_release_version(const ubuntu_cloud_release_list* releases, size_t release, size_t architecture) {
+  if (architecture >= ubuntu_cloud_release_architecture_count(releases, release)) {
+    return nullptr;
+  }
+  const std::vector<std::string>& versions { releases->releases[release].latest_versions };
+  return architecture < versions.size() ? versions[architecture].c_str() : "";
+}
+
+void ubuntu_cloud_release_list_free(ubuntu_cloud_release_list* releases) {
+  delete releases;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file UbuntuCloudC.h
+ * @brief Stable C interface of the ubuntucloud library, for embedding the fetcher in other languages.
+ *
+ * A handle owns one loaded catalog. Loading costs the download and parse (or the snapshot mapping) once, after which
+ * any number of threads may query the same handle at once: the catalog never changes after the load, so the query
+ * functions take no lock. To pick up a newer catalog, load a new handle and free the old one once no thread uses it.
+ *
+ * Every function returning ubuntu_cloud_status reports failures through it, no C++ exception crosses the interface.
+ * Strings returned by the library stay valid until the object they were read from is freed.
+ *
+ * @note libcurl is initialized by the first ubuntu_cloud_load() and never cleaned up by the library.
+ */
+
+#ifndef UBUNTU_CLOUD_C_H
+#define UBUNTU_CLOUD_C_H
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(UBUNTU_CLOUD_SHARED)
+  #ifdef UBUNTU_CLOUD_BUILDING
+    #define UBUNTU_CLOUD_API __declspec(dllexport)
+  #else
+    #define UBUNTU_CLOUD_API __declspec(dllimport)
+  #endif
+#elif defined(__GNUC__)
+  #define UBUNTU_CLOUD_API __attribute__((visibility("default")))
+#else
+  #define UBUNTU_CLOUD_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Version of this interface, incremented on every incompatible change.
+#define UBUNTU_CLOUD_API_VERSION 1
+
+/// Length of a sha256 in hexadecimal digits, buffers need one more byte for the terminating null.
+#define UBUNTU_CLOUD_SHA256_LENGTH 64
+
+/**
+ * @brief Outcome of a library call.
+ */
+typedef enum ubuntu_cloud_status {
+  UBUNTU_CLOUD_OK               = 0,  ///< Success.
+  UBUNTU_CLOUD_LOAD_FAILED      = 1,  ///< The catalog could not be fetched, parsed or mapped. Details went to standard error.
+  UBUNTU_CLOUD_NOT_LOADED       = 2,  ///< The asynchronous load of the handle has not completed, or failed.
+  UBUNTU_CLOUD_NOT_FOUND        = 3,  ///< The release is not in the catalog.
+  UBUNTU_CLOUD_INVALID_ARGUMENT = 4,  ///< A required pointer was null, or a stream could not be parsed.
+  UBUNTU_CLOUD_INTERNAL_ERROR   = 5   ///< Unexpected failure, e.g. out of memory.
+} ubuntu_cloud_status;
+
+/**
+ * @brief Flags of ubuntu_cloud_load().
+ */
+typedef enum ubuntu_cloud_flags {
+  UBUNTU_CLOUD_DEFAULT  = 0,  ///< Fetch the catalog, revalidating the cached copy, and wait for it.
+  UBUNTU_CLOUD_OFFLINE  = 1,  ///< Map the snapshot of the cache directory instead of fetching.
+  UBUNTU_CLOUD_NO_CACHE = 2,  ///< Download the whole catalog, without reading or writing the cache.
+  UBUNTU_CLOUD_ASYNC    = 4   ///< Return as soon as the load has started on a background thread, see ubuntu_cloud_wait().
+} ubuntu_cloud_flags;
+
+/// A loaded catalog.
+typedef struct ubuntu_cloud ubuntu_cloud;
+
+/// Releases returned by a query, with their architectures.
+typedef struct ubuntu_cloud_release_list ubuntu_cloud_release_list;
+
+/**
+ * @brief Returns the version of the interface the library implements.
+ * @return int UBUNTU_CLOUD_API_VERSION of the library, to compare with the one of the header.
+ */
+UBUNTU_CLOUD_API int ubuntu_cloud_api_version(void);
+
+/**
+ * @brief Returns a description of a status.
+ * @param status The status.
+ * @return const char* A static string.
+ */
+UBUNTU_CLOUD_API const char* ubuntu_cloud_status_message(ubuntu_cloud_status status);
+
+/**
+ * @brief Loads a catalog.
+ * @param cache_directory Directory of the cache and snapshot, NULL for the per-user cache directory.
+ * @param streams Comma-separated STREAM[:CONTENT] selectors as accepted by --stream, NULL or "" for the released images.
+ * @param max_age_seconds Age under which the cached catalog is used without contacting the server, 0 to always revalidate.
+ * @param flags A combination of ubuntu_cloud_flags.
+ * @param[out] handle Receives the handle, also on failure for UBUNTU_CLOUD_LOAD_FAILED (it must be freed), NULL otherwise.
+ * @return ubuntu_cloud_status UBUNTU_CLOUD_OK once loaded, or as soon as an asynchronous load has started.
+ */
+UBUNTU_CLOUD_API ubuntu_cloud_status ubuntu_cloud_load(const char* cache_directory, const char* streams, long long max_age_seconds,
+                                                       unsigned flags, ubuntu_cloud** handle);
+
+/**
+ * @brief Waits for the load of a handle to complete.
+ * @param handle The handle.
+ * @return ubuntu_cloud_status UBUNTU_CLOUD_OK if the catalog is loaded, UBUNTU_CLOUD_LOAD_FAILED otherwise.
+ */
+UBUNTU_CLOUD_API ubuntu_cloud_status ubuntu_cloud_wait(ubuntu_cloud* handle);
+
+/**
+ * @brief Frees a handle, waiting for its load if still in progress. NULL is ignored.
+ * @param handle The handle, no thread may still be querying it.
+ */
+UBUNTU_CLOUD_API void ubuntu_cloud_free(ubuntu_cloud* handle);
+
+/**
+ * @brief Lists the supported releases, non-LTS releases first, each with its architectures.
+ * @param handle The loaded handle.
+ * @param[out] releases Receives the list, to free with ubuntu_cloud_release_list_free(). NULL on failure.
+ * @return ubuntu_cloud_status UBUNTU_CLOUD_OK, or UBUNTU_CLOUD_NOT_FOUND if no release is supported.
+ */
+UBUNTU_CLOUD_API ubuntu_cloud_status ubuntu_cloud_supported_releases(const ubuntu_cloud* handle, ubuntu_cloud_release_list** releases);
+
+/**
+ * @brief Looks up the current LTS release, with the latest serial of each architecture.
+ * @param handle The loaded handle.
+ * @param[out] release Receives a list of one release, to free with ubuntu_cloud_release_list_free(). NULL on failure.
+ * @return ubuntu_cloud_status UBUNTU_CLOUD_OK, or UBUNTU_CLOUD_NOT_FOUND if the catalog has no LTS release.
+ */
+UBUNTU_CLOUD_API ubuntu_cloud_status ubuntu_cloud_current_lts(const ubuntu_cloud* handle, ubuntu_cloud_release_list** release);
+
+/**
+ * @brief Looks up the sha256 of disk1.img in the latest serial of a release, for amd64.
+ * @param handle The loaded handle.
+ * @param release The release or its title, e.g. "noble" or "24.04".
+ * @param[out] sha256 Receives the UBUNTU_CLOUD_SHA256_LENGTH hexadecimal digits and a terminating null.
+ * @return ubuntu_cloud_status UBUNTU_CLOUD_OK, or UBUNTU_CLOUD_NOT_FOUND for an unknown release.
+ */
+UBUNTU_CLOUD_API ubuntu_cloud_status ubuntu_cloud_sha256(const ubuntu_cloud* handle, const char* release,
+                                                         char sha256[UBUNTU_CLOUD_SHA256_LENGTH + 1]);
+
+/**
+ * @brief Returns the number of releases of a list.
+ * @param releases The list.
+ * @return size_t The number of releases.
+ */
+UBUNTU_CLOUD_API size_t ubuntu_cloud_release_count(const ubuntu_cloud_release_list* releases);
+
+/**
+ * @brief Returns the title of a release, e.g. "24.04 LTS (noble)".
+ * @param releases The list.
+ * @param release Index of the release, below ubuntu_cloud_release_count().
+ * @return const char* The title, NULL for an index out of range.
+ */
+UBUNTU_CLOUD_API const char* ubuntu_cloud_release_name(const ubuntu_cloud_release_list* releases, size_t release);
+
+/**
+ * @brief Returns the number of architectures of a release.
+ * @param releases The list.
+ * @param release Index of the release.
+ * @return size_t The number of architectures, 0 for an index out of range.
+ */
+UBUNTU_CLOUD_API size_t ubuntu_cloud_release_architecture_count(const ubuntu_cloud_release_list* releases, size_t release);
+
+/**
+ * @brief Returns an architecture of a release, e.g. "arm64".
+ * @param releases The list.
+ * @param release Index of the release.
+ * @param architecture Index of the architecture.
+ * @return const char* The architecture, NULL for an index out of range.
+ */
+UBUNTU_CLOUD_API const char* ubuntu_cloud_release_architecture(const ubuntu_cloud_release_list* releases, size_t release,
+                                                               size_t architecture);
+
+/**
+ * @brief Returns the latest serial of an architecture of the current LTS release.
+ * @param releases The list.
+ * @param release Index of the release.
+ * @param architecture Index of the architecture.
+ * @return const char* The serial, "" in the supported releases list, NULL for an index out of range.
+ */
+UBUNTU_CLOUD_API const char* ubuntu_cloud_release_version(const ubuntu_cloud_release_list* releases, size_t release, size_t architecture);
+
+/**
+ * @brief Frees a list of releases. NULL is ignored.
+ * @param releases The list.
+ */
+UBUNTU_CLOUD_API void ubuntu_cloud_release_list_free(ubuntu_cloud_release_list* releases);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // UBUNTU_CLOUD_C_H
@@ -0,0 +1,162 @@
+/**
+ * @file UbuntuCloudCache.cpp
+ * @brief Implementation of the UbuntuCloudCache class.
+ *
+ * Each URL maps to two files in the cache directory, named after a 64-bit FNV-1a hash of the URL:
+ * - `<hash>.json`: the raw response body.
+ * - `<hash>.meta`: a small JSON object with the URL, validators, fetch time and body size.
+ *
+ * Both files are replaced atomically (temporary file + rename), so concurrent invocations never read a half-written file.
+ * The body is written before the metadata and the metadata records the body size, so a body/metadata pair from two
+ * different writers is detected and treated as a miss.
+ */
+
+#include "UbuntuCloudCache.hpp"
+
+#include "UbuntuCloudFile.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a string.
+ *
+ * Used instead of std::hash because the file names have to be stable across builds and platforms.
+ * @param text The string to hash.
+ * @return std::uint64_t The hash value.
+ */
+static std::uint64_t fnv1aHash(const std::string& text) {
+  std::uint64_t hash { 14695981039346656037ULL };  // FNV offset basis
+  for (unsigned char character : text) {
+    hash ^= character;
+    hash *= 1099511628211ULL;  // FNV prime
+  }
+  return hash;
+}
+
+UbuntuCloudCache::UbuntuCloudCache(std::filesystem::path directory, std::chrono::seconds max_age):
+    _directory(std::move(directory)), _maxAge(max_age) { }
+
+std::optional<std::filesystem::path> UbuntuCloudCache::defaultDirectory() {
+  // Follow the XDG base directory convention first, then fall back to the usual per-user locations
+  if (const char* xdg_cache = std::getenv("XDG_CACHE_HOME"); xdg_cache != nullptr && *xdg_cache != '\0') {
+    return std::filesystem::path(xdg_cache) / "ubuntu-version-fetcher";
+  }
+  if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+    return std::filesystem::path(home) / ".cache" / "ubuntu-version-fetcher";
+  }
+  if (const char* local_app_data = std::getenv("LOCALAPPDATA"); local_app_data != nullptr && *local_app_data != '\0') {
+    return std::filesystem::path(local_app_data) / "ubuntu-version-fetcher";
+  }
+  return std::nullopt;  // No sensible location, caching is disabled
+}
+
+std::filesystem::path UbuntuCloudCache::entryPath(const std::string& url, const char* extension) const {
+  std::ostringstream name {};
+  name << std::hex << fnv1aHash(url) << extension;
+  return this->_directory / name.str();
+}
+
+std::optional<UbuntuCloudCacheEntry> UbuntuCloudCache::lookup(const std::string& url) const {
+  std::ifstream input(this->entryPath(url, ".meta"), std::ios::binary);
+  if (!input) {
+    return std::nullopt;  // Cache miss
+  }
+  try {
+    nlohmann::json meta = nlohmann::json::parse(input);
+    UbuntuCloudCacheEntry entry {};
+    entry.url           = meta.at("url").template get<std::string>();
+    entry.etag          = meta.value("etag", "");
+    entry.last_modified = meta.value("last_modified", "");
+    entry.fetched_at    = meta.at("fetched_at").template get<std::int64_t>();
+    entry.body_size     = meta.at("body_size").template get<std::uint64_t>();
+    if (entry.url != url) {
+      return std::nullopt;  // Hash collision with another URL, treat as a miss
+    }
+    std::error_code error {};
+    std::uintmax_t  body_size { std::filesystem::file_size(this->entryPath(url, ".json"), error) };
+    if (error || body_size != entry.body_size) {
+      return std::nullopt;  // Body missing or torn, an unconditional fetch is required
+    }
+    return entry;
+  } catch (const nlohmann::json::exception&) {
+    return std::nullopt;  // Corrupted metadata is a miss, it is overwritten on the next store
+  }
+}
+
+bool UbuntuCloudCache::isFresh(const UbuntuCloudCacheEntry& entry) const {
+  std::int64_t age { nowSeconds() - entry.fetched_at };
+  // A clock that went backwards gives a negative age, which is not trusted
+  return age >= 0 && age < this->_maxAge.count();
+}
+
+std::optional<std::ifstream> UbuntuCloudCache::openBody(const UbuntuCloudCacheEntry& entry) const {
+  std::ifstream input(this->entryPath(entry.url, ".json"), std::ios::binary);
+  if (!input) {
+    return std::nullopt;
+  }
+  return input;
+}
+
+std::unique_ptr<UbuntuCloudCacheWriter> UbuntuCloudCache::beginStore(const std::string& url) const {
+  std::error_code error {};
+  std::filesystem::create_directories(this->_directory, error);
+  if (error) {
+    return nullptr;
+  }
+  auto writer { std::make_unique<UbuntuCloudCacheWriter>(*this, url, temporaryPath(this->entryPath(url, ".json"))) };
+  if (!writer->good()) {
+    return nullptr;
+  }
+  return writer;
+}
+
+bool UbuntuCloudCache::touch(UbuntuCloudCacheEntry entry) const {
+  entry.fetched_at = nowSeconds();
+  nlohmann::json meta = {
+    {           "url",           entry.url },
+    {          "etag",          entry.etag },
+    { "last_modified", entry.last_modified },
+    {    "fetched_at",    entry.fetched_at },
+    {     "body_size",     entry.body_size }
+  };
+  return replaceFile(this->entryPath(entry.url, ".meta"), meta.dump());
+}
+
+UbuntuCloudCacheWriter::UbuntuCloudCacheWriter(const UbuntuCloudCache& cache, std::string url, std::filesystem::path temporary):
+    _cache(cache), _url(std::move(url)), _temporary(std::move(temporary)), _output(this->_temporary, std::ios::binary | std::ios::trunc),
+    _size(0), _committed(false) { }
+
+UbuntuCloudCacheWriter::~UbuntuCloudCacheWriter() {
+  if (!this->_committed) {
+    // Interrupted or rejected download, the previous entry stays in place
+    this->_output.close();
+    std::error_code ignored {};
+    std::filesystem::remove(this->_temporary, ignored);
+  }
+}
+
+bool UbuntuCloudCacheWriter::write(const char* data, std::size_t size) {
+  this->_size += size;
+  return static_cast<bool>(this->_output.write(data, static_cast<std::streamsize>(size)));
+}
+
+bool UbuntuCloudCacheWriter::commit(UbuntuCloudCacheEntry entry) {
+  this->_output.close();
+  if (this->_output.fail()) {
+    return false;  // The destructor removes the temporary file
+  }
+  std::error_code error {};
+  std::filesystem::rename(this->_temporary, this->_cache.entryPath(this->_url, ".json"), error);
+  if (error) {
+    return false;
+  }
+  this->_committed = true;
+  entry.url       = this->_url;
+  entry.body_size = this->_size;
+  return this->_cache.touch(std::move(entry));
+}
@@ -0,0 +1,167 @@
+/**
+ * @file UbuntuCloudCache.hpp
+ * @brief Declares the UbuntuCloudCache class, a persistent on-disk cache for the downloaded catalog.
+ *
+ * The cache keeps the last successful response body for a URL together with the validators the server sent
+ * (ETag and Last-Modified) and the time it was fetched. The fetcher uses it to:
+ * - Skip the network entirely while the entry is younger than the configured max-age.
+ * - Send a conditional request (If-None-Match / If-Modified-Since) once the entry is stale, and serve the body from disk on a 304.
+ *
+ * Entries are keyed by a hash of the URL, so one cache directory can hold several product files.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+/**
+ * @struct UbuntuCloudCacheEntry
+ * @brief Metadata stored next to a cached response body.
+ */
+struct UbuntuCloudCacheEntry {
+    std::string   url;            ///< URL the body was fetched from, checked on lookup to rule out key collisions.
+    std::string   etag;           ///< ETag header of the cached response, empty if the server sent none.
+    std::string   last_modified;  ///< Last-Modified header of the cached response, empty if the server sent none.
+    std::int64_t  fetched_at {};  ///< Unix time (seconds) of the last successful fetch or revalidation.
+    std::uint64_t body_size {};   ///< Size in bytes of the cached body, used to detect torn writes.
+};
+
+class UbuntuCloudCache;
+
+/**
+ * @class UbuntuCloudCacheWriter
+ * @brief Streams a response body into the cache while it is being downloaded.
+ *
+ * The body goes to a temporary file and only replaces the cached entry on commit(), so an interrupted or
+ * invalid download never overwrites a good entry. An uncommitted temporary file is removed on destruction.
+ */
+class UbuntuCloudCacheWriter {
+  private:
+    /// The cache the body belongs to.
+    const UbuntuCloudCache& _cache;
+    /// URL of the response being written.
+    std::string _url;
+    /// Temporary file receiving the body.
+    std::filesystem::path _temporary;
+    /// Output stream on the temporary file.
+    std::ofstream _output;
+    /// Number of bytes written so far.
+    std::uint64_t _size;
+    /// Whether the body has been moved into place.
+    bool _committed;
+
+  public:
+    /**
+     * @brief Opens a temporary file for the body of a URL.
+     * @param cache The cache the body belongs to.
+     * @param url URL of the response.
+     * @param temporary Path of the temporary file.
+     */
+    UbuntuCloudCacheWriter(const UbuntuCloudCache& cache, std::string url, std::filesystem::path temporary);
+
+    UbuntuCloudCacheWriter(const UbuntuCloudCacheWriter&)            = delete;
+    UbuntuCloudCacheWriter& operator=(const UbuntuCloudCacheWriter&) = delete;
+
+    ~UbuntuCloudCacheWriter();
+
+    /**
+     * @brief Checks whether the temporary file is usable.
+     * @return bool True if no write error has happened.
+     */
+    bool good() const { return this->_output.good(); }
+
+    /**
+     * @brief Appends a chunk of the body.
+     * @param data Pointer to the chunk.
+     * @param size Size of the chunk in bytes.
+     * @return bool True if the chunk was written.
+     */
+    bool write(const char* data, std::size_t size);
+
+    /**
+     * @brief Replaces the cached body with the written one and stores its metadata.
+     * @param entry Metadata of the response. fetched_at and body_size are filled in by this call.
+     * @return bool True if the entry was stored.
+     */
+    bool commit(UbuntuCloudCacheEntry entry);
+};
+
+/**
+ * @class UbuntuCloudCache
+ * @brief Stores and retrieves catalog responses in a cache directory.
+ *
+ * All operations are best-effort: a cache that cannot be read or written behaves like an empty cache,
+ * and never makes a fetch fail.
+ */
+class UbuntuCloudCache {
+  private:
+    /// Directory holding the cached bodies and their metadata.
+    std::filesystem::path _directory;
+    /// Age below which an entry is served without contacting the server.
+    std::chrono::seconds _maxAge;
+
+  public:
+    /**
+     * @brief Constructs a cache over a directory. The directory is created on the first store.
+     * @param directory The cache directory.
+     * @param max_age Freshness window. An entry younger than this is served without any network round trip.
+     */
+    UbuntuCloudCache(std::filesystem::path directory, std::chrono::seconds max_age);
+
+    /**
+     * @brief Returns the default cache directory for the current user.
+     *
+     * Uses $XDG_CACHE_HOME, then $HOME/.cache, then %LOCALAPPDATA% on Windows.
+     * @return std::optional<std::filesystem::path> The directory, or std::nullopt if none of the variables is set.
+     */
+    static std::optional<std::filesystem::path> defaultDirectory();
+
+    /**
+     * @brief Builds the path of a cache file for a URL.
+     * @param url The URL of the cached resource.
+     * @param extension The file extension, including the leading dot.
+     * @return std::filesystem::path Path inside the cache directory.
+     */
+    std::filesystem::path entryPath(const std::string& url, const char* extension) const;
+
+    /**
+     * @brief Reads the metadata of the cached entry for a URL.
+     * @param url The URL to look up.
+     * @return std::optional<UbuntuCloudCacheEntry> The entry, or std::nullopt if there is no usable entry.
+     */
+    std::optional<UbuntuCloudCacheEntry> lookup(const std::string& url) const;
+
+    /**
+     * @brief Checks whether an entry is still within the freshness window.
+     * @param entry The entry to check.
+     * @return bool True if the entry can be served without revalidation.
+     */
+    bool isFresh(const UbuntuCloudCacheEntry& entry) const;
+
+    /**
+     * @brief Opens the cached body for an entry.
+     * @param entry The entry returned by lookup().
+     * @return std::optional<std::ifstream> Stream on the body, or std::nullopt if it cannot be opened.
+     */
+    std::optional<std::ifstream> openBody(const UbuntuCloudCacheEntry& entry) const;
+
+    /**
+     * @brief Starts storing a response body for a URL.
+     * @param url URL of the response.
+     * @return std::unique_ptr<UbuntuCloudCacheWriter> The writer, or nullptr if the cache directory is not writable.
+     */
+    std::unique_ptr<UbuntuCloudCacheWriter> beginStore(const std::string& url) const;
+
+    /**
+     * @brief Marks an entry as freshly revalidated (after a 304 response).
+     * @param entry The entry to refresh. Its fetched_at is updated on disk.
+     * @return bool True if the metadata was rewritten.
+     */
+    bool touch(UbuntuCloudCacheEntry entry) const;
+};
@@ -0,0 +1,769 @@
+/**
+ * @file UbuntuCloudCatalog.cpp
+ * @brief Implementation of the UbuntuCloudCatalog class.
+ *
+ * The catalog is built in a single pass over the parsed products: strings are interned as they are met,
+ * columns are appended, and the serials of each product are keyed and kept in key order. The release and title indexes
+ * are built afterwards, and everything is serialized into one image.
+ *
+ * The queries that look at every product (supported releases, current LTS) split a large catalog into runs of
+ * products, scanned on the resident worker pool into one accumulator per run. The runs are merged in product order,
+ * so the result is the one a single pass would give.
+ *
+ * Image layout (native byte order, all sections aligned to 8 bytes):
+ * - SnapshotHeader: magic, format version, byte order mark, image size, well-known string ids, and the offset and
+ *   element count of every section.
+ * - String table: the characters of every string, then the start offset of each string.
+ * - Product columns, version columns and item columns, as described in UbuntuCloudCatalog.hpp.
+ * - Release and title indexes: open-addressing hash tables (FNV-1a, linear probing) of UbuntuCatalogBucket, whose
+ *   product lists are ranges of a shared product column.
+ */
+
+#include "UbuntuCloudCatalog.hpp"
+
+#include "UbuntuCloudFile.hpp"
+#include "UbuntuCloudMappedFile.hpp"
+#include "UbuntuCloudWorkers.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+/// Largest date part of a serial sort key (40 bits).
+constexpr static std::uint64_t serial_major_limit { (std::uint64_t { 1 } << 40) - 1 };
+
+/// Largest point release part of a serial sort key (24 bits).
+constexpr static std::uint64_t serial_minor_limit { (std::uint64_t { 1 } << 24) - 1 };
+
+std::uint64_t serialSortKey(std::string_view serial) {
+  std::uint64_t major { 0 };
+  std::uint64_t minor { 0 };
+  std::size_t   idx { 0 };
+  for (; idx < serial.size() && serial[idx] >= '0' && serial[idx] <= '9'; idx++) {
+    major = std::min(major * 10 + static_cast<std::uint64_t>(serial[idx] - '0'), serial_major_limit);
+  }
+  if (idx < serial.size() && serial[idx] == '.') {
+    for (idx++; idx < serial.size() && serial[idx] >= '0' && serial[idx] <= '9'; idx++) {
+      minor = std::min(minor * 10 + static_cast<std::uint64_t>(serial[idx] - '0'), serial_minor_limit);
+    }
+  }
+  return (major << 24) | minor;
+}
+
+bool versionPrecedes(const UbuntuProductVersion& first, const UbuntuProductVersion& second) {
+  std::uint64_t first_key { serialSortKey(first.serial) };
+  std::uint64_t second_key { serialSortKey(second.serial) };
+  return first_key != second_key ? first_key < second_key : first.serial < second.serial;
+}
+
+/**
+ * @brief Computes the 32-bit FNV-1a hash of a string.
+ *
+ * The hash decides bucket positions in the stored indexes, so it must not change between builds or platforms.
+ * @param text The string to hash.
+ * @return std::uint32_t The hash value.
+ */
+static std::uint32_t hashString(std::string_view text) {
+  std::uint32_t hash { 2166136261U };  // FNV offset basis
+  for (unsigned char character : text) {
+    hash ^= character;
+    hash *= 16777619U;  // FNV prime
+  }
+  return hash;
+}
+
+/// Identifies a catalog image.
+constexpr static char snapshot_magic[8] { 'U', 'V', 'F', 'S', 'N', 'A', 'P', '\0' };
+
+/// Layout version of the image. Snapshots of another version are rejected and replaced on the next fetch.
+constexpr static std::uint32_t snapshot_version { 3 };
+
+/// Written in native byte order, reads back differently on a machine of the other endianness.
+constexpr static std::uint32_t snapshot_byte_order { 0x01020304 };
+
+/// Sections of a catalog image, in storage order.
+enum SnapshotSection : std::uint32_t {
+  StringData,
+  StringOffsets,
+  ProductName,
+  ProductRelease,
+  ProductReleaseTitle,
+  ProductArch,
+  ProductVersion,
+  ProductMirror,
+  ProductFlags,
+  ProductVersionBegin,
+  VersionSerial,
+  VersionKey,
+  VersionItemBegin,
+  ItemName,
+  ItemSha256,
+  ItemPath,
+  ItemSize,
+  ReleaseIndex,
+  TitleIndex,
+  IndexProducts,
+  SectionCount
+};
+
+/**
+ * @struct SnapshotSectionEntry
+ * @brief Location of one section in the image.
+ */
+struct SnapshotSectionEntry {
+    std::uint64_t offset;  ///< Offset of the first element from the start of the image, aligned to the element size.
+    std::uint64_t count;   ///< Number of elements.
+};
+
+/**
+ * @struct SnapshotHeader
+ * @brief Fixed-size header at the start of every image.
+ */
+struct SnapshotHeader {
+    char                 magic[8];                ///< Always snapshot_magic.
+    std::uint32_t        version;                 ///< Always snapshot_version.
+    std::uint32_t        byte_order;              ///< Always snapshot_byte_order.
+    std::uint64_t        image_size;              ///< Size of the whole image, equal to the file size.
+    std::uint32_t        amd64_id;                ///< String id of "amd64", or npos.
+    std::uint32_t        disk_image_id;           ///< String id of "disk1.img", or npos.
+    SnapshotSectionEntry sections[SectionCount];  ///< Location of every section.
+};
+
+/**
+ * @struct CatalogColumns
+ * @brief Growable columns used while building a catalog, serialized into the image once complete.
+ */
+struct CatalogColumns {
+    std::vector<char>                string_data;
+    std::vector<std::uint32_t>       string_offsets { 0 };
+    std::vector<std::uint32_t>       product_name;
+    std::vector<std::uint32_t>       product_release;
+    std::vector<std::uint32_t>       product_release_title;
+    std::vector<std::uint32_t>       product_arch;
+    std::vector<std::uint32_t>       product_version;
+    std::vector<std::uint32_t>       product_mirror;
+    std::vector<std::uint8_t>        product_flags;
+    std::vector<std::uint32_t>       product_version_begin { 0 };
+    std::vector<std::uint32_t>       version_serial;
+    std::vector<std::uint64_t>       version_key;
+    std::vector<std::uint32_t>       version_item_begin { 0 };
+    std::vector<std::uint32_t>       item_name;
+    std::vector<std::uint32_t>       item_sha256;
+    std::vector<std::uint32_t>       item_path;
+    std::vector<std::uint64_t>       item_size;
+    std::vector<UbuntuCatalogBucket> release_index;
+    std::vector<UbuntuCatalogBucket> title_index;
+    std::vector<std::uint32_t>       index_products;
+
+    /**
+     * @brief Resolves a string id while building.
+     * @param id The string id.
+     * @return std::string_view The string, valid until the next string is added.
+     */
+    std::string_view string(std::uint32_t id) const {
+      return std::string_view(this->string_data.data() + this->string_offsets[id], this->string_offsets[id + 1] - this->string_offsets[id]);
+    }
+};
+
+/**
+ * @class StringInterner
+ * @brief Assigns one id per distinct string while a catalog is being built.
+ */
+class StringInterner {
+  private:
+    /// Ids of the strings seen so far. Keys point into the products being built from, which outlive the interner.
+    std::unordered_map<std::string_view, std::uint32_t> _ids;
+    /// Character storage of the catalog.
+    std::vector<char>& _data;
+    /// Offset storage of the catalog.
+    std::vector<std::uint32_t>& _offsets;
+
+  public:
+    /**
+     * @brief Constructs an interner writing into a catalog's string table.
+     * @param data The catalog's character storage.
+     * @param offsets The catalog's offset storage, initially holding the single end offset 0.
+     */
+    StringInterner(std::vector<char>& data, std::vector<std::uint32_t>& offsets): _ids(), _data(data), _offsets(offsets) { }
+
+    /**
+     * @brief Returns the id of a string, adding it to the table if it is new.
+     * @param text The string to intern.
+     * @return std::uint32_t The string id.
+     */
+    std::uint32_t intern(std::string_view text) {
+      auto [iterator, inserted] = this->_ids.try_emplace(text, static_cast<std::uint32_t>(this->_offsets.size() - 1));
+      if (inserted) {
+        this->_data.insert(this->_data.end(), text.begin(), text.end());
+        this->_offsets.push_back(static_cast<std::uint32_t>(this->_data.size()));
+      }
+      return iterator->second;
+    }
+
+    /**
+     * @brief Returns the id of a string without adding it.
+     * @param text The string to look up.
+     * @return std::uint32_t The string id, or UbuntuCloudCatalog::npos if it was never interned.
+     */
+    std::uint32_t find(std::string_view text) const {
+      auto iterator { this->_ids.find(text) };
+      return iterator == this->_ids.end() ? UbuntuCloudCatalog::npos : iterator->second;
+    }
+};
+
+/**
+ * @brief Builds an open-addressing hash index over a product column.
+ *
+ * @param columns The columns being built, for string lookups.
+ * @param product_column The product column to index (string ids).
+ * @param[out] buckets Receives the buckets, a power of two at least twice the number of distinct values.
+ */
+static void buildIndex(CatalogColumns& columns, const std::vector<std::uint32_t>& product_column, std::vector<UbuntuCatalogBucket>& buckets) {
+  // Group products by value, keeping product order inside each group
+  std::map<std::uint32_t, std::vector<std::uint32_t>> groups {};
+  for (std::uint32_t product = 0; product < product_column.size(); product++) {
+    groups[product_column[product]].push_back(product);
+  }
+  std::size_t bucket_count { 1 };
+  while (bucket_count < 2 * groups.size()) {
+    bucket_count *= 2;  // Load factor of at most one half keeps probe sequences short
+  }
+  buckets.assign(bucket_count, UbuntuCatalogBucket { UbuntuCloudCatalog::npos, 0, 0 });
+  for (const auto& [key, products] : groups) {
+    std::size_t slot { hashString(columns.string(key)) & (bucket_count - 1) };
+    while (buckets[slot].key != UbuntuCloudCatalog::npos) {
+      slot = (slot + 1) & (bucket_count - 1);  // Linear probing
+    }
+    buckets[slot] = { key, static_cast<std::uint32_t>(columns.index_products.size()), static_cast<std::uint32_t>(products.size()) };
+    columns.index_products.insert(columns.index_products.end(), products.begin(), products.end());
+  }
+}
+
+/**
+ * @brief Appends a column as a section of the image, aligned to 8 bytes.
+ * @tparam T The element type.
+ * @param image The image being written.
+ * @param header The header being filled.
+ * @param section The section the column is stored as.
+ * @param column The column.
+ */
+template <typename T>
+static void appendSection(std::vector<std::byte>& image, SnapshotHeader& header, SnapshotSection section, const std::vector<T>& column) {
+  std::size_t offset { (image.size() + 7) & ~static_cast<std::size_t>(7) };
+  image.resize(offset + column.size() * sizeof(T));
+  if (!column.empty()) {
+    std::memcpy(image.data() + offset, column.data(), column.size() * sizeof(T));
+  }
+  header.sections[section] = { offset, column.size() };
+}
+
+/**
+ * @brief Points a column at a section of an image, checking that it lies inside the image.
+ * @tparam T The element type.
+ * @param header The image header.
+ * @param section The section to read.
+ * @param image First byte of the image.
+ * @param image_size Size of the image.
+ * @param[out] column Receives the view.
+ * @return bool True if the section is aligned and in bounds.
+ */
+template <typename T>
+static bool sectionColumn(const SnapshotHeader& header, SnapshotSection section, const std::byte* image, std::size_t image_size,
+                          UbuntuCatalogColumn<T>& column) {
+  const SnapshotSectionEntry& entry { header.sections[section] };
+  if (entry.offset % alignof(T) != 0 || entry.offset > image_size || entry.count > (image_size - entry.offset) / sizeof(T)) {
+    return false;
+  }
+  column = UbuntuCatalogColumn<T>(reinterpret_cast<const T*>(image + entry.offset), static_cast<std::size_t>(entry.count));
+  return true;
+}
+
+/**
+ * @brief Checks a begin-offset column: one more entry than its owners, starting at 0, non-decreasing, ending at the target size.
+ * @param column The column to check.
+ * @param owner_count Number of owners (products or versions).
+ * @param target_size Size of the referenced column.
+ * @return bool True if the column is consistent.
+ */
+static bool validOffsets(const UbuntuCatalogColumn<std::uint32_t>& column, std::size_t owner_count, std::size_t target_size) {
+  if (column.size() != owner_count + 1 || column[0] != 0 || column[owner_count] != target_size) {
+    return false;
+  }
+  return std::is_sorted(column.begin(), column.end());
+}
+
+/**
+ * @brief Checks that every id of a column is below a limit.
+ * @param column The column to check.
+ * @param limit Exclusive upper bound.
+ * @return bool True if all ids are in range.
+ */
+static bool validIds(const UbuntuCatalogColumn<std::uint32_t>& column, std::size_t limit) {
+  return std::all_of(column.begin(), column.end(), [limit](std::uint32_t id) { return id < limit; });
+}
+
+UbuntuCloudCatalog::UbuntuCloudCatalog(): UbuntuCloudCatalog(std::vector<UbuntuProduct>()) { }
+
+UbuntuCloudCatalog::UbuntuCloudCatalog(const std::vector<UbuntuProduct>& products):
+    _storage(), _image(nullptr), _imageSize(0), _amd64Id(npos), _diskImageId(npos) {
+  CatalogColumns columns {};
+  StringInterner interner(columns.string_data, columns.string_offsets);
+  columns.product_name.reserve(products.size());
+  columns.product_release.reserve(products.size());
+  columns.product_release_title.reserve(products.size());
+  columns.product_arch.reserve(products.size());
+  columns.product_version.reserve(products.size());
+  columns.product_mirror.reserve(products.size());
+  columns.product_flags.reserve(products.size());
+
+  for (const UbuntuProduct& product : products) {
+    columns.product_name.push_back(interner.intern(product.name));
+    columns.product_release.push_back(interner.intern(product.release));
+    columns.product_release_title.push_back(interner.intern(product.release_title));
+    columns.product_arch.push_back(interner.intern(product.arch));
+    columns.product_version.push_back(interner.intern(product.version));
+    columns.product_mirror.push_back(interner.intern(product.mirror));
+    // The aliases are only ever searched for "lts", so the flag replaces the string
+    columns.product_flags.push_back(static_cast<std::uint8_t>((product.supported ? supported_flag : 0) |
+                                                              (product.aliases.find("lts") != std::string::npos ? lts_flag : 0)));
+
+    // Keys are computed once here, queries only compare integers. Parsed versions already come in this order.
+    std::vector<std::pair<std::uint64_t, const UbuntuProductVersion*>> versions {};
+    versions.reserve(product.versions.size());
+    for (const UbuntuProductVersion& version : product.versions) {
+      versions.emplace_back(serialSortKey(version.serial), &version);
+    }
+    auto precedes { [](const auto& first, const auto& second) {
+      return first.first != second.first ? first.first < second.first : first.second->serial < second.second->serial;
+    } };
+    if (!std::is_sorted(versions.begin(), versions.end(), precedes)) {
+      std::stable_sort(versions.begin(), versions.end(), precedes);
+    }
+    for (const auto& [key, version] : versions) {
+      columns.version_serial.push_back(interner.intern(version->serial));
+      columns.version_key.push_back(key);
+      for (const UbuntuProductItem& item : version->items) {
+        columns.item_name.push_back(interner.intern(item.name));
+        columns.item_sha256.push_back(interner.intern(item.sha256));
+        columns.item_path.push_back(interner.intern(item.path));
+        columns.item_size.push_back(item.size);
+      }
+      columns.version_item_begin.push_back(static_cast<std::uint32_t>(columns.item_name.size()));
+    }
+    columns.product_version_begin.push_back(static_cast<std::uint32_t>(columns.version_serial.size()));
+  }
+  buildIndex(columns, columns.product_release, columns.release_index);
+  buildIndex(columns, columns.product_release_title, columns.title_index);
+
+  // Serialize the columns into a single image, the same bytes a snapshot file holds
+  auto           image { std::make_shared<std::vector<std::byte>>(sizeof(SnapshotHeader)) };
+  SnapshotHeader header {};
+  std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+  header.version       = snapshot_version;
+  header.byte_order    = snapshot_byte_order;
+  header.amd64_id      = interner.find("amd64");
+  header.disk_image_id = interner.find("disk1.img");
+  appendSection(*image, header, StringData, columns.string_data);
+  appendSection(*image, header, StringOffsets, columns.string_offsets);
+  appendSection(*image, header, ProductName, columns.product_name);
+  appendSection(*image, header, ProductRelease, columns.product_release);
+  appendSection(*image, header, ProductReleaseTitle, columns.product_release_title);
+  appendSection(*image, header, ProductArch, columns.product_arch);
+  appendSection(*image, header, ProductVersion, columns.product_version);
+  appendSection(*image, header, ProductMirror, columns.product_mirror);
+  appendSection(*image, header, ProductFlags, columns.product_flags);
+  appendSection(*image, header, ProductVersionBegin, columns.product_version_begin);
+  appendSection(*image, header, VersionSerial, columns.version_serial);
+  appendSection(*image, header, VersionKey, columns.version_key);
+  appendSection(*image, header, VersionItemBegin, columns.version_item_begin);
+  appendSection(*image, header, ItemName, columns.item_name);
+  appendSection(*image, header, ItemSha256, columns.item_sha256);
+  appendSection(*image, header, ItemPath, columns.item_path);
+  appendSection(*image, header, ItemSize, columns.item_size);
+  appendSection(*image, header, ReleaseIndex, columns.release_index);
+  appendSection(*image, header, TitleIndex, columns.title_index);
+  appendSection(*image, header, IndexProducts, columns.index_products);
+  image->resize((image->size() + 7) & ~static_cast<std::size_t>(7));
+  header.image_size = image->size();
+  std::memcpy(image->data(), &header, sizeof(header));
+
+  std::string error {};
+  const std::byte* image_data { image->data() };
+  std::size_t      image_size { image->size() };
+  this->attach(std::move(image), image_data, image_size, error);  // Cannot fail on an image built here
+}
+
+std::optional<UbuntuCloudCatalog> UbuntuCloudCatalog::openSnapshot(const std::filesystem::path& path, std::string& error) {
+  auto mapped_file { std::make_shared<UbuntuCloudMappedFile>(path, error) };
+  if (!mapped_file->isMapped()) {
+    return std::nullopt;  // Error set by the mapping
+  }
+  UbuntuCloudCatalog catalog {};
+  const std::byte*   image_data { mapped_file->data() };
+  std::size_t        image_size { mapped_file->size() };
+  if (!catalog.attach(std::move(mapped_file), image_data, image_size, error)) {
+    error = "Invalid snapshot " + path.string() + ": " + error;
+    return std::nullopt;
+  }
+  return catalog;
+}
+
+bool UbuntuCloudCatalog::writeSnapshot(const std::filesystem::path& path) const {
+  std::error_code error {};
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path(), error);
+    if (error) {
+      return false;
+    }
+  }
+  // Replaced atomically, so readers only ever map a complete snapshot
+  return replaceFile(path, std::string_view(reinterpret_cast<const char*>(this->_image), this->_imageSize));
+}
+
+bool UbuntuCloudCatalog::attach(std::shared_ptr<const void> storage, const std::byte* image, std::size_t image_size, std::string& error) {
+  SnapshotHeader header {};
+  if (image_size < sizeof(header)) {
+    error = "file too small";
+    return false;
+  }
+  std::memcpy(&header, image, sizeof(header));
+  if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0) {
+    error = "not a catalog snapshot";
+    return false;
+  }
+  if (header.byte_order != snapshot_byte_order) {
+    error = "written on a machine with another byte order";
+    return false;
+  }
+  if (header.version != snapshot_version) {
+    error = "format version " + std::to_string(header.version) + ", expected " + std::to_string(snapshot_version);
+    return false;
+  }
+  if (header.image_size != image_size) {
+    error = "truncated";
+    return false;
+  }
+  this->_amd64Id     = header.amd64_id;
+  this->_diskImageId = header.disk_image_id;
+  bool sections_valid { sectionColumn(header, StringData, image, image_size, this->_stringData) &&
+                        sectionColumn(header, StringOffsets, image, image_size, this->_stringOffsets) &&
+                        sectionColumn(header, ProductName, image, image_size, this->_productName) &&
+                        sectionColumn(header, ProductRelease, image, image_size, this->_productRelease) &&
+                        sectionColumn(header, ProductReleaseTitle, image, image_size, this->_productReleaseTitle) &&
+                        sectionColumn(header, ProductArch, image, image_size, this->_productArch) &&
+                        sectionColumn(header, ProductVersion, image, image_size, this->_productVersion) &&
+                        sectionColumn(header, ProductMirror, image, image_size, this->_productMirror) &&
+                        sectionColumn(header, ProductFlags, image, image_size, this->_productFlags) &&
+                        sectionColumn(header, ProductVersionBegin, image, image_size, this->_productVersionBegin) &&
+                        sectionColumn(header, VersionSerial, image, image_size, this->_versionSerial) &&
+                        sectionColumn(header, VersionKey, image, image_size, this->_versionKey) &&
+                        sectionColumn(header, VersionItemBegin, image, image_size, this->_versionItemBegin) &&
+                        sectionColumn(header, ItemName, image, image_size, this->_itemName) &&
+                        sectionColumn(header, ItemSha256, image, image_size, this->_itemSha256) &&
+                        sectionColumn(header, ItemPath, image, image_size, this->_itemPath) &&
+                        sectionColumn(header, ItemSize, image, image_size, this->_itemSize) &&
+                        sectionColumn(header, ReleaseIndex, image, image_size, this->_releaseIndex) &&
+                        sectionColumn(header, TitleIndex, image, image_size, this->_titleIndex) &&
+                        sectionColumn(header, IndexProducts, image, image_size, this->_indexProducts) };
+  if (!sections_valid) {
+    error = "section out of bounds";
+    return false;
+  }
+  // Every offset and id is checked once here, so queries can index the columns without bounds checks
+  std::size_t product_count { this->_productName.size() };
+  std::size_t version_count { this->_versionSerial.size() };
+  std::size_t string_count { this->_stringOffsets.size() == 0 ? 0 : this->_stringOffsets.size() - 1 };
+  bool        columns_valid { validOffsets(this->_stringOffsets, string_count, this->_stringData.size()) };
+  columns_valid = columns_valid && this->_productRelease.size() == product_count && this->_productReleaseTitle.size() == product_count &&
+                  this->_productArch.size() == product_count && this->_productVersion.size() == product_count &&
+                  this->_productMirror.size() == product_count && this->_productFlags.size() == product_count &&
+                  this->_versionKey.size() == version_count && this->_itemSha256.size() == this->_itemName.size() &&
+                  this->_itemPath.size() == this->_itemName.size() && this->_itemSize.size() == this->_itemName.size();
+  columns_valid = columns_valid && validOffsets(this->_productVersionBegin, product_count, version_count) &&
+                  validOffsets(this->_versionItemBegin, version_count, this->_itemName.size());
+  for (const auto* column : { &this->_productName, &this->_productRelease, &this->_productReleaseTitle, &this->_productArch,
+                              &this->_productVersion, &this->_productMirror, &this->_versionSerial, &this->_itemName, &this->_itemSha256,
+                              &this->_itemPath }) {
+    columns_valid = columns_valid && validIds(*column, string_count);
+  }
+  for (std::size_t product = 0; columns_valid && product < product_count; product++) {
+    // findVersion() and latestVersion() rely on the order of the keys
+    columns_valid = std::is_sorted(this->_versionKey.begin() + this->_productVersionBegin[product],
+                                   this->_versionKey.begin() + this->_productVersionBegin[product + 1]);
+  }
+  for (const auto* index : { &this->_releaseIndex, &this->_titleIndex }) {
+    columns_valid = columns_valid && index->size() > 0 && (index->size() & (index->size() - 1)) == 0;
+    for (const UbuntuCatalogBucket& bucket : *index) {
+      columns_valid = columns_valid && (bucket.key == npos || (bucket.key < string_count && bucket.first <= this->_indexProducts.size() &&
+                                                               bucket.count <= this->_indexProducts.size() - bucket.first));
+    }
+  }
+  columns_valid = columns_valid && validIds(this->_indexProducts, product_count);
+  columns_valid = columns_valid && (this->_amd64Id == npos || this->_amd64Id < string_count) &&
+                  (this->_diskImageId == npos || this->_diskImageId < string_count);
+  if (!columns_valid) {
+    error = "inconsistent contents";
+    return false;
+  }
+  this->_storage   = std::move(storage);
+  this->_image     = image;
+  this->_imageSize = image_size;
+  return true;
+}
+
+UbuntuCatalogColumn<std::uint32_t> UbuntuCloudCatalog::findProducts(const UbuntuCatalogColumn<UbuntuCatalogBucket>& index,
+                                                                     std::string_view                                value) const {
+  std::size_t mask { index.size() - 1 };
+  std::size_t slot { hashString(value) & mask };
+  for (std::size_t probe = 0; probe < index.size(); probe++) {
+    const UbuntuCatalogBucket& bucket { index[slot] };
+    if (bucket.key == npos) {
+      break;  // Empty slot ends the probe sequence
+    }
+    if (this->string(bucket.key) == value) {
+      return UbuntuCatalogColumn<std::uint32_t>(this->_indexProducts.begin() + bucket.first, bucket.count);
+    }
+    slot = (slot + 1) & mask;
+  }
+  return UbuntuCatalogColumn<std::uint32_t>();
+}
+
+std::vector<std::uint32_t> UbuntuCloudCatalog::productsForRelease(std::string_view release_name) const {
+  std::vector<std::uint32_t> products {};
+  for (const auto* index : { &this->_releaseIndex, &this->_titleIndex }) {
+    UbuntuCatalogColumn<std::uint32_t> matches { this->findProducts(*index, release_name) };
+    products.insert(products.end(), matches.begin(), matches.end());
+  }
+  // A release whose codename is also a title of another, or of itself, must not list a product twice
+  std::sort(products.begin(), products.end());
+  products.erase(std::unique(products.begin(), products.end()), products.end());
+  return products;
+}
+
+std::uint32_t UbuntuCloudCatalog::findVersion(std::uint32_t product, std::string_view serial) const {
+  std::uint64_t        key { serialSortKey(serial) };
+  const std::uint64_t* first { this->_versionKey.begin() + this->_productVersionBegin[product] };
+  const std::uint64_t* last { this->_versionKey.begin() + this->_productVersionBegin[product + 1] };
+  // Serials sharing a key, e.g. "20240423" and "20240423.0", are adjacent
+  for (const std::uint64_t* version = std::lower_bound(first, last, key); version != last && *version == key; version++) {
+    std::uint32_t index { static_cast<std::uint32_t>(version - this->_versionKey.begin()) };
+    if (this->string(this->_versionSerial[index]) == serial) {
+      return index;
+    }
+  }
+  return npos;
+}
+
+std::vector<UbuntuCatalogChange> UbuntuCloudCatalog::changesSince(const UbuntuCloudCatalog& previous) const {
+  std::vector<UbuntuCatalogChange> changes {};
+  auto add_change { [&changes](const UbuntuCloudCatalog& catalog, std::uint32_t product, UbuntuCatalogChange::Kind kind, std::string_view serial) {
+    changes.push_back({ kind, std::string(catalog.string(catalog._productName[product])), std::string(catalog.string(catalog._productRelease[product])),
+                        std::string(catalog.string(catalog._productArch[product])), std::string(serial) });
+  } };
+  std::size_t   product_count { this->productCount() };
+  std::size_t   previous_count { previous.productCount() };
+  std::uint32_t product { 0 };
+  std::uint32_t old_product { 0 };
+  while (product < product_count || old_product < previous_count) {
+    int order { product == product_count        ? 1
+                : old_product == previous_count ? -1
+                                                : this->string(this->_productName[product]).compare(previous.string(previous._productName[old_product])) };
+    if (order < 0) {
+      std::uint32_t latest_version { this->latestVersion(product) };
+      add_change(*this, product, UbuntuCatalogChange::Kind::NewProduct,
+                 latest_version == npos ? std::string_view() : this->string(this->_versionSerial[latest_version]));
+      product++;
+      continue;
+    }
+    if (order > 0) {
+      add_change(previous, old_product, UbuntuCatalogChange::Kind::RemovedProduct, {});
+      old_product++;
+      continue;
+    }
+    std::uint8_t flags { this->_productFlags[product] };
+    std::uint8_t old_flags { previous._productFlags[old_product] };
+    if ((flags & supported_flag) != (old_flags & supported_flag)) {
+      add_change(*this, product, (flags & supported_flag) != 0 ? UbuntuCatalogChange::Kind::Supported : UbuntuCatalogChange::Kind::Unsupported, {});
+    }
+    std::string_view release { this->string(this->_productRelease[product]) };
+    if ((flags & lts_flag) != 0 && (old_flags & lts_flag) == 0 &&
+        std::none_of(changes.begin(), changes.end(), [release](const UbuntuCatalogChange& change) {
+          return change.kind == UbuntuCatalogChange::Kind::NewLTS && change.release == release;
+        })) {
+      add_change(*this, product, UbuntuCatalogChange::Kind::NewLTS, {});
+    }
+    // Serials are only ever added in practice, so equal counts and latest serials mean equal versions
+    std::uint32_t begin { this->_productVersionBegin[product] };
+    std::uint32_t end { this->_productVersionBegin[product + 1] };
+    std::uint32_t latest_version { this->latestVersion(product) };
+    std::uint32_t old_latest_version { previous.latestVersion(old_product) };
+    bool          same_versions { end - begin == previous._productVersionBegin[old_product + 1] - previous._productVersionBegin[old_product] &&
+                         (latest_version == npos ||
+                          this->string(this->_versionSerial[latest_version]) == previous.string(previous._versionSerial[old_latest_version])) };
+    for (std::uint32_t version = begin; !same_versions && version < end; version++) {
+      std::string_view serial { this->string(this->_versionSerial[version]) };
+      if (previous.findVersion(old_product, serial) == npos) {
+        add_change(*this, product, UbuntuCatalogChange::Kind::NewSerial, serial);
+      }
+    }
+    product++;
+    old_product++;
+  }
+  return changes;
+}
+
+/// Products a run of a parallel scan holds at least. A smaller run takes less time to scan than a worker to wake up.
+constexpr static std::size_t min_run_products { 4096 };
+
+/**
+ * @brief Scans every product of a catalog, in runs of consecutive products spread over the shared worker pool.
+ *
+ * A large catalog is cut into a few runs per pool thread, each scanned into an accumulator of its own, so the threads
+ * share nothing while scanning and those that finish first steal the runs left to the others. A catalog of less than
+ * two runs is scanned by the calling thread alone, without waking the pool.
+ * @tparam Accumulator Result of the scan of one run, default constructible.
+ * @tparam Scan Callable as scan(Accumulator&, std::uint32_t first_product, std::uint32_t end_product).
+ * @param product_count Number of products of the catalog.
+ * @param scan Scans a run into its accumulator. Called concurrently, on distinct runs.
+ * @return std::vector<Accumulator> One accumulator per run, in product order.
+ */
+template <typename Accumulator, typename Scan>
+static std::vector<Accumulator> scanProducts(std::size_t product_count, const Scan& scan) {
+  if (product_count < 2 * min_run_products) {
+    std::vector<Accumulator> runs(1);
+    scan(runs.front(), 0, static_cast<std::uint32_t>(product_count));
+    return runs;
+  }
+  UbuntuCloudWorkerPool&   pool { sharedWorkerPool() };
+  std::vector<Accumulator> runs(std::min(product_count / min_run_products, pool.threads() * 4));
+  pool.run(runs.size(), [product_count, &scan, &runs](std::size_t idx) {
+    // Runs of equal size, whose bounds do not depend on the order they are scanned in
+    scan(runs[idx], static_cast<std::uint32_t>(product_count * idx / runs.size()), static_cast<std::uint32_t>(product_count * (idx + 1) / runs.size()));
+  });
+  return runs;
+}
+
+std::vector<UbuntuRelease> UbuntuCloudCatalog::supportedReleases() const {
+  // Supported products of a run, by title and release id, with their architecture ids in product order
+  using ReleaseRun = std::map<std::pair<std::uint32_t, std::uint32_t>, std::vector<std::uint32_t>>;
+  std::vector<ReleaseRun> runs { scanProducts<ReleaseRun>(this->productCount(), [this](ReleaseRun& run, std::uint32_t first, std::uint32_t end) {
+    for (std::uint32_t product = first; product < end; product++) {
+      if ((this->_productFlags[product] & supported_flag) == 0) {
+        continue;
+      }
+      std::vector<std::uint32_t>& archs { run[{ this->_productReleaseTitle[product], this->_productRelease[product] }] };
+      std::uint32_t               arch { this->_productArch[product] };
+      if (std::find(archs.begin(), archs.end(), arch) == archs.end()) {
+        // Merged streams can hold several products of one release and architecture, each architecture is listed once
+        archs.push_back(arch);
+      }
+    }
+  }) };
+  std::map<std::string, std::vector<std::string>, std::greater<>> release_map;
+  // The inherent sorting of the std::map will allow to separate the LTS from the non-LTS versions, for later handling
+  for (const ReleaseRun& run : runs) {
+    for (const auto& [release_ids, arch_ids] : run) {
+      std::string_view release_title { this->string(release_ids.first) };
+      std::string_view release { this->string(release_ids.second) };
+      std::string      complete_name {};
+      complete_name.reserve(release_title.size() + release.size() + 3);
+      complete_name.append(release_title).append(" (").append(release).append(")");
+      std::vector<std::string>& archs { release_map[std::move(complete_name)] };
+      for (std::uint32_t arch_id : arch_ids) {
+        // Runs are merged in product order, so each release lists its architectures as a single pass would
+        std::string_view arch { this->string(arch_id) };
+        if (std::find(archs.begin(), archs.end(), arch) == archs.end()) {
+          archs.emplace_back(arch);
+        }
+      }
+    }
+  }
+  // The vector is constructed using the struct's constructor from std::pair<std::string,std::vector<std::string>>
+  return std::vector<UbuntuRelease>(release_map.begin(), release_map.end());
+}
+
+std::optional<UbuntuRelease> UbuntuCloudCatalog::currentLTS() const {
+  // The products flagged LTS, a handful out of the whole catalog
+  std::vector<std::vector<std::uint32_t>> runs { scanProducts<std::vector<std::uint32_t>>(
+      this->productCount(), [this](std::vector<std::uint32_t>& run, std::uint32_t first, std::uint32_t end) {
+        for (std::uint32_t product = first; product < end; product++) {
+          if ((this->_productFlags[product] & lts_flag) != 0) {
+            run.push_back(product);
+          }
+        }
+      }) };
+  std::optional<UbuntuRelease> current_LTS { std::nullopt };
+  for (const std::vector<std::uint32_t>& run : runs) {
+    for (std::uint32_t product : run) {
+      if (!current_LTS) {
+        // Version instead of release_title because we do not need the LTS label
+        current_LTS = UbuntuRelease({ std::string(this->string(this->_productVersion[product])) + " (" +
+                                        std::string(this->string(this->_productRelease[product])) + ")",
+                                      {} });
+      }
+      std::string_view arch { this->string(this->_productArch[product]) };
+      if (std::find(current_LTS->architectures.begin(), current_LTS->architectures.end(), arch) != current_LTS->architectures.end()) {
+        continue;  // Same architecture from another merged stream, the first product in name order is shown
+      }
+      current_LTS->architectures.emplace_back(arch);
+      std::uint32_t latest_version { this->latestVersion(product) };
+      current_LTS->latest_versions.emplace_back(latest_version == npos ? std::string_view() : this->string(this->_versionSerial[latest_version]));
+    }
+  }
+  return current_LTS;
+}
+
+std::pair<std::uint32_t, std::uint32_t> UbuntuCloudCatalog::findDiskImage(std::string_view release_name) const {
+  if (this->_amd64Id == npos || this->_diskImageId == npos) {
+    return { npos, npos };  // No amd64 product or no disk image at all
+  }
+  // The amd64 products, in product order, whose release or title matches
+  std::vector<std::uint32_t> matches {};
+  for (const auto* index : { &this->_releaseIndex, &this->_titleIndex }) {
+    for (std::uint32_t product : this->findProducts(*index, release_name)) {
+      if (this->_productArch[product] == this->_amd64Id) {
+        matches.push_back(product);
+      }
+    }
+  }
+  std::sort(matches.begin(), matches.end());
+  // The first one whose latest version has a disk image, merged streams may hold products without one
+  for (std::uint32_t match : matches) {
+    std::uint32_t latest_version { this->latestVersion(match) };
+    if (latest_version == npos) {
+      continue;
+    }
+    for (std::uint32_t item = this->_versionItemBegin[latest_version]; item < this->_versionItemBegin[latest_version + 1]; item++) {
+      if (this->_itemName[item] == this->_diskImageId) {
+        return { match, item };
+      }
+    }
+  }
+  return { npos, npos };  // No match, or latest versions without a disk image
+}
+
+std::optional<std::string> UbuntuCloudCatalog::sha256ForRelease(const std::string& release_name) const {
+  std::uint32_t item { this->findDiskImage(release_name).second };
+  if (item == npos) {
+    return std::nullopt;
+  }
+  return std::string(this->string(this->_itemSha256[item]));
+}
+
+std::optional<UbuntuCloudImage> UbuntuCloudCatalog::diskImageForRelease(const std::string& release_name) const {
+  auto [product, item] = this->findDiskImage(release_name);
+  if (item == npos) {
+    return std::nullopt;
+  }
+  std::string_view mirror { this->string(this->_productMirror[product]) };
+  std::string_view path { this->string(this->_itemPath[item]) };
+  if (path.empty()) {
+    return std::nullopt;  // Published without a path, nothing to download
+  }
+  std::string url {};
+  url.reserve(mirror.size() + path.size());
+  url.append(mirror).append(path);
+  return UbuntuCloudImage { std::move(url), std::string(this->string(this->_itemSha256[item])), this->_itemSize[item] };
+}
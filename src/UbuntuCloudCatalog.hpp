@@ -0,0 +1,490 @@
+/**
+ * @file UbuntuCloudCatalog.hpp
+ * @brief Declares the reduced in-memory model of a simplestreams product file and its indexed form.
+ *
+ * Only the fields used by the queries are kept: the release identifiers, architecture, aliases, support flag,
+ * version, and for each version (serial) the sha256, path and size of each item. Everything else in the product file
+ * is dropped while parsing.
+ *
+ * The parser produces a list of UbuntuProduct records, which is turned once into a UbuntuCloudCatalog:
+ * a struct-of-arrays table with interned strings and hash indexes on the release and release title.
+ * The records are discarded afterwards, and all queries run against the catalog. The catalog can be saved as
+ * a binary snapshot and opened again through a memory mapping, skipping the download and the parse.
+ */
+
+#pragma once
+
+#include "UbuntuCloudArena.hpp"
+#include "UbuntuCloudInterface.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct UbuntuProductItem
+ * @brief One file of a published serial, e.g. its disk image. The strings live in the arena of the product.
+ */
+struct UbuntuProductItem {
+    std::string_view name;     ///< The item key in the product file, e.g. "disk1.img".
+    std::string_view sha256;   ///< The sha256 of the file.
+    std::string_view path;     ///< Path of the file relative to the mirror root, e.g. "server/releases/noble/release-20240423/...".
+    std::uint64_t    size {};  ///< Size of the file in bytes, 0 if not published.
+};
+
+/**
+ * @struct UbuntuProductVersion
+ * @brief One published serial of a product, e.g. "20240423".
+ */
+struct UbuntuProductVersion {
+    std::string                    serial;  ///< The version key in the product file.
+    std::vector<UbuntuProductItem> items;   ///< The files of the serial.
+};
+
+/**
+ * @struct UbuntuProduct
+ * @brief One product entry, i.e. one release for one architecture.
+ */
+struct UbuntuProduct {
+    std::string                       name;           ///< The product key, e.g. "com.ubuntu.cloud:server:24.04:amd64".
+    std::string                       release;        ///< Release codename, e.g. "noble".
+    std::string                       release_title;  ///< Release title, e.g. "24.04 LTS".
+    std::string                       arch;           ///< Architecture, e.g. "amd64".
+    std::string                       aliases;        ///< Comma separated aliases, contains "lts" for the current LTS.
+    std::string                       version;        ///< Numeric version, e.g. "24.04".
+    std::string                       mirror;         ///< Root URL the item paths are relative to, set by the fetcher.
+    bool                              supported {};   ///< Whether the release is still supported.
+    std::vector<UbuntuProductVersion> versions;       ///< Published serials, sorted by versionPrecedes().
+    std::unique_ptr<UbuntuCloudArena> strings;        ///< Storage of the item strings, released in bulk with the product.
+};
+
+/**
+ * @brief Computes the numeric sort key of a serial.
+ *
+ * Serials have the form "<date>[.<n>]", e.g. "20240423" or "20240423.1". The key packs the date into the upper
+ * 40 bits and the point release into the lower 24 bits, both saturating, so comparing two keys compares the serials
+ * numerically. Characters after these two numbers are ignored; serials with equal keys are ordered by their text.
+ * @param serial The serial.
+ * @return std::uint64_t The sort key.
+ */
+std::uint64_t serialSortKey(std::string_view serial);
+
+/**
+ * @brief Orders two versions from the oldest to the most recent, by serialSortKey() then by serial text.
+ * @param first The first version.
+ * @param second The second version.
+ * @return bool True if first is older than second.
+ */
+bool versionPrecedes(const UbuntuProductVersion& first, const UbuntuProductVersion& second);
+
+/**
+ * @struct UbuntuCatalogChange
+ * @brief One difference between two loads of the catalog, see UbuntuCloudCatalog::changesSince().
+ */
+struct UbuntuCatalogChange {
+    /// What changed.
+    enum class Kind {
+      NewProduct,      ///< A product that was not in the previous catalog, e.g. a new release or architecture.
+      RemovedProduct,  ///< A product that is no longer in the catalog.
+      NewSerial,       ///< A serial published for a known product.
+      Unsupported,     ///< A product that is no longer supported.
+      Supported,       ///< A product that is supported again.
+      NewLTS           ///< A release that became the current LTS, reported once for all its products.
+    };
+    Kind        kind;     ///< What changed.
+    std::string product;  ///< The product name, e.g. "com.ubuntu.cloud:server:24.04:amd64".
+    std::string release;  ///< Release codename of the product, e.g. "noble".
+    std::string arch;     ///< Architecture of the product, e.g. "amd64".
+    std::string serial;   ///< The new serial for NewSerial, the latest serial for NewProduct, empty otherwise.
+};
+
+/**
+ * @class UbuntuCatalogColumn
+ * @brief Read-only view of one fixed-width column of a catalog image.
+ * @tparam T The element type of the column.
+ */
+template <typename T>
+class UbuntuCatalogColumn {
+  private:
+    /// First element of the column.
+    const T* _data;
+    /// Number of elements.
+    std::size_t _size;
+
+  public:
+    /**
+     * @brief Constructs an empty column.
+     */
+    UbuntuCatalogColumn(): _data(nullptr), _size(0) { }
+
+    /**
+     * @brief Constructs a view over existing elements.
+     * @param data First element.
+     * @param size Number of elements.
+     */
+    UbuntuCatalogColumn(const T* data, std::size_t size): _data(data), _size(size) { }
+
+    const T&    operator[](std::size_t index) const { return this->_data[index]; }
+    std::size_t size() const { return this->_size; }
+    const T*    begin() const { return this->_data; }
+    const T*    end() const { return this->_data + this->_size; }
+};
+
+/**
+ * @struct UbuntuCatalogBucket
+ * @brief One slot of an open-addressing hash index stored in a catalog image.
+ */
+struct UbuntuCatalogBucket {
+    std::uint32_t key;    ///< String id of the indexed value, UbuntuCloudCatalog::npos for an empty slot.
+    std::uint32_t first;  ///< First entry of the slot's product list in the index product column.
+    std::uint32_t count;  ///< Number of products with this value, in product order.
+};
+
+/**
+ * @class UbuntuCloudCatalog
+ * @brief Immutable, pre-indexed table of products, versions and items.
+ *
+ * Every string is stored once in a shared string table and referred to by a 32-bit id. Products, versions and items
+ * are stored column by column; the versions of a product and the items of a version are contiguous ranges, addressed
+ * through begin offsets. The versions of a product are sorted by the numeric key of their serial, so the latest one
+ * is the last of its range and any serial is found by binary search. Products are indexed by release and release
+ * title, so looking up the sha256 of a release does not scan the table.
+ *
+ * All columns and indexes live in a single contiguous image, which is also the on-disk snapshot format:
+ * a versioned header followed by 8-byte aligned sections, where every reference is an index or offset rather than
+ * a pointer. A catalog built from parsed products owns its image in memory; a catalog opened from a snapshot
+ * points its columns straight into a read-only mapping of the file, without any parse step.
+ * Copies of a catalog share the same image.
+ */
+class UbuntuCloudCatalog {
+  public:
+    /// Sentinel for a missing index or string id.
+    static constexpr std::uint32_t npos { UINT32_MAX };
+
+  private:
+    /// Bit set in _productFlags for supported products.
+    static constexpr std::uint8_t supported_flag { 1 };
+    /// Bit set in _productFlags for products whose aliases include "lts".
+    static constexpr std::uint8_t lts_flag { 2 };
+
+    /// Keeps the image alive: an in-memory buffer or a file mapping.
+    std::shared_ptr<const void> _storage;
+    /// First byte of the image.
+    const std::byte* _image;
+    /// Size of the image in bytes.
+    std::size_t _imageSize;
+
+    /// Characters of all interned strings, back to back.
+    UbuntuCatalogColumn<char> _stringData;
+    /// Start offset of each interned string in _stringData, plus a final end offset.
+    UbuntuCatalogColumn<std::uint32_t> _stringOffsets;
+
+    /// Product name column (string ids), products are sorted by name.
+    UbuntuCatalogColumn<std::uint32_t> _productName;
+    /// Release codename column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _productRelease;
+    /// Release title column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _productReleaseTitle;
+    /// Architecture column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _productArch;
+    /// Numeric version column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _productVersion;
+    /// Mirror root column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _productMirror;
+    /// Flag column, combination of supported_flag and lts_flag.
+    UbuntuCatalogColumn<std::uint8_t> _productFlags;
+    /// First version index of each product, plus a final end offset.
+    UbuntuCatalogColumn<std::uint32_t> _productVersionBegin;
+    /// Serial column of the versions (string ids). The versions of a product are sorted by _versionKey, then by serial.
+    UbuntuCatalogColumn<std::uint32_t> _versionSerial;
+    /// Sort key column of the versions, see serialSortKey().
+    UbuntuCatalogColumn<std::uint64_t> _versionKey;
+    /// First item index of each version, plus a final end offset.
+    UbuntuCatalogColumn<std::uint32_t> _versionItemBegin;
+
+    /// Item name column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _itemName;
+    /// Item sha256 column (string ids).
+    UbuntuCatalogColumn<std::uint32_t> _itemSha256;
+    /// Item path column (string ids), relative to the mirror root of the product.
+    UbuntuCatalogColumn<std::uint32_t> _itemPath;
+    /// Item size column in bytes, 0 if not published.
+    UbuntuCatalogColumn<std::uint64_t> _itemSize;
+
+    /// Hash index of the products by release codename.
+    UbuntuCatalogColumn<UbuntuCatalogBucket> _releaseIndex;
+    /// Hash index of the products by release title.
+    UbuntuCatalogColumn<UbuntuCatalogBucket> _titleIndex;
+    /// Product lists referenced by the buckets of both indexes.
+    UbuntuCatalogColumn<std::uint32_t> _indexProducts;
+
+    /// String id of "amd64", npos if no product uses it.
+    std::uint32_t _amd64Id;
+    /// String id of "disk1.img", npos if no item uses it.
+    std::uint32_t _diskImageId;
+
+    /**
+     * @brief Points the columns into an image after checking that it is well formed.
+     * @param storage Owner of the image memory.
+     * @param image First byte of the image.
+     * @param image_size Size of the image in bytes.
+     * @param[out] error Receives a description of the problem on failure.
+     * @return bool True if the image is valid. On failure the catalog is left inconsistent and must be discarded.
+     */
+    bool attach(std::shared_ptr<const void> storage, const std::byte* image, std::size_t image_size, std::string& error);
+
+    /**
+     * @brief Looks up the products whose indexed value equals a string.
+     * @param index The hash index to search.
+     * @param value The value to look for.
+     * @return UbuntuCatalogColumn<std::uint32_t> The matching products in product order, empty if none.
+     */
+    UbuntuCatalogColumn<std::uint32_t> findProducts(const UbuntuCatalogColumn<UbuntuCatalogBucket>& index, std::string_view value) const;
+
+    /**
+     * @brief Finds the disk1.img item in the latest amd64 version of a release.
+     * @param release_name The release codename or title.
+     * @return std::pair<std::uint32_t, std::uint32_t> The product and item indexes, both npos if not found.
+     */
+    std::pair<std::uint32_t, std::uint32_t> findDiskImage(std::string_view release_name) const;
+
+  public:
+    /**
+     * @brief Constructs an empty catalog.
+     */
+    UbuntuCloudCatalog();
+
+    /**
+     * @brief Builds the catalog from parsed products.
+     * @param products Products sorted by name, as returned by parseProductStream().
+     */
+    explicit UbuntuCloudCatalog(const std::vector<UbuntuProduct>& products);
+
+    /**
+     * @brief Opens a snapshot written by writeSnapshot() by mapping it into memory.
+     * @param path The snapshot file.
+     * @param[out] error Receives a description of the problem on failure.
+     * @return std::optional<UbuntuCloudCatalog> The catalog, or std::nullopt if the file is missing, of another format version, or corrupt.
+     */
+    static std::optional<UbuntuCloudCatalog> openSnapshot(const std::filesystem::path& path, std::string& error);
+
+    /**
+     * @brief Writes the catalog image to a snapshot file, atomically replacing any previous snapshot.
+     * @param path The snapshot file.
+     * @return bool True if the snapshot was written.
+     * @note Processes that still map the previous snapshot keep reading it until they exit.
+     */
+    bool writeSnapshot(const std::filesystem::path& path) const;
+
+    /**
+     * @brief Returns the number of products in the catalog.
+     * @return std::size_t The product count.
+     */
+    std::size_t productCount() const { return this->_productName.size(); }
+
+    /**
+     * @brief Resolves an interned string id.
+     * @param id The string id.
+     * @return std::string_view The string, valid as long as the catalog or one of its copies.
+     */
+    std::string_view string(std::uint32_t id) const {
+      return std::string_view(this->_stringData.begin() + this->_stringOffsets[id], this->_stringOffsets[id + 1] - this->_stringOffsets[id]);
+    }
+
+    /**
+     * @brief Returns the name of a product.
+     * @param product The product index.
+     * @return std::string_view The name, e.g. "com.ubuntu.cloud:server:24.04:amd64".
+     */
+    std::string_view productName(std::uint32_t product) const { return this->string(this->_productName[product]); }
+
+    /**
+     * @brief Returns the release codename of a product.
+     * @param product The product index.
+     * @return std::string_view The codename, e.g. "noble".
+     */
+    std::string_view productRelease(std::uint32_t product) const { return this->string(this->_productRelease[product]); }
+
+    /**
+     * @brief Returns the release title of a product.
+     * @param product The product index.
+     * @return std::string_view The title, e.g. "24.04 LTS".
+     */
+    std::string_view productReleaseTitle(std::uint32_t product) const { return this->string(this->_productReleaseTitle[product]); }
+
+    /**
+     * @brief Returns the architecture of a product.
+     * @param product The product index.
+     * @return std::string_view The architecture, e.g. "amd64".
+     */
+    std::string_view productArch(std::uint32_t product) const { return this->string(this->_productArch[product]); }
+
+    /**
+     * @brief Returns the numeric version of a product.
+     * @param product The product index.
+     * @return std::string_view The version, e.g. "24.04".
+     */
+    std::string_view productVersion(std::uint32_t product) const { return this->string(this->_productVersion[product]); }
+
+    /**
+     * @brief Returns the mirror root the item paths of a product are relative to.
+     * @param product The product index.
+     * @return std::string_view The root URL, ending with a slash.
+     */
+    std::string_view productMirror(std::uint32_t product) const { return this->string(this->_productMirror[product]); }
+
+    /**
+     * @brief Tells whether a product is still supported.
+     * @param product The product index.
+     * @return bool True if supported.
+     */
+    bool productSupported(std::uint32_t product) const { return (this->_productFlags[product] & supported_flag) != 0; }
+
+    /**
+     * @brief Tells whether a product belongs to the current LTS release.
+     * @param product The product index.
+     * @return bool True if its aliases include "lts".
+     */
+    bool productLts(std::uint32_t product) const { return (this->_productFlags[product] & lts_flag) != 0; }
+
+    /**
+     * @brief Lists the products whose release codename or title is a given string, through the hash indexes.
+     * @param release_name The release codename or title.
+     * @return std::vector<std::uint32_t> The matching products in product order, without duplicates.
+     */
+    std::vector<std::uint32_t> productsForRelease(std::string_view release_name) const;
+
+    /**
+     * @brief Returns the versions of a product as a range of version indexes, from the oldest to the latest.
+     * @param product The product index.
+     * @return std::pair<std::uint32_t, std::uint32_t> The first version and one past the last.
+     */
+    std::pair<std::uint32_t, std::uint32_t> versionRange(std::uint32_t product) const {
+      return { this->_productVersionBegin[product], this->_productVersionBegin[product + 1] };
+    }
+
+    /**
+     * @brief Returns the serial of a version.
+     * @param version The version index.
+     * @return std::string_view The serial, e.g. "20240423".
+     */
+    std::string_view versionSerial(std::uint32_t version) const { return this->string(this->_versionSerial[version]); }
+
+    /**
+     * @brief Returns the sort key of a version, see serialSortKey().
+     * @param version The version index.
+     * @return std::uint64_t The key. Keys increase along the versions of a product.
+     */
+    std::uint64_t versionKey(std::uint32_t version) const { return this->_versionKey[version]; }
+
+    /**
+     * @brief Returns the items of a version as a range of item indexes.
+     * @param version The version index.
+     * @return std::pair<std::uint32_t, std::uint32_t> The first item and one past the last.
+     */
+    std::pair<std::uint32_t, std::uint32_t> itemRange(std::uint32_t version) const {
+      return { this->_versionItemBegin[version], this->_versionItemBegin[version + 1] };
+    }
+
+    /**
+     * @brief Returns the string id of an item's name, equal for items of the same name.
+     * @param item The item index.
+     * @return std::uint32_t The string id, see string().
+     */
+    std::uint32_t itemNameId(std::uint32_t item) const { return this->_itemName[item]; }
+
+    /**
+     * @brief Returns the name of an item.
+     * @param item The item index.
+     * @return std::string_view The name, e.g. "disk1.img".
+     */
+    std::string_view itemName(std::uint32_t item) const { return this->string(this->_itemName[item]); }
+
+    /**
+     * @brief Returns the number of items of every version of every product.
+     * @return std::size_t The item count.
+     */
+    std::size_t itemCount() const { return this->_itemName.size(); }
+
+    /**
+     * @brief Returns the path of an item, relative to the mirror root of its product.
+     * @param item The item index.
+     * @return std::string_view The path, empty if none was published.
+     */
+    std::string_view itemPath(std::uint32_t item) const { return this->string(this->_itemPath[item]); }
+
+    /**
+     * @brief Returns the published sha256 of an item.
+     * @param item The item index.
+     * @return std::string_view The sha256.
+     */
+    std::string_view itemSha256(std::uint32_t item) const { return this->string(this->_itemSha256[item]); }
+
+    /**
+     * @brief Returns the published size of an item.
+     * @param item The item index.
+     * @return std::uint64_t The size in bytes, 0 if none was published.
+     */
+    std::uint64_t itemSize(std::uint32_t item) const { return this->_itemSize[item]; }
+
+    /**
+     * @brief Returns the latest version of a product.
+     * @param product The product index.
+     * @return std::uint32_t The version index, or npos if the product has no versions.
+     */
+    std::uint32_t latestVersion(std::uint32_t product) const {
+      std::uint32_t end { this->_productVersionBegin[product + 1] };
+      return end == this->_productVersionBegin[product] ? npos : end - 1;
+    }
+
+    /**
+     * @brief Finds a version of a product by its serial, with a binary search on the sort keys.
+     * @param product The product index.
+     * @param serial The serial to look for, e.g. "20240423".
+     * @return std::uint32_t The version index, or npos if the product has no such serial.
+     */
+    std::uint32_t findVersion(std::uint32_t product, std::string_view serial) const;
+
+    /**
+     * @brief Lists what changed since an earlier catalog, product by product.
+     *
+     * Both catalogs keep their products sorted by name, so they are walked side by side. A product whose version count
+     * and latest serial are the same in both is skipped without looking at its versions; otherwise each of its serials
+     * is looked up in the earlier catalog.
+     * @param previous The earlier catalog.
+     * @return std::vector<UbuntuCatalogChange> The changes in product order, empty if both hold the same data.
+     */
+    std::vector<UbuntuCatalogChange> changesSince(const UbuntuCloudCatalog& previous) const;
+
+    /**
+     * @brief Lists the supported releases with their architectures.
+     * @return std::vector<UbuntuRelease> Releases sorted by descending name, see UbuntuCloudInterface::getSupportedReleases().
+     */
+    std::vector<UbuntuRelease> supportedReleases() const;
+
+    /**
+     * @brief Finds the current LTS release with the latest version of each architecture.
+     * @return std::optional<UbuntuRelease> The LTS release, or std::nullopt if no product is flagged LTS.
+     */
+    std::optional<UbuntuRelease> currentLTS() const;
+
+    /**
+     * @brief Looks up the sha256 of disk1.img in the latest amd64 version of a release.
+     * @param release_name The release codename or title.
+     * @return std::optional<std::string> The sha256, or std::nullopt if not found.
+     */
+    std::optional<std::string> sha256ForRelease(const std::string& release_name) const;
+
+    /**
+     * @brief Looks up the disk1.img in the latest amd64 version of a release, the same item sha256ForRelease() reads.
+     * @param release_name The release codename or title.
+     * @return std::optional<UbuntuCloudImage> Its URL, sha256 and size, or std::nullopt if not found.
+     */
+    std::optional<UbuntuCloudImage> diskImageForRelease(const std::string& release_name) const;
+};
@@ -0,0 +1,209 @@
+/**
+ * @file UbuntuCloudDecoder.cpp
+ * @brief Implementation of the decompression stage, on zlib and, when available, libzstd.
+ */
+
+#include "UbuntuCloudDecoder.hpp"
+
+#include <zlib.h>
+
+#ifdef UBUNTU_CLOUD_ZSTD
+#include <zstd.h>
+#endif
+
+#include <array>
+#include <functional>
+#include <memory>
+
+/// Bytes read from the body at a time, the size of the chunks libcurl delivers (CURL_MAX_WRITE_SIZE).
+constexpr static std::size_t input_chunk_size { 16 * 1024 };
+
+/// Bytes decoded at a time, compressed JSON typically expands about tenfold.
+constexpr static std::size_t output_chunk_size { 128 * 1024 };
+
+/// Hands a decoded chunk on, returns false once nobody reads anymore.
+using ChunkSink = std::function<bool(const char*, std::size_t)>;
+
+/**
+ * @brief Reads the next chunk of a body.
+ * @param input The body.
+ * @param buffer Receives the bytes.
+ * @return std::size_t Number of bytes read, 0 at the end of the body.
+ */
+static std::size_t readChunk(std::istream& input, std::array<char, input_chunk_size>& buffer) {
+  input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  return static_cast<std::size_t>(input.gcount());
+}
+
+/**
+ * @brief Inflates a gzip or zlib body.
+ * @param input The rest of the body.
+ * @param buffer Holds the first bytes of the body on entry, used as the input buffer afterwards.
+ * @param size Number of bytes in buffer on entry.
+ * @param emit Receives the decoded bytes.
+ * @param[out] error Receives a description of corrupt or truncated data.
+ * @return bool True if the whole body was decoded.
+ */
+static bool inflateBody(std::istream& input, std::array<char, input_chunk_size>& buffer, std::size_t size, const ChunkSink& emit,
+                        std::string& error) {
+  z_stream stream {};
+  // 15 window bits plus 32: accept both the gzip and the zlib header
+  if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+    error = "Could not initialize zlib";
+    return false;
+  }
+  std::unique_ptr<z_stream, int (*)(z_streamp)> guard(&stream, inflateEnd);
+  std::unique_ptr<char[]>                       decoded(new char[output_chunk_size]);
+  bool                                          member_ended { false };
+  for (; size > 0; size = readChunk(input, buffer)) {
+    stream.next_in  = reinterpret_cast<Bytef*>(buffer.data());
+    stream.avail_in = static_cast<uInt>(size);
+    do {
+      if (member_ended) {
+        // Concatenated gzip members form a single body, as gunzip reads them
+        inflateReset(&stream);
+        member_ended = false;
+      }
+      stream.next_out  = reinterpret_cast<Bytef*>(decoded.get());
+      stream.avail_out = static_cast<uInt>(output_chunk_size);
+      int code { inflate(&stream, Z_NO_FLUSH) };
+      if (code == Z_STREAM_END) {
+        member_ended = true;
+      } else if (code == Z_BUF_ERROR && stream.avail_in == 0) {
+        break;  // The output filled up as the input ran out, the rest of the member is in the next chunk
+      } else if (code != Z_OK) {
+        error = std::string("Corrupt gzip data: ") + (stream.msg ? stream.msg : zError(code));
+        return false;
+      }
+      std::size_t produced { output_chunk_size - stream.avail_out };
+      if (produced > 0 && !emit(decoded.get(), produced)) {
+        return false;  // The parser stopped reading
+      }
+    } while (stream.avail_in > 0 || stream.avail_out == 0);
+  }
+  if (!member_ended) {
+    error = "Truncated gzip data";
+    return false;
+  }
+  return true;
+}
+
+#ifdef UBUNTU_CLOUD_ZSTD
+/**
+ * @brief Decompresses a zstd body.
+ * @param input The rest of the body.
+ * @param buffer Holds the first bytes of the body on entry, used as the input buffer afterwards.
+ * @param size Number of bytes in buffer on entry.
+ * @param emit Receives the decoded bytes.
+ * @param[out] error Receives a description of corrupt or truncated data.
+ * @return bool True if the whole body was decoded.
+ */
+static bool decompressZstdBody(std::istream& input, std::array<char, input_chunk_size>& buffer, std::size_t size, const ChunkSink& emit,
+                               std::string& error) {
+  std::unique_ptr<ZSTD_DStream, std::size_t (*)(ZSTD_DStream*)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+  if (!stream || ZSTD_isError(ZSTD_initDStream(stream.get()))) {
+    error = "Could not initialize zstd";
+    return false;
+  }
+  std::unique_ptr<char[]> decoded(new char[output_chunk_size]);
+  std::size_t             remaining { 0 };  // 0 once the last frame is complete
+  for (; size > 0; size = readChunk(input, buffer)) {
+    ZSTD_inBuffer  in { buffer.data(), size, 0 };
+    ZSTD_outBuffer out { decoded.get(), output_chunk_size, 0 };
+    do {
+      out.pos   = 0;
+      remaining = ZSTD_decompressStream(stream.get(), &out, &in);
+      if (ZSTD_isError(remaining)) {
+        error = std::string("Corrupt zstd data: ") + ZSTD_getErrorName(remaining);
+        return false;
+      }
+      if (out.pos > 0 && !emit(decoded.get(), out.pos)) {
+        return false;  // The parser stopped reading
+      }
+    } while (in.pos < in.size || out.pos == out.size);
+  }
+  if (remaining != 0) {
+    error = "Truncated zstd data";
+    return false;
+  }
+  return true;
+}
+#endif
+
+UbuntuCloudEncoding detectEncoding(std::string_view prefix) {
+  if (prefix.size() >= 2 && prefix[0] == '\x1f' && prefix[1] == '\x8b') {
+    return UbuntuCloudEncoding::Gzip;
+  }
+  if (prefix.size() >= 2 && prefix[0] == '\x78' && (static_cast<unsigned char>(prefix[0]) * 256 + static_cast<unsigned char>(prefix[1])) % 31 == 0) {
+    return UbuntuCloudEncoding::Gzip;  // zlib header, the deflate Content-Encoding. Never the start of a JSON document
+  }
+  if (prefix.size() >= 4 && prefix.substr(0, 4) == std::string_view("\x28\xb5\x2f\xfd", 4)) {
+    return UbuntuCloudEncoding::Zstd;
+  }
+  return UbuntuCloudEncoding::Identity;
+}
+
+const char* encodingName(UbuntuCloudEncoding encoding) {
+  switch (encoding) {
+    case UbuntuCloudEncoding::Gzip:
+      return "gzip";
+    case UbuntuCloudEncoding::Zstd:
+      return "zstd";
+    default:
+      return "identity";
+  }
+}
+
+const char* acceptedEncodings() {
+#ifdef UBUNTU_CLOUD_ZSTD
+  return "zstd, gzip";
+#else
+  return "gzip";
+#endif
+}
+
+bool decodableSuffix(std::string_view suffix) {
+  if (suffix == ".gz") {
+    return true;
+  }
+#ifdef UBUNTU_CLOUD_ZSTD
+  return suffix == ".zst";
+#else
+  return false;
+#endif
+}
+
+bool decodeStream(std::istream& input, UbuntuCloudStreamBuffer& output, UbuntuCloudEncoding& encoding, std::string& error,
+                  const std::function<void(const char*, std::size_t)>& copy) {
+  ChunkSink emit { [&output, &copy](const char* data, std::size_t size) {
+    if (copy) {
+      copy(data, size);
+    }
+    return output.push(data, size);
+  } };
+  std::array<char, input_chunk_size> buffer {};
+  std::size_t                        size { readChunk(input, buffer) };
+  bool                               decoded { true };
+  encoding = detectEncoding(std::string_view(buffer.data(), size));
+  switch (encoding) {
+    case UbuntuCloudEncoding::Gzip:
+      decoded = inflateBody(input, buffer, size, emit, error);
+      break;
+    case UbuntuCloudEncoding::Zstd:
+#ifdef UBUNTU_CLOUD_ZSTD
+      decoded = decompressZstdBody(input, buffer, size, emit, error);
+#else
+      error   = "The body is zstd compressed, which this build cannot decode";
+      decoded = false;
+#endif
+      break;
+    default:
+      // Not compressed, forwarded chunk by chunk
+      for (; size > 0 && decoded; size = readChunk(input, buffer)) {
+        decoded = emit(buffer.data(), size);
+      }
+      break;
+  }
+  output.finish();
+  return decoded;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file UbuntuCloudDecoder.hpp
+ * @brief Declares the decompression stage between the download and the parser.
+ *
+ * The fetcher asks for compressed responses (Accept-Encoding) and can fetch pre-compressed copies of the product
+ * files, but leaves the decoding out of the curl callbacks: the compressed bytes flow into one UbuntuCloudStreamBuffer,
+ * a decoder thread inflates them into a second one, and the parser reads that. The three stages overlap and each
+ * queue is bounded, so memory does not grow with the size of the file.
+ *
+ * The encoding is detected from the first bytes of the body rather than from the Content-Encoding header or the file
+ * name, so a pre-compressed file served without that header is decoded all the same. The cache receives the decoded
+ * bytes, its entries stay plain JSON. gzip is always supported through zlib, zstd when the build finds libzstd
+ * (UBUNTU_CLOUD_ZSTD).
+ */
+
+#pragma once
+
+#include "UbuntuCloudStream.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+
+/**
+ * @enum UbuntuCloudEncoding
+ * @brief Compression of a body.
+ */
+enum class UbuntuCloudEncoding {
+  Identity,  ///< Not compressed.
+  Gzip,      ///< gzip (RFC 1952) or zlib (RFC 1950) stream, possibly several concatenated members.
+  Zstd       ///< Zstandard frames.
+};
+
+/**
+ * @brief Detects the encoding of a body from its magic number.
+ * @param prefix The first bytes of the body, at least 4 for a reliable answer.
+ * @return UbuntuCloudEncoding The encoding, Identity when no supported magic number matches.
+ */
+UbuntuCloudEncoding detectEncoding(std::string_view prefix);
+
+/**
+ * @brief Returns the name of an encoding.
+ * @param encoding The encoding.
+ * @return const char* "identity", "gzip" or "zstd".
+ */
+const char* encodingName(UbuntuCloudEncoding encoding);
+
+/**
+ * @brief Returns the value of the Accept-Encoding request header: the encodings decodeStream() supports.
+ * @return const char* "zstd, gzip" or "gzip".
+ */
+const char* acceptedEncodings();
+
+/**
+ * @brief Tells whether decodeStream() can decode the files with a suffix, e.g. the pre-compressed copies of a mirror.
+ * @param suffix The file name suffix, e.g. ".gz" or ".zst".
+ * @return bool True for the gzip suffix (.gz), and for the zstd one (.zst) when this build decodes zstd.
+ */
+bool decodableSuffix(std::string_view suffix);
+
+/**
+ * @brief Decodes a body into a stream buffer, chunk by chunk.
+ *
+ * The encoding is detected from the first bytes. A body that is not compressed is forwarded as is.
+ * @param input The body.
+ * @param output Receives the decoded bytes, and is finished once this function returns, whatever the outcome.
+ * @param[out] encoding Receives the detected encoding.
+ * @param[out] error Receives a description of the problem if the compressed data is corrupt or truncated.
+ * @param copy Optional, receives every decoded chunk before output does, e.g. to store the body in the cache.
+ * @return bool True if the whole body was decoded; false on corrupt data (error set) or if the consumer closed
+ *         output (error left empty).
+ */
+bool decodeStream(std::istream& input, UbuntuCloudStreamBuffer& output, UbuntuCloudEncoding& encoding, std::string& error,
+                  const std::function<void(const char*, std::size_t)>& copy = {});
@@ -0,0 +1,307 @@
+/**
+ * @file UbuntuCloudDownload.cpp
+ * @brief Implementation of the ranged, hash-while-downloading image download.
+ *
+ * Every callback runs on the thread driving the multi handle, so the front, the file and the hasher need no locking.
+ * At most twice as many chunks as connections are started ahead of the front, which bounds the memory held by
+ * chunks that completed out of order.
+ */
+
+#include "UbuntuCloudDownload.hpp"
+
+#include "UbuntuCloudIO.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <system_error>
+
+/// Length of the single chunk of a download without range requests.
+constexpr static std::uint64_t unknown_length { UINT64_MAX };
+
+UbuntuCloudDownload::UbuntuCloudDownload(UbuntuCloudImage image, std::filesystem::path destination, UbuntuCloudDownloadOptions options):
+    _image(std::move(image)), _destination(std::move(destination)), _options(options), _chunks(), _front(0), _file(), _hash(), _written(0),
+    _rangesIgnored(false) { }
+
+bool UbuntuCloudDownload::prepare(bool ranged, std::string& error) {
+  this->_chunks.clear();
+  this->_front         = 0;
+  this->_hash          = UbuntuCloudSha256();
+  this->_written       = 0;
+  this->_rangesIgnored = false;
+  std::filesystem::path partial { this->_destination };
+  partial += ".part";
+  this->_file.close();
+  this->_file.clear();
+  this->_file.open(partial, std::ios::binary | std::ios::trunc);
+  if (!this->_file) {
+    error = "Could not create " + partial.string();
+    return false;
+  }
+  if (!ranged) {
+    this->_chunks.push_back({ this, 0, 0, unknown_length, 0, {}, 0, false, false, nullptr });
+    return true;
+  }
+  std::uint64_t chunk_size { std::max<std::uint64_t>(this->_options.chunk_size, 1) };
+  for (std::uint64_t offset = 0; offset < this->_image.size; offset += chunk_size) {
+    this->_chunks.push_back({ this, this->_chunks.size(), offset, std::min(chunk_size, this->_image.size - offset), 0, {}, 0, false, false, nullptr });
+  }
+  return true;
+}
+
+bool UbuntuCloudDownload::consume(const char* data, std::size_t size) {
+  if (!this->_file.write(data, static_cast<std::streamsize>(size))) {
+    return false;
+  }
+  this->_hash.update(data, size);
+  this->_written += size;
+  return true;
+}
+
+bool UbuntuCloudDownload::restartChunk(UbuntuCloudChunk& chunk) {
+  std::filesystem::path partial { this->_destination };
+  partial += ".part";
+  this->_file.close();
+  this->_file.clear();
+  this->_file.open(partial, std::ios::binary | std::ios::trunc);
+  this->_hash    = UbuntuCloudSha256();
+  this->_written = 0;
+  chunk.received = 0;
+  return static_cast<bool>(this->_file);
+}
+
+bool UbuntuCloudDownload::advanceFront() {
+  while (this->_front < this->_chunks.size() && this->_chunks[this->_front].done) {
+    this->_front++;
+    if (this->_front == this->_chunks.size()) {
+      break;
+    }
+    // The new front writes out what it received ahead of time, and streams directly from now on
+    UbuntuCloudChunk& front { this->_chunks[this->_front] };
+    if (!front.buffer.empty() && !this->consume(front.buffer.data(), front.buffer.size())) {
+      return false;
+    }
+    std::vector<char>().swap(front.buffer);  // Release the memory, not only the contents
+  }
+  return true;
+}
+
+bool UbuntuCloudDownload::startChunk(CURLM* multi_handle, UbuntuCloudChunk& chunk) {
+  chunk.handle = curl_easy_init();
+  if (!chunk.handle) {
+    return false;
+  }
+  chunk.attempts++;
+  chunk.response_checked = false;
+  curl_easy_setopt(chunk.handle, CURLOPT_URL, this->_image.url.c_str());
+  curl_easy_setopt(chunk.handle, CURLOPT_WRITEFUNCTION, this->writeChunk);  // Static member function
+  curl_easy_setopt(chunk.handle, CURLOPT_WRITEDATA, &chunk);                // Data pointer for writeChunk
+  curl_easy_setopt(chunk.handle, CURLOPT_PRIVATE, &chunk);                  // Finds the chunk back when curl reports it done
+  curl_easy_setopt(chunk.handle, CURLOPT_FOLLOWLOCATION, 1L);               // follow HTTP 3xx redirects
+  curl_easy_setopt(chunk.handle, CURLOPT_FAILONERROR, 1L);                  // An error page is not image data
+  // Images take minutes, so instead of a total timeout a request fails once it has stalled for 30 seconds
+  curl_easy_setopt(chunk.handle, CURLOPT_CONNECTTIMEOUT, 30L);
+  curl_easy_setopt(chunk.handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(chunk.handle, CURLOPT_LOW_SPEED_TIME, 30L);
+  if (chunk.length != unknown_length || chunk.received > 0) {
+    // Resume a retried chunk where it stopped, the bytes before are already written or buffered. A range rather than
+    // CURLOPT_RESUME_FROM_LARGE, which fails the request when the server sends the whole file instead of restarting it
+    std::string range { std::to_string(chunk.offset + chunk.received) + "-" +
+                        (chunk.length != unknown_length ? std::to_string(chunk.offset + chunk.length - 1) : std::string()) };
+    curl_easy_setopt(chunk.handle, CURLOPT_RANGE, range.c_str());  // Copied by curl
+  }
+  if (chunk.index > this->_front && chunk.length != unknown_length) {
+    chunk.buffer.reserve(static_cast<std::size_t>(chunk.length));  // Held in memory until the front reaches it
+  }
+  curl_multi_add_handle(multi_handle, chunk.handle);
+  return true;
+}
+
+bool UbuntuCloudDownload::transferChunks(std::string& error) {
+  CURLM* multi_handle { curl_multi_init() };
+  if (!multi_handle) {
+    error = "Could not create a curl multi handle";
+    return false;  // Early return without clean-up required
+  }
+  bool        result { true };
+  std::size_t connections { std::max<std::size_t>(this->_options.connections, 1) };
+  std::size_t next_chunk { 0 };
+  std::size_t running_chunks { 0 };
+  // Keeps the connections busy, without running further ahead of the front than the window allows
+  auto start_chunks { [&]() {
+    while (result && running_chunks < connections && next_chunk < this->_chunks.size() && next_chunk < this->_front + 2 * connections) {
+      if (!this->startChunk(multi_handle, this->_chunks[next_chunk])) {
+        error  = "Could not create a curl handle";
+        result = false;
+        break;
+      }
+      next_chunk++;
+      running_chunks++;
+    }
+  } };
+  start_chunks();
+  while (result && running_chunks > 0) {
+    int       running { 0 };
+    CURLMcode multi_code { curl_multi_perform(multi_handle, &running) };
+    if (multi_code == CURLM_OK && running > 0) {
+      multi_code = curl_multi_poll(multi_handle, nullptr, 0, 1000, nullptr);
+    }
+    if (multi_code != CURLM_OK) {
+      error  = std::string("curl error: ") + curl_multi_strerror(multi_code);
+      result = false;
+      break;
+    }
+    int      queued { 0 };
+    CURLMsg* message { nullptr };
+    while (result && (message = curl_multi_info_read(multi_handle, &queued)) != nullptr) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      UbuntuCloudChunk* chunk { nullptr };
+      curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &chunk);
+      CURLcode result_code { message->data.result };
+      curl_multi_remove_handle(multi_handle, chunk->handle);
+      curl_easy_cleanup(chunk->handle);
+      chunk->handle = nullptr;
+      running_chunks--;
+      if (this->_rangesIgnored) {
+        error  = "The server ignores range requests";
+        result = false;
+        break;
+      }
+      if (result_code != CURLE_OK || (chunk->length != unknown_length && chunk->received != chunk->length)) {
+        if (chunk->attempts >= this->_options.attempts) {
+          error = "Download of " + this->_image.url + " failed: " +
+                  (result_code != CURLE_OK ? std::string(curl_easy_strerror(result_code)) : std::string("incomplete range"));
+          result = false;
+          break;
+        }
+        if (!this->startChunk(multi_handle, *chunk)) {
+          error  = "Could not create a curl handle";
+          result = false;
+          break;
+        }
+        running_chunks++;
+        continue;
+      }
+      chunk->done = true;
+      if (!this->advanceFront()) {
+        error  = "Could not write " + this->_destination.string();
+        result = false;
+        break;
+      }
+    }
+    start_chunks();
+  }
+
+  // Clean-up functions whatever result the transfers have, including the ones an error left unfinished
+  for (UbuntuCloudChunk& chunk : this->_chunks) {
+    if (chunk.handle) {
+      curl_multi_remove_handle(multi_handle, chunk.handle);
+      curl_easy_cleanup(chunk.handle);
+      chunk.handle = nullptr;
+    }
+  }
+  curl_multi_cleanup(multi_handle);
+  return result;
+}
+
+bool UbuntuCloudDownload::run(std::string& error) {
+  std::filesystem::path partial { this->_destination };
+  partial += ".part";
+  std::error_code remove_error {};
+  // Without a published size the file cannot be split, it comes in one transfer
+  if (!this->prepare(this->_image.size > 0, error)) {
+    return false;
+  }
+  bool transferred { this->transferChunks(error) };
+  if (!transferred && this->_rangesIgnored) {
+    // The first response already told, so little was transferred before restarting as a single request
+    transferred = this->prepare(false, error) && this->transferChunks(error);
+  }
+  this->_file.close();
+  if (!transferred || !this->_file) {
+    if (transferred) {
+      error = "Could not write " + partial.string();
+    }
+    std::filesystem::remove(partial, remove_error);
+    return false;
+  }
+  if (this->_image.size > 0 && this->_written != this->_image.size) {
+    error = "Size mismatch for " + this->_image.url + ": expected " + std::to_string(this->_image.size) + " bytes, got " +
+            std::to_string(this->_written);
+    std::filesystem::remove(partial, remove_error);
+    return false;
+  }
+  // The digest covers every byte written, in order, so the file is never read back
+  std::string digest { this->_hash.hexDigest() };
+  std::string expected { this->_image.sha256 };
+  std::transform(expected.begin(), expected.end(), expected.begin(), [](unsigned char character) { return std::tolower(character); });
+  if (digest != expected) {
+    error = "SHA256 mismatch for " + this->_image.url + ": expected " + expected + ", got " + digest;
+    std::filesystem::remove(partial, remove_error);
+    return false;
+  }
+  std::error_code rename_error {};
+  std::filesystem::rename(partial, this->_destination, rename_error);
+  if (rename_error) {
+    error = "Could not rename " + partial.string() + ": " + rename_error.message();
+    std::filesystem::remove(partial, remove_error);
+    return false;
+  }
+  return true;
+}
+
+size_t UbuntuCloudDownload::writeChunk(void* buffer_ptr, size_t size, size_t nmemb, void* chunk_ptr) {
+  UbuntuCloudChunk*    chunk { static_cast<UbuntuCloudChunk*>(chunk_ptr) };
+  UbuntuCloudDownload* download { chunk->download };
+  const char*          bytes { static_cast<const char*>(buffer_ptr) };
+  std::size_t          byte_count { size * nmemb };
+  if (!chunk->response_checked) {
+    chunk->response_checked = true;
+    long response_code { 0 };
+    curl_easy_getinfo(chunk->handle, CURLINFO_RESPONSE_CODE, &response_code);
+    bool whole_file { chunk->length == unknown_length || (chunk->offset == 0 && chunk->length == download->_image.size) };
+    if (response_code == 200 && !whole_file) {
+      // The whole file instead of the range, returning less than received aborts the request
+      download->_rangesIgnored = true;
+      return 0;
+    }
+    if (response_code == 200 && chunk->received > 0 && !download->restartChunk(*chunk)) {
+      return 0;  // The server ignored the resume and sends the whole file, which could not be restarted
+    }
+  }
+  if (chunk->length != unknown_length && byte_count > chunk->length - chunk->received) {
+    return 0;  // More than the range, the server does not honour it
+  }
+  if (chunk->index == download->_front) {
+    if (!download->consume(bytes, byte_count)) {
+      return 0;
+    }
+  } else {
+    chunk->buffer.insert(chunk->buffer.end(), bytes, bytes + byte_count);
+  }
+  chunk->received += byte_count;
+  // Return processed data size in bytes
+  return byte_count;
+}
+
+int downloadReleaseImage(const UbuntuCloudInterface& fetcher, const std::string& release, const std::optional<std::filesystem::path>& destination,
+                         const UbuntuCloudDownloadOptions& options, std::ostream& output, std::ostream& errors) {
+  std::optional<UbuntuCloudImage> image { fetcher.getDiskImageForRelease(release) };
+  if (!image) {
+    errors << "The release was not found\n";
+    return 1;
+  }
+  // Named as on the mirror unless told otherwise, e.g. "ubuntu-24.04-server-cloudimg-amd64.img"
+  std::filesystem::path path { destination ? *destination : std::filesystem::path(image->url.substr(image->url.rfind('/') + 1)) };
+  std::string           error {};
+  UbuntuCloudDownload   download(*image, path, options);
+  if (!download.run(error)) {
+    errors << error << "\n";
+    return 1;
+  }
+  output << '\n'
+         << indentation(0) << "Downloaded the disk1.img of Ubuntu " << release << " to " << path.string() << ", its SHA256 matches the catalog:\n"
+         << indentation(0) << ">" << indentation(1) << image->sha256 << '\n';
+  return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file UbuntuCloudDownload.hpp
+ * @brief Declares the image download, split into concurrent HTTP range requests and verified while it is written.
+ *
+ * The file is cut into fixed-size chunks, and a bounded window of them is downloaded at once over one curl multi
+ * handle. The chunk at the front of the window streams straight into the output file and the SHA-256 hasher; chunks
+ * further ahead are held in memory until the front reaches them. The file is therefore written and hashed once,
+ * in order, and the digest is compared with the catalog as soon as the last byte arrives, without reading the file
+ * back. Memory stays bounded by the window size whatever the size of the image.
+ *
+ * A failed chunk is retried from the byte it stopped at. A server that ignores range requests is detected on its
+ * first response, and the download restarts as a single transfer. A retried single transfer the server answers with
+ * the whole file starts over from the first byte.
+ */
+
+#pragma once
+
+#include "UbuntuCloudInterface.hpp"
+#include "UbuntuCloudSha256.hpp"
+
+#include <curl/curl.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @struct UbuntuCloudDownloadOptions
+ * @brief Tuning of a download.
+ */
+struct UbuntuCloudDownloadOptions {
+    std::size_t   connections { 4 };                              ///< Range requests in flight at once.
+    std::uint64_t chunk_size { std::uint64_t { 8 } * 1024 * 1024 };  ///< Bytes per range request.
+    int           attempts { 3 };                                 ///< Tries per chunk before the download fails.
+};
+
+class UbuntuCloudDownload;
+
+/**
+ * @struct UbuntuCloudChunk
+ * @brief State of one byte range of the download.
+ */
+struct UbuntuCloudChunk {
+    UbuntuCloudDownload* download;  ///< The download the chunk belongs to, for the write callback.
+    std::size_t          index;     ///< Position of the chunk in the file.
+    std::uint64_t        offset;    ///< First byte of the range.
+    std::uint64_t        length;    ///< Bytes in the range, UINT64_MAX for a single transfer of unknown size.
+    std::uint64_t        received;          ///< Bytes received so far.
+    std::vector<char>    buffer;            ///< Received bytes not yet written, while the chunk is ahead of the front.
+    int                  attempts;          ///< Requests started for the chunk.
+    bool                 response_checked;  ///< Whether the response of the running request was checked for ignored ranges.
+    bool                 done;              ///< Whether every byte of the range was received.
+    CURL*                handle;            ///< The easy handle of the running request, null otherwise.
+};
+
+/**
+ * @class UbuntuCloudDownload
+ * @brief Downloads one image to a file and checks it against its published sha256.
+ */
+class UbuntuCloudDownload {
+  private:
+    /// The image to download.
+    const UbuntuCloudImage _image;
+    /// The file to create.
+    const std::filesystem::path _destination;
+    /// Tuning of the transfers.
+    const UbuntuCloudDownloadOptions _options;
+    /// Every chunk of the file, in file order.
+    std::vector<UbuntuCloudChunk> _chunks;
+    /// First chunk not yet completely written, the only one streaming to the file.
+    std::size_t _front;
+    /// Partial file, renamed to the destination once verified.
+    std::ofstream _file;
+    /// Hash of the bytes written so far.
+    UbuntuCloudSha256 _hash;
+    /// Bytes written so far.
+    std::uint64_t _written;
+    /// Set by the write callback when a range request was answered with the whole file.
+    bool _rangesIgnored;
+
+    /**
+     * @brief Writes and hashes received bytes, which must directly follow the ones written before.
+     * @param data First byte.
+     * @param size Number of bytes.
+     * @return bool False if the file could not be written.
+     */
+    bool consume(const char* data, std::size_t size);
+
+    /**
+     * @brief Drops the bytes a chunk starting at the first byte of the file wrote, for a resume answered with the whole file.
+     * @param chunk The chunk, which is the front.
+     * @return bool False if the partial file could not be truncated.
+     */
+    bool restartChunk(UbuntuCloudChunk& chunk);
+
+    /**
+     * @brief Moves the front past the completed chunks, writing out the bytes the new front chunk holds in memory.
+     * @return bool False if the file could not be written.
+     */
+    bool advanceFront();
+
+    /**
+     * @brief Starts, or resumes, the request of a chunk from its first byte not yet received.
+     * @param multi_handle The multi handle driving the transfers.
+     * @param chunk The chunk.
+     * @return bool False if no easy handle could be created.
+     */
+    bool startChunk(CURLM* multi_handle, UbuntuCloudChunk& chunk);
+
+    /**
+     * @brief Runs the transfers of every chunk.
+     * @param[out] error Receives a description of the problem on failure.
+     * @return bool True if every chunk was received and written.
+     */
+    bool transferChunks(std::string& error);
+
+    /**
+     * @brief Splits the file into chunks and resets the output.
+     * @param ranged Whether to use range requests, or a single transfer.
+     * @param[out] error Receives a description of the problem on failure.
+     * @return bool False if the partial file could not be created.
+     */
+    bool prepare(bool ranged, std::string& error);
+
+  public:
+    /**
+     * @brief Constructs a download that has not started yet.
+     * @param image The image, with its URL, sha256 and size. Without a size a single transfer is used.
+     * @param destination The file to create. A partial file next to it is renamed over it once verified.
+     * @param options Tuning of the transfers.
+     */
+    UbuntuCloudDownload(UbuntuCloudImage image, std::filesystem::path destination, UbuntuCloudDownloadOptions options = {});
+
+    /**
+     * @brief Downloads and verifies the image.
+     * @param[out] error Receives a description of the problem on failure.
+     * @return bool True if the file was downloaded and its sha256 matches; nothing is left at the destination otherwise.
+     */
+    bool run(std::string& error);
+
+    /**
+     * @brief Static callback function for curl to write the received bytes of a chunk.
+     * @param[in] buffer_ptr Pointer to the received data.
+     * @param[in] size Size of each data element.
+     * @param[in] nmemb Number of data elements.
+     * @param[out] chunk_ptr Pointer to the UbuntuCloudChunk of the request.
+     * @return size_t Number of bytes processed, 0 to abort the request.
+     */
+    static size_t writeChunk(void* buffer_ptr, size_t size, size_t nmemb, void* chunk_ptr);
+};
+
+/**
+ * @brief Downloads the disk1.img of a release, the file whose sha256 --sha256 prints, and reports the outcome.
+ * @param fetcher The catalog to look the image up in.
+ * @param release The release codename or title.
+ * @param destination The file to create, the last component of the image path in the working directory if not given.
+ * @param options Tuning of the transfers.
+ * @param output Stream receiving the result.
+ * @param errors Stream receiving the errors.
+ * @return int 0 if the image was downloaded and verified, 1 otherwise.
+ */
+int downloadReleaseImage(const UbuntuCloudInterface& fetcher, const std::string& release, const std::optional<std::filesystem::path>& destination,
+                         const UbuntuCloudDownloadOptions& options = {}, std::ostream& output = std::cout, std::ostream& errors = std::cerr);
@@ -10,6 +10,9 @@
 #pragma once
 
 #include "UbuntuCloudFetcher.hpp"
+#include "UbuntuCloudSnapshot.hpp"
+
+#include <algorithm>
 /**
  * @brief Factory class for creating UbuntuCloudInterface instances
  *
@@ -20,20 +23,108 @@ class UbuntuCloudFactory {
     // Factory class for our UbuntuCloudInterface to abstract and encapsulate the fetcher's interface
 
   public:
+    /// Root of the official Ubuntu cloud images mirror, the stream names are relative to it.
+    static constexpr const char* default_mirror { "https://cloud-images.ubuntu.com/" };
+
+    /**
+     * @brief Builds a stream selector from its command line form.
+     *
+     * The form is STREAM[:CONTENT], where STREAM is the stream's directory on the mirror (e.g. "releases", "daily",
+     * "minimal/releases") and CONTENT the last component of the wanted content ids (e.g. "download", the default, "aws",
+     * or "*" for every product file of the stream). A STREAM with a scheme is the full URL of a stream on another
+     * mirror, e.g. "http://127.0.0.1:8000/releases:download" for a local copy.
+     *
+     * @param specification The selector, e.g. "releases:aws".
+     * @return std::optional<UbuntuCloudStreamSelector> The selector, or std::nullopt if the stream or content is empty.
+     */
+    static std::optional<UbuntuCloudStreamSelector> createStreamSelector(const std::string& specification) {
+      std::size_t scheme { specification.find("://") };
+      std::size_t separator { specification.find(':') };
+      if (scheme != std::string::npos) {
+        // The port is part of the URL, only a colon after the first slash of the path separates the content
+        std::size_t path { specification.find('/', scheme + 3) };
+        separator = specification.rfind(':');
+        if (path == std::string::npos || separator < path) {
+          separator = std::string::npos;
+        }
+      }
+      std::string stream { specification.substr(0, separator) };
+      std::string content { separator == std::string::npos ? "download" : specification.substr(separator + 1) };
+      while (!stream.empty() && stream.back() == '/') {
+        stream.pop_back();
+      }
+      if (stream.empty() || content.empty()) {
+        return std::nullopt;
+      }
+      if (scheme != std::string::npos) {
+        return UbuntuCloudStreamSelector { stream + "/streams/v1/index.json", content };
+      }
+      return UbuntuCloudStreamSelector { default_mirror + stream + "/streams/v1/index.json", content };
+    }
+
+    /**
+     * @brief Builds the mirror list of a fetcher from alternates of the official mirror.
+     *
+     * The official mirror stays first, so the streams selected with createStreamSelector() are raced across every
+     * alternate. An empty list leaves a single mirror, whose requests are only retried.
+     *
+     * @param alternates Roots serving the same tree as default_mirror, e.g. "https://mirror.example.com/cloud-images/".
+     * @return UbuntuCloudEndpoints The endpoints, with the default race, hedge delay and backoff.
+     */
+    static UbuntuCloudEndpoints createEndpoints(const std::vector<std::string>& alternates) {
+      UbuntuCloudEndpoints endpoints {};
+      endpoints.mirrors.push_back(default_mirror);
+      for (std::string mirror : alternates) {
+        if (!mirror.empty() && mirror.back() != '/') {
+          mirror += '/';
+        }
+        if (std::find(endpoints.mirrors.begin(), endpoints.mirrors.end(), mirror) == endpoints.mirrors.end()) {
+          endpoints.mirrors.push_back(std::move(mirror));
+        }
+      }
+      return endpoints;
+    }
+
     /**
      * @brief Creates a cloud interface fetcher for Ubuntu release information
      *
      * Factory function that creates and returns a new UbuntuCloudInterface implementation
-     * configured to fetch data from the official Ubuntu cloud images stream.
+     * configured to fetch data from the official Ubuntu cloud images streams.
      *
+     * @param cache Optional on-disk cache for the product files. Without it, every call downloads them whole.
+     * @param snapshot_path Optional path of the binary snapshot to refresh after a successful fetch.
+     * @param streams The product files to merge into the catalog, the released image downloads by default.
+     * @param loading Eager to fetch the catalog before returning, Lazy to return an unloaded fetcher whose fetch starts
+     *        with startLoading(), waitUntilLoaded() or the first asynchronous query.
+     * @param endpoints Mirrors the files are raced and failed over across, see createEndpoints().
      * @return std::unique_ptr<UbuntuCloudInterface> A smart pointer to a newly created
      *         UbuntuCloudFetcher instance that implements the UbuntuCloudInterface
      *
      * @note The returned pointer is owned by the caller, who is responsible for
      *       its lifetime management
      */
-    static std::unique_ptr<UbuntuCloudInterface> createUbuntuVersionFetcher() {
-      std::string url = "https://cloud-images.ubuntu.com/releases/streams/v1/com.ubuntu.cloud:released:download.json";
-      return std::make_unique<UbuntuCloudFetcher>(url);
+    static std::unique_ptr<UbuntuCloudInterface> createUbuntuVersionFetcher(std::optional<UbuntuCloudCache>        cache         = std::nullopt,
+                                                                            std::optional<std::filesystem::path>   snapshot_path = std::nullopt,
+                                                                            std::vector<UbuntuCloudStreamSelector> streams       = {},
+                                                                            UbuntuCloudLoading                     loading       = UbuntuCloudLoading::Eager,
+                                                                            UbuntuCloudEndpoints                   endpoints     = createEndpoints({})) {
+      if (streams.empty()) {
+        streams.push_back(*createStreamSelector("releases"));
+      }
+      return std::make_unique<UbuntuCloudFetcher>(std::move(streams), std::move(cache), std::move(snapshot_path), loading,
+                                                  std::move(endpoints));
+    }
+
+    /**
+     * @brief Creates a cloud interface reading Ubuntu release information from a local snapshot
+     *
+     * The snapshot is memory-mapped, no network access and no parsing takes place.
+     *
+     * @param snapshot_path Path of a snapshot written by a previous successful fetch.
+     * @return std::unique_ptr<UbuntuCloudInterface> A smart pointer to a newly created
+     *         UbuntuCloudSnapshot instance that implements the UbuntuCloudInterface
+     */
+    static std::unique_ptr<UbuntuCloudInterface> createOfflineFetcher(const std::filesystem::path& snapshot_path) {
+      return std::make_unique<UbuntuCloudSnapshot>(snapshot_path);
     }
 };
@@ -3,199 +3,687 @@
  * @brief Implementation of the UbuntuCloudFetcher class for fetching and parsing Ubuntu cloud image metadata.
  *
  * This file provides the concrete implementation of the UbuntuCloudInterface interface, responsible for:
- * - Performing HTTP(S) requests to retrieve release metadata from the official Ubuntu cloud images server.
+ * - Resolving the selected product files through the stream indexes of the mirrors.
+ * - Performing concurrent HTTP(S) requests to retrieve release metadata from the official Ubuntu cloud images server, over
+ *   the connections of a UbuntuCloudTransport shared with the earlier requests.
+ * - Decompressing the responses, which are requested gzip or zstd encoded, on a thread of their own.
  * - Parsing the retrieved JSON data to extract release, architecture, and version details.
- * - Providing helper functions to query the latest LTS release, all supported releases, and SHA256 checksums for a release.
+ * - Merging the products of every product file and indexing them into a UbuntuCloudCatalog, which answers the queries.
  *
  * Dependencies:
  * - libcurl: for HTTP requests.
- * - nlohmann::json: for JSON parsing.
+ * - nlohmann::json: for JSON parsing, through its SAX interface (see UbuntuCloudParser.cpp).
+ * - zlib, and libzstd when found: for decompression (see UbuntuCloudDecoder.cpp).
  *
  * @note In this implementation the structure of the data is assumed from
  * https://cloud-images.ubuntu.com/releases/streams/v1/com.ubuntu.cloud:released:download.json
- * @note This implementation prioritizes minimal memory overhead during version comparison and data extraction.
+ * @note This implementation prioritizes minimal memory overhead during data extraction.
  */
 
 #include "UbuntuCloudFetcher.hpp"
 
+#include "UbuntuCloudParser.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
 /**
- * @brief Compares two version strings to determine which one is more recent.
- *
- * @param first_version The reference version string.
- * @param second_version The version string to compare against the reference.
- * @return 1 if first_version is newer, -1 if second_version is newer, 0 if both are equal.
+ * @brief Returns the seconds elapsed since a point in time.
+ * @param start The starting point.
+ * @return double Elapsed seconds.
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Reads a libcurl timing, reported in microseconds since the start of the transfer.
+ * @param handle The easy handle.
+ * @param info The CURLINFO_*_TIME_T value to read.
+ * @return double The timing in seconds, 0 if unavailable.
+ */
+static double curlSeconds(CURL* handle, CURLINFO info) {
+  curl_off_t microseconds { 0 };
+  if (curl_easy_getinfo(handle, info, &microseconds) != CURLE_OK) {
+    return 0;
+  }
+  return static_cast<double>(microseconds) / 1e6;
+}
+
+/**
+ * @brief Lists the URLs a file can be fetched from: its own, then the same path under every other mirror.
+ * @param url The URL of the file.
+ * @param mirrors Roots serving the same tree, each ending with '/'.
+ * @return std::vector<std::string> The URLs, just url if it is under none of the mirrors.
  */
-static int isMoreRecentVersion(const std::string& first_version, const std::string& second_version) {
-  // This method avoids using extra memory
-  size_t min_len { std::min(first_version.size(), second_version.size()) };
-  for (size_t idx = 0; idx < min_len; idx++) {
-    if (first_version.at(idx) == second_version.at(idx)) {
-      continue;  // equal
-    } else if (first_version.at(idx) == '.') {
-      return -1;  // first version is older
-    } else if (second_version.at(idx) == '.') {
-      return 1;  // first version is newer
-    } else if (first_version.at(idx) > second_version.at(idx)) {
-      return 1;  // first version is newer
-    } else {
-      return -1;  // first version is older
+static std::vector<std::string> mirrorUrls(const std::string& url, const std::vector<std::string>& mirrors) {
+  std::vector<std::string> urls { url };
+  auto                     own { std::find_if(mirrors.begin(), mirrors.end(),
+                                              [&url](const std::string& mirror) { return url.compare(0, mirror.size(), mirror) == 0; }) };
+  if (own == mirrors.end()) {
+    return urls;
+  }
+  std::string path { url.substr(own->size()) };
+  for (const std::string& mirror : mirrors) {
+    if (mirror != *own) {
+      urls.push_back(mirror + path);
     }
   }
-  return 0;  // both are equal
+  return urls;
 }
 
-UbuntuCloudFetcher::UbuntuCloudFetcher(const std::string& url): _url(url), _initialized(false) {
-  // Call fetch data to attemp to initialize the fetcher
-  _initialized = fetchData();
+/**
+ * @brief Starts the decoder and parser threads of a transfer, which consume its body while curl is still receiving it.
+ *
+ * The decoder reads the bytes pushed by the write callback and the parser reads the decoder's output, each through a
+ * bounded UbuntuCloudStreamBuffer, so the download, the decompression and the parse overlap.
+ * @param transfer The transfer.
+ */
+static void startPipeline(UbuntuCloudTransfer& transfer) {
+  transfer.decoder = std::thread([&transfer]() {
+    std::istream        input(&transfer.stream);
+    UbuntuCloudEncoding encoding { UbuntuCloudEncoding::Identity };
+    // The cache keeps the decoded body, so its entries are product files whatever encoding the response had
+    decodeStream(input, transfer.decoded, encoding, transfer.decode_error, [&transfer](const char* data, std::size_t size) {
+      if (transfer.cache_writer && !transfer.cache_writer->write(data, size)) {
+        // Caching is best-effort, drop the copy and keep streaming to the parser
+        transfer.cache_writer.reset();
+      }
+    });
+    transfer.stream.close();  // Release the write callback if decoding stopped early
+    transfer.stats.encoding = encodingName(encoding);
+  });
+  transfer.parser = std::thread([&transfer]() {
+    std::chrono::steady_clock::time_point parse_start { std::chrono::steady_clock::now() };
+    std::istream                          input(&transfer.decoded);
+    transfer.parsed = transfer.parse(input, transfer.error);
+    transfer.decoded.close();  // Release the decoder if parsing stopped early
+    transfer.stats.parse_seconds = secondsSince(parse_start);
+  });
 }
 
-UbuntuCloudFetcher::~UbuntuCloudFetcher() { }
+/**
+ * @brief Ends the body of a transfer and waits for its decoder and parser threads.
+ * @param transfer The transfer.
+ */
+static void finishPipeline(UbuntuCloudTransfer& transfer) {
+  transfer.stream.finish();
+  transfer.decoder.join();
+  transfer.parser.join();
+}
 
-std::vector<UbuntuRelease> UbuntuCloudFetcher::getSupportedReleases() const {
-  std::map<std::string, std::vector<std::string>, std::greater<>> release_map;
-  // Assume only unique version names are wanted in said list
-  // The inherent sorting of the std::map will allow to separate the LTS from the non-LTS versions, for later handling
+/**
+ * @brief Returns the error that made the body of a transfer invalid: corrupt compressed data, or else the parse error.
+ * @param transfer The transfer, whose pipeline is over.
+ * @return const std::string& The error message.
+ */
+static const std::string& bodyError(const UbuntuCloudTransfer& transfer) {
+  return transfer.decode_error.empty() ? transfer.error : transfer.decode_error;
+}
 
-  for (const auto& [product_name, product_json] : this->_productData.items()) {
-    // Iterate over each product entry
-    if (product_json.find("supported") != product_json.end() && product_json.at("supported") == true) {
-      // If the version is supported, we include its name in the map
-      std::string complete_name =
-        product_json.at("release_title").template get<std::string>() + " (" + product_json.at("release").template get<std::string>() + ")";
-      release_map[complete_name].push_back(product_json.at("arch").template get<std::string>());
-      // At the same time, we store the architectures of each release
-    }
+/**
+ * @brief Returns the mirror root of a file published on a simplestreams mirror, which the paths in its data are relative to.
+ * @param url The URL of a stream index or product file, e.g. "https://cloud-images.ubuntu.com/releases/streams/v1/index.json".
+ * @return std::string The part before "streams/v1/", or the directory of the file if it is not under one.
+ */
+static std::string mirrorRoot(const std::string& url) {
+  std::size_t root_end { url.rfind("streams/v1/") };
+  return url.substr(0, root_end == std::string::npos ? url.rfind('/') + 1 : root_end);
+}
+
+UbuntuCloudFetcher::UbuntuCloudFetcher(const std::string& url, std::optional<UbuntuCloudCache> cache,
+                                       std::optional<std::filesystem::path> snapshot_path, UbuntuCloudLoading loading,
+                                       UbuntuCloudEndpoints endpoints):
+    _productUrls({ url }), _streams(), _initialized(false), _cache(std::move(cache)), _snapshotPath(std::move(snapshot_path)),
+    _catalogUrls(), _catalogChanged(false), _endpoints(std::move(endpoints)),
+    _transport(this->_endpoints.transport ? this->_endpoints.transport : std::make_shared<UbuntuCloudTransport>()) {
+  if (loading == UbuntuCloudLoading::Eager) {
+    // Call fetch data to attemp to initialize the fetcher
+    _initialized = fetchData();
+    this->setLoaded(_initialized);
+  }
+}
+
+UbuntuCloudFetcher::UbuntuCloudFetcher(std::vector<UbuntuCloudStreamSelector> streams, std::optional<UbuntuCloudCache> cache,
+                                       std::optional<std::filesystem::path> snapshot_path, UbuntuCloudLoading loading,
+                                       UbuntuCloudEndpoints endpoints):
+    _productUrls(), _streams(std::move(streams)), _initialized(false), _cache(std::move(cache)), _snapshotPath(std::move(snapshot_path)),
+    _catalogUrls(), _catalogChanged(false), _endpoints(std::move(endpoints)),
+    _transport(this->_endpoints.transport ? this->_endpoints.transport : std::make_shared<UbuntuCloudTransport>()) {
+  if (loading == UbuntuCloudLoading::Eager) {
+    _initialized = fetchData();
+    this->setLoaded(_initialized);
   }
-  // The vector is constructed using the struct's constructor from std::pair<std::string,std::vector<std::string>>, which is the std::map's
-  // underlying type
-  return std::vector<UbuntuRelease>(release_map.begin(), release_map.end());
+}
+
+UbuntuCloudFetcher::~UbuntuCloudFetcher() {
+  // The loading thread uses this object until the fetch completes
+  this->waitForLoading();
+}
+
+bool UbuntuCloudFetcher::load() {
+  this->_initialized = this->fetchData();
+  return this->_initialized;
+}
+
+std::vector<UbuntuRelease> UbuntuCloudFetcher::getSupportedReleases() const {
+  // The catalog keeps the products in name order, so architectures are listed as in the product file
+  return this->_catalog.supportedReleases();
 }
 
 std::optional<UbuntuRelease> UbuntuCloudFetcher::getCurrentLTS() const {
-  // The lts versions have LTS in release_title, the current version is the latest LTS
-  std::optional<UbuntuRelease> current_LTS { std::nullopt };
-  // We do not know if the current LTS is in the data, so optional is empty
-
-  for (const auto& [product_name, product_json] : this->_productData.items()) {
-    // Iterate over each product entry
-    if (product_json.find("aliases") != product_json.end() &&
-        product_json.at("aliases").template get<std::string>().find("lts") != std::string::npos) {
-      // The lts flag in aliases is the latest/current LTS release
-      if (!current_LTS) {
-        // If optional is not initalized, initialize
-        current_LTS = UbuntuRelease(
-          { product_json.at("version").template get<std::string>() + " (" + product_json.at("release").template get<std::string>() + ")",
-            {} });
-        // Version instead of release_title because we do not need the LTS label
-      }
-      current_LTS->architectures.push_back(product_json.at("arch").template get<std::string>());
-      // Add each architecture to the version
-      std::string latest_version {};
-      for (const auto& [version, version_contents] : product_json.at("versions").items()) {
-        // Avoid assumption that entries are sorted
-        if (latest_version.empty() || isMoreRecentVersion(latest_version, version) == -1) {
-          latest_version = version;
-          // Store latest version
-        }
-      }
-      current_LTS->latest_versions.push_back(latest_version);
-      // Store latest version in same order as architecture
+  // The lts flag in aliases is the latest/current LTS release, resolved when the catalog was built
+  return this->_catalog.currentLTS();
+}
+
+std::optional<std::string> UbuntuCloudFetcher::getSha256ForRelease(const std::string& release_name) const {
+  // ID by release or release_title, both are shown in --supported-releases. amd64 only, latest version.
+  return this->_catalog.sha256ForRelease(release_name);
+}
+
+std::optional<UbuntuCloudImage> UbuntuCloudFetcher::getDiskImageForRelease(const std::string& release_name) const {
+  // The same item getSha256ForRelease() reads, with the mirror it was published on
+  return this->_catalog.diskImageForRelease(release_name);
+}
+
+bool UbuntuCloudFetcher::fetchData() {
+  std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
+  this->_stats = UbuntuCloudStats {};
+  std::vector<std::string> product_urls { this->_productUrls };
+  if (!this->_streams.empty() && !this->resolveStreams(product_urls)) {
+    return false;  // Early return, the indexes have reported the problem
+  }
+  // One product list per file, merged once all of them are parsed
+  std::vector<std::vector<UbuntuProduct>>           product_lists(product_urls.size());
+  std::vector<std::unique_ptr<UbuntuCloudTransfer>> transfers {};
+  // On a refresh of the same files, unchanged ones are only parsed if another file changed
+  bool same_files { this->_initialized && product_urls == this->_catalogUrls };
+  for (std::size_t idx = 0; idx < product_urls.size(); idx++) {
+    std::vector<UbuntuProduct>& products { product_lists[idx] };
+    transfers.push_back(std::make_unique<UbuntuCloudTransfer>(
+        product_urls[idx], [&products](std::istream& input, std::string& error) { return parseProductStream(input, products, error); }));
+    transfers.back()->skip_unchanged = same_files;
+  }
+  if (!this->transferAll(transfers)) {
+    return false;
+  }
+  if (same_files && std::all_of(transfers.begin(), transfers.end(), [](const auto& transfer) { return transfer->unchanged; })) {
+    // Nothing was published since the last fetch, the catalog and the snapshot are still current
+    this->_catalogChanged     = false;
+    this->_stats.load_seconds = secondsSince(start);
+    return true;
+  }
+  for (std::unique_ptr<UbuntuCloudTransfer>& transfer : transfers) {
+    if (transfer->unchanged && !this->loadFromCache(*transfer, *transfer->cached_entry)) {
+      std::cerr << (transfer->error.empty() ? "Cached data could not be read" : transfer->error) << std::endl;
+      return false;  // Early return
+    }
+  }
+  for (std::size_t idx = 0; idx < product_urls.size(); idx++) {
+    // Item paths are relative to the mirror the product file was published on
+    std::string root { mirrorRoot(product_urls[idx]) };
+    for (UbuntuProduct& product : product_lists[idx]) {
+      product.mirror = root;
     }
   }
-  return current_LTS;
+  // Index the data on success, the parsed records are released when they go out of scope
+  this->storeCatalog(mergeProducts(std::move(product_lists)));
+  this->_catalogUrls        = std::move(product_urls);
+  this->_catalogChanged     = true;
+  this->_stats.load_seconds = secondsSince(start);
+  return true;
 }
 
-std::optional<std::string> UbuntuCloudFetcher::getSha256ForRelease(const std::string& release_name) const {
-  // ID by title and by release_title or release. Both are shown in --supported-releases
-  //  amd64 only in terms of releases, get the latest version in versions.
-  std::optional<std::string> stringSha256 { std::nullopt };
-  // We do not know if the version is in the data, so optional is empty
-
-  auto is_release_lambda = [release_name](const json& product_json) -> bool {
-    return (product_json.find("arch") != product_json.end() && product_json.at("arch").template get<std::string>().compare("amd64") == 0) &&
-           ((product_json.find("release") != product_json.end() &&
-             product_json.at("release").template get<std::string>().compare(release_name) == 0) ||
-            (product_json.find("release_title") != product_json.end() &&
-             product_json.at("release_title").template get<std::string>().compare(release_name) == 0));
-    // The check against both the title and release in case user gives either, amd64 only
-  };
-
-  for (const auto& [product_name, product_json] : this->_productData.items()) {
-    // Iterate over each product entry
-    if (is_release_lambda(product_json)) {
-      std::string latest_version {};
-      for (const auto& [version, version_contents] : product_json.at("versions").items()) {
-        // Avoid assumption that entries are sorted
-        if (latest_version.empty() || isMoreRecentVersion(latest_version, version) == -1) {
-          // Store the latest version and its sha256
-          latest_version = version;
-          stringSha256   = version_contents.at("items").at("disk1.img").at("sha256").template get<std::string>();
-        }
+bool UbuntuCloudFetcher::resolveStreams(std::vector<std::string>& product_urls) {
+  // Several selectors may share one index, which is then downloaded once
+  std::vector<std::string> index_urls {};
+  for (const UbuntuCloudStreamSelector& stream : this->_streams) {
+    if (std::find(index_urls.begin(), index_urls.end(), stream.index_url) == index_urls.end()) {
+      index_urls.push_back(stream.index_url);
+    }
+  }
+  std::vector<std::vector<UbuntuStreamIndexEntry>>  index_entries(index_urls.size());
+  std::vector<std::unique_ptr<UbuntuCloudTransfer>> transfers {};
+  for (std::size_t idx = 0; idx < index_urls.size(); idx++) {
+    std::vector<UbuntuStreamIndexEntry>& entries { index_entries[idx] };
+    transfers.push_back(std::make_unique<UbuntuCloudTransfer>(
+        index_urls[idx], [&entries](std::istream& input, std::string& error) { return parseStreamIndex(input, entries, error); }));
+  }
+  if (!this->transferAll(transfers)) {
+    return false;
+  }
+  for (const UbuntuCloudStreamSelector& stream : this->_streams) {
+    std::size_t index { static_cast<std::size_t>(std::find(index_urls.begin(), index_urls.end(), stream.index_url) - index_urls.begin()) };
+    // Paths in the index are relative to the mirror root, which holds streams/v1/index.json
+    std::string root { mirrorRoot(stream.index_url) };
+    std::string suffix { ":" + stream.content_id };
+    bool        matched { false };
+    for (const UbuntuStreamIndexEntry& entry : index_entries[index]) {
+      const std::string& content_id { entry.content_id };
+      if (stream.content_id != "*" && content_id != stream.content_id &&
+          (content_id.size() < suffix.size() || content_id.compare(content_id.size() - suffix.size(), suffix.size(), suffix) != 0)) {
+        continue;
+      }
+      matched = true;
+      std::string url { root + entry.path };
+      if (std::find(product_urls.begin(), product_urls.end(), url) == product_urls.end()) {
+        product_urls.push_back(std::move(url));
       }
-      return stringSha256;
+    }
+    if (!matched) {
+      std::cerr << "No product file matching " << stream.content_id << " in " << stream.index_url << std::endl;
+      return false;
     }
   }
-  return std::nullopt;
+  return true;
 }
 
-bool UbuntuCloudFetcher::fetchData() {
-  // Initialize the handle
-  CURL*       curl_handle { nullptr };
-  std::string curl_response {};
-
-  curl_handle = curl_easy_init();
-  if (!curl_handle) {
+bool UbuntuCloudFetcher::startAttempt(CURLM* multi_handle, UbuntuCloudTransfer& transfer) {
+  UbuntuCloudAttempt& attempt { *transfer.attempts.emplace_back(std::make_unique<UbuntuCloudAttempt>()) };
+  // Mirrors are taken in turn, so retries and hedges go to the ones not tried yet first
+  attempt.transfer           = &transfer;
+  attempt.url                = transfer.mirror_urls[(transfer.attempts.size() - 1) % transfer.mirror_urls.size()];
+  attempt.response_entry.url = transfer.url;  // The cache is keyed by the URL of the file, whichever mirror serves it
+  attempt.start              = std::chrono::steady_clock::now();
+  attempt.handle             = curl_easy_init();
+  // At least one millisecond, 0 would disable the timeout
+  long remaining { static_cast<long>(
+      std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(transfer.deadline - attempt.start).count(), 1)) };
+  if (!attempt.handle) {
     // If the handle is not initialized properly, the request fails
-    return false;  // Early return without clean-up required
+    return false;
   }
-  // Separate this part with function for handle set-up? Not really possible bc of cleanup probably?
   //  Set curl options: url, writing function with set signature, data pointer for said function and timeout.
-  curl_easy_setopt(curl_handle, CURLOPT_URL, this->_url.data());          // C-str only
-  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, this->writeData);  // Static member function
-  curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &(curl_response));     // Data pointer for the writeData static member function
-  curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 30L);                    // maximum time the transfer is allowed to complete
-  curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);              // follow HTTP 3xx redirects
+  curl_easy_setopt(attempt.handle, CURLOPT_URL, attempt.url.data());          // C-str only
+  curl_easy_setopt(attempt.handle, CURLOPT_WRITEFUNCTION, this->writeData);   // Static member function
+  curl_easy_setopt(attempt.handle, CURLOPT_WRITEDATA, &attempt);              // Data pointer for the writeData static member function
+  curl_easy_setopt(attempt.handle, CURLOPT_HEADERFUNCTION, this->writeHeader);  // Static member function collecting the validators
+  curl_easy_setopt(attempt.handle, CURLOPT_HEADERDATA, &attempt);             // Data pointer for writeHeader
+  curl_easy_setopt(attempt.handle, CURLOPT_HTTPHEADER, transfer.headers);     // Conditional request headers, may be null
+  curl_easy_setopt(attempt.handle, CURLOPT_ACCEPT_ENCODING, acceptedEncodings());  // Ask for a compressed body
+  curl_easy_setopt(attempt.handle, CURLOPT_HTTP_CONTENT_DECODING, 0L);        // Decoded on the decoder thread, not in the transfer loop
+  curl_easy_setopt(attempt.handle, CURLOPT_TIMEOUT_MS, remaining);           // What is left of the time budget of the file
+  curl_easy_setopt(attempt.handle, CURLOPT_FOLLOWLOCATION, 1L);               // follow HTTP 3xx redirects
+  curl_easy_setopt(attempt.handle, CURLOPT_PRIVATE, &attempt);                // Finds the request back when curl reports it done
+  this->_transport->configure(attempt.handle);                                // Shared connections, TLS sessions and addresses, HTTP/2
+  curl_multi_add_handle(multi_handle, attempt.handle);
+  return true;
+}
+
+bool UbuntuCloudFetcher::transferAll(std::vector<std::unique_ptr<UbuntuCloudTransfer>>& transfers) {
+  bool   result { true };
+  CURLM* multi_handle { curl_multi_init() };
+  if (!multi_handle) {
+    return false;  // Early return without clean-up required
+  }
+  std::vector<std::string> mirrors { this->_endpoints.mirrors };
+  // Requests raced at once for a file, on distinct mirrors; one more may go out as a hedge
+  auto race_width { [this](const UbuntuCloudTransfer& transfer) {
+    return std::min(std::max<std::size_t>(this->_endpoints.race, 1), transfer.mirror_count);
+  } };
+  // Whether a request was for the pre-compressed copy of its file
+  auto precompressed_copy { [this](const UbuntuCloudAttempt& attempt) {
+    const std::string& suffix { this->_endpoints.precompressed };
+    return !suffix.empty() && attempt.url.size() > attempt.transfer->url.size() &&
+           attempt.url.compare(attempt.url.size() - suffix.size(), suffix.size(), suffix) == 0;
+  } };
+  for (std::string& mirror : mirrors) {
+    if (!mirror.empty() && mirror.back() != '/') {
+      mirror += '/';
+    }
+  }
+  for (std::unique_ptr<UbuntuCloudTransfer>& transfer_ptr : transfers) {
+    UbuntuCloudTransfer& transfer { *transfer_ptr };
+    if (this->_cache) {
+      transfer.cached_entry = this->_cache->lookup(transfer.url);
+      if (transfer.cached_entry && this->_cache->isFresh(*transfer.cached_entry)) {
+        // Inside the freshness window, no network round trip at all
+        if (transfer.skip_unchanged) {
+          transfer.unchanged    = true;
+          transfer.done         = true;
+          transfer.stats.source = "cache";
+          this->_stats.transfers.push_back(transfer.stats);
+          continue;  // Already in the catalog, parsed later only if another file changed
+        }
+        if (this->loadFromCache(transfer, *transfer.cached_entry)) {
+          transfer.done         = true;
+          transfer.stats.source = "cache";
+          this->_stats.transfers.push_back(transfer.stats);
+          continue;  // Served from disk
+        }
+        transfer.error.clear();
+        transfer.cached_entry = std::nullopt;  // Unusable entry, fall back to an unconditional request
+      }
+      // The body is copied into the cache while it streams to the parser
+      transfer.cache_writer = this->_cache->beginStore(transfer.url);
+    }
+    transfer.response_entry.url = transfer.url;
+    transfer.deadline           = std::chrono::steady_clock::now() + this->_endpoints.timeout;
+    transfer.mirror_urls        = mirrorUrls(transfer.url, mirrors);
+    transfer.mirror_count       = transfer.mirror_urls.size();
+    if (!this->_endpoints.precompressed.empty()) {
+      // Requests go to the pre-compressed copies first, and to the file itself on the mirrors that do not have one
+      std::vector<std::string> copies {};
+      for (const std::string& mirror_url : transfer.mirror_urls) {
+        copies.push_back(mirror_url + this->_endpoints.precompressed);
+      }
+      transfer.mirror_urls.insert(transfer.mirror_urls.begin(), copies.begin(), copies.end());
+    }
+    if (transfer.cached_entry) {
+      // Make the request conditional on the cached validators, so an unchanged file costs a 304 without a body
+      if (!transfer.cached_entry->etag.empty()) {
+        transfer.headers = curl_slist_append(transfer.headers, ("If-None-Match: " + transfer.cached_entry->etag).c_str());
+      }
+      if (!transfer.cached_entry->last_modified.empty()) {
+        transfer.headers = curl_slist_append(transfer.headers, ("If-Modified-Since: " + transfer.cached_entry->last_modified).c_str());
+      }
+    }
+    // The first requests race on distinct mirrors, the first response wins
+    for (std::size_t idx = 0; idx < race_width(transfer) && result; idx++) {
+      result = this->startAttempt(multi_handle, transfer);
+    }
+    if (!result) {
+      break;
+    }
+    // The decoder and the parser consume the body on their own threads while curl is still receiving it.
+    // A full stream pauses the request instead of blocking the loop, the decoder wakes the loop once it made room
+    transfer.stream.onRoom([multi_handle]() { curl_multi_wakeup(multi_handle); });
+    startPipeline(transfer);
+  }
+  auto stop_attempt { [multi_handle](UbuntuCloudAttempt& attempt) {
+    curl_multi_remove_handle(multi_handle, attempt.handle);
+    curl_easy_cleanup(attempt.handle);
+    attempt.handle = nullptr;
+  } };
+  auto running_attempts { [](const UbuntuCloudTransfer& transfer) {
+    return static_cast<std::size_t>(
+        std::count_if(transfer.attempts.begin(), transfer.attempts.end(), [](const auto& attempt) { return attempt->handle != nullptr; }));
+  } };
 
-  bool result { curlRequest(curl_handle, curl_response) };  // Store success or failure for return after clean-up
+  // One event loop drives every download, so the total time is that of the slowest one
+  bool pending { result };  // Nothing is performed if a handle could not be created
+  while (pending) {
+    int       running { 0 };
+    CURLMcode multi_code { curl_multi_perform(multi_handle, &running) };
+    if (multi_code != CURLM_OK) {
+      std::cerr << "curl error: " << curl_multi_strerror(multi_code) << std::endl;
+      result = false;
+      break;
+    }
+    int      queued { 0 };
+    CURLMsg* message { nullptr };
+    while ((message = curl_multi_info_read(multi_handle, &queued)) != nullptr) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      UbuntuCloudAttempt* attempt { nullptr };
+      curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &attempt);
+      UbuntuCloudTransfer& transfer { *attempt->transfer };
+      CURLcode             result_code { message->data.result };
+      this->_transport->finished(attempt->handle, result_code);  // Remembers the address, or forgets a persisted one that failed
+      if (transfer.winner == attempt) {
+        finishPipeline(transfer);  // End of the body, whatever the outcome
+        transfer.response_entry = attempt->response_entry;
+        transfer.stats.url      = attempt->url;
+        transfer.stats.requests = transfer.attempts.size();
+        result                  = this->completeTransfer(transfer, result_code) && result;
+        this->_stats.transfers.push_back(transfer.stats);
+        transfer.done = true;
+        stop_attempt(*attempt);
+        continue;
+      }
+      long response_code { 0 };
+      curl_easy_getinfo(attempt->handle, CURLINFO_RESPONSE_CODE, &response_code);
+      stop_attempt(*attempt);
+      if (transfer.winner || transfer.done) {
+        continue;  // Cancelled, another mirror answered first
+      }
+      // Failed before any response won: the file is retried on the next mirror once every request of it failed.
+      // A mirror without the pre-compressed copy has not failed, the file itself is requested right away
+      bool missing_copy { precompressed_copy(*attempt) };
+      if (!missing_copy) {
+        transfer.failures++;
+      }
+      std::string reason { result_code != CURLE_OK ? curl_easy_strerror(result_code) : "HTTP " + std::to_string(response_code) };
+      // A mirror without the pre-compressed copy is retried right away, a failed request after a backoff
+      std::chrono::milliseconds backoff { this->_endpoints.backoff * (1LL << std::min(std::max(transfer.failures, 1) - 1, 16)) };
+      transfer.next_start = std::chrono::steady_clock::now() + (missing_copy ? std::chrono::milliseconds(0)
+                                                                             : std::min(backoff, this->_endpoints.max_backoff));
+      // Out of retries, or out of time before the retry would start
+      if ((transfer.failures >= this->_endpoints.max_failures || transfer.next_start >= transfer.deadline) &&
+          running_attempts(transfer) == 0) {
+        std::cerr << "curl error: " << reason << " (" << attempt->url << ")" << std::endl;
+        finishPipeline(transfer);
+        transfer.stats.url      = attempt->url;
+        transfer.stats.requests = transfer.attempts.size();
+        this->_stats.transfers.push_back(transfer.stats);
+        transfer.done = true;
+        result        = false;
+      }
+    }
+
+    // Cancel the requests that lost their race, and start the hedges and retries that are due
+    std::chrono::steady_clock::time_point now { std::chrono::steady_clock::now() };
+    std::chrono::steady_clock::time_point wake { now + std::chrono::seconds(1) };
+    pending = false;
+    for (std::unique_ptr<UbuntuCloudTransfer>& transfer_ptr : transfers) {
+      UbuntuCloudTransfer& transfer { *transfer_ptr };
+      if (transfer.done) {
+        continue;
+      }
+      pending = true;
+      if (transfer.winner) {
+        for (std::unique_ptr<UbuntuCloudAttempt>& attempt : transfer.attempts) {
+          if (attempt->handle && attempt.get() != transfer.winner) {
+            stop_attempt(*attempt);
+          }
+        }
+        UbuntuCloudAttempt& winner { *transfer.winner };
+        if (winner.paused && winner.handle && transfer.stream.writable()) {
+          // The decoder made room, curl delivers the data it held back before anything else
+          winner.paused = false;
+          curl_easy_pause(winner.handle, CURLPAUSE_CONT);
+        }
+        continue;
+      }
+      std::size_t in_flight { running_attempts(transfer) };
+      if (in_flight > race_width(transfer) || transfer.failures >= this->_endpoints.max_failures) {
+        continue;  // Hedged already, or out of retries and waiting for the last requests
+      }
+      // With requests in flight, a hedge goes out once the latest one has waited longer than the budget for its response
+      std::chrono::steady_clock::time_point due { in_flight > 0 ? transfer.attempts.back()->start + this->_endpoints.hedge_delay
+                                                                : transfer.next_start };
+      if (due >= transfer.deadline) {
+        continue;  // No time left for another request, the ones in flight time out by the deadline
+      }
+      if (due <= now) {
+        if (!this->startAttempt(multi_handle, transfer)) {
+          result = false;
+          break;
+        }
+        due = transfer.attempts.back()->start + this->_endpoints.hedge_delay;
+      }
+      wake = std::min(wake, due);
+    }
+    if (!result || !pending) {
+      break;
+    }
+    int timeout { static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count()) };
+    multi_code = curl_multi_poll(multi_handle, nullptr, 0, std::max(timeout, 0), nullptr);
+    if (multi_code != CURLM_OK) {
+      std::cerr << "curl error: " << curl_multi_strerror(multi_code) << std::endl;
+      result = false;
+      break;
+    }
+  }
 
-  // Clean-up functions whatever result the request has
-  curl_easy_cleanup(curl_handle);
+  // Clean-up functions whatever result the transfers have, including the ones an error left unfinished
+  for (std::unique_ptr<UbuntuCloudTransfer>& transfer : transfers) {
+    for (std::unique_ptr<UbuntuCloudAttempt>& attempt : transfer->attempts) {
+      if (attempt->handle) {
+        stop_attempt(*attempt);
+      }
+    }
+    if (transfer->parser.joinable()) {
+      transfer->stream.close();
+      transfer->decoded.close();
+      finishPipeline(*transfer);
+    }
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = nullptr;
+  }
+  curl_multi_cleanup(multi_handle);
+  // Best-effort, the next invocation resolves the names and negotiates the sessions again without it
+  this->_transport->save();
   return result;  // Return result
 }
 
-bool UbuntuCloudFetcher::curlRequest(CURL* curl_handle, std::string& curl_response) {
-  CURLcode result_code { curl_easy_perform(curl_handle) };
+bool UbuntuCloudFetcher::completeTransfer(UbuntuCloudTransfer& transfer, CURLcode result_code) {
+  CURL* handle { transfer.winner->handle };
   // Curl code is CURLE_OK if everything went well.
   if (result_code != CURLE_OK) {
+    if (result_code == CURLE_WRITE_ERROR && !transfer.parsed && !bodyError(transfer).empty()) {
+      // The transfer was aborted because the body is not valid
+      std::cerr << bodyError(transfer) << std::endl;
+      return false;  // Early return
+    }
     // Print error with curl handler function
-    std::cerr << "curl error: " << curl_easy_strerror(result_code) << std::endl;
-    // Force flush to ensure output is clear
+    std::cerr << "curl error: " << curl_easy_strerror(result_code) << " (" << transfer.winner->url << ")" << std::endl;
     return false;  // Early return
   }
-  // After curl handle initialization, we do the request
-  try {
-    // Parse the received data
-    json data = json::parse(curl_response);
-    if (!data.contains("products")) {
-      // Problem with data content, this key contains our data of interest
-      std::cerr << "Data not found on curl request" << std::endl;
+  long response_code { 0 };
+  curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+  // libcurl reports when each phase ended, relative to the start of the transfer
+  UbuntuCloudTransferStats& stats { transfer.stats };
+  double                    name_lookup { curlSeconds(handle, CURLINFO_NAMELOOKUP_TIME_T) };
+  double                    connect { std::max(curlSeconds(handle, CURLINFO_CONNECT_TIME_T), name_lookup) };
+  double                    handshake { std::max(curlSeconds(handle, CURLINFO_APPCONNECT_TIME_T), connect) };  // 0 without TLS
+  double                    first_byte { std::max(curlSeconds(handle, CURLINFO_STARTTRANSFER_TIME_T), handshake) };
+  curl_off_t                bytes_received { 0 };
+  long                      new_connections { 0 };
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes_received);
+  curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &new_connections);
+  stats.source            = response_code == 304 ? "not-modified" : "network";
+  stats.response_code     = response_code;
+  stats.dns_seconds       = name_lookup;
+  stats.connect_seconds   = connect - name_lookup;
+  stats.tls_seconds       = handshake - connect;
+  stats.wait_seconds      = first_byte - handshake;
+  stats.total_seconds     = curlSeconds(handle, CURLINFO_TOTAL_TIME_T);
+  stats.receive_seconds   = std::max(stats.total_seconds - first_byte, 0.0);
+  stats.bytes_received    = static_cast<std::uint64_t>(bytes_received);
+  stats.reused_connection = response_code != 0 && new_connections == 0;  // No lookup, connect or handshake at all
+  if (response_code == 304 && transfer.cached_entry) {
+    // Not modified, the cached body is still current
+    if (transfer.skip_unchanged) {
+      this->_cache->touch(*transfer.cached_entry);  // Restart the freshness window
+      transfer.unchanged = true;
+      return true;  // Already in the catalog, parsed later only if another file changed
+    }
+    if (!this->loadFromCache(transfer, *transfer.cached_entry)) {
+      std::cerr << (transfer.error.empty() ? "Cached data could not be read" : transfer.error) << std::endl;
       return false;  // Early return
     }
-    // Store data on success
-    this->_productData = data.at("products");
-  } catch (const json::parse_error& exception) {
-    // Exception during parsing
-    std::cerr << "JSON parsing error: " << exception.what() << std::endl;
-    // Force flush to ensure output is clear
-    return false;
+    this->_cache->touch(*transfer.cached_entry);  // Restart the freshness window
+    return true;
+  }
+  if (!transfer.parsed || !transfer.decode_error.empty()) {
+    // Corrupt compressed data, exception during parsing, or missing products
+    std::cerr << bodyError(transfer) << std::endl;
+    return false;  // Early return
+  }
+  if (transfer.cache_writer && (response_code == 200 || response_code == 0)) {
+    // Only complete responses are cached (0 is the response code of non-HTTP URLs such as file://)
+    transfer.cache_writer->commit(transfer.response_entry);
   }
   return true;  // Return after success
 }
 
+bool UbuntuCloudFetcher::loadFromCache(UbuntuCloudTransfer& transfer, const UbuntuCloudCacheEntry& entry) {
+  std::optional<std::ifstream> input { this->_cache->openBody(entry) };
+  if (!input) {
+    return false;  // Leaves the error empty, the caller decides how to report it
+  }
+  std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
+  bool                                  parsed { transfer.parse(*input, transfer.error) };
+  transfer.stats.parse_seconds = secondsSince(start);
+  return parsed;
+}
+
+void UbuntuCloudFetcher::storeCatalog(const std::vector<UbuntuProduct>& products) {
+  std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
+  this->_catalog             = UbuntuCloudCatalog(products);
+  this->_stats.index_seconds = secondsSince(start);
+  if (this->_snapshotPath) {
+    // Best-effort, offline mode keeps working from the previous snapshot if this fails
+    start = std::chrono::steady_clock::now();
+    this->_catalog.writeSnapshot(*this->_snapshotPath);
+    this->_stats.snapshot_seconds = secondsSince(start);
+  }
+}
+
 size_t UbuntuCloudFetcher::writeData(void* buffer_ptr, size_t size, size_t nmemb, void* data_ptr) {
-  std::string* string_ptr { static_cast<std::string*>(data_ptr) };
-  // Append data to the string
-  string_ptr->append(static_cast<char*>(buffer_ptr), size * nmemb);
+  UbuntuCloudAttempt*  attempt { static_cast<UbuntuCloudAttempt*>(data_ptr) };
+  UbuntuCloudTransfer* transfer { attempt->transfer };
+  const char*          bytes { static_cast<const char*>(buffer_ptr) };
+  if (!transfer->winner) {
+    long response_code { 0 };
+    curl_easy_getinfo(attempt->handle, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code != 0) {
+      return size * nmemb;  // An error page, the request fails once it is over and the file is retried elsewhere
+    }
+    transfer->winner = attempt;  // Non-HTTP URLs have no headers, their first bytes win
+  }
+  if (transfer->winner != attempt) {
+    return 0;  // Another mirror answered first, returning less than received aborts the request
+  }
+  if (!transfer->stream.writable()) {
+    attempt->paused = true;
+    return CURL_WRITEFUNC_PAUSE;  // Blocking would stall every other transfer, the loop resumes this one once there is room
+  }
+  if (!transfer->stream.push(bytes, size * nmemb)) {
+    return 0;  // The decoder stopped, returning less than received aborts the transfer
+  }
   // Return processed data size in bytes
   return size * nmemb;
 }
+
+size_t UbuntuCloudFetcher::writeHeader(char* buffer_ptr, size_t size, size_t nitems, void* attempt_ptr) {
+  UbuntuCloudAttempt*    attempt { static_cast<UbuntuCloudAttempt*>(attempt_ptr) };
+  UbuntuCloudCacheEntry* entry { &attempt->response_entry };
+  std::string            line(buffer_ptr, size * nitems);
+  if (line == "\r\n" || line == "\n") {
+    // End of the headers of one response: the first final answer wins the race, redirects and errors do not
+    long response_code { 0 };
+    curl_easy_getinfo(attempt->handle, CURLINFO_RESPONSE_CODE, &response_code);
+    if (!attempt->transfer->winner && ((response_code >= 200 && response_code < 300) || response_code == 304)) {
+      attempt->transfer->winner = attempt;
+    }
+    return size * nitems;
+  }
+  if (line.rfind("HTTP/", 0) == 0) {
+    // A new status line starts a new response (redirects), forget the validators of the previous one
+    entry->etag.clear();
+    entry->last_modified.clear();
+    return size * nitems;
+  }
+  size_t colon { line.find(':') };
+  if (colon == std::string::npos) {
+    return size * nitems;  // Blank separator line or malformed header
+  }
+  std::string name { line.substr(0, colon) };
+  std::transform(name.begin(), name.end(), name.begin(), [](unsigned char character) { return std::tolower(character); });
+  // Header names are case-insensitive, values are kept verbatim without surrounding whitespace
+  size_t value_begin { line.find_first_not_of(" \t", colon + 1) };
+  size_t value_end { line.find_last_not_of(" \t\r\n") };
+  std::string value { value_begin == std::string::npos || value_end < value_begin ? "" : line.substr(value_begin, value_end - value_begin + 1) };
+  if (name == "etag") {
+    entry->etag = value;
+  } else if (name == "last-modified") {
+    entry->last_modified = value;
+  }
+  return size * nitems;
+}
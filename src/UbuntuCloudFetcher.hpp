@@ -6,24 +6,139 @@
  * cloud image release information from a specified URL. The class offers methods for querying
  * supported releases, the current Long Term Support (LTS) release, and SHA256 checksums for specific releases.
  *
- * The implementation uses libcurl for HTTP requests and the nlohmann::json library for JSON parsing.
+ * The implementation uses libcurl for HTTP requests and the SAX interface of the nlohmann::json library for JSON parsing.
+ * Responses are requested compressed. The body goes through a pipeline of three overlapping stages: curl receives it,
+ * a decoder thread decompresses it (see UbuntuCloudDecoder.hpp) and a parser thread keeps only the fields the queries use.
+ *
+ * The product files are either given directly, or selected from the stream index of one or more mirrors. All the files
+ * are downloaded concurrently over a single curl multi handle, and their products are merged into one catalog.
+ *
+ * A file under a root with configured alternates (UbuntuCloudEndpoints) is requested from several of them: the first
+ * response wins and the other requests are cancelled, a request still waiting for its response after the hedge delay
+ * gets a second one on the next mirror, and failed requests are retried on the next mirror after an exponential backoff.
+ *
+ * Every request goes through a UbuntuCloudTransport, so the stream indexes, the product files and later refreshes reuse
+ * the connections, TLS sessions and resolved addresses of the earlier requests (see UbuntuCloudTransport.hpp).
+ *
+ * By default the constructor fetches the catalog. A fetcher constructed with UbuntuCloudLoading::Lazy fetches it on
+ * a background thread once asked to, see UbuntuCloudInterface::startLoading().
  *
  * Intended for use in applications that need to automate or display Ubuntu cloud image information
  * fetched from an online source.
  */
 
 #pragma once
+#include "UbuntuCloudCache.hpp"
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudDecoder.hpp"
 #include "UbuntuCloudInterface.hpp"
+#include "UbuntuCloudStats.hpp"
+#include "UbuntuCloudStream.hpp"
+#include "UbuntuCloudTransport.hpp"
 
 #include <curl/curl.h>
-#include <nlohmann/json.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
+/**
+ * @struct UbuntuCloudStreamSelector
+ * @brief Selects product files of a simplestreams mirror through its stream index.
+ */
+struct UbuntuCloudStreamSelector {
+    std::string index_url;   ///< URL of the stream index, e.g. "https://cloud-images.ubuntu.com/releases/streams/v1/index.json".
+    std::string content_id;  ///< Last component of the wanted content ids (e.g. "download" or "aws"), "*" for every product file.
+};
+
+/**
+ * @struct UbuntuCloudEndpoints
+ * @brief Mirrors serving the same files, and how the requests of one file are spread over them.
+ */
+struct UbuntuCloudEndpoints {
+    /// Roots serving the same tree, e.g. "https://cloud-images.ubuntu.com/". A URL under one of them can be fetched from any.
+    std::vector<std::string>  mirrors;
+    std::size_t               race { 2 };               ///< Requests started at once for a file, on distinct mirrors.
+    std::chrono::milliseconds hedge_delay { 1000 };     ///< Without any response by then, one more request goes to the next mirror.
+    std::chrono::milliseconds backoff { 250 };          ///< Wait before a retry once every request of a file failed, doubled each time.
+    std::chrono::milliseconds max_backoff { 4000 };     ///< Upper bound of the backoff.
+    int                       max_failures { 3 };       ///< Failed requests of a file before the file fails.
+    std::chrono::milliseconds timeout { 30000 };        ///< Time a file may take over all of its requests, each gets what is left.
+    /// Suffix of pre-compressed copies of the files, e.g. ".gz" or ".zst", requested before the files themselves. Empty for none.
+    std::string precompressed;
+    /// Connections, TLS sessions and addresses shared with other fetchers and kept across invocations. Null for one per fetcher.
+    std::shared_ptr<UbuntuCloudTransport> transport;
+};
+
+struct UbuntuCloudTransfer;
+
+/**
+ * @struct UbuntuCloudAttempt
+ * @brief One request for a transfer, on one mirror. Only the request whose response comes first feeds the parser.
+ */
+struct UbuntuCloudAttempt {
+    UbuntuCloudTransfer*                  transfer;        ///< The transfer the request is for.
+    std::string                           url;             ///< The URL on the mirror of the request.
+    UbuntuCloudCacheEntry                 response_entry;  ///< Validators collected from the response headers.
+    CURL*                                 handle;          ///< The easy handle, null once the request is over.
+    std::chrono::steady_clock::time_point start;           ///< When the request was started.
+    bool                                  paused;          ///< Whether the write callback paused the request on a full stream.
+};
+
+/**
+ * @struct UbuntuCloudTransfer
+ * @brief State of one download, shared by the curl callbacks, the parser thread and the transfer loop.
+ */
+struct UbuntuCloudTransfer {
+    std::string                             url;             ///< The URL to download.
+    UbuntuCloudStreamBuffer                 stream;          ///< Bytes flowing from the write callback to the decoder, as received.
+    UbuntuCloudStreamBuffer                 decoded;         ///< Bytes flowing from the decoder to the parser, decompressed.
+    std::unique_ptr<UbuntuCloudCacheWriter> cache_writer;    ///< Copy of the body going into the cache, null without a cache.
+    std::optional<UbuntuCloudCacheEntry>    cached_entry;    ///< The cache entry the request is conditional on, if any.
+    UbuntuCloudCacheEntry                   response_entry;  ///< Validators collected from the response headers of the winning request.
+    /// Parses a body, either on the parser thread while it downloads or from the cache. Returns false and sets the error on failure.
+    std::function<bool(std::istream&, std::string&)> parse;
+    std::thread                                      decoder;  ///< Thread decompressing stream into decoded during the download.
+    std::thread                                      parser;   ///< Thread running parse on decoded during the download.
+    bool                                             parsed;   ///< Result of parse on the downloaded body.
+    std::string                                      error;    ///< Error message of parse.
+    std::string                                      decode_error;  ///< Error message of the decoder, empty unless the body is corrupt.
+    curl_slist*                                      headers;  ///< Conditional request headers, may be null.
+    UbuntuCloudTransferStats                         stats;    ///< Timings of the transfer and of the parse.
+    std::vector<std::string>                         mirror_urls;  ///< The URL on every mirror, its own first. Pre-compressed copies come first.
+    std::size_t                                      mirror_count; ///< Mirrors of the file, the distinct requests a race can start.
+    std::vector<std::unique_ptr<UbuntuCloudAttempt>> attempts;     ///< Requests started, never erased while the transfer runs.
+    UbuntuCloudAttempt*                              winner;       ///< The request whose response came first, null until then.
+    int                                              failures;     ///< Requests that failed before any response won.
+    std::chrono::steady_clock::time_point            next_start;   ///< Earliest start of a retry once every request failed.
+    std::chrono::steady_clock::time_point            deadline;     ///< When the time budget of the file runs out.
+    bool                                             done;         ///< Whether the transfer is over, successful or not.
+    /// Whether an unchanged body (fresh cache entry or 304) is left unparsed, because the current catalog already holds it.
+    bool skip_unchanged;
+    /// Set when the body was left unparsed because it is unchanged.
+    bool unchanged;
+
+    /**
+     * @brief Constructs a transfer that has not started yet.
+     * @param url_ The URL to download.
+     * @param parse_ Parses the body.
+     */
+    UbuntuCloudTransfer(std::string url_, std::function<bool(std::istream&, std::string&)> parse_):
+        url(std::move(url_)), stream(), decoded(), cache_writer(), cached_entry(), response_entry(), parse(std::move(parse_)), decoder(),
+        parser(), parsed(false), error(), decode_error(), headers(nullptr), stats(), mirror_urls(), mirror_count(0), attempts(),
+        winner(nullptr), failures(0), next_start(), deadline(), done(false), skip_unchanged(false), unchanged(false) {
+      this->stats.url = this->url;
+    }
+};
+
 /**
  * @brief Implementation of UbuntuCloudInterface that fetches Ubuntu release data from a cloud source.
  *
@@ -32,38 +147,143 @@
  */
 class UbuntuCloudFetcher : public UbuntuCloudInterface {
   private:
-    /// The URL used for curl request.
-    const std::string _url;
-    /// Whether the instance has successfully initialized json data.
-    bool _initialized;
-    /// Received data from curl request in json format.
-    json _productData;
+    /// Product files given directly.
+    const std::vector<std::string> _productUrls;
+    /// Product files to look up in stream indexes before the download.
+    const std::vector<UbuntuCloudStreamSelector> _streams;
+    /// Whether the instance has successfully initialized json data. Set by the loading thread of a lazy fetcher.
+    std::atomic<bool> _initialized;
+    /// Index of the products parsed from the received data.
+    UbuntuCloudCatalog _catalog;
+    /// Optional on-disk cache used to skip or revalidate the download.
+    std::optional<UbuntuCloudCache> _cache;
+    /// Optional path of the binary snapshot refreshed after every successful fetch.
+    std::optional<std::filesystem::path> _snapshotPath;
+    /// Timings of the last fetch.
+    UbuntuCloudStats _stats;
+    /// Product files the current catalog was built from.
+    std::vector<std::string> _catalogUrls;
+    /// Whether the last successful fetch rebuilt the catalog.
+    bool _catalogChanged;
+    /// Mirrors the files are raced and failed over across.
+    const UbuntuCloudEndpoints _endpoints;
+    /// The transport of the endpoints, or one of its own: successive fetches reuse its connections.
+    const std::shared_ptr<UbuntuCloudTransport> _transport;
+
+    /**
+     * @brief Downloads a set of URLs concurrently over one curl multi handle, parsing each body while it arrives.
+     *
+     * Fresh cache entries are parsed from disk without any request. Stale entries turn the request into a conditional
+     * one, and the cached body is parsed on a 304. Complete responses are written to the cache.
+     * @param transfers The transfers to run. Each one's parse function receives its body.
+     * @return bool True if every transfer succeeded and every body was valid; false otherwise.
+     */
+    bool transferAll(std::vector<std::unique_ptr<UbuntuCloudTransfer>>& transfers);
+
+    /**
+     * @brief Starts one more request of a transfer, on the next mirror in its list.
+     * @param multi_handle The multi handle driving the transfers.
+     * @param transfer The transfer.
+     * @return bool False if the easy handle could not be created.
+     */
+    bool startAttempt(CURLM* multi_handle, UbuntuCloudTransfer& transfer);
+
+    /**
+     * @brief Checks the outcome of a finished transfer, and falls back to the cached body on a 304.
+     * @param transfer The transfer, whose parser thread has been joined and whose winner is the finished request.
+     * @param result_code Result of the transfer reported by curl.
+     * @return bool True if the body, downloaded or cached, was valid; false otherwise.
+     */
+    bool completeTransfer(UbuntuCloudTransfer& transfer, CURLcode result_code);
+
+    /**
+     * @brief Parses the cached body of an entry.
+     * @param transfer The transfer whose parse function receives the body.
+     * @param entry The cache entry to load.
+     * @return bool True if the cached body was valid; false otherwise, with transfer.error set if it could be read.
+     */
+    bool loadFromCache(UbuntuCloudTransfer& transfer, const UbuntuCloudCacheEntry& entry);
+
+    /**
+     * @brief Downloads the stream indexes and resolves the selected product files.
+     * @param[out] product_urls Receives the URLs of the selected product files, without duplicates.
+     * @return bool True if every index was valid and every selector matched at least one product file.
+     */
+    bool resolveStreams(std::vector<std::string>& product_urls);
+
+    /**
+     * @brief Indexes freshly parsed products and refreshes the snapshot, if one is configured.
+     * @param products The parsed products.
+     * @note Result stored in class member _catalog.
+     */
+    void storeCatalog(const std::vector<UbuntuProduct>& products);
 
     /**
-     * @brief Performs the actual HTTP request using libcurl and parses the server's JSON response.
-     * @param curl_handle The curl handle to use.
-     * @param curl_response String reference to store the server's raw response.
-     * @return bool True if the request was successful and the data was valid; false otherwise.
-     * @note Result stored in class member _productData.
+     * @brief Fetches the catalog of a lazy fetcher, on the thread started by startLoading().
+     * @return bool True if the fetch succeeded.
      */
-    bool curlRequest(CURL* curl_handle, std::string& curl_response);
+    bool load() override;
 
   public:
     /**
      * @brief Constructor that sets the URL for fetching data.
      *
      * The constructor calls fetchData(), and sets the class member _initizalied to the return value of the call.
-     * @param url The URL to fetch data from.
+     * @param url The URL of the product file to fetch data from.
+     * @param cache Optional on-disk cache. Without it every fetch downloads the whole product file.
+     * @param snapshot_path Optional path where a binary snapshot of the catalog is written after each successful fetch.
+     * @param loading Lazy to leave the fetch to startLoading() instead of the constructor.
+     * @param endpoints Alternate mirrors of the files, and how requests are raced and retried across them.
      */
-    UbuntuCloudFetcher(const std::string& url);
+    UbuntuCloudFetcher(const std::string& url, std::optional<UbuntuCloudCache> cache = std::nullopt,
+                       std::optional<std::filesystem::path> snapshot_path = std::nullopt, UbuntuCloudLoading loading = UbuntuCloudLoading::Eager,
+                       UbuntuCloudEndpoints endpoints = {});
 
+    /**
+     * @brief Constructor that selects the product files through stream indexes.
+     *
+     * The constructor calls fetchData(), and sets the class member _initizalied to the return value of the call.
+     * @param streams The product files to select. The products of earlier selectors take precedence when merging.
+     * @param cache Optional on-disk cache, holding the indexes as well as the product files.
+     * @param snapshot_path Optional path where a binary snapshot of the merged catalog is written after each successful fetch.
+     * @param loading Lazy to leave the fetch to startLoading() instead of the constructor.
+     * @param endpoints Alternate mirrors of the files, and how requests are raced and retried across them.
+     */
+    UbuntuCloudFetcher(std::vector<UbuntuCloudStreamSelector> streams, std::optional<UbuntuCloudCache> cache = std::nullopt,
+                       std::optional<std::filesystem::path> snapshot_path = std::nullopt, UbuntuCloudLoading loading = UbuntuCloudLoading::Eager,
+                       UbuntuCloudEndpoints endpoints = {});
+
+    /**
+     * @brief Destructor, waits for a lazy load in progress.
+     */
     ~UbuntuCloudFetcher();
 
     /**
      * @brief Checks if the fetcher has successfully initialized.
-     * @return bool True if initialized (_productData contains json with parsed data), false otherwise.
+     * @return bool True if initialized (_catalog holds the parsed data), false otherwise.
+     */
+    bool isInitialized() const override { return this->_initialized.load(); }
+
+    /**
+     * @brief Returns the timings of the last fetch: every transfer with its network phases and parse, the catalog build and the snapshot.
+     * @return const UbuntuCloudStats& The statistics. The query fields are left to the caller.
+     */
+    const UbuntuCloudStats& getStats() const { return this->_stats; }
+
+    /**
+     * @brief Returns the indexed catalog, e.g. to compare it with the one of a later fetch.
+     * @return const UbuntuCloudCatalog& The catalog. Copies share its image and outlive later fetches.
+     */
+    const UbuntuCloudCatalog& getCatalog() const override { return this->_catalog; }
+
+    /**
+     * @brief Tells whether the last successful fetchData() replaced the catalog.
+     *
+     * A refetch that finds every product file unchanged (a fresh cache entry or a 304) keeps the current catalog
+     * without parsing anything, and without rewriting the snapshot.
+     * @return bool True if the catalog was rebuilt, false if it was kept.
      */
-    bool isInitialized() const override { return _initialized; }
+    bool catalogChanged() const { return this->_catalogChanged; }
 
     /**
      * @brief Returns a list of all currently supported Ubuntu releases.
@@ -90,7 +310,23 @@ class UbuntuCloudFetcher : public UbuntuCloudInterface {
     std::optional<std::string> getSha256ForRelease(const std::string& release) const override;
 
     /**
-     * @brief Fetches Ubuntu product data from the configured URL using libcurl.
+     * @brief Retrieves the URL, checksum and size of the disk1.img whose checksum getSha256ForRelease() returns.
+     * @param release The name or title of the release to search for.
+     * @return An optional UbuntuCloudImage, or std::nullopt if no match is found.
+     */
+    std::optional<UbuntuCloudImage> getDiskImageForRelease(const std::string& release) const override;
+
+    /**
+     * @brief Fetches Ubuntu product data from the configured URLs or streams using libcurl.
+     *
+     * With streams configured, their indexes are downloaded first, then all selected product files at once.
+     * With a cache configured, a fresh entry is served without any network access, and a stale one
+     * turns the download into a conditional request. With a snapshot path configured, the snapshot is
+     * rewritten on success so that offline queries see the same data.
+     *
+     * Once a catalog is loaded, calling it again refreshes the catalog: if the same product files are selected and none
+     * of them changed, the catalog is kept as is; otherwise it is rebuilt from all of them (see catalogChanged()).
+     * On failure the previous catalog stays in place.
      * @return bool True if the data was successfully fetched and parsed; false otherwise.
      * @note Should be called after construction to initialize the fetcher.
      */
@@ -101,10 +337,24 @@ class UbuntuCloudFetcher : public UbuntuCloudInterface {
      * @param[in] buffer_ptr Pointer to the received data.
      * @param[in] size Size of each data element.
      * @param[in] nmemb Number of data elements.
-     * @param[out] data_ptr Pointer to the data storage location.
-     * @return size_t Number of bytes processed.
+     * @param[out] data_ptr Pointer to the UbuntuCloudAttempt of the request.
+     * @return size_t Number of bytes processed, 0 to abort the request once the parser has stopped or another request won,
+     * CURL_WRITEFUNC_PAUSE to pause it while the stream to the decoder is full.
      */
     static size_t writeData(void* buffer_ptr, size_t size, size_t nmemb, void* data_ptr);
+
+    /**
+     * @brief Static callback function for curl to receive response headers, one line per call.
+     *
+     * Collects the ETag and Last-Modified validators of the request. The end of the headers of a successful or 304
+     * response makes the request the winner of its transfer, if no other request won before.
+     * @param[in] buffer_ptr Pointer to the header line (not null-terminated).
+     * @param[in] size Size of each data element.
+     * @param[in] nitems Number of data elements.
+     * @param[out] attempt_ptr Pointer to the UbuntuCloudAttempt of the request.
+     * @return size_t Number of bytes processed.
+     */
+    static size_t writeHeader(char* buffer_ptr, size_t size, size_t nitems, void* attempt_ptr);
     // Method has to be static because libcurl is a C library and does not support C++ member functions directly. If multi-threaded support
     // is desired, use the static method to call a non-static method that does the actual data writing.
 };
\ No newline at end of file
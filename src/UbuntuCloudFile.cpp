@@ -0,0 +1,53 @@
+/**
+ * @file UbuntuCloudFile.cpp
+ * @brief Implementation of the atomic file replacement and of the clock of the persisted expiries.
+ */
+
+#include "UbuntuCloudFile.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+
+std::filesystem::path temporaryPath(const std::filesystem::path& target) {
+  // A random suffix keeps concurrent writers from sharing a temporary file
+  std::ostringstream suffix {};
+  suffix << ".tmp." << std::hex << std::random_device {}();
+  std::filesystem::path temporary { target };
+  temporary += suffix.str();
+  return temporary;
+}
+
+bool replaceFile(const std::filesystem::path& target, const std::function<bool(std::ostream&)>& write, bool owner_only) {
+  std::filesystem::path temporary { temporaryPath(target) };
+  std::error_code       error {};
+  std::ofstream         file(temporary, std::ios::binary | std::ios::trunc);
+  if (owner_only) {
+    // Restricted before the contents are written. Unsupported on some file systems
+    std::filesystem::permissions(temporary, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write, error);
+  }
+  bool written { file && write(file) };
+  file.close();  // Flushes the stream, whose failure counts, before renaming
+  if (!written || !file) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+  std::filesystem::rename(temporary, target, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+bool replaceFile(const std::filesystem::path& target, std::string_view contents, bool owner_only) {
+  return replaceFile(
+      target, [contents](std::ostream& file) { return static_cast<bool>(file.write(contents.data(), static_cast<std::streamsize>(contents.size()))); },
+      owner_only);
+}
+
+std::int64_t nowSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
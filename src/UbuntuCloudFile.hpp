@@ -0,0 +1,46 @@
+/**
+ * @file UbuntuCloudFile.hpp
+ * @brief Declares the file and clock helpers shared by the caches and the writers of the output files.
+ *
+ * Every file another process may read while it is being written is written next to its destination under a unique
+ * name and renamed over it, so that readers see the previous file or the complete new one, never a partial one.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string_view>
+
+/**
+ * @brief Returns a unique temporary path next to a target file.
+ * @param target Final path of the file.
+ * @return std::filesystem::path The target followed by ".tmp." and a random suffix, so concurrent writers never share it.
+ */
+std::filesystem::path temporaryPath(const std::filesystem::path& target);
+
+/**
+ * @brief Writes a file atomically: a temporary file next to it is written, then renamed over it.
+ * @param target Final path of the file. Its directory must exist.
+ * @param write Writes the contents to the temporary file, and returns false to abandon the file.
+ * @param owner_only Whether the file is made readable by its owner only, before anything is written.
+ * @return bool True if the file was replaced; the target is left untouched and the temporary file removed otherwise.
+ */
+bool replaceFile(const std::filesystem::path& target, const std::function<bool(std::ostream&)>& write, bool owner_only = false);
+
+/**
+ * @brief Writes a file atomically, see the overload above.
+ * @param target Final path of the file. Its directory must exist.
+ * @param contents Bytes to write.
+ * @param owner_only Whether the file is made readable by its owner only, before anything is written.
+ * @return bool True if the file was replaced.
+ */
+bool replaceFile(const std::filesystem::path& target, std::string_view contents, bool owner_only = false);
+
+/**
+ * @brief Returns the current Unix time in seconds, the clock of every persisted expiry.
+ * @return std::int64_t Seconds since the epoch.
+ */
+std::int64_t nowSeconds();
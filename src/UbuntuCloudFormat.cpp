@@ -0,0 +1,236 @@
+/**
+ * @file UbuntuCloudFormat.cpp
+ * @brief Implementation of the machine-readable output formats.
+ */
+
+#include "UbuntuCloudFormat.hpp"
+
+#include <charconv>
+
+std::optional<UbuntuCloudOutputFormat> parseOutputFormat(std::string_view name) {
+  if (name == "text") {
+    return UbuntuCloudOutputFormat::Text;
+  }
+  if (name == "json") {
+    return UbuntuCloudOutputFormat::Json;
+  }
+  if (name == "jsonl") {
+    return UbuntuCloudOutputFormat::Jsonl;
+  }
+  if (name == "csv") {
+    return UbuntuCloudOutputFormat::Csv;
+  }
+  if (name == "tsv") {
+    return UbuntuCloudOutputFormat::Tsv;
+  }
+  return std::nullopt;
+}
+
+const char* outputFormatName(UbuntuCloudOutputFormat format) {
+  switch (format) {
+    case UbuntuCloudOutputFormat::Json:
+      return "json";
+    case UbuntuCloudOutputFormat::Jsonl:
+      return "jsonl";
+    case UbuntuCloudOutputFormat::Csv:
+      return "csv";
+    case UbuntuCloudOutputFormat::Tsv:
+      return "tsv";
+    default:
+      return "text";
+  }
+}
+
+UbuntuCloudRecordWriter::UbuntuCloudRecordWriter(std::ostream& output, UbuntuCloudOutputFormat format, std::vector<std::string_view> columns):
+    _output(output), _format(format), _columns(std::move(columns)), _buffer(), _column(0), _records(0), _finished(false), _fragment(false) {
+  this->_buffer.reserve(flush_threshold + 4096);  // Room for the record that crosses the threshold
+  if (this->_format == UbuntuCloudOutputFormat::Json) {
+    this->_buffer += '[';
+  } else if (this->_format == UbuntuCloudOutputFormat::Csv || this->_format == UbuntuCloudOutputFormat::Tsv) {
+    for (std::size_t idx = 0; idx < this->_columns.size(); idx++) {
+      this->beginField();
+      this->_buffer += this->_columns[idx];  // Plain identifiers, nothing to escape
+      this->_column++;
+    }
+    this->_buffer += '\n';
+    this->_column = 0;
+  }
+}
+
+UbuntuCloudRecordWriter::UbuntuCloudRecordWriter(std::ostream& output, UbuntuCloudOutputFormat format, std::vector<std::string_view> columns,
+                                                 std::size_t first_record):
+    _output(output), _format(format), _columns(std::move(columns)), _buffer(), _column(0), _records(first_record), _finished(false), _fragment(true) {
+  // No header: the records of the fragment follow the ones before it, including their JSON separators
+  this->_buffer.reserve(flush_threshold + 4096);
+}
+
+UbuntuCloudRecordWriter::~UbuntuCloudRecordWriter() {
+  if (!this->_finished) {
+    this->finish();
+  }
+}
+
+void UbuntuCloudRecordWriter::beginField() {
+  switch (this->_format) {
+    case UbuntuCloudOutputFormat::Json:
+    case UbuntuCloudOutputFormat::Jsonl:
+      if (this->_column == 0 && this->_format == UbuntuCloudOutputFormat::Json) {
+        this->_buffer += this->_records == 0 ? "\n" : ",\n";  // One object per line inside the array
+      }
+      this->_buffer += this->_column == 0 ? "{\"" : ",\"";
+      this->_buffer += this->_columns[this->_column];
+      this->_buffer += "\":";
+      break;
+    case UbuntuCloudOutputFormat::Csv:
+      if (this->_column > 0) {
+        this->_buffer += ',';
+      }
+      break;
+    case UbuntuCloudOutputFormat::Tsv:
+      if (this->_column > 0) {
+        this->_buffer += '\t';
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void UbuntuCloudRecordWriter::appendEscaped(std::string_view value) {
+  constexpr static char hex_digits[] { "0123456789abcdef" };
+  switch (this->_format) {
+    case UbuntuCloudOutputFormat::Json:
+    case UbuntuCloudOutputFormat::Jsonl:
+      this->_buffer += '"';
+      for (char character : value) {
+        switch (character) {
+          case '"':
+            this->_buffer += "\\\"";
+            break;
+          case '\\':
+            this->_buffer += "\\\\";
+            break;
+          case '\n':
+            this->_buffer += "\\n";
+            break;
+          case '\r':
+            this->_buffer += "\\r";
+            break;
+          case '\t':
+            this->_buffer += "\\t";
+            break;
+          default:
+            if (static_cast<unsigned char>(character) < 0x20) {
+              this->_buffer += "\\u00";
+              this->_buffer += hex_digits[(character >> 4) & 0xf];
+              this->_buffer += hex_digits[character & 0xf];
+            } else {
+              this->_buffer += character;  // UTF-8 passes through unchanged
+            }
+        }
+      }
+      this->_buffer += '"';
+      break;
+    case UbuntuCloudOutputFormat::Csv:
+      if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+        this->_buffer += value;
+        break;
+      }
+      // RFC 4180: the field is quoted and its quotes doubled
+      this->_buffer += '"';
+      for (char character : value) {
+        if (character == '"') {
+          this->_buffer += '"';
+        }
+        this->_buffer += character;
+      }
+      this->_buffer += '"';
+      break;
+    case UbuntuCloudOutputFormat::Tsv:
+      for (char character : value) {
+        switch (character) {
+          case '\t':
+            this->_buffer += "\\t";
+            break;
+          case '\n':
+            this->_buffer += "\\n";
+            break;
+          case '\r':
+            this->_buffer += "\\r";
+            break;
+          case '\\':
+            this->_buffer += "\\\\";
+            break;
+          default:
+            this->_buffer += character;
+        }
+      }
+      break;
+    default:
+      this->_buffer += value;
+  }
+}
+
+void UbuntuCloudRecordWriter::flush(bool force) {
+  if (this->_buffer.empty() || (!force && this->_buffer.size() < flush_threshold)) {
+    return;
+  }
+  this->_output.write(this->_buffer.data(), static_cast<std::streamsize>(this->_buffer.size()));
+  this->_buffer.clear();  // Keeps the capacity for the next records
+}
+
+void UbuntuCloudRecordWriter::field(std::string_view value) {
+  this->beginField();
+  this->appendEscaped(value);
+  this->_column++;
+}
+
+void UbuntuCloudRecordWriter::field(std::uint64_t value) {
+  this->beginField();
+  char digits[20];
+  auto [end, error] { std::to_chars(digits, digits + sizeof(digits), value) };
+  this->_buffer.append(digits, end);
+  this->_column++;
+}
+
+void UbuntuCloudRecordWriter::field(bool value) {
+  this->beginField();
+  this->_buffer += value ? "true" : "false";
+  this->_column++;
+}
+
+void UbuntuCloudRecordWriter::endRecord() {
+  bool json { this->_format == UbuntuCloudOutputFormat::Json || this->_format == UbuntuCloudOutputFormat::Jsonl };
+  while (this->_column < this->_columns.size()) {
+    this->beginField();
+    if (json) {
+      this->_buffer += "null";
+    }
+    this->_column++;
+  }
+  if (this->_format == UbuntuCloudOutputFormat::Json) {
+    this->_buffer += '}';  // The separator comes with the next record, if any
+  } else if (this->_format == UbuntuCloudOutputFormat::Jsonl) {
+    this->_buffer += "}\n";
+  } else {
+    this->_buffer += '\n';
+  }
+  this->_column = 0;
+  this->_records++;
+  this->flush(false);
+}
+
+void UbuntuCloudRecordWriter::append(std::string_view fragment, std::size_t records) {
+  this->flush(true);  // Keep the buffered records before the fragment
+  this->_output.write(fragment.data(), static_cast<std::streamsize>(fragment.size()));
+  this->_records += records;
+}
+
+void UbuntuCloudRecordWriter::finish() {
+  if (this->_format == UbuntuCloudOutputFormat::Json && !this->_fragment) {
+    this->_buffer += this->_records == 0 ? "]\n" : "\n]\n";
+  }
+  this->flush(true);
+  this->_output.flush();
+  this->_finished = true;
+}
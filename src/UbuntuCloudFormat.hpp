@@ -0,0 +1,159 @@
+/**
+ * @file UbuntuCloudFormat.hpp
+ * @brief Declares the machine-readable output formats and the buffered record writer behind them.
+ *
+ * Query results are tables: a fixed list of columns and one record per row. The writer renders them as a JSON
+ * array of objects, one JSON object per line (JSON Lines), or comma or tab separated values with a header line.
+ * Every field is appended to one string buffer that is reused for the whole table and handed to the stream in
+ * large writes, so a table of any size costs neither an allocation per field nor the formatting state of an
+ * iostream.
+ *
+ * The renderings are stable: columns always come in the documented order, CSV follows RFC 4180 quoting, and TSV
+ * escapes tabs, newlines and backslashes as "\t", "\n" and "\\".
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum UbuntuCloudOutputFormat
+ * @brief How query results are written.
+ */
+enum class UbuntuCloudOutputFormat {
+  Text,   ///< The human-readable layout.
+  Json,   ///< One JSON array of objects per query.
+  Jsonl,  ///< One JSON object per line.
+  Csv,    ///< Comma separated values, with a header line per query.
+  Tsv     ///< Tab separated values, with a header line per query.
+};
+
+/**
+ * @brief Parses the name of an output format.
+ * @param name One of "text", "json", "jsonl", "csv" or "tsv".
+ * @return std::optional<UbuntuCloudOutputFormat> The format, or std::nullopt for an unknown name.
+ */
+std::optional<UbuntuCloudOutputFormat> parseOutputFormat(std::string_view name);
+
+/**
+ * @brief Returns the name parseOutputFormat() reads back.
+ * @param format The format.
+ * @return const char* The name, e.g. "jsonl".
+ */
+const char* outputFormatName(UbuntuCloudOutputFormat format);
+
+/**
+ * @class UbuntuCloudRecordWriter
+ * @brief Writes one table in a machine-readable format through a reusable buffer.
+ *
+ * Fields are given in column order, each record ended with endRecord(). The table is complete once finish() is
+ * called, or the writer is destroyed.
+ *
+ * A large table can be rendered in parallel: each thread renders a run of records with a fragment writer, which
+ * writes neither header nor closing bracket, and the fragments are appended in order to the writer of the table.
+ */
+class UbuntuCloudRecordWriter {
+  private:
+    /// Buffer size at which the buffered text is handed to the stream.
+    static constexpr std::size_t flush_threshold { 64 * 1024 };
+
+    /// Stream receiving the table.
+    std::ostream& _output;
+    /// The rendering.
+    UbuntuCloudOutputFormat _format;
+    /// Column names, string literals that outlive the writer.
+    std::vector<std::string_view> _columns;
+    /// Text not yet handed to the stream.
+    std::string _buffer;
+    /// Index of the next field in the current record.
+    std::size_t _column;
+    /// Number of records ended so far.
+    std::size_t _records;
+    /// Whether finish() was called.
+    bool _finished;
+    /// Whether the writer renders a fragment, without header nor closing bracket.
+    bool _fragment;
+
+    /**
+     * @brief Appends the separator and, for JSON, the key that precede the next field.
+     */
+    void beginField();
+
+    /**
+     * @brief Appends a string field, escaped for the format.
+     * @param value The value.
+     */
+    void appendEscaped(std::string_view value);
+
+    /**
+     * @brief Hands the buffer to the stream once it is large enough, or unconditionally.
+     * @param force Whether to write a partially filled buffer.
+     */
+    void flush(bool force);
+
+  public:
+    /**
+     * @brief Starts a table and writes its header, if the format has one.
+     * @param output Stream receiving the table.
+     * @param format The rendering, any format but Text.
+     * @param columns The column names, in field order. They must be string literals or otherwise outlive the writer.
+     */
+    UbuntuCloudRecordWriter(std::ostream& output, UbuntuCloudOutputFormat format, std::vector<std::string_view> columns);
+
+    /**
+     * @brief Starts a fragment of a table, records that append() adds to the writer of the table.
+     * @param output Stream receiving the fragment.
+     * @param format The rendering, the one of the table.
+     * @param columns The column names, the ones of the table.
+     * @param first_record Number of records of the table before this fragment, 0 for the first fragment.
+     */
+    UbuntuCloudRecordWriter(std::ostream& output, UbuntuCloudOutputFormat format, std::vector<std::string_view> columns, std::size_t first_record);
+
+    /**
+     * @brief Completes the table, unless finish() already did.
+     */
+    ~UbuntuCloudRecordWriter();
+
+    UbuntuCloudRecordWriter(const UbuntuCloudRecordWriter&)            = delete;
+    UbuntuCloudRecordWriter& operator=(const UbuntuCloudRecordWriter&) = delete;
+
+    /**
+     * @brief Appends a string field.
+     * @param value The value.
+     */
+    void field(std::string_view value);
+
+    /**
+     * @brief Appends an integer field, a JSON number.
+     * @param value The value.
+     */
+    void field(std::uint64_t value);
+
+    /**
+     * @brief Appends a boolean field, a JSON boolean and "true" or "false" elsewhere.
+     * @param value The value.
+     */
+    void field(bool value);
+
+    /**
+     * @brief Ends the current record. Missing trailing fields are written empty, or as null in JSON.
+     */
+    void endRecord();
+
+    /**
+     * @brief Appends records rendered by a fragment writer, in table order.
+     * @param fragment The text of the fragment, complete with its finish().
+     * @param records Number of records in the fragment.
+     */
+    void append(std::string_view fragment, std::size_t records);
+
+    /**
+     * @brief Completes the table, or fragment, and writes everything still buffered.
+     */
+    void finish();
+};
@@ -7,14 +7,22 @@
  * - Display a list of supported Ubuntu releases and their architectures.
  * - Print information about the current Long Term Support (LTS) release.
  * - Retrieve and display the SHA256 checksum for a specific Ubuntu release.
+ * - Answer general queries over the catalog (UbuntuCloudQuery) as aligned columns.
+ * - Write the same results as JSON, JSON Lines, CSV or TSV tables through UbuntuCloudRecordWriter.
  * - Show command-line usage instructions.
  *
  * The functions expect a valid, initialized `UbuntuCloudInterface` instance and handle
  * common output formatting, including structured indentation, table layouts, and console-friendly spacing.
  *
- * @note Functions in this file assume ownership of the provided `UbuntuCloudInterface` pointer via `std::unique_ptr` and move semantics.
+ * @note Functions in this file only borrow the provided `UbuntuCloudInterface`, so one loaded catalog can answer a whole batch of queries.
  */
 
+#include "UbuntuCloudQuery.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <string_view>
+
 /// Base indentation level for all formatted output.
 constexpr static int base_indentation { 1 };
 
@@ -30,23 +38,23 @@ std::string indentation(int indentation_level) {
   return std::string(2 * (indentation_level + base_indentation), ' ');
 }
 
-int printSupportedReleases(std::unique_ptr<UbuntuCloudInterface> fetcher) {
-  std::vector<UbuntuRelease> releases { fetcher->getSupportedReleases() };
+int printSupportedReleases(const UbuntuCloudInterface& fetcher, std::ostream& output) {
+  std::vector<UbuntuRelease> releases { fetcher.getSupportedReleases() };
   // Call function with RVO in mind to avoid copies, guaranteed to be sorted (with non-LTS versions first).
   if (releases.empty()) {
     return 1;
   }
   bool LTS { false };  // Boolean to track if we are in the LTS versions.
   // Aesthetic newline.
-  std::cout << '\n';
-  std::cout << indentation(0) << "Supported Ubuntu releases:\n";
-  std::cout << indentation(1) << "Non-LTS:\n";
+  output << '\n';
+  output << indentation(0) << "Supported Ubuntu releases:\n";
+  output << indentation(1) << "Non-LTS:\n";
   for (auto& [release_name, archs, version] : releases) {
     // Structured binding to avoid repetitive struct member access.
     if (!LTS && release_name.find("LTS") != std::string::npos) {
       // Because of sorted output, when we find the first LTS the rest of releases are LTS.
       LTS = true;
-      std::cout << indentation(1) << "LTS:\n";
+      output << indentation(1) << "LTS:\n";
     }
     if (LTS) {
       // Remove LTS from the title as we know it is an LTS version from the boolean (aesthetics).
@@ -55,58 +63,277 @@ int printSupportedReleases(std::unique_ptr<UbuntuCloudInterface> fetcher) {
         release_name.erase(pos, 4);
       }
     }
-    std::cout << indentation(2) << release_name << " : ";
+    output << indentation(2) << release_name << " : ";
     for (const std::string& arch : archs) {
       // Print supported architectures.
-      std::cout << arch << " ";
+      output << arch << " ";
     }
-    std::cout << "\n";  // Aesthetic newline.
+    output << "\n";  // Aesthetic newline.
   }
   return 0;
 }
 
-int printCurrentLTSRelease(std::unique_ptr<UbuntuCloudInterface> fetcher) {
-  std::optional<UbuntuRelease> currentLTS { fetcher->getCurrentLTS() };
+int printCurrentLTSRelease(const UbuntuCloudInterface& fetcher, std::ostream& output) {
+  std::optional<UbuntuRelease> currentLTS { fetcher.getCurrentLTS() };
   if (!currentLTS) {
     // If optional is empty, no LTS release was found in data.
     return 1;
   }
 
-  std::cout << '\n';
+  output << '\n';
   // Aesthetic newline.
-  std::cout << indentation(0) << "Current LTS version:";
-  std::cout << indentation(0) << currentLTS->release_name << "\n\n";
+  output << indentation(0) << "Current LTS version:";
+  output << indentation(0) << currentLTS->release_name << "\n\n";
 
-  std::cout << indentation(1) << std::left  // left-align columns.
-            << std::setw(15) << "Architecture"
-            << " : " << std::setw(10) << "Version" << '\n';
+  output << indentation(1) << std::left  // left-align columns.
+         << std::setw(15) << "Architecture"
+         << " : " << std::setw(10) << "Version" << '\n';
 
-  std::cout << indentation(1) << std::string(30, '-') << '\n';  // separator.
+  output << indentation(1) << std::string(30, '-') << '\n';  // separator.
 
   size_t arch_size { currentLTS->architectures.size() };
   for (size_t arch = 0; arch < arch_size; arch++) {
     // Printing each version with its own architecture.
-    std::cout << indentation(1) << std::left << std::setw(table_width_left) << currentLTS->architectures.at(arch) << " : "
-              << std::setw(table_width_right) << currentLTS->latest_versions.at(arch) << '\n';
+    output << indentation(1) << std::left << std::setw(table_width_left) << currentLTS->architectures.at(arch) << " : "
+           << std::setw(table_width_right) << currentLTS->latest_versions.at(arch) << '\n';
   }
   // Aesthetic newline.
-  std::cout << "\n";
+  output << "\n";
   return 0;
 }
 
-int printReleaseSHA256(std::unique_ptr<UbuntuCloudInterface> fetcher, const std::string& version) {
-  std::optional<std::string> releaseSha256 { fetcher->getSha256ForRelease(version) };
+int printReleaseSHA256(const UbuntuCloudInterface& fetcher, const std::string& version, std::ostream& output, std::ostream& errors) {
+  std::optional<std::string> releaseSha256 { fetcher.getSha256ForRelease(version) };
   if (!releaseSha256) {
-    std::cerr << "The release was not found";
+    errors << "The release was not found\n";
     return 1;
   }
-  std::cout << '\n'
-            << indentation(0) << "The SHA256 of disk1.img in the most recent version of Ubuntu " << version << " is:\n"
-            << indentation(0) << ">" << indentation(1) << *releaseSha256 << '\n';
+  output << '\n'
+         << indentation(0) << "The SHA256 of disk1.img in the most recent version of Ubuntu " << version << " is:\n"
+         << indentation(0) << ">" << indentation(1) << *releaseSha256 << '\n';
+
+  return 0;
+}
+
+int writeSupportedReleases(const UbuntuCloudInterface& fetcher, UbuntuCloudOutputFormat format, std::ostream& output) {
+  std::vector<UbuntuRelease> releases { fetcher.getSupportedReleases() };
+  if (releases.empty()) {
+    return 1;
+  }
+  UbuntuCloudRecordWriter writer(output, format, { "release", "lts", "arch" });
+  for (const auto& [release_name, archs, version] : releases) {
+    // The title is kept whole, it is what --sha256 accepts back
+    bool lts { release_name.find("LTS") != std::string::npos };
+    for (const std::string& arch : archs) {
+      writer.field(release_name);
+      writer.field(lts);
+      writer.field(arch);
+      writer.endRecord();
+    }
+  }
+  writer.finish();
+  return 0;
+}
+
+int writeCurrentLTSRelease(const UbuntuCloudInterface& fetcher, UbuntuCloudOutputFormat format, std::ostream& output) {
+  std::optional<UbuntuRelease> currentLTS { fetcher.getCurrentLTS() };
+  if (!currentLTS) {
+    return 1;
+  }
+  UbuntuCloudRecordWriter writer(output, format, { "release", "arch", "version" });
+  size_t                  arch_size { currentLTS->architectures.size() };
+  for (size_t arch = 0; arch < arch_size; arch++) {
+    writer.field(currentLTS->release_name);
+    writer.field(currentLTS->architectures.at(arch));
+    writer.field(currentLTS->latest_versions.at(arch));
+    writer.endRecord();
+  }
+  writer.finish();
+  return 0;
+}
+
+int writeReleaseSHA256(const UbuntuCloudInterface& fetcher, const std::string& version, UbuntuCloudOutputFormat format, std::ostream& output,
+                       std::ostream& errors) {
+  std::optional<std::string> releaseSha256 { fetcher.getSha256ForRelease(version) };
+  if (!releaseSha256) {
+    errors << "The release was not found\n";
+    return 1;
+  }
+  UbuntuCloudRecordWriter writer(output, format, { "release", "sha256" });
+  writer.field(version);
+  writer.field(*releaseSha256);
+  writer.endRecord();
+  writer.finish();
+  return 0;
+}
+
+int printQuery(const UbuntuCloudInterface& fetcher, const std::string& query_text, std::ostream& output, std::ostream& errors) {
+  std::string                     error {};
+  std::optional<UbuntuCloudQuery> query { parseQuery(query_text, error) };
+  if (!query) {
+    errors << error << "\n";
+    return 1;
+  }
+  const UbuntuCloudCatalog&          catalog { fetcher.getCatalog() };
+  std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, *query) };
+  if (matches.empty()) {
+    errors << "Nothing matches the query\n";
+    return 1;
+  }
+  std::vector<UbuntuCloudQueryField>    fields { queryFields(*query) };
+  std::vector<std::vector<std::string>> rows {};
+  std::vector<size_t>                   widths {};
+  rows.reserve(matches.size());
+  for (UbuntuCloudQueryField field : fields) {
+    widths.push_back(queryFieldName(field).size());
+  }
+  for (const UbuntuCloudQueryMatch& match : matches) {
+    std::vector<std::string>& row { rows.emplace_back() };
+    for (size_t column = 0; column < fields.size(); column++) {
+      row.push_back(queryFieldText(catalog, match, fields.at(column)));
+      widths.at(column) = std::max(widths.at(column), row.back().size());
+    }
+  }
 
+  output << '\n';
+  output << indentation(0) << matches.size() << (matches.size() == 1 ? " match:\n" : " matches:\n");
+  // Every column but the last is padded to its widest value, so lines carry no trailing blanks
+  auto print_row = [&](const auto& row) {
+    output << indentation(1) << std::left;
+    for (size_t column = 0; column + 1 < fields.size(); column++) {
+      output << std::setw(static_cast<int>(widths.at(column) + 2)) << row.at(column);
+    }
+    output << row.back() << '\n';
+  };
+  std::vector<std::string_view> header {};
+  for (UbuntuCloudQueryField field : fields) {
+    header.push_back(queryFieldName(field));
+  }
+  print_row(header);
+  for (const std::vector<std::string>& row : rows) {
+    print_row(row);
+  }
   return 0;
 }
 
+int writeQuery(const UbuntuCloudInterface& fetcher, const std::string& query_text, UbuntuCloudOutputFormat format, std::ostream& output,
+               std::ostream& errors) {
+  std::string                     error {};
+  std::optional<UbuntuCloudQuery> query { parseQuery(query_text, error) };
+  if (!query) {
+    errors << error << "\n";
+    return 1;
+  }
+  const UbuntuCloudCatalog&          catalog { fetcher.getCatalog() };
+  std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, *query) };
+  if (matches.empty()) {
+    errors << "Nothing matches the query\n";
+    return 1;
+  }
+  std::vector<UbuntuCloudQueryField> fields { queryFields(*query) };
+  std::vector<std::string_view>      columns {};
+  for (UbuntuCloudQueryField field : fields) {
+    columns.push_back(queryFieldName(field));
+  }
+  UbuntuCloudRecordWriter writer(output, format, std::move(columns));
+  writeQueryMatches(catalog, fields, matches, writer);
+  return 0;
+}
+
+bool isQueryOption(const std::string& option) {
+  return option == "--supported-releases" || option == "--lts-version" || option == "--sha256" || option == "--query";
+}
+
+bool queryRequiresArgument(const std::string& option) {
+  return option == "--sha256" || option == "--query";
+}
+
+std::optional<UbuntuCloudRequest> parseRequestLine(const std::string& line, std::string& error, UbuntuCloudOutputFormat format) {
+  error.clear();
+  size_t begin { line.find_first_not_of(" \t\r") };
+  if (begin == std::string::npos || line.at(begin) == '#') {
+    return std::nullopt;  // Blank line or comment, skipped without error
+  }
+  size_t end { line.find_last_not_of(" \t\r") };
+  size_t option_end { std::min(line.find_first_of(" \t", begin), end + 1) };
+
+  UbuntuCloudRequest request { line.substr(begin, option_end - begin), "", format };
+  if (request.option.rfind("--", 0) != 0) {
+    request.option.insert(0, "--");  // Dashes are optional in batch input
+  }
+  if (request.option == "--format") {
+    // "--format FORMAT" prefixes the query it applies to
+    size_t                                 format_begin { line.find_first_not_of(" \t", option_end) };
+    size_t                                 format_end { std::min(line.find_first_of(" \t", format_begin), end + 1) };
+    std::optional<UbuntuCloudOutputFormat> line_format { std::nullopt };
+    if (format_begin != std::string::npos && format_begin <= end) {
+      line_format = parseOutputFormat(std::string_view(line).substr(format_begin, format_end - format_begin));
+    }
+    if (!line_format) {
+      error = "Invalid format, use text, json, jsonl, csv or tsv";
+      return std::nullopt;
+    }
+    std::optional<UbuntuCloudRequest> formatted { parseRequestLine(line.substr(format_end), error, *line_format) };
+    if (!formatted && error.empty()) {
+      error = "--format must be followed by a query";
+    }
+    return formatted;
+  }
+  size_t argument_begin { line.find_first_not_of(" \t", option_end) };
+  if (argument_begin != std::string::npos && argument_begin <= end) {
+    request.argument = line.substr(argument_begin, end - argument_begin + 1);
+  }
+  if (!isQueryOption(request.option)) {
+    error = "Unknown option: " + request.option;
+    return std::nullopt;
+  }
+  if (queryRequiresArgument(request.option) && request.argument.empty()) {
+    error = "This option requires an additional argument: " + request.option;
+    return std::nullopt;
+  }
+  if (request.option == "--query" && !parseQuery(request.argument, error)) {
+    return std::nullopt;  // Rejected before the catalog is touched, like an unknown option
+  }
+  return request;
+}
+
+int runRequest(const UbuntuCloudInterface& fetcher, const UbuntuCloudRequest& request, std::ostream& output, std::ostream& errors) {
+  int return_code { 1 };
+  if (request.format != UbuntuCloudOutputFormat::Text) {
+    // Tables for other programs, without the blank lines that separate human-readable answers
+    if (request.option == "--supported-releases") {
+      return_code = writeSupportedReleases(fetcher, request.format, output);
+      if (return_code == 1) {
+        errors << "No supported Ubuntu releases were found.\n";
+      }
+    } else if (request.option == "--lts-version") {
+      return_code = writeCurrentLTSRelease(fetcher, request.format, output);
+    } else if (request.option == "--sha256") {
+      return_code = writeReleaseSHA256(fetcher, request.argument, request.format, output, errors);
+    } else if (request.option == "--query") {
+      return_code = writeQuery(fetcher, request.argument, request.format, output, errors);
+    }
+    output.flush();
+    return return_code;
+  }
+  if (request.option == "--supported-releases") {
+    return_code = printSupportedReleases(fetcher, output);
+    if (return_code == 1) {
+      errors << "No supported Ubuntu releases were found.\n";
+    }
+  } else if (request.option == "--lts-version") {
+    return_code = printCurrentLTSRelease(fetcher, output);
+  } else if (request.option == "--sha256") {
+    return_code = printReleaseSHA256(fetcher, request.argument, output, errors);
+  } else if (request.option == "--query") {
+    return_code = printQuery(fetcher, request.argument, output, errors);
+  }
+  // Aesthetics newline, and hand the result over before the next request is answered.
+  output << "\n";
+  output.flush();
+  return return_code;
+}
+
 void printHelp() {
   std::cout << '\n';
   std::cout << "Usage: ubuntu-version-fetcher [OPTIONS]\n"
@@ -118,6 +345,80 @@ void printHelp() {
                "                                          Examples:\n"
                "                                            ubuntu-version-fetcher --sha256 noble\n"
                "                                            ubuntu-version-fetcher --sha256 22.04\n"
-            << "  --help                                 Display this help and exit\n";
+            << "  --query FILTERS                        List the products, serials or items matching space-separated filters:\n"
+               "                                         release=, arch=, item= (comma-separated lists), supported=, lts= (true or\n"
+               "                                         false), serial=FROM..TO, latest, and fields= to pick the columns among product,\n"
+               "                                         release, title, arch, version, supported, lts, serial, item, sha256, path, size, url\n"
+               "                                          Example:\n"
+               "                                            ubuntu-version-fetcher --query 'arch=arm64 supported=true latest item=root.tar.xz'\n"
+            << "  --batch                                Read more queries from standard input, one per line, written as above\n"
+               "                                         (e.g. \"--sha256 noble\"). All queries share one download of the catalog\n"
+               "                                          Examples:\n"
+               "                                            ubuntu-version-fetcher --sha256 noble --sha256 jammy --lts-version\n"
+               "                                            printf 'sha256 noble\\nsha256 22.04 LTS\\n' | ubuntu-version-fetcher --batch\n"
+            << "  --format FORMAT                        Write the answers as text (default), json, jsonl, csv or tsv. Tables have the\n"
+               "                                         columns release,lts,arch (--supported-releases), release,arch,version\n"
+               "                                         (--lts-version), release,sha256 (--sha256) and the query fields (--query)\n"
+            << "  --help                                 Display this help and exit\n"
+            << "Download options:\n"
+            << "  --download RELEASE_TITLE/RELEASE       Download the disk1.img whose SHA256 --sha256 prints, in concurrent HTTP range\n"
+               "                                         requests, and check it against the catalog while it is written\n"
+            << "  --output FILE                          File to download to (default: the image's name on the mirror)\n"
+            << "  --connections COUNT                    Range requests, or --mirror files, in flight at once (default: 4)\n"
+            << "Verification options:\n"
+            << "  --verify-dir PATH                      Check every file under PATH against the SHA256 of the catalog items of the same\n"
+               "                                         name and list the files that do not match. Files are hashed in parallel\n"
+            << "  --export-manifest FILE                 Write the SHA256 and path of every item of every serial of the supported releases\n"
+               "                                         as a SHA256SUMS file, or with --format as a table with the columns product,\n"
+               "                                         release,arch,serial,item,sha256,size,path. - writes to standard output\n"
+               "                                          Example:\n"
+               "                                            ubuntu-version-fetcher --export-manifest SHA256SUMS && sha256sum -c SHA256SUMS\n"
+            << "  --threads COUNT                        Threads of --verify-dir and --export-manifest (default: one per hardware thread)\n"
+            << "Mirror options:\n"
+            << "  --mirror DIR                           Bring the local simplestreams mirror DIR up to date with the catalog: download the\n"
+               "                                         missing and stale items, verify them against their SHA256 and rewrite\n"
+               "                                         DIR/streams/v1. Interrupted files resume, unchanged ones are not read again\n"
+            << "  --mirror-query FILTERS                 Items to mirror, written as for --query (default: 'supported=true latest')\n"
+            << "  --max-rate BYTES                       Cap on the total download rate of --mirror, in bytes per second (default: none)\n"
+            << "Daemon options:\n"
+            << "  --serve                                Keep the catalog in memory and answer queries on a Unix domain socket,\n"
+               "                                         refreshing it in the background. Stop it with SIGINT or SIGTERM\n"
+            << "  --client                               Send the queries to a running --serve process instead of fetching the catalog\n"
+            << "  --socket PATH                          Socket of the daemon (default: daemon.sock in the cache directory)\n"
+            << "  --refresh SECONDS                      Time between two catalog refreshes of the daemon or of --watch (default: 3600)\n"
+            << "Watch options:\n"
+            << "  --watch                                Answer the queries, if any, then revalidate the catalog every --refresh seconds\n"
+               "                                         and print one line per change: new-serial, new-product, removed-product,\n"
+               "                                         unsupported, supported or new-lts. An unchanged catalog is not parsed again\n"
+            << "Stream options:\n"
+            << "  --stream STREAM[:CONTENT]              Add the product files of a stream to the catalog. STREAM is its directory on the mirror\n"
+               "                                         (releases, daily, minimal/releases, ...), CONTENT the end of the content ids\n"
+               "                                         (download, aws, ... or * for all). Can be repeated, all files are downloaded\n"
+               "                                         concurrently and merged (default: releases:download). A STREAM with a scheme is the URL of\n"
+               "                                         a stream on another mirror, e.g. http://127.0.0.1:8000/releases\n"
+            << "  --endpoint URL                         Add a mirror of https://cloud-images.ubuntu.com/. Every file is requested from\n"
+               "                                         --race mirrors at once, the first response wins and the other requests are cancelled.\n"
+               "                                         A file without a response after --hedge-delay gets one more request on the next\n"
+               "                                         mirror, and failed requests are retried with exponential backoff. Can be repeated\n"
+            << "  --race COUNT                           Mirrors each file is requested from at once (default: 2)\n"
+            << "  --hedge-delay MILLISECONDS             Wait for a response before a hedged request goes out (default: 1000)\n"
+            << "  --precompressed SUFFIX                 Request the pre-compressed copy of every file first (.gz, or .zst when supported),\n"
+               "                                         and the file itself from the mirrors without one. Responses are requested\n"
+               "                                         compressed either way, and decompressed while they download\n"
+            << "Statistics options:\n"
+            << "  --stats                                Print the timings of the run (DNS, connect, TLS, transfer, parse, index, queries),\n"
+               "                                         the bytes received and the peak memory as one JSON object on standard error\n"
+            << "  --stats-file FILE                      Write the same statistics as a Prometheus textfile\n"
+            << "Cache options:\n"
+            << "  --cache-dir DIR                        Directory of the on-disk catalog cache (default: ~/.cache/ubuntu-version-fetcher)\n"
+            << "  --max-age SECONDS                      Use the cached catalog without contacting the server while it is younger than\n"
+               "                                         SECONDS. Older entries are revalidated with a conditional request (default: 0)\n"
+            << "  --no-cache                             Always download the whole catalog\n"
+            << "  --snapshot FILE                        Binary catalog snapshot refreshed after every fetch\n"
+               "                                         (default: catalog.snapshot in the cache directory)\n"
+            << "  --transport-ttl SECONDS                Keep the resolved addresses and TLS sessions of the mirrors in the cache directory\n"
+               "                                         for this long, so the next runs skip the lookup and the full handshake.\n"
+               "                                         0 to not keep them (default: 300)\n"
+            << "  --offline                              Answer from the snapshot only, without network access\n";
   std::cout << '\n';
 }
@@ -11,12 +11,25 @@
  */
 #pragma once
 
+#include "UbuntuCloudFormat.hpp"
 #include "UbuntuCloudInterface.hpp"
 
 #include <iostream>
+#include <optional>
+#include <string>
 
 // This file is to clean up main.cpp by separating most of the I/O work.
 
+/**
+ * @struct UbuntuCloudRequest
+ * @brief One query to answer, as given on the command line or on a line of batch input.
+ */
+struct UbuntuCloudRequest {
+    std::string             option;     ///< The query option, e.g. "--sha256".
+    std::string             argument;   ///< The option's argument, empty for options without one.
+    UbuntuCloudOutputFormat format {};  ///< How the result is written, the human-readable layout by default.
+};
+
 /**
  * @brief Generates a string of whitespace for indentation.
  *
@@ -33,8 +46,8 @@ std::string indentation(int indentation_level);
  * The output is organized with non-LTS releases first, followed by LTS releases.
  * For each release, its name and supported architectures are displayed.
  *
- * @param fetcher Smart pointer to a UbuntuCloudInterface that provides release information.
- *                Ownership is transferred to this function, and the pointer will be invalidated after the call.
+ * @param fetcher A UbuntuCloudInterface that provides release information. It can serve any number of further queries.
+ * @param output Stream receiving the result, std::cout by default.
  * @return int Status code: 0 for success, 1 if no releases were found.
  *
  * @note Assumes the releases returned by fetcher->getSupportedReleases() are sorted
@@ -43,7 +56,7 @@ std::string indentation(int indentation_level);
  * @note Writes formatted output to std::cout on success.
  * @note Writes error message to std::cerr if release is not found.
  */
-int printSupportedReleases(std::unique_ptr<UbuntuCloudInterface> fetcher);
+int printSupportedReleases(const UbuntuCloudInterface& fetcher, std::ostream& output = std::cout);
 /**
  * @brief Prints information about the current Ubuntu LTS release.
  *
@@ -51,8 +64,8 @@ int printSupportedReleases(std::unique_ptr<UbuntuCloudInterface> fetcher);
  * interface and displays its name, supported architectures, and corresponding version
  * numbers in a formatted table.
  *
- * @param fetcher Smart pointer to a UbuntuCloudInterface that provides release information
- *                Ownership is transferred to this function, and the pointer will be invalidated after the call.
+ * @param fetcher A UbuntuCloudInterface that provides release information. It can serve any number of further queries.
+ * @param output Stream receiving the result, std::cout by default.
  * @return int Status code: 0 for success, 1 if no LTS release is found.
  *
  * @note The output is formatted as a table with architectures aligned to the left
@@ -61,22 +74,124 @@ int printSupportedReleases(std::unique_ptr<UbuntuCloudInterface> fetcher);
  * @note Writes formatted output to std::cout on success.
  * @note Writes error message to std::cerr if release is not found.
  */
-int printCurrentLTSRelease(std::unique_ptr<UbuntuCloudInterface> fetcher);
+int printCurrentLTSRelease(const UbuntuCloudInterface& fetcher, std::ostream& output = std::cout);
 /**
  * @brief Prints the SHA256 hash for a specified Ubuntu release version for amd64.
  *
  * Fetches and displays the SHA256 hash of disk1.img for the requested Ubuntu version.
  * The function queries the provided cloud interface to retrieve the hash information.
  *
- * @param fetcher Smart pointer to a UbuntuCloudInterface that provides release information.
- *                    Ownership is transferred to this function, and the pointer will be invalidated after the call.
+ * @param fetcher A UbuntuCloudInterface that provides release information. It can serve any number of further queries.
  * @param version The Ubuntu version string to query (e.g., "22.04" or "23.10")
+ * @param output Stream receiving the result, std::cout by default.
+ * @param errors Stream receiving the error message, std::cerr by default.
  * @return int Status code: 0 for success, 1 if the specified release was not found
  *
  * @note Writes formatted output to std::cout on success.
  * @note Writes error message to std::cerr if release is not found.
  */
-int printReleaseSHA256(std::unique_ptr<UbuntuCloudInterface> fetcher, const std::string& version);
+int printReleaseSHA256(const UbuntuCloudInterface& fetcher, const std::string& version, std::ostream& output = std::cout,
+                       std::ostream& errors = std::cerr);
+
+/**
+ * @brief Writes the supported releases as a table with the columns release, lts and arch, one record per architecture.
+ *
+ * @param fetcher A UbuntuCloudInterface that provides release information.
+ * @param format The rendering, any format but Text.
+ * @param output Stream receiving the table.
+ * @return int Status code: 0 for success, 1 if no releases were found (nothing is written then).
+ */
+int writeSupportedReleases(const UbuntuCloudInterface& fetcher, UbuntuCloudOutputFormat format, std::ostream& output);
+/**
+ * @brief Writes the current LTS release as a table with the columns release, arch and version, one record per architecture.
+ *
+ * @param fetcher A UbuntuCloudInterface that provides release information.
+ * @param format The rendering, any format but Text.
+ * @param output Stream receiving the table.
+ * @return int Status code: 0 for success, 1 if no LTS release is found (nothing is written then).
+ */
+int writeCurrentLTSRelease(const UbuntuCloudInterface& fetcher, UbuntuCloudOutputFormat format, std::ostream& output);
+/**
+ * @brief Writes the SHA256 of disk1.img for a release as a table with the columns release and sha256, with one record.
+ *
+ * @param fetcher A UbuntuCloudInterface that provides release information.
+ * @param version The Ubuntu version string to query (e.g., "22.04" or "noble").
+ * @param format The rendering, any format but Text.
+ * @param output Stream receiving the table.
+ * @param errors Stream receiving the error message.
+ * @return int Status code: 0 for success, 1 if the specified release was not found (nothing is written then).
+ */
+int writeReleaseSHA256(const UbuntuCloudInterface& fetcher, const std::string& version, UbuntuCloudOutputFormat format, std::ostream& output,
+                       std::ostream& errors);
+/**
+ * @brief Prints the rows matching a query as aligned columns under a header naming the fields.
+ *
+ * @param fetcher A UbuntuCloudInterface that provides the catalog.
+ * @param query_text The query, in the syntax of parseQuery().
+ * @param output Stream receiving the table.
+ * @param errors Stream receiving the error message.
+ * @return int Status code: 0 for success, 1 if the query is invalid or nothing matches (nothing is written then).
+ */
+int printQuery(const UbuntuCloudInterface& fetcher, const std::string& query_text, std::ostream& output, std::ostream& errors);
+/**
+ * @brief Writes the rows matching a query as a table whose columns are the fields of the query.
+ *
+ * @param fetcher A UbuntuCloudInterface that provides the catalog.
+ * @param query_text The query, in the syntax of parseQuery().
+ * @param format The rendering, any format but Text.
+ * @param output Stream receiving the table.
+ * @param errors Stream receiving the error message.
+ * @return int Status code: 0 for success, 1 if the query is invalid or nothing matches (nothing is written then).
+ */
+int writeQuery(const UbuntuCloudInterface& fetcher, const std::string& query_text, UbuntuCloudOutputFormat format, std::ostream& output,
+               std::ostream& errors);
+
+/**
+ * @brief Checks whether an option is one of the queries answered by runRequest().
+ *
+ * @param option The option, e.g. "--lts-version".
+ * @return bool True for --supported-releases, --lts-version, --sha256 and --query.
+ */
+bool isQueryOption(const std::string& option);
+
+/**
+ * @brief Checks whether a query option takes an argument.
+ *
+ * @param option The query option.
+ * @return bool True for --sha256 and --query.
+ */
+bool queryRequiresArgument(const std::string& option);
+
+/**
+ * @brief Parses one line of batch input into a request.
+ *
+ * A line holds one query written as on the command line, e.g. "--sha256 noble". The leading dashes are optional,
+ * and everything after the option is its argument, so release titles with spaces ("22.04 LTS") need no quoting.
+ * Blank lines and lines starting with '#' are skipped. A line may start with "--format FORMAT" to pick the output
+ * format of that query, e.g. "--format json --lts-version"; the daemon protocol sends the format this way.
+ *
+ * @param line The input line.
+ * @param[out] error Receives a description of the problem for an invalid line.
+ * @param format Output format of a line without a "--format" prefix.
+ * @return std::optional<UbuntuCloudRequest> The request, or std::nullopt for a skipped or invalid line (error is empty when skipped).
+ */
+std::optional<UbuntuCloudRequest> parseRequestLine(const std::string& line, std::string& error,
+                                                   UbuntuCloudOutputFormat format = UbuntuCloudOutputFormat::Text);
+
+/**
+ * @brief Answers one request with the matching print function, followed by a blank line.
+ *
+ * Requests for a machine-readable format are answered with the matching write function instead, without the blank line.
+ * Output is flushed at the end of each request, so results stream out while later requests are still being read.
+ *
+ * @param fetcher A UbuntuCloudInterface that provides release information.
+ * @param request The request to answer. Its option must satisfy isQueryOption().
+ * @param output Stream receiving the result, std::cout by default. The daemon mode passes a buffer per request.
+ * @param errors Stream receiving error messages, std::cerr by default.
+ * @return int Status code of the print function: 0 for success, 1 otherwise.
+ */
+int runRequest(const UbuntuCloudInterface& fetcher, const UbuntuCloudRequest& request, std::ostream& output = std::cout,
+               std::ostream& errors = std::cerr);
 /**
  * @brief Displays the help message with usage instructions for the ubuntu-version-fetcher tool.
  *
@@ -90,6 +205,9 @@ int printReleaseSHA256(std::unique_ptr<UbuntuCloudInterface> fetcher, const std:
  * - --lts-version: Show the current Ubuntu LTS version for each architecture.
  * - --sha256: Get the SHA256 hash for a specified Ubuntu release.
  * - --help: Display the help message.
+ * - --batch: Read further queries from standard input, one per line.
+ * - --cache-dir, --max-age, --no-cache: Control the on-disk catalog cache.
+ * - --snapshot, --offline: Control the binary snapshot and answer from it without network access.
  *
  */
 void printHelp();
\ No newline at end of file
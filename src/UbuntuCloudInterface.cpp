@@ -0,0 +1,110 @@
+/**
+ * @file UbuntuCloudInterface.cpp
+ * @brief Implementation of the lazy load and of the asynchronous queries shared by every UbuntuCloudInterface.
+ *
+ * The load runs on a thread started by std::async. Callbacks registered before it completes are queued and run by
+ * that thread; callbacks registered afterwards run on the caller's thread. The futures of the asynchronous queries
+ * are fulfilled by such callbacks, so waiting on one never costs a thread of its own.
+ */
+
+#include "UbuntuCloudInterface.hpp"
+
+#include <memory>
+
+void UbuntuCloudInterface::setLoaded(bool initialized) {
+  std::promise<bool> loaded {};
+  loaded.set_value(initialized);
+  std::lock_guard<std::mutex> lock(this->_loadMutex);
+  this->_loaded        = loaded.get_future().share();
+  this->_loadCompleted = true;
+  this->_loadResult    = initialized;
+}
+
+void UbuntuCloudInterface::waitForLoading() {
+  std::shared_future<bool> loaded {};
+  {
+    std::lock_guard<std::mutex> lock(this->_loadMutex);
+    loaded = this->_loaded;
+  }
+  if (loaded.valid()) {
+    loaded.wait();
+  }
+}
+
+std::shared_future<bool> UbuntuCloudInterface::startLoading() {
+  std::lock_guard<std::mutex> lock(this->_loadMutex);
+  if (this->_loaded.valid()) {
+    // Early return, loading or loaded already
+    return this->_loaded;
+  }
+  this->_loaded = std::async(std::launch::async, [this]() {
+                    bool                                   initialized { this->load() };
+                    std::vector<std::function<void(bool)>> callbacks {};
+                    {
+                      std::lock_guard<std::mutex> callbacks_lock(this->_loadMutex);
+                      this->_loadCompleted = true;
+                      this->_loadResult    = initialized;
+                      callbacks.swap(this->_loadCallbacks);
+                    }
+                    for (std::function<void(bool)>& callback : callbacks) {
+                      callback(initialized);
+                    }
+                    return initialized;
+                  }).share();
+  return this->_loaded;
+}
+
+void UbuntuCloudInterface::whenLoaded(std::function<void(bool)> callback) {
+  this->startLoading();
+  bool initialized { false };
+  {
+    std::lock_guard<std::mutex> lock(this->_loadMutex);
+    if (!this->_loadCompleted) {
+      this->_loadCallbacks.push_back(std::move(callback));  // The loading thread runs it
+      return;
+    }
+    // Not _loaded.get(), a callback already running on the loading thread may be the caller
+    initialized = this->_loadResult;
+  }
+  callback(initialized);
+}
+
+void UbuntuCloudInterface::getSupportedReleasesAsync(std::function<void(std::vector<UbuntuRelease>)> callback) {
+  this->whenLoaded([this, callback = std::move(callback)](bool initialized) {
+    callback(initialized ? this->getSupportedReleases() : std::vector<UbuntuRelease> {});
+  });
+}
+
+std::future<std::vector<UbuntuRelease>> UbuntuCloudInterface::getSupportedReleasesAsync() {
+  // Shared, std::function requires a copyable callback
+  auto                                    promise { std::make_shared<std::promise<std::vector<UbuntuRelease>>>() };
+  std::future<std::vector<UbuntuRelease>> result { promise->get_future() };
+  this->getSupportedReleasesAsync([promise](std::vector<UbuntuRelease> releases) { promise->set_value(std::move(releases)); });
+  return result;
+}
+
+void UbuntuCloudInterface::getCurrentLTSAsync(std::function<void(std::optional<UbuntuRelease>)> callback) {
+  this->whenLoaded([this, callback = std::move(callback)](bool initialized) {
+    callback(initialized ? this->getCurrentLTS() : std::nullopt);
+  });
+}
+
+std::future<std::optional<UbuntuRelease>> UbuntuCloudInterface::getCurrentLTSAsync() {
+  auto                                      promise { std::make_shared<std::promise<std::optional<UbuntuRelease>>>() };
+  std::future<std::optional<UbuntuRelease>> result { promise->get_future() };
+  this->getCurrentLTSAsync([promise](std::optional<UbuntuRelease> release) { promise->set_value(std::move(release)); });
+  return result;
+}
+
+void UbuntuCloudInterface::getSha256ForReleaseAsync(const std::string& release, std::function<void(std::optional<std::string>)> callback) {
+  this->whenLoaded([this, release, callback = std::move(callback)](bool initialized) {
+    callback(initialized ? this->getSha256ForRelease(release) : std::nullopt);
+  });
+}
+
+std::future<std::optional<std::string>> UbuntuCloudInterface::getSha256ForReleaseAsync(const std::string& release) {
+  auto                                    promise { std::make_shared<std::promise<std::optional<std::string>>>() };
+  std::future<std::optional<std::string>> result { promise->get_future() };
+  this->getSha256ForReleaseAsync(release, [promise](std::optional<std::string> sha256) { promise->set_value(std::move(sha256)); });
+  return result;
+}
@@ -10,18 +10,28 @@
  *
  * Classes implementing this interface are expected to support release enumeration, LTS detection,
  * checksum retrieval for cloud images, and a basic initialization check.
+ *
+ * An implementation may also be created unloaded (see UbuntuCloudLoading), so that an embedder starts the load on a
+ * background thread with startLoading() and overlaps it with its own initialization. The asynchronous query variants
+ * wait for the load, starting it if needed, and deliver their result through a std::future or a callback.
  */
 
 #pragma once
 
 #include <nlohmann/json.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
 
 using json = nlohmann::json;  ///< Alias to reduce verbosity when using nlohmann::json.
 
+class UbuntuCloudCatalog;
+
 /**
  * @struct UbuntuRelease
  * @brief Represents metadata for an Ubuntu release, including its name, supported architectures, and available versions.
@@ -49,17 +59,131 @@ struct UbuntuRelease {
      */
     bool operator>(const UbuntuRelease& other) { return release_name > other.release_name; }
 };
+/**
+ * @struct UbuntuCloudImage
+ * @brief Location and checksum of a published image file.
+ */
+struct UbuntuCloudImage {
+    std::string   url;      ///< Full URL of the file, the mirror root followed by the item path.
+    std::string   sha256;   ///< The sha256 published for the file.
+    std::uint64_t size {};  ///< Size in bytes as published, 0 if unknown.
+};
+
+/**
+ * @enum UbuntuCloudLoading
+ * @brief When an implementation loads its data.
+ */
+enum class UbuntuCloudLoading {
+  Eager,  ///< The constructor loads the data, the instance is ready once constructed.
+  Lazy    ///< Nothing is loaded until startLoading(), waitUntilLoaded() or an asynchronous query asks for it.
+};
+
 /**
  * @class UbuntuCloudInterface
  * @brief Abstract interface for fetching and querying Ubuntu cloud image metadata.
  */
 class UbuntuCloudInterface {
+  private:
+    /// Guards the load state below.
+    std::mutex _loadMutex;
+    /// Result of the load, valid once it has started.
+    std::shared_future<bool> _loaded;
+    /// Whether the load has completed, the callbacks below are then being run or done.
+    bool _loadCompleted {};
+    /// Result of the completed load, readable before _loaded becomes ready.
+    bool _loadResult {};
+    /// Callbacks waiting for the load, run by the loading thread once it completes.
+    std::vector<std::function<void(bool)>> _loadCallbacks;
+
+  protected:
+    /**
+     * @brief Loads the data of a lazy instance. Called once, on the loading thread started by startLoading().
+     * @return bool True if the instance is initialized afterwards.
+     */
+    virtual bool load() = 0;
+
+    /**
+     * @brief Records the result of a load done by the constructor, so that startLoading() does not load again.
+     * @param initialized The result of the load.
+     */
+    void setLoaded(bool initialized);
+
+    /**
+     * @brief Waits for a load in progress to complete.
+     * @note Destructors of implementations must call it, load() may not run once the derived object is gone.
+     */
+    void waitForLoading();
+
   public:
+    UbuntuCloudInterface() = default;
     /**
      * @brief Virtual destructor.
      */
     virtual ~UbuntuCloudInterface() = default;
 
+    UbuntuCloudInterface(const UbuntuCloudInterface&)            = delete;
+    UbuntuCloudInterface& operator=(const UbuntuCloudInterface&) = delete;
+
+    /**
+     * @brief Starts loading the data on a background thread, unless it is loading or loaded already.
+     *
+     * Network implementations need curl_global_init() to have been called before the load starts.
+     * @return std::shared_future<bool> Becomes ready with the value of isInitialized() once the load has completed.
+     */
+    std::shared_future<bool> startLoading();
+
+    /**
+     * @brief Starts the load if needed and waits for it.
+     * @return bool The value of isInitialized() once loaded.
+     */
+    bool waitUntilLoaded() { return this->startLoading().get(); }
+
+    /**
+     * @brief Runs a callback once the data is loaded, starting the load if needed.
+     *
+     * The callback runs on the loading thread, or right away on the calling thread if the load has completed.
+     * @param callback Receives the value of isInitialized().
+     */
+    void whenLoaded(std::function<void(bool)> callback);
+
+    /**
+     * @brief Asynchronous getSupportedReleases(), answered once the data is loaded.
+     * @param callback Receives the releases, empty if the load failed. Runs as described in whenLoaded().
+     */
+    void getSupportedReleasesAsync(std::function<void(std::vector<UbuntuRelease>)> callback);
+
+    /**
+     * @brief Asynchronous getSupportedReleases(), answered once the data is loaded.
+     * @return std::future<std::vector<UbuntuRelease>> The releases, empty if the load failed.
+     */
+    std::future<std::vector<UbuntuRelease>> getSupportedReleasesAsync();
+
+    /**
+     * @brief Asynchronous getCurrentLTS(), answered once the data is loaded.
+     * @param callback Receives the LTS release, std::nullopt if the load failed. Runs as described in whenLoaded().
+     */
+    void getCurrentLTSAsync(std::function<void(std::optional<UbuntuRelease>)> callback);
+
+    /**
+     * @brief Asynchronous getCurrentLTS(), answered once the data is loaded.
+     * @return std::future<std::optional<UbuntuRelease>> The LTS release, std::nullopt if the load failed.
+     */
+    std::future<std::optional<UbuntuRelease>> getCurrentLTSAsync();
+
+    /**
+     * @brief Asynchronous getSha256ForRelease(), answered once the data is loaded.
+     * @param release The name or title of the Ubuntu release to search for.
+     * @param callback Receives the checksum, std::nullopt if the load failed. Runs as described in whenLoaded().
+     */
+    void getSha256ForReleaseAsync(const std::string& release, std::function<void(std::optional<std::string>)> callback);
+
+    /**
+     * @brief Asynchronous getSha256ForRelease(), answered once the data is loaded.
+     * @param release The name or title of the Ubuntu release to search for.
+     * @return std::future<std::optional<std::string>> The checksum, std::nullopt if the load failed.
+     */
+    std::future<std::optional<std::string>> getSha256ForReleaseAsync(const std::string& release);
+
     /**
      * @brief Retrieves a list of all currently supported Ubuntu releases.
      *
@@ -82,10 +206,26 @@ class UbuntuCloudInterface {
      */
     virtual std::optional<std::string> getSha256ForRelease(const std::string& release) const = 0;
 
+    /**
+     * @brief Retrieves the location of the "disk1.img" whose checksum getSha256ForRelease() returns, if available.
+     *
+     * @param release The name or title of the Ubuntu release to search for.
+     * @return An optional UbuntuCloudImage with the URL, checksum and size of the file, or std::nullopt if not available.
+     */
+    virtual std::optional<UbuntuCloudImage> getDiskImageForRelease(const std::string& release) const = 0;
+
+    /**
+     * @brief Returns the indexed catalog the queries are answered from, e.g. to run a UbuntuCloudQuery on it.
+     *
+     * @return const UbuntuCloudCatalog& The catalog, empty until the implementation is initialized.
+     */
+    virtual const UbuntuCloudCatalog& getCatalog() const = 0;
+
     /**
      * @brief Indicates whether the implementation has been successfully initialized.
      *
-     * @return True if the fetcher has valid data and is ready; false otherwise.
+     * The synchronous queries above may only be called once this returns true, or once the load has completed.
+     * @return True if the fetcher has valid data and is ready; false otherwise, including while a lazy load is in progress.
      */
     virtual bool isInitialized() const = 0;
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+/**
+ * @file UbuntuCloudManifest.cpp
+ * @brief Implementation of the manifest export.
+ */
+
+#include "UbuntuCloudManifest.hpp"
+
+#include "UbuntuCloudFile.hpp"
+#include "UbuntuCloudWorkers.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/// Columns of the manifest in the machine-readable formats.
+static const std::vector<std::string_view> manifest_columns { "product", "release", "arch", "serial", "item", "sha256", "size", "path" };
+
+/// Items a run of products holds at least, unless the catalog is smaller: below this, threads cost more than they save.
+constexpr static std::size_t min_run_items { 4096 };
+
+/**
+ * @struct ManifestRun
+ * @brief Products rendered by one task, and its output.
+ */
+struct ManifestRun {
+    std::size_t first_product;  ///< First entry of the supported product list.
+    std::size_t last_product;   ///< One past the last entry.
+    std::size_t first_record;   ///< Items of the manifest before the run.
+    std::size_t records;        ///< Items of the run.
+    std::string text;           ///< The rendered run.
+};
+
+/**
+ * @brief Renders the items of a run of products.
+ * @param catalog The catalog.
+ * @param products The supported products.
+ * @param format The format.
+ * @param run The run, whose text is filled.
+ */
+static void renderRun(const UbuntuCloudCatalog& catalog, const std::vector<std::uint32_t>& products, UbuntuCloudOutputFormat format,
+                      ManifestRun& run) {
+  std::ostringstream                     stream {};
+  std::optional<UbuntuCloudRecordWriter> writer {};
+  if (format != UbuntuCloudOutputFormat::Text) {
+    writer.emplace(stream, format, manifest_columns, run.first_record);
+  }
+  std::string lines {};
+  for (std::size_t idx = run.first_product; idx < run.last_product; idx++) {
+    std::uint32_t product { products[idx] };
+    auto [first_version, last_version] { catalog.versionRange(product) };
+    for (std::uint32_t version = first_version; version < last_version; version++) {
+      auto [first_item, last_item] { catalog.itemRange(version) };
+      for (std::uint32_t item = first_item; item < last_item; item++) {
+        std::string_view sha256 { catalog.itemSha256(item) };
+        if (sha256.empty()) {
+          continue;  // Not part of a checksum manifest
+        }
+        if (!writer) {
+          // The SHA256SUMS layout: digest, two blanks (text mode) and the path
+          lines.append(sha256).append("  ").append(catalog.itemPath(item)) += '\n';
+          continue;
+        }
+        writer->field(catalog.productName(product));
+        writer->field(catalog.productRelease(product));
+        writer->field(catalog.productArch(product));
+        writer->field(catalog.versionSerial(version));
+        writer->field(catalog.itemName(item));
+        writer->field(sha256);
+        writer->field(catalog.itemSize(item));
+        writer->field(catalog.itemPath(item));
+        writer->endRecord();
+      }
+    }
+  }
+  if (!writer) {
+    run.text = std::move(lines);
+    return;
+  }
+  writer->finish();
+  run.text = stream.str();
+}
+
+std::size_t writeManifest(const UbuntuCloudCatalog& catalog, UbuntuCloudOutputFormat format, std::size_t threads, std::ostream& output) {
+  // Count the items of each supported product first, so that every run knows where it starts in the manifest
+  std::vector<std::uint32_t> products {};
+  std::vector<std::size_t>   product_records {};
+  std::size_t                total_records { 0 };
+  for (std::uint32_t product = 0; product < catalog.productCount(); product++) {
+    if (!catalog.productSupported(product)) {
+      continue;
+    }
+    auto [first_version, last_version] { catalog.versionRange(product) };
+    if (first_version == last_version) {
+      continue;
+    }
+    // The items of the versions of a product are contiguous too
+    std::size_t   records { 0 };
+    std::uint32_t first_item { catalog.itemRange(first_version).first };
+    std::uint32_t last_item { catalog.itemRange(last_version - 1).second };
+    for (std::uint32_t item = first_item; item < last_item; item++) {
+      records += catalog.itemSha256(item).empty() ? 0 : 1;
+    }
+    if (records > 0) {
+      products.push_back(product);
+      product_records.push_back(records);
+      total_records += records;
+    }
+  }
+
+  threads = workerThreads(threads);
+  // A few runs per thread, so that a thread given large products does not hold back the others
+  std::size_t              run_items { std::max(total_records / (threads * 4) + 1, min_run_items) };
+  std::vector<ManifestRun> runs {};
+  for (std::size_t idx = 0; idx < products.size(); idx++) {
+    if (runs.empty() || runs.back().records >= run_items) {
+      std::size_t first_record { runs.empty() ? 0 : runs.back().first_record + runs.back().records };
+      runs.push_back({ idx, idx, first_record, 0, {} });
+    }
+    runs.back().last_product = idx + 1;
+    runs.back().records += product_records[idx];
+  }
+
+  runTasks(runs.size(), threads, [&catalog, &products, format, &runs](std::size_t idx) { renderRun(catalog, products, format, runs[idx]); });
+
+  if (format == UbuntuCloudOutputFormat::Text) {
+    for (const ManifestRun& run : runs) {
+      output.write(run.text.data(), static_cast<std::streamsize>(run.text.size()));
+    }
+    output.flush();
+    return total_records;
+  }
+  UbuntuCloudRecordWriter writer(output, format, manifest_columns);
+  for (const ManifestRun& run : runs) {
+    writer.append(run.text, run.records);
+  }
+  writer.finish();
+  return total_records;
+}
+
+int exportManifest(const UbuntuCloudCatalog& catalog, const std::filesystem::path& path, UbuntuCloudOutputFormat format, std::size_t threads,
+                   std::ostream& errors) {
+  if (path == "-") {
+    if (writeManifest(catalog, format, threads, std::cout) == 0) {
+      errors << "No supported item has a sha256\n";
+      return 1;
+    }
+    return 0;
+  }
+  // Replaced atomically, so a reader never sees a partial manifest. An empty one is abandoned
+  std::optional<std::size_t> records {};
+  bool                       written { replaceFile(path, [&](std::ostream& file) {
+    records = writeManifest(catalog, format, threads, file);
+    return *records > 0;
+  }) };
+  if (records && *records == 0) {
+    errors << "No supported item has a sha256\n";
+    return 1;
+  }
+  if (!written) {
+    errors << "Could not write " << path.string() << "\n";
+    return 1;
+  }
+  errors << "Wrote " << *records << " items to " << path.string() << "\n";
+  return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file UbuntuCloudManifest.hpp
+ * @brief Declares the export of a checksum manifest of every item of the supported products.
+ *
+ * The manifest lists, for every supported product, every serial and every item with a published sha256, the item's
+ * sha256 and path. As text it is a SHA256SUMS file that `sha256sum -c` checks from the root of a mirror; the other
+ * output formats give one record per item with its product, release, architecture, serial and size as well.
+ *
+ * The products are cut into runs of about the same number of items, rendered in parallel into separate buffers and
+ * written in catalog order, so the output does not depend on the number of threads.
+ */
+
+#pragma once
+
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudFormat.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+
+/**
+ * @brief Writes the manifest of a catalog.
+ * @param catalog The catalog.
+ * @param format Text for a SHA256SUMS file, or a table with the columns product, release, arch, serial, item,
+ * sha256, size and path.
+ * @param threads Number of rendering threads, 0 for one per hardware thread.
+ * @param output Stream receiving the manifest.
+ * @return std::size_t Number of items written.
+ */
+std::size_t writeManifest(const UbuntuCloudCatalog& catalog, UbuntuCloudOutputFormat format, std::size_t threads, std::ostream& output);
+
+/**
+ * @brief Writes the manifest of a catalog to a file, replaced atomically, or to standard output.
+ * @param catalog The catalog.
+ * @param path The file, "-" for standard output.
+ * @param format The format, see writeManifest().
+ * @param threads Number of rendering threads, 0 for one per hardware thread.
+ * @param errors Stream receiving the errors and, for a file, the number of items written.
+ * @return int 0 on success, 1 if the file cannot be written or the catalog has no supported item.
+ */
+int exportManifest(const UbuntuCloudCatalog& catalog, const std::filesystem::path& path, UbuntuCloudOutputFormat format, std::size_t threads,
+                   std::ostream& errors = std::cerr);
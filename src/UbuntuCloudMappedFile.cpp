@@ -0,0 +1,104 @@
+/**
+ * @file UbuntuCloudMappedFile.cpp
+ * @brief Implementation of the UbuntuCloudMappedFile class for POSIX and Windows.
+ */
+
+#include "UbuntuCloudMappedFile.hpp"
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+
+  #include <cerrno>
+  #include <cstring>
+#endif
+
+#ifdef _WIN32
+
+UbuntuCloudMappedFile::UbuntuCloudMappedFile(const std::filesystem::path& path, std::string& error):
+    _data(nullptr), _size(0), _mapping(nullptr) {
+  HANDLE file { CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr) };
+  if (file == INVALID_HANDLE_VALUE) {
+    error = "Could not open " + path.string();
+    return;
+  }
+  LARGE_INTEGER file_size {};
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    error = "Could not map empty or unreadable file " + path.string();
+    CloseHandle(file);
+    return;
+  }
+  // The mapping object keeps its own reference to the file, the file handle can be closed right away
+  this->_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (this->_mapping == nullptr) {
+    error = "Could not map " + path.string();
+    return;
+  }
+  this->_data = static_cast<const std::byte*>(MapViewOfFile(this->_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (this->_data == nullptr) {
+    error = "Could not map " + path.string();
+    CloseHandle(this->_mapping);
+    this->_mapping = nullptr;
+    return;
+  }
+  this->_size = static_cast<std::size_t>(file_size.QuadPart);
+}
+
+UbuntuCloudMappedFile::~UbuntuCloudMappedFile() {
+  if (this->_data != nullptr) {
+    UnmapViewOfFile(this->_data);
+  }
+  if (this->_mapping != nullptr) {
+    CloseHandle(this->_mapping);
+  }
+}
+
+void UbuntuCloudMappedFile::adviseSequential() const { }
+
+#else
+
+UbuntuCloudMappedFile::UbuntuCloudMappedFile(const std::filesystem::path& path, std::string& error): _data(nullptr), _size(0) {
+  int file { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+  if (file < 0) {
+    error = "Could not open " + path.string() + ": " + std::strerror(errno);
+    return;
+  }
+  struct stat file_status {};
+  if (::fstat(file, &file_status) != 0 || file_status.st_size == 0) {
+    error = "Could not map empty or unreadable file " + path.string();
+    ::close(file);
+    return;
+  }
+  void* mapping { ::mmap(nullptr, static_cast<std::size_t>(file_status.st_size), PROT_READ, MAP_SHARED, file, 0) };
+  // The mapping keeps its own reference to the file, the descriptor can be closed right away
+  ::close(file);
+  if (mapping == MAP_FAILED) {
+    error = "Could not map " + path.string() + ": " + std::strerror(errno);
+    return;
+  }
+  this->_data = static_cast<const std::byte*>(mapping);
+  this->_size = static_cast<std::size_t>(file_status.st_size);
+}
+
+UbuntuCloudMappedFile::~UbuntuCloudMappedFile() {
+  if (this->_data != nullptr) {
+    ::munmap(const_cast<std::byte*>(this->_data), this->_size);
+  }
+}
+
+void UbuntuCloudMappedFile::adviseSequential() const {
+  if (this->_data != nullptr) {
+    ::madvise(const_cast<std::byte*>(this->_data), this->_size, MADV_SEQUENTIAL);
+  }
+}
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file UbuntuCloudMappedFile.hpp
+ * @brief Declares UbuntuCloudMappedFile, a read-only memory mapping of a whole file.
+ *
+ * Mapping a file instead of reading it avoids the copy into process memory, and lets concurrent processes share
+ * the single copy held in the page cache. POSIX systems use mmap(), Windows uses a file mapping object.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+/**
+ * @class UbuntuCloudMappedFile
+ * @brief Owns a read-only mapping of a file for its whole lifetime.
+ */
+class UbuntuCloudMappedFile {
+  private:
+    /// First byte of the mapping, nullptr if nothing is mapped.
+    const std::byte* _data;
+    /// Size of the mapping in bytes.
+    std::size_t _size;
+#ifdef _WIN32
+    /// Handle of the file mapping object.
+    void* _mapping;
+#endif
+
+  public:
+    /**
+     * @brief Maps a file.
+     * @param path The file to map.
+     * @param[out] error Receives a description of the problem on failure.
+     * @note Check isMapped() afterwards. An empty file is reported as an error because it cannot be mapped.
+     */
+    UbuntuCloudMappedFile(const std::filesystem::path& path, std::string& error);
+
+    UbuntuCloudMappedFile(const UbuntuCloudMappedFile&)            = delete;
+    UbuntuCloudMappedFile& operator=(const UbuntuCloudMappedFile&) = delete;
+
+    ~UbuntuCloudMappedFile();
+
+    /**
+     * @brief Checks whether the file was mapped.
+     * @return bool True if data() points to the file contents.
+     */
+    bool isMapped() const { return this->_data != nullptr; }
+
+    /**
+     * @brief Returns the mapped bytes.
+     * @return const std::byte* First byte of the file. The mapping is page aligned.
+     */
+    const std::byte* data() const { return this->_data; }
+
+    /**
+     * @brief Returns the size of the mapping.
+     * @return std::size_t Size of the file in bytes.
+     */
+    std::size_t size() const { return this->_size; }
+
+    /**
+     * @brief Tells the kernel the mapping will be read once from start to end, so it reads ahead aggressively.
+     * @note A hint only, without effect on Windows.
+     */
+    void adviseSequential() const;
+};
@@ -0,0 +1,464 @@
+/**
+ * @file UbuntuCloudMirror.cpp
+ * @brief Implementation of the mirror sync.
+ *
+ * Every callback runs on the thread driving the multi handle, so the files need no locking. The product file is
+ * written with the items the catalog keeps: the aliases of a product are reduced to "lts" for the current LTS, and
+ * items carry their sha256, path and size.
+ */
+
+#include "UbuntuCloudMirror.hpp"
+
+#include "UbuntuCloudFile.hpp"
+#include "UbuntuCloudIO.hpp"
+#include "UbuntuCloudMappedFile.hpp"
+#include "UbuntuCloudParser.hpp"
+#include "UbuntuCloudVerify.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <system_error>
+#include <unordered_map>
+
+/**
+ * @brief Tells whether an item path stays inside the mirror directory once appended to it.
+ * @param path The item path, relative to the mirror root.
+ * @return bool False for absolute paths and paths with a ".." component.
+ */
+static bool isContainedPath(std::string_view path) {
+  if (path.empty() || path.front() == '/' || path.front() == '\\') {
+    return false;
+  }
+  for (std::size_t begin = 0; begin <= path.size();) {
+    std::size_t end { std::min(path.find_first_of("/\\", begin), path.size()) };
+    if (path.substr(begin, end - begin) == "..") {
+      return false;
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Formats the current time the way simplestreams dates its files.
+ * @return std::string The date, e.g. "Tue, 23 Apr 2024 12:00:00 +0000".
+ */
+static std::string simplestreamsDate() {
+  std::time_t now { std::time(nullptr) };
+  std::tm     utc {};
+#ifdef _WIN32
+  gmtime_s(&utc, &now);
+#else
+  gmtime_r(&now, &utc);
+#endif
+  char        text[64];
+  std::size_t length { std::strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S +0000", &utc) };
+  return std::string(text, length);
+}
+
+UbuntuCloudMirror::UbuntuCloudMirror(const UbuntuCloudCatalog& catalog, std::filesystem::path root, UbuntuCloudMirrorOptions options):
+    _catalog(catalog), _root(std::move(root)), _options(options), _files(), _bytesReceived(0) { }
+
+bool UbuntuCloudMirror::openPart(UbuntuCloudMirrorFile& file) {
+  std::filesystem::path part_path { file.path };
+  part_path += ".part";
+  std::error_code fs_error {};
+  std::filesystem::create_directories(file.path.parent_path(), fs_error);
+  std::uint64_t existing { std::filesystem::file_size(part_path, fs_error) };
+  if (fs_error || (file.size > 0 && existing > file.size)) {
+    existing = 0;  // Missing, or not a prefix of the file: start over
+  }
+  file.hash = UbuntuCloudSha256();
+  if (existing > 0) {
+    // The bytes of an interrupted transfer are hashed once, then the transfer resumes after them
+    std::string           map_error {};
+    UbuntuCloudMappedFile mapped_file(part_path, map_error);
+    if (mapped_file.isMapped()) {
+      mapped_file.adviseSequential();
+      file.hash.update(mapped_file.data(), mapped_file.size());
+    } else {
+      existing = 0;
+    }
+  }
+  file.part.close();
+  file.part.clear();
+  file.part.open(part_path, std::ios::binary | (existing > 0 ? std::ios::app : std::ios::trunc));
+  file.received = existing;
+  if (!file.part) {
+    file.error = "Could not create " + part_path.string();
+    return false;
+  }
+  return true;
+}
+
+bool UbuntuCloudMirror::truncatePart(UbuntuCloudMirrorFile& file) {
+  std::filesystem::path part_path { file.path };
+  part_path += ".part";
+  file.part.close();
+  file.part.clear();
+  file.part.open(part_path, std::ios::binary | std::ios::trunc);
+  file.hash     = UbuntuCloudSha256();
+  file.received = 0;
+  return static_cast<bool>(file.part);
+}
+
+bool UbuntuCloudMirror::startFile(CURLM* multi_handle, UbuntuCloudMirrorFile& file) {
+  if (!file.part.is_open() && !this->openPart(file)) {
+    return false;
+  }
+  file.handle = curl_easy_init();
+  if (!file.handle) {
+    file.error = "Could not create a curl handle";
+    return false;
+  }
+  file.attempts++;
+  file.response_checked = false;
+  curl_easy_setopt(file.handle, CURLOPT_URL, file.url.c_str());
+  curl_easy_setopt(file.handle, CURLOPT_WRITEFUNCTION, this->writeFile);  // Static member function
+  curl_easy_setopt(file.handle, CURLOPT_WRITEDATA, &file);                // Data pointer for writeFile
+  curl_easy_setopt(file.handle, CURLOPT_PRIVATE, &file);                  // Finds the file back when curl reports it done
+  curl_easy_setopt(file.handle, CURLOPT_FOLLOWLOCATION, 1L);              // follow HTTP 3xx redirects
+  curl_easy_setopt(file.handle, CURLOPT_FAILONERROR, 1L);                 // An error page is not image data
+  // Images take minutes, so instead of a total timeout a request fails once it has stalled for 30 seconds
+  curl_easy_setopt(file.handle, CURLOPT_CONNECTTIMEOUT, 30L);
+  curl_easy_setopt(file.handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(file.handle, CURLOPT_LOW_SPEED_TIME, 30L);
+  if (this->_options.max_bytes_per_second > 0) {
+    std::uint64_t share { std::max<std::uint64_t>(this->_options.max_bytes_per_second / std::max<std::size_t>(this->_options.connections, 1), 1) };
+    curl_easy_setopt(file.handle, CURLOPT_MAX_RECV_SPEED_LARGE, static_cast<curl_off_t>(share));
+  }
+  if (file.received > 0) {
+    curl_easy_setopt(file.handle, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(file.received));
+  }
+  curl_multi_add_handle(multi_handle, file.handle);
+  return true;
+}
+
+bool UbuntuCloudMirror::finishFile(UbuntuCloudMirrorFile& file) {
+  std::filesystem::path part_path { file.path };
+  part_path += ".part";
+  std::error_code fs_error {};
+  file.part.close();
+  if (!file.part) {
+    file.error = "Could not write " + part_path.string();
+    std::filesystem::remove(part_path, fs_error);
+    return false;
+  }
+  // The digest covers every byte written, in order, so the file is never read back
+  std::string digest { file.hash.hexDigest() };
+  if ((file.size > 0 && file.received != file.size) || digest != file.sha256) {
+    file.error = "SHA256 mismatch for " + file.url + ": expected " + file.sha256 + ", got " + digest;
+    std::filesystem::remove(part_path, fs_error);  // A resume would keep the bad bytes
+    return false;
+  }
+  std::filesystem::rename(part_path, file.path, fs_error);
+  if (fs_error) {
+    file.error = "Could not rename " + part_path.string() + ": " + fs_error.message();
+    std::filesystem::remove(part_path, fs_error);
+    return false;
+  }
+  file.verified = true;
+  return true;
+}
+
+bool UbuntuCloudMirror::transferFiles(std::string& error) {
+  CURLM* multi_handle { curl_multi_init() };
+  if (!multi_handle) {
+    error = "Could not create a curl multi handle";
+    return false;  // Early return without clean-up required
+  }
+  std::size_t connections { std::max<std::size_t>(this->_options.connections, 1) };
+  std::size_t next_file { 0 };
+  std::size_t running_files { 0 };
+  auto        start_files { [&]() {
+    while (running_files < connections && next_file < this->_files.size()) {
+      UbuntuCloudMirrorFile& file { this->_files[next_file++] };
+      if (!file.part.is_open() && !this->openPart(file)) {
+        continue;  // Reported through the file's error
+      }
+      if (file.size > 0 && file.received == file.size) {
+        // Complete before an earlier run could rename it, nothing left to request
+        if (this->finishFile(file) || !this->truncatePart(file)) {
+          continue;
+        }
+      }
+      if (this->startFile(multi_handle, file)) {
+        running_files++;
+      }
+    }
+  } };
+  start_files();
+  while (running_files > 0) {
+    int       running { 0 };
+    CURLMcode multi_code { curl_multi_perform(multi_handle, &running) };
+    if (multi_code == CURLM_OK && running > 0) {
+      multi_code = curl_multi_poll(multi_handle, nullptr, 0, 1000, nullptr);
+    }
+    if (multi_code != CURLM_OK) {
+      error = std::string("curl error: ") + curl_multi_strerror(multi_code);
+      break;
+    }
+    int      queued { 0 };
+    CURLMsg* message { nullptr };
+    while ((message = curl_multi_info_read(multi_handle, &queued)) != nullptr) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      UbuntuCloudMirrorFile* file { nullptr };
+      curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &file);
+      CURLcode result_code { message->data.result };
+      curl_multi_remove_handle(multi_handle, file->handle);
+      curl_easy_cleanup(file->handle);
+      file->handle = nullptr;
+      running_files--;
+      bool retry { false };
+      if (result_code == CURLE_RANGE_ERROR) {
+        // The server does not serve ranges, the file is requested again from the first byte
+        file->error = "Download of " + file->url + " failed: " + curl_easy_strerror(result_code);
+        retry       = this->truncatePart(*file);
+      } else if (result_code != CURLE_OK || !file->part) {
+        // The bytes received so far stay in the ".part" file, the retry resumes after them
+        file->error = "Download of " + file->url + " failed: " + (file->part ? curl_easy_strerror(result_code) : "write error");
+        retry       = static_cast<bool>(file->part);
+      } else if (file->size > 0 && file->received < file->size) {
+        file->error = "Download of " + file->url + " failed: incomplete file";
+        retry       = true;
+      } else if (!this->finishFile(*file)) {
+        retry = this->truncatePart(*file);  // The whole file again, from the first byte
+      }
+      if (retry && file->attempts < this->_options.attempts && this->startFile(multi_handle, *file)) {
+        running_files++;
+      } else if (!file->verified) {
+        file->part.close();
+      }
+    }
+    start_files();
+  }
+
+  // Clean-up functions whatever result the transfers have, including the ones an error left unfinished
+  for (UbuntuCloudMirrorFile& file : this->_files) {
+    if (file.handle) {
+      curl_multi_remove_handle(multi_handle, file.handle);
+      curl_easy_cleanup(file.handle);
+      file.handle = nullptr;
+    }
+    file.part.close();
+  }
+  curl_multi_cleanup(multi_handle);
+  return error.empty();
+}
+
+bool UbuntuCloudMirror::writeProducts(const std::vector<UbuntuCloudQueryMatch>& matches, const std::vector<bool>& verified, std::string& error) const {
+  using json = nlohmann::json;
+  const UbuntuCloudCatalog& catalog { this->_catalog };
+  std::string               updated { simplestreamsDate() };
+  json                      products = json::object();
+  for (std::size_t idx = 0; idx < matches.size(); idx++) {
+    if (!verified[idx]) {
+      continue;  // Only what is in place is published
+    }
+    const UbuntuCloudQueryMatch& match { matches[idx] };
+    std::string                  name { catalog.productName(match.product) };
+    if (!products.contains(name)) {
+      json product = {
+        {       "release",                      catalog.productRelease(match.product) },
+        { "release_title",                 catalog.productReleaseTitle(match.product) },
+        {          "arch",                         catalog.productArch(match.product) },
+        {       "version",                      catalog.productVersion(match.product) },
+        {     "supported",                    catalog.productSupported(match.product) },
+        {      "versions",                                             json::object() }
+      };
+      if (catalog.productLts(match.product)) {
+        product["aliases"] = "lts";
+      }
+      products[name] = std::move(product);
+    }
+    json& items { products[name]["versions"][std::string(catalog.versionSerial(match.version))]["items"] };
+    items[std::string(catalog.itemName(match.item))] = {
+      { "sha256", catalog.itemSha256(match.item) },
+      {   "path",   catalog.itemPath(match.item) },
+      {   "size",   catalog.itemSize(match.item) }
+    };
+  }
+  json product_file = {
+    { "content_id",       content_id },
+    {   "datatype", "image-downloads" },
+    {     "format",    "products:1.0" },
+    {    "updated",           updated },
+    {   "products",          products }
+  };
+  json product_names = json::array();
+  for (const auto& [name, product] : products.items()) {
+    product_names.push_back(name);
+  }
+  std::string relative_path { std::string("streams/v1/") + content_id + ".json" };
+  json        index = {
+    {   "format", "index:1.0" },
+    {  "updated",     updated },
+    {    "index",
+     { { content_id,
+          { { "datatype", "image-downloads" },
+            { "format", "products:1.0" },
+            { "path", relative_path },
+            { "products", product_names },
+            { "updated", updated } } } } }
+  };
+  // The product file first: the index never points at a product file older than itself
+  if (!replaceFile(this->_root / relative_path, product_file.dump(1) + "\n") ||
+      !replaceFile(this->_root / "streams" / "v1" / "index.json", index.dump(1) + "\n")) {
+    error = "Could not write the product files in " + (this->_root / "streams" / "v1").string();
+    return false;
+  }
+  return true;
+}
+
+bool UbuntuCloudMirror::run(const UbuntuCloudQuery& query, UbuntuCloudMirrorReport& report, std::string& error) {
+  const UbuntuCloudCatalog& catalog { this->_catalog };
+  report               = UbuntuCloudMirrorReport();
+  this->_bytesReceived = 0;
+  UbuntuCloudQuery item_query { query };
+  item_query.fields = { UbuntuCloudQueryField::Path };  // Item rows, whatever the filters
+  std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, item_query) };
+  matches.erase(std::remove_if(matches.begin(), matches.end(),
+                               [&catalog](const UbuntuCloudQueryMatch& match) {
+                                 return catalog.itemSha256(match.item).empty() || catalog.itemPath(match.item).empty();
+                               }),
+                matches.end());
+
+  std::error_code       fs_error {};
+  std::filesystem::path streams_directory { this->_root / "streams" / "v1" };
+  std::filesystem::create_directories(streams_directory, fs_error);
+  if (fs_error) {
+    error = "Could not create " + streams_directory.string() + ": " + fs_error.message();
+    return false;
+  }
+  // The product file of the last sync lists the files already verified, they are only checked for their size
+  std::unordered_map<std::string, std::string> listed {};
+  std::ifstream                                listed_file(streams_directory / (std::string(content_id) + ".json"), std::ios::binary);
+  std::vector<UbuntuProduct>                   listed_products {};
+  std::string                                  parse_error {};
+  if (listed_file && parseProductStream(listed_file, listed_products, parse_error)) {
+    for (const UbuntuProduct& product : listed_products) {
+      for (const UbuntuProductVersion& version : product.versions) {
+        for (const UbuntuProductItem& item : version.items) {
+          listed[std::string(item.path)] = item.sha256;
+        }
+      }
+    }
+  }
+
+  constexpr std::size_t                             no_file { SIZE_MAX };
+  std::vector<bool>                                 verified(matches.size(), false);
+  std::vector<std::size_t>                          match_files(matches.size(), no_file);
+  std::unordered_map<std::string_view, std::size_t> pending_paths {};  // Items sharing a file transfer it once
+  this->_files.clear();
+  this->_files.reserve(matches.size());
+  for (std::size_t idx = 0; idx < matches.size(); idx++) {
+    std::uint32_t    item { matches[idx].item };
+    std::string_view path { catalog.itemPath(item) };
+    if (!isContainedPath(path)) {
+      report.failures.push_back("Unsafe item path: " + std::string(path));
+      continue;
+    }
+    if (auto pending { pending_paths.find(path) }; pending != pending_paths.end()) {
+      match_files[idx] = pending->second;
+      continue;
+    }
+    std::string sha256 { catalog.itemSha256(item) };
+    std::transform(sha256.begin(), sha256.end(), sha256.begin(), [](unsigned char character) { return std::tolower(character); });
+    std::filesystem::path destination { this->_root / std::filesystem::path(std::string(path)) };
+    std::uint64_t         size { catalog.itemSize(item) };
+    std::uint64_t         local_size { std::filesystem::file_size(destination, fs_error) };
+    if (!fs_error && (size == 0 || local_size == size)) {
+      auto listed_entry { listed.find(std::string(path)) };
+      if (listed_entry != listed.end() && listed_entry->second == sha256) {
+        verified[idx] = true;
+        report.up_to_date++;
+        continue;
+      }
+      // In place but not listed, e.g. copied by hand or left by an interrupted sync: read once instead of downloaded
+      std::string digest {};
+      if (hashFile(destination, local_size, digest) && digest == sha256) {
+        verified[idx] = true;
+        report.adopted++;
+        continue;
+      }
+    }
+    pending_paths.emplace(path, this->_files.size());
+    match_files[idx] = this->_files.size();
+    UbuntuCloudMirrorFile& file { this->_files.emplace_back() };
+    file.mirror = this;
+    file.url    = std::string(catalog.productMirror(matches[idx].product)) + std::string(path);
+    file.path   = std::move(destination);
+    file.sha256 = std::move(sha256);
+    file.size   = size;
+  }
+
+  bool transferred { this->_files.empty() || this->transferFiles(error) };
+  for (std::size_t idx = 0; idx < matches.size(); idx++) {
+    if (match_files[idx] != no_file) {
+      verified[idx] = this->_files[match_files[idx]].verified;
+    }
+  }
+  for (const UbuntuCloudMirrorFile& file : this->_files) {
+    if (file.verified) {
+      report.downloaded++;
+    } else {
+      report.failures.push_back(file.error);
+    }
+  }
+  report.bytes_downloaded = this->_bytesReceived;
+  // Published even after a transfer error, so that the files verified so far count as up to date next time
+  return this->writeProducts(matches, verified, error) && transferred;
+}
+
+size_t UbuntuCloudMirror::writeFile(void* buffer_ptr, size_t size, size_t nmemb, void* file_ptr) {
+  UbuntuCloudMirrorFile* file { static_cast<UbuntuCloudMirrorFile*>(file_ptr) };
+  std::size_t            byte_count { size * nmemb };
+  if (!file->response_checked) {
+    file->response_checked = true;
+    long response_code { 0 };
+    curl_easy_getinfo(file->handle, CURLINFO_RESPONSE_CODE, &response_code);
+    if (file->received > 0 && response_code == 200 && !file->mirror->truncatePart(*file)) {
+      return 0;  // The server ignored the resume and sends the whole file, which could not be restarted
+    }
+  }
+  if (file->size > 0 && byte_count > file->size - file->received) {
+    return 0;  // More than the published size, the file changed upstream
+  }
+  if (!file->part.write(static_cast<const char*>(buffer_ptr), static_cast<std::streamsize>(byte_count))) {
+    return 0;
+  }
+  file->hash.update(buffer_ptr, byte_count);
+  file->received += byte_count;
+  file->mirror->_bytesReceived += byte_count;
+  // Return processed data size in bytes
+  return byte_count;
+}
+
+int syncMirror(const UbuntuCloudCatalog& catalog, const std::filesystem::path& root, const std::string& query_text,
+               const UbuntuCloudMirrorOptions& options, std::ostream& output, std::ostream& errors) {
+  std::string                     error {};
+  std::optional<UbuntuCloudQuery> query { parseQuery(query_text, error) };
+  if (!query) {
+    errors << error << "\n";
+    return 1;
+  }
+  UbuntuCloudMirror       mirror(catalog, root, options);
+  UbuntuCloudMirrorReport report {};
+  bool                    synced { mirror.run(*query, report, error) };
+  for (const std::string& failure : report.failures) {
+    errors << failure << "\n";
+  }
+  if (!synced) {
+    errors << error << "\n";
+  }
+  output << '\n'
+         << indentation(0) << "Mirror " << root.string() << ":\n"
+         << indentation(1) << report.downloaded << " downloaded (" << report.bytes_downloaded << " bytes), " << report.up_to_date
+         << " up to date, " << report.adopted << " verified in place, " << report.failures.size() << " failed\n";
+  return synced && report.failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file UbuntuCloudMirror.hpp
+ * @brief Declares the synchronization of a local simplestreams mirror with the catalog.
+ *
+ * The items selected by a query are laid out under the mirror directory at their path on the upstream mirror, and
+ * the product file the mirror publishes (streams/v1/com.ubuntu.cloud:mirror:download.json, listed by
+ * streams/v1/index.json) holds exactly the items whose file was verified against its sha256. That product file is
+ * also the state of the mirror: on the next run, an item it lists with the same sha256 and whose file has the
+ * published size is up to date without being read, so a sync costs a stat per item plus the transfer of the delta.
+ *
+ * Missing and stale files are downloaded over one curl multi handle, a bounded number at a time, into a ".part"
+ * file next to their destination. Bytes are hashed as they are written, and the file is renamed into place once
+ * its sha256 matches. An interrupted transfer, whether in this run or an earlier one, resumes from the end of its
+ * ".part" file. Files no longer selected are left in place, only the product file stops listing them.
+ */
+
+#pragma once
+
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudQuery.hpp"
+#include "UbuntuCloudSha256.hpp"
+
+#include <curl/curl.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @struct UbuntuCloudMirrorOptions
+ * @brief Tuning of a mirror sync.
+ */
+struct UbuntuCloudMirrorOptions {
+    std::size_t   connections { 4 };        ///< Files transferred at once.
+    std::uint64_t max_bytes_per_second {};  ///< Cap on the total download rate, split evenly between the transfers. 0 for no cap.
+    int           attempts { 3 };           ///< Tries per file before it is reported as failed.
+};
+
+class UbuntuCloudMirror;
+
+/**
+ * @struct UbuntuCloudMirrorFile
+ * @brief State of one file of the mirror that needs a transfer.
+ */
+struct UbuntuCloudMirrorFile {
+    UbuntuCloudMirror*    mirror {};            ///< The sync the file belongs to, for the write callback.
+    std::string           url;                  ///< Upstream URL of the file.
+    std::filesystem::path path;                 ///< Destination in the mirror directory.
+    std::string           sha256;               ///< The published sha256, in lowercase.
+    std::uint64_t         size {};              ///< The published size, 0 if unknown.
+    std::ofstream         part;                 ///< The ".part" file being written.
+    UbuntuCloudSha256     hash;                 ///< Hash of the bytes of the ".part" file.
+    std::uint64_t         received {};          ///< Bytes in the ".part" file.
+    bool                  response_checked {};  ///< Whether the response of the running request was checked for a resume.
+    int                   attempts {};          ///< Requests started for the file.
+    bool                  verified {};          ///< Whether the file is in place with the right sha256.
+    std::string           error;                ///< Why the last attempt failed.
+    CURL*                 handle {};            ///< The easy handle of the running request, null otherwise.
+};
+
+/**
+ * @struct UbuntuCloudMirrorReport
+ * @brief Outcome of a mirror sync.
+ */
+struct UbuntuCloudMirrorReport {
+    std::size_t              up_to_date {};        ///< Files the product file of the last sync already listed.
+    std::size_t              adopted {};           ///< Files found in place, unlisted, whose sha256 matched.
+    std::size_t              downloaded {};        ///< Files transferred and verified.
+    std::uint64_t            bytes_downloaded {};  ///< Bytes received for them, resumed bytes excluded.
+    std::vector<std::string> failures;             ///< One message per file that could not be mirrored.
+};
+
+/**
+ * @class UbuntuCloudMirror
+ * @brief Brings a mirror directory up to date with the items of a catalog selected by a query.
+ */
+class UbuntuCloudMirror {
+  private:
+    /// The catalog the items come from.
+    const UbuntuCloudCatalog& _catalog;
+    /// The mirror directory.
+    const std::filesystem::path _root;
+    /// Tuning of the transfers.
+    const UbuntuCloudMirrorOptions _options;
+    /// Files that need a transfer, never resized once transfers start: curl holds pointers to them.
+    std::vector<UbuntuCloudMirrorFile> _files;
+    /// Bytes received over the network in this run.
+    std::uint64_t _bytesReceived;
+
+    /**
+     * @brief Opens the ".part" file of a file and hashes the bytes it already holds, so the transfer resumes after them.
+     * @param file The file.
+     * @return bool False if the ".part" file could not be opened.
+     */
+    bool openPart(UbuntuCloudMirrorFile& file);
+
+    /**
+     * @brief Empties the ".part" file of a file, for a transfer from the first byte.
+     * @param file The file.
+     * @return bool False if the ".part" file could not be truncated.
+     */
+    bool truncatePart(UbuntuCloudMirrorFile& file);
+
+    /**
+     * @brief Starts, or resumes, the request of a file.
+     * @param multi_handle The multi handle driving the transfers.
+     * @param file The file.
+     * @return bool False if the ".part" file or the easy handle could not be created.
+     */
+    bool startFile(CURLM* multi_handle, UbuntuCloudMirrorFile& file);
+
+    /**
+     * @brief Checks a completed ".part" file and renames it into place.
+     * @param file The file, whose error is set on failure.
+     * @return bool True if the file is in place; false if it must be transferred again from the first byte.
+     */
+    bool finishFile(UbuntuCloudMirrorFile& file);
+
+    /**
+     * @brief Runs the transfers of every file.
+     * @param[out] error Receives a description of the problem if the transfers could not run at all.
+     * @return bool False on such a problem; files that failed are reported through their own error.
+     */
+    bool transferFiles(std::string& error);
+
+    /**
+     * @brief Writes the product file listing the verified items, and the stream index pointing to it.
+     * @param matches The selected items.
+     * @param verified Whether the file of each selected item is in place, in the order of matches.
+     * @param[out] error Receives a description of the problem on failure.
+     * @return bool True if both files were written.
+     */
+    bool writeProducts(const std::vector<UbuntuCloudQueryMatch>& matches, const std::vector<bool>& verified, std::string& error) const;
+
+  public:
+    /// Content id of the product file of the mirror.
+    static constexpr const char* content_id { "com.ubuntu.cloud:mirror:download" };
+
+    /**
+     * @brief Constructs a sync that has not started yet.
+     * @param catalog The catalog the items come from. It must outlive the sync.
+     * @param root The mirror directory, created if missing.
+     * @param options Tuning of the transfers.
+     */
+    UbuntuCloudMirror(const UbuntuCloudCatalog& catalog, std::filesystem::path root, UbuntuCloudMirrorOptions options = {});
+
+    UbuntuCloudMirror(const UbuntuCloudMirror&)            = delete;
+    UbuntuCloudMirror& operator=(const UbuntuCloudMirror&) = delete;
+
+    /**
+     * @brief Brings the mirror up to date with the items a query selects.
+     * @param query The query selecting the items. Its fields are ignored, every selected item is mirrored.
+     * @param[out] report Receives the counts and the failures.
+     * @param[out] error Receives a description of the problem if the sync could not run at all.
+     * @return bool False on such a problem. A sync that ran returns true even if some files failed.
+     */
+    bool run(const UbuntuCloudQuery& query, UbuntuCloudMirrorReport& report, std::string& error);
+
+    /**
+     * @brief Static callback function for curl to write the received bytes of a file.
+     * @param[in] buffer_ptr Pointer to the received data.
+     * @param[in] size Size of each data element.
+     * @param[in] nmemb Number of data elements.
+     * @param[out] file_ptr Pointer to the UbuntuCloudMirrorFile of the request.
+     * @return size_t Number of bytes processed, 0 to abort the request.
+     */
+    static size_t writeFile(void* buffer_ptr, size_t size, size_t nmemb, void* file_ptr);
+};
+
+/**
+ * @brief Syncs a mirror directory and reports the outcome.
+ * @param catalog The catalog the items come from.
+ * @param root The mirror directory.
+ * @param query_text The query selecting the items, in the syntax of parseQuery().
+ * @param options Tuning of the transfers.
+ * @param output Stream receiving the summary.
+ * @param errors Stream receiving the failures.
+ * @return int 0 if every selected file is in place, 1 otherwise.
+ */
+int syncMirror(const UbuntuCloudCatalog& catalog, const std::filesystem::path& root, const std::string& query_text,
+               const UbuntuCloudMirrorOptions& options = {}, std::ostream& output = std::cout, std::ostream& errors = std::cerr);
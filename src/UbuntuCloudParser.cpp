@@ -0,0 +1,313 @@
+/**
+ * @file UbuntuCloudParser.cpp
+ * @brief Implementation of the streaming product file parser.
+ *
+ * The SAX handler tracks where it is in the document with a stack of contexts. Only the following paths are kept:
+ * - products.<product>.{release, release_title, arch, aliases, version, supported}
+ * - products.<product>.versions.<serial>.items.<item>.{sha256, path, size}
+ *
+ * Any other value or subtree is skipped without being stored. Item strings are copied into the arena of their product,
+ * which leaves the lexer its string buffer and turns one allocation per string into one per arena block.
+ */
+
+#include "UbuntuCloudParser.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+using json = nlohmann::json;
+
+/**
+ * @class UbuntuCatalogSax
+ * @brief SAX handler building the reduced product model.
+ */
+class UbuntuCatalogSax : public nlohmann::json_sax<json> {
+  private:
+    /// Position of an object in the product file.
+    enum class Context { Root, Products, Product, Versions, Version, Items, Item, Ignored };
+
+    /// Contexts of the currently open objects and arrays, innermost last.
+    std::vector<Context> _contexts;
+    /// Last key seen in the innermost object.
+    std::string _key;
+    /// Products completed so far.
+    std::vector<UbuntuProduct>& _products;
+    /// Error message on failure.
+    std::string& _error;
+    /// Whether the root object had a "products" key.
+    bool _foundProducts;
+
+    /**
+     * @brief Returns the innermost context, Ignored for scalars outside any object.
+     * @return Context The innermost context.
+     */
+    Context current() const { return this->_contexts.empty() ? Context::Ignored : this->_contexts.back(); }
+
+    /**
+     * @brief Computes the context of an object that starts at the current position.
+     * @return Context The context of the new object.
+     */
+    Context nextObjectContext() const {
+      if (this->_contexts.empty()) {
+        return Context::Root;
+      }
+      switch (this->_contexts.back()) {
+        case Context::Root:
+          return this->_key == "products" ? Context::Products : Context::Ignored;
+        case Context::Products:
+          return Context::Product;  // Every member of "products" is a product
+        case Context::Product:
+          return this->_key == "versions" ? Context::Versions : Context::Ignored;
+        case Context::Versions:
+          return Context::Version;  // Every member of "versions" is a serial
+        case Context::Version:
+          return this->_key == "items" ? Context::Items : Context::Ignored;
+        case Context::Items:
+          return Context::Item;  // Every member of "items" is an item
+        default:
+          return Context::Ignored;
+      }
+    }
+
+  public:
+    /**
+     * @brief Constructs a handler writing into the given outputs.
+     * @param products Receives the parsed products.
+     * @param error Receives the error message on failure.
+     */
+    UbuntuCatalogSax(std::vector<UbuntuProduct>& products, std::string& error):
+        _contexts(), _key(), _products(products), _error(error), _foundProducts(false) { }
+
+    /// @return bool Whether the root object had a "products" key.
+    bool foundProducts() const { return this->_foundProducts; }
+
+    bool null() override { return true; }
+
+    bool boolean(bool value) override {
+      if (this->current() == Context::Product && this->_key == "supported") {
+        this->_products.back().supported = value;
+      }
+      return true;
+    }
+
+    bool number_integer(number_integer_t) override { return true; }
+
+    bool number_unsigned(number_unsigned_t value) override {
+      if (this->current() == Context::Item && this->_key == "size") {
+        this->_products.back().versions.back().items.back().size = value;
+      }
+      return true;
+    }
+
+    bool number_float(number_float_t, const string_t&) override { return true; }
+
+    bool string(string_t& value) override {
+      Context context { this->current() };
+      if (context == Context::Product) {
+        UbuntuProduct& product { this->_products.back() };
+        // Values are moved out of the parser's buffer, it does not need them anymore
+        if (this->_key == "release") {
+          product.release = std::move(value);
+        } else if (this->_key == "release_title") {
+          product.release_title = std::move(value);
+        } else if (this->_key == "arch") {
+          product.arch = std::move(value);
+        } else if (this->_key == "aliases") {
+          product.aliases = std::move(value);
+        } else if (this->_key == "version") {
+          product.version = std::move(value);
+        }
+      } else if (context == Context::Item) {
+        UbuntuProduct&     product { this->_products.back() };
+        UbuntuProductItem& item { product.versions.back().items.back() };
+        if (this->_key == "sha256") {
+          item.sha256 = product.strings->store(value);
+        } else if (this->_key == "path") {
+          item.path = product.strings->store(value);
+        }
+      }
+      return true;
+    }
+
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override {
+      Context context { this->nextObjectContext() };
+      switch (context) {
+        case Context::Products:
+          this->_foundProducts = true;
+          break;
+        case Context::Product:
+          this->_products.emplace_back();
+          this->_products.back().name    = this->_key;
+          this->_products.back().strings = std::make_unique<UbuntuCloudArena>();
+          break;
+        case Context::Version:
+          this->_products.back().versions.push_back({ this->_key, {} });
+          break;
+        case Context::Item:
+          this->_products.back().versions.back().items.push_back({ this->_products.back().strings->store(this->_key), {}, {}, 0 });
+          break;
+        default:
+          break;
+      }
+      this->_contexts.push_back(context);
+      return true;
+    }
+
+    bool key(string_t& value) override {
+      this->_key.swap(value);  // Reuse the key's storage instead of copying
+      return true;
+    }
+
+    bool end_object() override {
+      if (this->_contexts.back() == Context::Product) {
+        // Versions are kept from the oldest to the most recent serial, the order the catalog stores them in
+        std::vector<UbuntuProductVersion>& versions { this->_products.back().versions };
+        std::sort(versions.begin(), versions.end(), versionPrecedes);
+      }
+      this->_contexts.pop_back();
+      return true;
+    }
+
+    bool start_array(std::size_t) override {
+      this->_contexts.push_back(Context::Ignored);  // No array holds data of interest
+      return true;
+    }
+
+    bool end_array() override {
+      this->_contexts.pop_back();
+      return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& exception) override {
+      this->_error = std::string("JSON parsing error: ") + exception.what();
+      return false;  // Stop parsing
+    }
+};
+
+/**
+ * @brief Parses a product file with the SAX handler, as the body streams in.
+ * @param input Stream with the JSON text of the product file.
+ * @param[out] products Receives the products, in document order.
+ * @param[out] error Receives a description of the problem on failure.
+ * @return bool True if the input is valid JSON with a "products" object; false otherwise.
+ */
+static bool parseProductStreamNlohmann(std::istream& input, std::vector<UbuntuProduct>& products, std::string& error) {
+  UbuntuCatalogSax handler(products, error);
+  if (!json::sax_parse(input, &handler)) {
+    return false;  // Error message set by the handler
+  }
+  if (!handler.foundProducts()) {
+    // Problem with data content, this key contains our data of interest
+    error = "Data not found on curl request";
+    return false;
+  }
+  return true;
+}
+
+std::vector<UbuntuCloudParserBackend> availableParserBackends() {
+#ifdef UBUNTU_CLOUD_SIMDJSON
+  return { UbuntuCloudParserBackend::Simdjson, UbuntuCloudParserBackend::Nlohmann };
+#else
+  return { UbuntuCloudParserBackend::Nlohmann };
+#endif
+}
+
+UbuntuCloudParserBackend defaultParserBackend() {
+#ifdef UBUNTU_CLOUD_SIMDJSON
+  return UbuntuCloudParserBackend::Simdjson;
+#else
+  return UbuntuCloudParserBackend::Nlohmann;
+#endif
+}
+
+const char* parserBackendName(UbuntuCloudParserBackend backend) {
+  return backend == UbuntuCloudParserBackend::Simdjson ? "simdjson" : "nlohmann";
+}
+
+bool parseProductStream(std::istream& input, std::vector<UbuntuProduct>& products, std::string& error, UbuntuCloudParserBackend backend) {
+  products.clear();
+  bool parsed { false };
+  if (backend == UbuntuCloudParserBackend::Simdjson) {
+#ifdef UBUNTU_CLOUD_SIMDJSON
+    parsed = parseProductStreamSimdjson(input, products, error);
+#else
+    error = "The simdjson parser backend is not compiled in, configure with -DUBUNTU_CLOUD_SIMDJSON=ON";
+#endif
+  } else {
+    parsed = parseProductStreamNlohmann(input, products, error);
+  }
+  if (!parsed) {
+    products.clear();
+    return false;
+  }
+  // Keep the order a json object would have, so that queries list architectures in the same order
+  std::sort(products.begin(), products.end(), [](const UbuntuProduct& first, const UbuntuProduct& second) { return first.name < second.name; });
+  return true;
+}
+
+bool parseStreamIndex(std::istream& input, std::vector<UbuntuStreamIndexEntry>& entries, std::string& error) {
+  entries.clear();
+  json index = json::parse(input, nullptr, false);  // No exceptions, a parse error yields a discarded value. No braces, they would wrap it in an array
+  if (index.is_discarded()) {
+    error = "JSON parsing error in stream index";
+    return false;
+  }
+  if (!index.is_object() || !index.contains("index") || !index["index"].is_object()) {
+    error = "Stream index has no index object";
+    return false;
+  }
+  for (const auto& [content_id, entry] : index["index"].items()) {
+    // Only product files share the layout parseProductStream() reads
+    if (!entry.is_object() || entry.value("format", "") != "products:1.0" || !entry.contains("path") || !entry["path"].is_string()) {
+      continue;
+    }
+    entries.push_back({ content_id, entry["path"].get<std::string>() });
+  }
+  return true;
+}
+
+std::vector<UbuntuProduct> mergeProducts(std::vector<std::vector<UbuntuProduct>> product_lists) {
+  if (product_lists.size() == 1) {
+    return std::move(product_lists.front());  // Nothing to merge, the list is already in catalog order
+  }
+  std::vector<UbuntuProduct> merged {};
+  for (std::vector<UbuntuProduct>& products : product_lists) {
+    merged.insert(merged.end(), std::make_move_iterator(products.begin()), std::make_move_iterator(products.end()));
+  }
+  // Stable, so that products of the same name stay in priority order
+  std::stable_sort(merged.begin(), merged.end(), [](const UbuntuProduct& first, const UbuntuProduct& second) { return first.name < second.name; });
+  std::vector<UbuntuProduct> result {};
+  for (UbuntuProduct& product : merged) {
+    if (result.empty() || result.back().name != product.name) {
+      result.push_back(std::move(product));
+      continue;
+    }
+    // Both version lists are sorted, new serials are appended and merged in once the product is complete
+    // The strings of every item taken over move to the arena of the kept product, the other one is released with its product
+    std::vector<UbuntuProductVersion>& versions { result.back().versions };
+    std::size_t                        known_versions { versions.size() };
+    UbuntuCloudArena&                  strings { *result.back().strings };
+    auto                               adopt { [&strings](const UbuntuProductItem& item) -> UbuntuProductItem {
+      return { strings.store(item.name), strings.store(item.sha256), strings.store(item.path), item.size };
+    } };
+    for (UbuntuProductVersion& version : product.versions) {
+      auto existing { std::lower_bound(versions.begin(), versions.begin() + static_cast<std::ptrdiff_t>(known_versions), version, versionPrecedes) };
+      if (existing == versions.begin() + static_cast<std::ptrdiff_t>(known_versions) || existing->serial != version.serial) {
+        std::transform(version.items.begin(), version.items.end(), version.items.begin(), adopt);
+        versions.push_back(std::move(version));
+        continue;
+      }
+      for (auto& item : version.items) {
+        if (std::none_of(existing->items.begin(), existing->items.end(), [&item](const UbuntuProductItem& other) { return other.name == item.name; })) {
+          existing->items.push_back(adopt(item));
+        }
+      }
+    }
+    std::inplace_merge(versions.begin(), versions.begin() + static_cast<std::ptrdiff_t>(known_versions), versions.end(), versionPrecedes);
+  }
+  return result;
+}
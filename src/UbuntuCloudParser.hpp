@@ -0,0 +1,104 @@
+/**
+ * @file UbuntuCloudParser.hpp
+ * @brief Declares the streaming parser for simplestreams product files.
+ *
+ * The parser is built on the SAX interface of nlohmann::json: it never builds a DOM, and keeps only the fields
+ * declared in UbuntuCloudCatalog.hpp. It reads from any std::istream, which allows it to run directly on the
+ * bytes coming out of the curl write callback (see UbuntuCloudStreamBuffer) or on a file in the cache.
+ *
+ * Built with -DUBUNTU_CLOUD_SIMDJSON=ON, product files can also be parsed with the On-Demand API of simdjson, which
+ * becomes the default backend. It needs the whole body in memory, so it parses once the download is complete instead of
+ * during it, but walks the document with SIMD instructions and only materializes the same fields as the SAX handler.
+ * Both backends produce the same products.
+ *
+ * The stream index (streams/v1/index.json), which lists the product files of a mirror, is small and parsed as a DOM.
+ */
+
+#pragma once
+
+#include "UbuntuCloudCatalog.hpp"
+
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * @enum UbuntuCloudParserBackend
+ * @brief JSON parser reading the product files.
+ */
+enum class UbuntuCloudParserBackend {
+  Nlohmann,  ///< The SAX interface of nlohmann::json, parsing while the body streams in. Always available.
+  Simdjson   ///< The On-Demand API of simdjson, parsing the complete body. Only with -DUBUNTU_CLOUD_SIMDJSON=ON.
+};
+
+/**
+ * @brief Returns the backends compiled in.
+ * @return std::vector<UbuntuCloudParserBackend> The backends, the default one first.
+ */
+std::vector<UbuntuCloudParserBackend> availableParserBackends();
+
+/**
+ * @brief Returns the backend parseProductStream() uses by default: simdjson when it is compiled in.
+ * @return UbuntuCloudParserBackend The default backend.
+ */
+UbuntuCloudParserBackend defaultParserBackend();
+
+/**
+ * @brief Returns the name of a backend.
+ * @param backend The backend.
+ * @return const char* The name, "nlohmann" or "simdjson".
+ */
+const char* parserBackendName(UbuntuCloudParserBackend backend);
+
+/**
+ * @brief Parses a product file into the reduced product model.
+ *
+ * @param input Stream with the JSON text of the product file.
+ * @param[out] products Receives the products, sorted by product name as in the product file's JSON object.
+ * @param[out] error Receives a description of the problem on failure.
+ * @param backend The parser to use. A backend that was not compiled in fails with an error.
+ * @return bool True if the input is valid JSON with a "products" object; false otherwise.
+ */
+bool parseProductStream(std::istream& input, std::vector<UbuntuProduct>& products, std::string& error,
+                        UbuntuCloudParserBackend backend = defaultParserBackend());
+
+#ifdef UBUNTU_CLOUD_SIMDJSON
+/**
+ * @brief Parses a product file with the simdjson backend, see parseProductStream().
+ * @param input Stream with the JSON text of the product file, read to its end before the parse starts.
+ * @param[out] products Receives the products, in document order. Versions are sorted, products are not.
+ * @param[out] error Receives a description of the problem on failure.
+ * @return bool True if the input is valid JSON with a "products" object; false otherwise.
+ */
+bool parseProductStreamSimdjson(std::istream& input, std::vector<UbuntuProduct>& products, std::string& error);
+#endif
+
+/**
+ * @struct UbuntuStreamIndexEntry
+ * @brief One product file listed in a stream index.
+ */
+struct UbuntuStreamIndexEntry {
+    std::string content_id;  ///< The index key, e.g. "com.ubuntu.cloud:released:download".
+    std::string path;        ///< Path of the product file, relative to the mirror root.
+};
+
+/**
+ * @brief Parses a stream index into the list of its product files.
+ *
+ * Entries of another format than "products:1.0" are skipped.
+ * @param input Stream with the JSON text of the index.
+ * @param[out] entries Receives the product files, sorted by content id.
+ * @param[out] error Receives a description of the problem on failure.
+ * @return bool True if the input is valid JSON with an "index" object; false otherwise.
+ */
+bool parseStreamIndex(std::istream& input, std::vector<UbuntuStreamIndexEntry>& entries, std::string& error);
+
+/**
+ * @brief Merges the products of several product files into one list.
+ *
+ * Products are matched by name. The first list a product appears in provides its fields, and the versions of all
+ * lists are combined; for a serial present in several lists, items missing from the first one are added.
+ * @param product_lists Products of each product file, each sorted by name, in priority order.
+ * @return std::vector<UbuntuProduct> The merged products, sorted by name, each with its versions sorted by serial.
+ */
+std::vector<UbuntuProduct> mergeProducts(std::vector<std::vector<UbuntuProduct>> product_lists);
@@ -0,0 +1,350 @@
+/**
+ * @file UbuntuCloudQuery.cpp
+ * @brief Implementation of the query parser and of the query engine.
+ */
+
+#include "UbuntuCloudQuery.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+/// Rows a query produces, from the coarsest to the finest.
+enum class QueryLevel { Product, Version, Item };
+
+/// Names of the fields, in the order of UbuntuCloudQueryField.
+static constexpr std::string_view field_names[] { "product", "release", "title",     "arch", "version", "supported", "lts",
+                                                  "serial",  "item",    "sha256",    "path", "size",    "url" };
+
+std::string_view queryFieldName(UbuntuCloudQueryField field) { return field_names[static_cast<std::size_t>(field)]; }
+
+/**
+ * @brief Splits a comma-separated list, skipping empty elements.
+ * @param text The list.
+ * @return std::vector<std::string> The elements.
+ */
+static std::vector<std::string> splitList(std::string_view text) {
+  std::vector<std::string> values {};
+  while (!text.empty()) {
+    std::size_t      comma { text.find(',') };
+    std::string_view value { text.substr(0, comma) };
+    if (!value.empty()) {
+      values.emplace_back(value);
+    }
+    text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+  }
+  return values;
+}
+
+/**
+ * @brief Parses a boolean term value.
+ * @param text The value.
+ * @return std::optional<bool> The value, or std::nullopt if it is not true, false, yes, no, 1 or 0.
+ */
+static std::optional<bool> parseFlag(std::string_view text) {
+  if (text == "true" || text == "yes" || text == "1") {
+    return true;
+  }
+  if (text == "false" || text == "no" || text == "0") {
+    return false;
+  }
+  return std::nullopt;
+}
+
+std::optional<UbuntuCloudQuery> parseQuery(std::string_view text, std::string& error) {
+  UbuntuCloudQuery query {};
+  while (true) {
+    std::size_t begin { text.find_first_not_of(" \t") };
+    if (begin == std::string_view::npos) {
+      break;
+    }
+    text.remove_prefix(begin);
+    // A term ends at the first blank outside double quotes, which let titles such as "22.04 LTS" be given whole
+    std::string term {};
+    bool        quoted { false };
+    while (!text.empty() && (quoted || (text.front() != ' ' && text.front() != '\t'))) {
+      if (text.front() == '"') {
+        quoted = !quoted;
+      } else {
+        term += text.front();
+      }
+      text.remove_prefix(1);
+    }
+    if (quoted) {
+      error = "Unterminated quote in query term: " + term;
+      return std::nullopt;
+    }
+
+    std::size_t      equal { term.find('=') };
+    std::string_view key { std::string_view(term).substr(0, equal) };
+    std::string_view value { equal == std::string::npos ? std::string_view() : std::string_view(term).substr(equal + 1) };
+    if (key == "latest") {
+      std::optional<bool> latest { equal == std::string::npos ? true : parseFlag(value) };
+      if (!latest) {
+        error = "Invalid value for latest: " + std::string(value);
+        return std::nullopt;
+      }
+      query.latest = *latest;
+      continue;
+    }
+    if (equal == std::string::npos || value.empty()) {
+      error = "Query term without value: " + term;
+      return std::nullopt;
+    }
+    if (key == "release") {
+      std::vector<std::string> values { splitList(value) };
+      query.releases.insert(query.releases.end(), values.begin(), values.end());
+    } else if (key == "arch") {
+      std::vector<std::string> values { splitList(value) };
+      query.archs.insert(query.archs.end(), values.begin(), values.end());
+    } else if (key == "item") {
+      std::vector<std::string> values { splitList(value) };
+      query.items.insert(query.items.end(), values.begin(), values.end());
+    } else if (key == "supported" || key == "lts") {
+      std::optional<bool> flag { parseFlag(value) };
+      if (!flag) {
+        error = "Invalid value for " + std::string(key) + ": " + std::string(value);
+        return std::nullopt;
+      }
+      (key == "lts" ? query.lts : query.supported) = flag;
+    } else if (key == "serial") {
+      std::size_t dots { value.find("..") };
+      if (dots == std::string_view::npos) {
+        query.serial_from = std::string(value);
+        query.serial_to   = std::string(value);
+      } else {
+        std::string_view from { value.substr(0, dots) };
+        std::string_view to { value.substr(dots + 2) };
+        query.serial_from = from.empty() ? std::nullopt : std::optional<std::string>(from);
+        query.serial_to   = to.empty() ? std::nullopt : std::optional<std::string>(to);
+      }
+    } else if (key == "fields") {
+      for (const std::string& name : splitList(value)) {
+        auto field { std::find(std::begin(field_names), std::end(field_names), name) };
+        if (field == std::end(field_names)) {
+          error = "Unknown query field: " + name;
+          return std::nullopt;
+        }
+        query.fields.push_back(static_cast<UbuntuCloudQueryField>(field - std::begin(field_names)));
+      }
+    } else {
+      error = "Unknown query term: " + std::string(key);
+      return std::nullopt;
+    }
+  }
+  return query;
+}
+
+/**
+ * @brief Returns the level of the rows of a field.
+ * @param field The field.
+ * @return QueryLevel The coarsest level the field has a value at.
+ */
+static QueryLevel fieldLevel(UbuntuCloudQueryField field) {
+  if (field == UbuntuCloudQueryField::Serial) {
+    return QueryLevel::Version;
+  }
+  return field >= UbuntuCloudQueryField::Item ? QueryLevel::Item : QueryLevel::Product;
+}
+
+/**
+ * @brief Returns the level of the rows of a query, from its filters and explicit fields.
+ * @param query The query.
+ * @return QueryLevel The finest level any filter or field needs.
+ */
+static QueryLevel queryLevel(const UbuntuCloudQuery& query) {
+  QueryLevel level { QueryLevel::Product };
+  if (query.serial_from || query.serial_to || query.latest) {
+    level = QueryLevel::Version;
+  }
+  if (!query.items.empty()) {
+    level = QueryLevel::Item;
+  }
+  for (UbuntuCloudQueryField field : query.fields) {
+    level = std::max(level, fieldLevel(field));
+  }
+  return level;
+}
+
+std::vector<UbuntuCloudQueryField> queryFields(const UbuntuCloudQuery& query) {
+  if (!query.fields.empty()) {
+    return query.fields;
+  }
+  using Field = UbuntuCloudQueryField;
+  switch (queryLevel(query)) {
+    case QueryLevel::Product:
+      return { Field::Product, Field::Release, Field::Arch, Field::Supported };
+    case QueryLevel::Version:
+      return { Field::Product, Field::Release, Field::Arch, Field::Supported, Field::Serial };
+    default:
+      return { Field::Product, Field::Release, Field::Arch, Field::Serial, Field::Item, Field::Sha256 };
+  }
+}
+
+/**
+ * @brief Finds the first version of a range whose key is not below a bound.
+ * @param catalog The catalog.
+ * @param first The first version of the range.
+ * @param last One past the last version of the range.
+ * @param key The bound.
+ * @param inclusive Whether versions equal to the bound are skipped too, giving the end of a range ending at key.
+ * @return std::uint32_t The version index, last if there is none.
+ */
+static std::uint32_t versionBound(const UbuntuCloudCatalog& catalog, std::uint32_t first, std::uint32_t last, std::uint64_t key, bool inclusive) {
+  // Keys are sorted within a product, so this is lower_bound (or upper_bound) over the key column
+  while (first < last) {
+    std::uint32_t middle { first + (last - first) / 2 };
+    std::uint64_t middle_key { catalog.versionKey(middle) };
+    if (middle_key < key || (inclusive && middle_key == key)) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first;
+}
+
+std::vector<UbuntuCloudQueryMatch> runQuery(const UbuntuCloudCatalog& catalog, const UbuntuCloudQuery& query) {
+  constexpr std::uint32_t npos { UbuntuCloudCatalog::npos };
+  QueryLevel              level { queryLevel(query) };
+  std::uint64_t           key_from { query.serial_from ? serialSortKey(*query.serial_from) : 0 };
+  std::uint64_t           key_to { query.serial_to ? serialSortKey(*query.serial_to) : UINT64_MAX };
+  // Whether an item name matches, by string id: each distinct name is compared once, not once per item
+  std::unordered_map<std::uint32_t, bool> item_names {};
+
+  std::vector<UbuntuCloudQueryMatch> matches {};
+  auto                               visit = [&](std::uint32_t product) {
+    if ((query.supported && catalog.productSupported(product) != *query.supported) || (query.lts && catalog.productLts(product) != *query.lts)) {
+      return;
+    }
+    if (!query.archs.empty() && std::find(query.archs.begin(), query.archs.end(), catalog.productArch(product)) == query.archs.end()) {
+      return;
+    }
+    if (level == QueryLevel::Product) {
+      matches.push_back({ product, npos, npos });
+      return;
+    }
+    auto [first, last] { catalog.versionRange(product) };
+    first = versionBound(catalog, first, last, key_from, false);
+    last  = versionBound(catalog, first, last, key_to, true);
+    if (query.latest && first < last) {
+      first = last - 1;
+    }
+    for (std::uint32_t version { first }; version < last; ++version) {
+      if (level == QueryLevel::Version) {
+        matches.push_back({ product, version, npos });
+        continue;
+      }
+      auto [item_first, item_last] { catalog.itemRange(version) };
+      for (std::uint32_t item { item_first }; item < item_last; ++item) {
+        if (!query.items.empty()) {
+          auto [name, inserted] { item_names.try_emplace(catalog.itemNameId(item), false) };
+          if (inserted) {
+            name->second = std::find(query.items.begin(), query.items.end(), catalog.itemName(item)) != query.items.end();
+          }
+          if (!name->second) {
+            continue;
+          }
+        }
+        matches.push_back({ product, version, item });
+      }
+    }
+  };
+
+  if (query.releases.empty()) {
+    for (std::uint32_t product {}; product < catalog.productCount(); ++product) {
+      visit(product);
+    }
+    return matches;
+  }
+  // Only the products of the requested releases are visited, found through the release and title indexes
+  std::vector<std::uint32_t> products {};
+  for (const std::string& release : query.releases) {
+    std::vector<std::uint32_t> release_products { catalog.productsForRelease(release) };
+    products.insert(products.end(), release_products.begin(), release_products.end());
+  }
+  std::sort(products.begin(), products.end());
+  products.erase(std::unique(products.begin(), products.end()), products.end());
+  for (std::uint32_t product : products) {
+    visit(product);
+  }
+  return matches;
+}
+
+std::string queryFieldText(const UbuntuCloudCatalog& catalog, const UbuntuCloudQueryMatch& match, UbuntuCloudQueryField field) {
+  constexpr std::uint32_t npos { UbuntuCloudCatalog::npos };
+  QueryLevel              field_level { fieldLevel(field) };
+  if ((field_level == QueryLevel::Version && match.version == npos) || (field_level == QueryLevel::Item && match.item == npos)) {
+    return {};
+  }
+  switch (field) {
+    case UbuntuCloudQueryField::Product:
+      return std::string(catalog.productName(match.product));
+    case UbuntuCloudQueryField::Release:
+      return std::string(catalog.productRelease(match.product));
+    case UbuntuCloudQueryField::Title:
+      return std::string(catalog.productReleaseTitle(match.product));
+    case UbuntuCloudQueryField::Arch:
+      return std::string(catalog.productArch(match.product));
+    case UbuntuCloudQueryField::Version:
+      return std::string(catalog.productVersion(match.product));
+    case UbuntuCloudQueryField::Supported:
+      return catalog.productSupported(match.product) ? "true" : "false";
+    case UbuntuCloudQueryField::Lts:
+      return catalog.productLts(match.product) ? "true" : "false";
+    case UbuntuCloudQueryField::Serial:
+      return std::string(catalog.versionSerial(match.version));
+    case UbuntuCloudQueryField::Item:
+      return std::string(catalog.itemName(match.item));
+    case UbuntuCloudQueryField::Sha256:
+      return std::string(catalog.itemSha256(match.item));
+    case UbuntuCloudQueryField::Path:
+      return std::string(catalog.itemPath(match.item));
+    case UbuntuCloudQueryField::Size:
+      return std::to_string(catalog.itemSize(match.item));
+    case UbuntuCloudQueryField::Url:
+      return std::string(catalog.productMirror(match.product)) + std::string(catalog.itemPath(match.item));
+  }
+  return {};
+}
+
+void writeQueryMatches(const UbuntuCloudCatalog& catalog, const std::vector<UbuntuCloudQueryField>& fields,
+                       const std::vector<UbuntuCloudQueryMatch>& matches, UbuntuCloudRecordWriter& writer) {
+  constexpr std::uint32_t npos { UbuntuCloudCatalog::npos };
+  for (const UbuntuCloudQueryMatch& match : matches) {
+    for (UbuntuCloudQueryField field : fields) {
+      // Flags and sizes keep their JSON type, everything else is written straight from the string table
+      switch (field) {
+        case UbuntuCloudQueryField::Supported:
+          writer.field(catalog.productSupported(match.product));
+          break;
+        case UbuntuCloudQueryField::Lts:
+          writer.field(catalog.productLts(match.product));
+          break;
+        case UbuntuCloudQueryField::Size:
+          writer.field(match.item == npos ? std::uint64_t {} : catalog.itemSize(match.item));
+          break;
+        case UbuntuCloudQueryField::Product:
+          writer.field(catalog.productName(match.product));
+          break;
+        case UbuntuCloudQueryField::Release:
+          writer.field(catalog.productRelease(match.product));
+          break;
+        case UbuntuCloudQueryField::Arch:
+          writer.field(catalog.productArch(match.product));
+          break;
+        case UbuntuCloudQueryField::Serial:
+          writer.field(match.version == npos ? std::string_view() : catalog.versionSerial(match.version));
+          break;
+        case UbuntuCloudQueryField::Sha256:
+          writer.field(match.item == npos ? std::string_view() : catalog.itemSha256(match.item));
+          break;
+        default:
+          writer.field(std::string_view(queryFieldText(catalog, match, field)));
+          break;
+      }
+    }
+    writer.endRecord();
+  }
+  writer.finish();
+}
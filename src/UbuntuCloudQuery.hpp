@@ -0,0 +1,127 @@
+/**
+ * @file UbuntuCloudQuery.hpp
+ * @brief Declares the general query over the products, versions and items of a catalog.
+ *
+ * A query combines filters on the release, architecture, support and LTS flags, serial range and item name with a
+ * list of fields to output. Its text form is a list of space-separated terms, e.g.
+ * "arch=arm64 supported=true latest item=root.tar.xz fields=release,serial,sha256".
+ *
+ * The filters are applied as early as the catalog layout allows: a release filter goes through the hash indexes
+ * instead of scanning the products, product filters reject a product before its versions are looked at, the serial
+ * range is a binary search over the sorted versions of each product, and an item name is compared by string id.
+ * Matches are index triples into the catalog; strings are only read when the requested fields are written.
+ */
+
+#pragma once
+
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudFormat.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum UbuntuCloudQueryField
+ * @brief A field a query can output.
+ */
+enum class UbuntuCloudQueryField {
+  Product,    ///< Product name, e.g. "com.ubuntu.cloud:server:24.04:amd64".
+  Release,    ///< Release codename, e.g. "noble".
+  Title,      ///< Release title, e.g. "24.04 LTS".
+  Arch,       ///< Architecture, e.g. "amd64".
+  Version,    ///< Numeric version, e.g. "24.04".
+  Supported,  ///< Whether the release is supported.
+  Lts,        ///< Whether the release is the current LTS.
+  Serial,     ///< Serial of the version, e.g. "20240423".
+  Item,       ///< Item name, e.g. "disk1.img".
+  Sha256,     ///< The item's sha256.
+  Path,       ///< The item's path on the mirror.
+  Size,       ///< The item's size in bytes, 0 if not published.
+  Url         ///< The item's full URL.
+};
+
+/**
+ * @struct UbuntuCloudQuery
+ * @brief Filters and projection of a query. Empty filters match everything.
+ */
+struct UbuntuCloudQuery {
+    std::vector<std::string>           releases;     ///< Release codenames or titles, any of them matches.
+    std::vector<std::string>           archs;        ///< Architectures, any of them matches.
+    std::vector<std::string>           items;        ///< Item names, e.g. "disk1.img" or "root.tar.xz", any of them matches.
+    std::optional<bool>                supported;    ///< Required value of the support flag.
+    std::optional<bool>                lts;          ///< Required value of the LTS flag.
+    std::optional<std::string>         serial_from;  ///< Oldest serial to include.
+    std::optional<std::string>         serial_to;    ///< Most recent serial to include.
+    bool                               latest {};    ///< Only the most recent serial of each product within the range.
+    std::vector<UbuntuCloudQueryField> fields;       ///< Fields to output, in order. Empty for the defaults of the query's level.
+};
+
+/**
+ * @struct UbuntuCloudQueryMatch
+ * @brief One row of a query result, as indexes into the catalog.
+ */
+struct UbuntuCloudQueryMatch {
+    std::uint32_t product;  ///< The product index.
+    std::uint32_t version;  ///< The version index, UbuntuCloudCatalog::npos for a product row.
+    std::uint32_t item;     ///< The item index, UbuntuCloudCatalog::npos for a product or version row.
+};
+
+/**
+ * @brief Parses the text form of a query.
+ *
+ * Terms are release=, arch= and item= with comma-separated values, supported= and lts= with true or false,
+ * serial=FROM..TO where either bound may be left out (a single serial selects just it), latest, and fields= with
+ * comma-separated field names (product, release, title, arch, version, supported, lts, serial, item, sha256, path,
+ * size, url). Double quotes keep blanks inside a term, e.g. release="22.04 LTS".
+ * @param text The query, e.g. "release=noble arch=amd64,arm64 latest".
+ * @param[out] error Receives a description of the problem for an invalid query.
+ * @return std::optional<UbuntuCloudQuery> The query, or std::nullopt if it is invalid.
+ */
+std::optional<UbuntuCloudQuery> parseQuery(std::string_view text, std::string& error);
+
+/**
+ * @brief Returns the fields a query outputs: its own, or the defaults of its level.
+ *
+ * A query matches products, versions or items depending on its filters and fields. By default, product rows show
+ * product, release, arch and supported; version rows add serial; item rows add item and sha256.
+ * @param query The query.
+ * @return std::vector<UbuntuCloudQueryField> The fields, in output order.
+ */
+std::vector<UbuntuCloudQueryField> queryFields(const UbuntuCloudQuery& query);
+
+/**
+ * @brief Returns the name of a field, as accepted by fields= and used as column name.
+ * @param field The field.
+ * @return std::string_view The name, e.g. "sha256".
+ */
+std::string_view queryFieldName(UbuntuCloudQueryField field);
+
+/**
+ * @brief Runs a query on a catalog.
+ * @param catalog The catalog.
+ * @param query The query.
+ * @return std::vector<UbuntuCloudQueryMatch> The matching rows, ordered by product, then serial, then item.
+ */
+std::vector<UbuntuCloudQueryMatch> runQuery(const UbuntuCloudCatalog& catalog, const UbuntuCloudQuery& query);
+
+/**
+ * @brief Returns the text of one field of a match.
+ * @param catalog The catalog the match comes from.
+ * @param match The match.
+ * @param field The field. Version and item fields of a row of a coarser level are empty.
+ * @return std::string The text, "true" or "false" for flags.
+ */
+std::string queryFieldText(const UbuntuCloudCatalog& catalog, const UbuntuCloudQueryMatch& match, UbuntuCloudQueryField field);
+
+/**
+ * @brief Writes matches as records, one field per requested field.
+ * @param catalog The catalog the matches come from.
+ * @param fields The fields, in the column order of the writer.
+ * @param matches The matches.
+ * @param writer The writer, whose columns are the names of the fields.
+ */
+void writeQueryMatches(const UbuntuCloudCatalog& catalog, const std::vector<UbuntuCloudQueryField>& fields,
+                       const std::vector<UbuntuCloudQueryMatch>& matches, UbuntuCloudRecordWriter& writer);
@@ -0,0 +1,343 @@
+/**
+ * @file UbuntuCloudServer.cpp
+ * @brief Implementation of the resident daemon and its thin client.
+ *
+ * Each connection is served by its own thread. Readers take a reference to the current catalog with
+ * std::atomic_load() for the duration of one query, so the refresh thread can publish a new catalog at any time
+ * and the old one is destroyed by whichever thread drops the last reference.
+ */
+
+#include "UbuntuCloudServer.hpp"
+
+#ifndef _WIN32
+  #include <poll.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+
+  #include <cerrno>
+  #include <csignal>
+  #include <cstring>
+  #include <thread>
+#endif
+
+#include <sstream>
+
+/// Longest query line accepted, a client sending more without a newline is disconnected.
+constexpr static std::size_t max_request_line { 4096 };
+
+/// Interval at which blocking waits check whether the server is shutting down.
+constexpr static int poll_interval_ms { 250 };
+
+UbuntuCloudServer::UbuntuCloudServer(std::filesystem::path socket_path, std::chrono::seconds refresh_interval, Loader loader):
+    _socketPath(std::move(socket_path)), _refreshInterval(refresh_interval), _loader(std::move(loader)), _catalog(nullptr), _stopping(false),
+    _connections(0), _mutex(), _condition() { }
+
+bool UbuntuCloudServer::refresh() {
+  std::unique_ptr<UbuntuCloudInterface> catalog { this->_loader() };
+  if (catalog == nullptr || !catalog->isInitialized()) {
+    // Keep serving the previous catalog, the loader has reported the reason on std::cerr.
+    return false;
+  }
+  std::atomic_store(&this->_catalog, std::shared_ptr<const UbuntuCloudInterface>(std::move(catalog)));
+  return true;
+}
+
+void UbuntuCloudServer::refreshLoop() {
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while (!this->_condition.wait_for(lock, this->_refreshInterval, [this]() { return this->_stopping.load(); })) {
+    // Loading can take a while, connections must be able to update the counter meanwhile.
+    lock.unlock();
+    if (!this->refresh()) {
+      std::cerr << "Catalog refresh failed, still serving the previous catalog\n";
+    }
+    lock.lock();
+  }
+}
+
+void UbuntuCloudServer::stop() {
+  {
+    // Set under the lock so the refresh thread cannot miss the notification between its check and its wait.
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_condition.notify_all();
+}
+
+#ifdef _WIN32
+
+int UbuntuCloudServer::run() {
+  std::cerr << "--serve is only available on POSIX systems\n";
+  return 1;
+}
+
+void UbuntuCloudServer::serveConnection(int) { }
+
+UbuntuCloudClient::UbuntuCloudClient(const std::filesystem::path&, std::string& error): _connection(-1), _received() {
+  error = "--client is only available on POSIX systems";
+}
+
+UbuntuCloudClient::~UbuntuCloudClient() { }
+
+bool UbuntuCloudClient::receive(std::size_t) {
+  return false;
+}
+
+int UbuntuCloudClient::query(const UbuntuCloudRequest&, std::ostream&, std::ostream&) {
+  return 1;
+}
+
+#else
+
+/// Set by the signal handler, polled by the accept loop.
+static volatile std::sig_atomic_t stop_signal_received { 0 };
+
+/**
+ * @brief Signal handler for SIGINT and SIGTERM.
+ */
+extern "C" void handleStopSignal(int) {
+  stop_signal_received = 1;
+}
+
+/**
+ * @brief Fills a socket address for a path.
+ * @param path The socket path.
+ * @param[out] address The address to fill.
+ * @param[out] error Receives a description of the problem on failure.
+ * @return bool False if the path does not fit into sockaddr_un.
+ */
+static bool socketAddress(const std::filesystem::path& path, sockaddr_un& address, std::string& error) {
+  const std::string& native { path.native() };
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (native.empty() || native.size() >= sizeof(address.sun_path)) {
+    error = "Socket path is empty or longer than " + std::to_string(sizeof(address.sun_path) - 1) + " bytes: " + native;
+    return false;
+  }
+  std::memcpy(address.sun_path, native.c_str(), native.size() + 1);
+  return true;
+}
+
+/**
+ * @brief Writes a whole buffer to a socket.
+ * @param connection The socket.
+ * @param data The bytes to write.
+ * @return bool False if the peer went away.
+ */
+static bool sendAll(int connection, const std::string& data) {
+  #ifdef MSG_NOSIGNAL
+  constexpr int flags { MSG_NOSIGNAL };  // A client hanging up must not kill the process with SIGPIPE
+  #else
+  constexpr int flags { 0 };
+  #endif
+  std::size_t sent { 0 };
+  while (sent < data.size()) {
+    ssize_t written { ::send(connection, data.data() + sent, data.size() - sent, flags) };
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    sent += static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+void UbuntuCloudServer::serveConnection(int connection) {
+  std::string buffer {};
+  std::string error {};
+  char        chunk[4096];
+  while (!this->_stopping) {
+    pollfd readable { connection, POLLIN, 0 };
+    int    ready { ::poll(&readable, 1, poll_interval_ms) };
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+      continue;  // Check again whether the server is stopping
+    }
+    ssize_t received { ready < 0 ? -1 : ::recv(connection, chunk, sizeof(chunk), 0) };
+    if (received <= 0) {
+      break;  // Client disconnected or error
+    }
+    buffer.append(chunk, static_cast<std::size_t>(received));
+
+    std::size_t line_begin { 0 };
+    std::size_t line_end { buffer.find('\n') };
+    bool        connected { true };
+    for (; connected && line_end != std::string::npos; line_end = buffer.find('\n', line_begin)) {
+      std::optional<UbuntuCloudRequest> request { parseRequestLine(buffer.substr(line_begin, line_end - line_begin), error) };
+      line_begin = line_end + 1;
+      if (!request && error.empty()) {
+        continue;  // Blank line or comment
+      }
+      std::ostringstream output {};
+      std::ostringstream errors {};
+      int                return_code { 1 };
+      if (request) {
+        // Hold this catalog for the whole query, even if a refresh publishes a new one meanwhile.
+        std::shared_ptr<const UbuntuCloudInterface> catalog { std::atomic_load(&this->_catalog) };
+        return_code = runRequest(*catalog, *request, output, errors);
+      } else {
+        errors << error << "\n";
+      }
+      std::string output_text { output.str() };
+      std::string errors_text { errors.str() };
+      connected = sendAll(connection, std::to_string(return_code) + " " + std::to_string(output_text.size()) + " " +
+                                          std::to_string(errors_text.size()) + "\n" + output_text + errors_text);
+    }
+    buffer.erase(0, line_begin);
+    if (!connected || buffer.size() > max_request_line) {
+      break;
+    }
+  }
+  ::close(connection);
+}
+
+int UbuntuCloudServer::run() {
+  if (!this->refresh()) {
+    std::cerr << "Data could not be fetched." << std::endl;
+    return 1;
+  }
+  sockaddr_un address {};
+  std::string error {};
+  if (!socketAddress(this->_socketPath, address, error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  int listener { ::socket(AF_UNIX, SOCK_STREAM, 0) };
+  if (listener < 0) {
+    std::cerr << "Could not create socket: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  // A socket file nobody accepts on is left over from a crashed server and can be replaced.
+  if (::connect(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+    std::cerr << "A server is already listening on " << this->_socketPath.string() << "\n";
+    ::close(listener);
+    return 1;
+  }
+  ::close(listener);
+  std::error_code filesystem_error {};
+  std::filesystem::remove(this->_socketPath, filesystem_error);
+  std::filesystem::create_directories(this->_socketPath.parent_path(), filesystem_error);
+
+  listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 || ::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+    std::cerr << "Could not listen on " << this->_socketPath.string() << ": " << std::strerror(errno) << "\n";
+    if (listener >= 0) {
+      ::close(listener);
+    }
+    return 1;
+  }
+
+  std::signal(SIGPIPE, SIG_IGN);
+  std::signal(SIGINT, handleStopSignal);
+  std::signal(SIGTERM, handleStopSignal);
+  std::cerr << "Serving queries on " << this->_socketPath.string() << "\n";
+
+  std::thread refresher(&UbuntuCloudServer::refreshLoop, this);
+  while (!this->_stopping) {
+    if (stop_signal_received) {
+      this->stop();
+      break;
+    }
+    pollfd incoming { listener, POLLIN, 0 };
+    if (::poll(&incoming, 1, poll_interval_ms) <= 0) {
+      continue;  // Timeout or signal, check the stop conditions again
+    }
+    int connection { ::accept(listener, nullptr, nullptr) };
+    if (connection < 0) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(this->_mutex);
+      this->_connections++;
+    }
+    std::thread([this, connection]() {
+      this->serveConnection(connection);
+      std::lock_guard<std::mutex> lock(this->_mutex);
+      this->_connections--;
+      this->_condition.notify_all();  // Notified under the lock, run() may destroy the server as soon as the count reaches 0
+    }).detach();
+  }
+
+  ::close(listener);
+  std::filesystem::remove(this->_socketPath, filesystem_error);
+  refresher.join();
+  // Connections notice _stopping within one poll interval.
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  this->_condition.wait(lock, [this]() { return this->_connections == 0; });
+  return 0;
+}
+
+UbuntuCloudClient::UbuntuCloudClient(const std::filesystem::path& socket_path, std::string& error): _connection(-1), _received() {
+  sockaddr_un address {};
+  if (!socketAddress(socket_path, address, error)) {
+    return;
+  }
+  this->_connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (this->_connection < 0) {
+    error = std::string("Could not create socket: ") + std::strerror(errno);
+    return;
+  }
+  #ifdef SO_NOSIGPIPE
+  int enabled { 1 };
+  ::setsockopt(this->_connection, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+  #endif
+  if (::connect(this->_connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    error = "Could not connect to " + socket_path.string() + ": " + std::strerror(errno);
+    ::close(this->_connection);
+    this->_connection = -1;
+  }
+}
+
+UbuntuCloudClient::~UbuntuCloudClient() {
+  if (this->_connection >= 0) {
+    ::close(this->_connection);
+  }
+}
+
+bool UbuntuCloudClient::receive(std::size_t size) {
+  char chunk[4096];
+  while (this->_received.size() < size) {
+    ssize_t received { ::recv(this->_connection, chunk, sizeof(chunk), 0) };
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    this->_received.append(chunk, static_cast<std::size_t>(received));
+  }
+  return true;
+}
+
+int UbuntuCloudClient::query(const UbuntuCloudRequest& request, std::ostream& output, std::ostream& errors) {
+  // The format travels as a prefix of the request line, see parseRequestLine()
+  std::string format_prefix { request.format == UbuntuCloudOutputFormat::Text ? "" : std::string("--format ") + outputFormatName(request.format) + " " };
+  if (!this->isConnected() || !sendAll(this->_connection, format_prefix + request.option + " " + request.argument + "\n")) {
+    errors << "Lost connection to the server\n";
+    return 1;
+  }
+  // Header line: "<status> <output bytes> <error bytes>"
+  std::size_t header_end { std::string::npos };
+  while ((header_end = this->_received.find('\n')) == std::string::npos) {
+    if (!this->receive(this->_received.size() + 1)) {
+      errors << "Lost connection to the server\n";
+      return 1;
+    }
+  }
+  std::istringstream header(this->_received.substr(0, header_end));
+  int                return_code { 1 };
+  std::size_t        output_size { 0 };
+  std::size_t        errors_size { 0 };
+  if (!(header >> return_code >> output_size >> errors_size) || !this->receive(header_end + 1 + output_size + errors_size)) {
+    errors << "Invalid answer from the server\n";
+    return 1;
+  }
+  output.write(this->_received.data() + header_end + 1, static_cast<std::streamsize>(output_size));
+  output.flush();
+  errors.write(this->_received.data() + header_end + 1 + output_size, static_cast<std::streamsize>(errors_size));
+  this->_received.erase(0, header_end + 1 + output_size + errors_size);
+  return return_code;
+}
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * @file UbuntuCloudServer.hpp
+ * @brief Declares the resident daemon serving queries over a Unix domain socket, and the thin client talking to it.
+ *
+ * The daemon keeps one parsed catalog in memory and answers the same queries as the command line. A background
+ * thread refreshes the catalog on a timer and publishes the new one with an atomic shared_ptr store, so a query
+ * never waits for a refresh: it keeps answering from the catalog it started with, which stays alive until the
+ * last reader releases it.
+ *
+ * The protocol is line based. A client sends one query per line, written as in --batch input (e.g. "sha256 noble").
+ * The daemon answers each query with a header line "<status> <output bytes> <error bytes>" followed by the output
+ * and error text the command line would have printed on std::cout and std::cerr. Blank and comment lines get no answer.
+ *
+ * Unix domain sockets are only used on POSIX systems. On Windows both classes report that the mode is unavailable.
+ */
+
+#pragma once
+
+#include "UbuntuCloudIO.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @class UbuntuCloudServer
+ * @brief Answers queries from a resident catalog that is refreshed in the background.
+ */
+class UbuntuCloudServer {
+  public:
+    /// Function building a new catalog, called once at start-up and then on every refresh.
+    using Loader = std::function<std::unique_ptr<UbuntuCloudInterface>()>;
+
+  private:
+    /// Path of the listening socket.
+    const std::filesystem::path _socketPath;
+    /// Time between two refreshes of the catalog.
+    const std::chrono::seconds _refreshInterval;
+    /// Builds the catalogs served.
+    const Loader _loader;
+    /// Catalog currently served. Only accessed through std::atomic_load() and std::atomic_store().
+    std::shared_ptr<const UbuntuCloudInterface> _catalog;
+    /// Set when the server has to shut down.
+    std::atomic<bool> _stopping;
+    /// Number of connections being served.
+    std::size_t _connections;
+    /// Protects _connections and wakes up the refresh thread on shutdown.
+    std::mutex _mutex;
+    /// Signalled when _stopping is set or a connection ends.
+    std::condition_variable _condition;
+
+    /**
+     * @brief Replaces the served catalog with a freshly loaded one, keeping the current one if the load fails.
+     * @return bool True if a new catalog was published.
+     */
+    bool refresh();
+
+    /**
+     * @brief Refreshes the catalog every _refreshInterval until the server stops.
+     */
+    void refreshLoop();
+
+    /**
+     * @brief Answers the queries of one client until it disconnects or the server stops.
+     * @param connection The connected socket, closed before returning.
+     */
+    void serveConnection(int connection);
+
+  public:
+    /**
+     * @brief Constructs a server. Nothing is loaded or bound until run().
+     * @param socket_path Path of the Unix domain socket to listen on.
+     * @param refresh_interval Time between two refreshes of the catalog.
+     * @param loader Function building a catalog, e.g. a UbuntuCloudFactory call.
+     */
+    UbuntuCloudServer(std::filesystem::path socket_path, std::chrono::seconds refresh_interval, Loader loader);
+
+    UbuntuCloudServer(const UbuntuCloudServer&)            = delete;
+    UbuntuCloudServer& operator=(const UbuntuCloudServer&) = delete;
+
+    /**
+     * @brief Loads the catalog, binds the socket and serves queries until SIGINT or SIGTERM is received.
+     *
+     * A stale socket file left by a crashed server is replaced, a socket with a live server behind it is not.
+     * @return int Status code: 0 after a clean shutdown, 1 if the catalog could not be loaded or the socket could not be bound.
+     */
+    int run();
+
+    /**
+     * @brief Asks run() to return. Safe to call from any thread.
+     */
+    void stop();
+};
+
+/**
+ * @class UbuntuCloudClient
+ * @brief Forwards queries to a running UbuntuCloudServer.
+ */
+class UbuntuCloudClient {
+  private:
+    /// The connected socket, -1 if not connected.
+    int _connection;
+    /// Bytes received but not consumed yet.
+    std::string _received;
+
+    /**
+     * @brief Reads from the socket until _received holds at least a given number of bytes.
+     * @param size Number of bytes needed.
+     * @return bool False if the server closed the connection first.
+     */
+    bool receive(std::size_t size);
+
+  public:
+    /**
+     * @brief Connects to a server.
+     * @param socket_path Path of the server's socket.
+     * @param[out] error Receives a description of the problem on failure.
+     * @note Check isConnected() afterwards.
+     */
+    UbuntuCloudClient(const std::filesystem::path& socket_path, std::string& error);
+
+    UbuntuCloudClient(const UbuntuCloudClient&)            = delete;
+    UbuntuCloudClient& operator=(const UbuntuCloudClient&) = delete;
+
+    ~UbuntuCloudClient();
+
+    /**
+     * @brief Checks whether the client is connected.
+     * @return bool True if queries can be sent.
+     */
+    bool isConnected() const { return this->_connection >= 0; }
+
+    /**
+     * @brief Sends one query and copies the answer to the given streams.
+     * @param request The query. Its option must satisfy isQueryOption().
+     * @param output Stream receiving the query's result.
+     * @param errors Stream receiving the query's error messages.
+     * @return int Status code of the query on the server, 1 if the connection failed.
+     */
+    int query(const UbuntuCloudRequest& request, std::ostream& output = std::cout, std::ostream& errors = std::cerr);
+};
@@ -0,0 +1,218 @@
+/**
+ * @file UbuntuCloudSha256.cpp
+ * @brief Implementation of the incremental SHA-256 hasher.
+ *
+ * On x86 processors with the SHA extensions (SHA-NI), blocks are compressed with the dedicated instructions, several
+ * times faster than the portable code. The choice is made once at run time from CPUID, so one binary runs everywhere.
+ */
+
+#include "UbuntuCloudSha256.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+  #define UBUNTU_CLOUD_SHA_NI
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define UBUNTU_CLOUD_TARGET_SHA
+  #else
+    #include <cpuid.h>
+    #define UBUNTU_CLOUD_TARGET_SHA __attribute__((target("sha,sse4.1,ssse3")))
+  #endif
+#endif
+
+/// Round constants, the first 32 bits of the fractional parts of the cube roots of the first 64 primes.
+constexpr static std::uint32_t round_constants[64] {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+  0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+  0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+  0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+  0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ * @brief Rotates a word right.
+ * @param value The word.
+ * @param count Number of bits, between 1 and 31.
+ * @return std::uint32_t The rotated word.
+ */
+static inline std::uint32_t rotateRight(std::uint32_t value, int count) {
+  return (value >> count) | (value << (32 - count));
+}
+
+#ifdef UBUNTU_CLOUD_SHA_NI
+/**
+ * @brief Tells whether the processor supports the SHA extensions and the SSE4.1 and SSSE3 instructions used with them.
+ * @return bool True if compressShaExtensions() can run.
+ */
+static bool hasShaExtensions() {
+  #ifdef _MSC_VER
+  int registers[4] {};
+  __cpuid(registers, 0);
+  if (registers[0] < 7) {
+    return false;
+  }
+  __cpuidex(registers, 7, 0);
+  bool sha { (registers[1] & (1 << 29)) != 0 };  // EBX bit 29
+  __cpuid(registers, 1);
+  return sha && (registers[2] & (1 << 19)) != 0 && (registers[2] & (1 << 9)) != 0;  // ECX bits 19 (SSE4.1) and 9 (SSSE3)
+  #else
+  unsigned int eax { 0 }, ebx { 0 }, ecx { 0 }, edx { 0 };
+  if (__get_cpuid_max(0, nullptr) < 7) {
+    return false;
+  }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  bool sha { (ebx & (1U << 29)) != 0 };
+  __cpuid(1, eax, ebx, ecx, edx);
+  return sha && (ecx & (1U << 19)) != 0 && (ecx & (1U << 9)) != 0;
+  #endif
+}
+
+/// Whether blocks are compressed with the SHA extensions, decided once per process.
+static const bool use_sha_extensions { hasShaExtensions() };
+
+/**
+ * @brief Runs the compression function over whole blocks with the SHA extensions.
+ *
+ * The state is kept as the ABEF and CDGH halves the instructions work on. Each iteration runs four rounds, and
+ * computes the message words of the following iterations with sha256msg1/sha256msg2 while the rounds run.
+ * @param state The intermediate hash value, updated in place.
+ * @param data First byte of the blocks.
+ * @param block_count Number of 64-byte blocks.
+ */
+UBUNTU_CLOUD_TARGET_SHA static void compressShaExtensions(std::uint32_t* state, const unsigned char* data, std::size_t block_count) {
+  const __m128i byte_swap { _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL) };  // Big-endian words
+  __m128i       swapped { _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1) };  // CDAB
+  __m128i       state1 { _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B) };  // EFGH
+  __m128i       state0 { _mm_alignr_epi8(swapped, state1, 8) };     // ABEF
+  state1 = _mm_blend_epi16(state1, swapped, 0xF0);                  // CDGH
+  for (std::size_t block = 0; block < block_count; block++, data += 64) {
+    __m128i abef { state0 };
+    __m128i cdgh { state1 };
+    __m128i words[4];
+    for (int idx = 0; idx < 4; idx++) {
+      words[idx] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * idx)), byte_swap);
+    }
+    for (int group = 0; group < 16; group++) {
+      const __m128i& current { words[group & 3] };
+      __m128i message { _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i*>(round_constants + 4 * group))) };
+      state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+      if (group >= 3 && group < 15) {
+        // Words of the next group, from the partial schedule sha256msg1 left in its slot
+        __m128i& next { words[(group + 1) & 3] };
+        next = _mm_add_epi32(next, _mm_alignr_epi8(current, words[(group - 1) & 3], 4));
+        next = _mm_sha256msg2_epu32(next, current);
+      }
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+      if (group >= 1 && group < 13) {
+        words[(group - 1) & 3] = _mm_sha256msg1_epu32(words[(group - 1) & 3], current);
+      }
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+  swapped = _mm_shuffle_epi32(state0, 0x1B);    // FEBA
+  state1  = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+  state0  = _mm_blend_epi16(swapped, state1, 0xF0);  // DCBA
+  state1  = _mm_alignr_epi8(state1, swapped, 8);     // HGFE
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+#endif
+
+UbuntuCloudSha256::UbuntuCloudSha256():
+    _state({ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }), _block(), _blockSize(0),
+    _length(0) { }
+
+void UbuntuCloudSha256::compress(const unsigned char* data, std::size_t block_count) {
+#ifdef UBUNTU_CLOUD_SHA_NI
+  if (use_sha_extensions) {
+    compressShaExtensions(this->_state.data(), data, block_count);
+    return;  // Early return, the portable rounds below are the fallback
+  }
+#endif
+  for (std::size_t block = 0; block < block_count; block++, data += 64) {
+    std::uint32_t schedule[64];
+    for (int idx = 0; idx < 16; idx++) {
+      // Words are big-endian
+      schedule[idx] = (std::uint32_t { data[4 * idx] } << 24) | (std::uint32_t { data[4 * idx + 1] } << 16) |
+                      (std::uint32_t { data[4 * idx + 2] } << 8) | std::uint32_t { data[4 * idx + 3] };
+    }
+    for (int idx = 16; idx < 64; idx++) {
+      std::uint32_t sigma0 { rotateRight(schedule[idx - 15], 7) ^ rotateRight(schedule[idx - 15], 18) ^ (schedule[idx - 15] >> 3) };
+      std::uint32_t sigma1 { rotateRight(schedule[idx - 2], 17) ^ rotateRight(schedule[idx - 2], 19) ^ (schedule[idx - 2] >> 10) };
+      schedule[idx] = schedule[idx - 16] + sigma0 + schedule[idx - 7] + sigma1;
+    }
+    std::uint32_t a { this->_state[0] }, b { this->_state[1] }, c { this->_state[2] }, d { this->_state[3] };
+    std::uint32_t e { this->_state[4] }, f { this->_state[5] }, g { this->_state[6] }, h { this->_state[7] };
+    for (int idx = 0; idx < 64; idx++) {
+      std::uint32_t sum1 { rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25) };
+      std::uint32_t choice { (e & f) ^ (~e & g) };
+      std::uint32_t temporary1 { h + sum1 + choice + round_constants[idx] + schedule[idx] };
+      std::uint32_t sum0 { rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22) };
+      std::uint32_t majority { (a & b) ^ (a & c) ^ (b & c) };
+      std::uint32_t temporary2 { sum0 + majority };
+      h = g;
+      g = f;
+      f = e;
+      e = d + temporary1;
+      d = c;
+      c = b;
+      b = a;
+      a = temporary1 + temporary2;
+    }
+    this->_state[0] += a;
+    this->_state[1] += b;
+    this->_state[2] += c;
+    this->_state[3] += d;
+    this->_state[4] += e;
+    this->_state[5] += f;
+    this->_state[6] += g;
+    this->_state[7] += h;
+  }
+}
+
+void UbuntuCloudSha256::update(const void* data, std::size_t size) {
+  const unsigned char* bytes { static_cast<const unsigned char*>(data) };
+  this->_length += size;
+  if (this->_blockSize > 0) {
+    // Complete the pending block first
+    std::size_t copied { std::min(size, this->_block.size() - this->_blockSize) };
+    std::memcpy(this->_block.data() + this->_blockSize, bytes, copied);
+    this->_blockSize += copied;
+    bytes += copied;
+    size -= copied;
+    if (this->_blockSize < this->_block.size()) {
+      return;  // Early return, still not a whole block
+    }
+    this->compress(this->_block.data(), 1);
+    this->_blockSize = 0;
+  }
+  // Whole blocks straight from the caller's buffer, without copying them
+  this->compress(bytes, size / 64);
+  std::size_t remainder { size % 64 };
+  std::memcpy(this->_block.data(), bytes + size - remainder, remainder);
+  this->_blockSize = remainder;
+}
+
+std::string UbuntuCloudSha256::hexDigest() {
+  std::uint64_t bit_length { this->_length * 8 };
+  // Padding: a one bit, zeros up to 56 bytes modulo 64, then the message length in bits, big-endian
+  unsigned char padding[72] { 0x80 };
+  std::size_t   padding_size { (this->_blockSize < 56 ? 56 : 120) - this->_blockSize };
+  for (int idx = 0; idx < 8; idx++) {
+    padding[padding_size + static_cast<std::size_t>(idx)] = static_cast<unsigned char>(bit_length >> (56 - 8 * idx));
+  }
+  this->update(padding, padding_size + 8);
+  static constexpr char digits[] { "0123456789abcdef" };
+  std::string digest(64, '0');
+  for (std::size_t word = 0; word < 8; word++) {
+    for (std::size_t nibble = 0; nibble < 8; nibble++) {
+      digest[word * 8 + nibble] = digits[(this->_state[word] >> (28 - 4 * nibble)) & 0xf];
+    }
+  }
+  return digest;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file UbuntuCloudSha256.hpp
+ * @brief Declares an incremental SHA-256 hasher (FIPS 180-4), used to verify images while they are written.
+ *
+ * The hasher is fed any number of byte ranges in order and produces the digest of their concatenation, so a file
+ * can be hashed as it streams in, without a second pass over it.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class UbuntuCloudSha256
+ * @brief Incremental SHA-256 of a byte stream.
+ */
+class UbuntuCloudSha256 {
+  private:
+    /// Intermediate hash value.
+    std::array<std::uint32_t, 8> _state;
+    /// Bytes waiting for a complete 64-byte block.
+    std::array<unsigned char, 64> _block;
+    /// Number of bytes in _block.
+    std::size_t _blockSize;
+    /// Total number of bytes hashed so far.
+    std::uint64_t _length;
+
+    /**
+     * @brief Runs the compression function over whole blocks.
+     * @param data First byte of the blocks.
+     * @param block_count Number of 64-byte blocks.
+     */
+    void compress(const unsigned char* data, std::size_t block_count);
+
+  public:
+    /**
+     * @brief Constructs a hasher of the empty stream.
+     */
+    UbuntuCloudSha256();
+
+    /**
+     * @brief Appends bytes to the hashed stream.
+     * @param data First byte.
+     * @param size Number of bytes.
+     */
+    void update(const void* data, std::size_t size);
+
+    /**
+     * @brief Finishes the hash and returns the digest. The hasher must not be updated afterwards.
+     * @return std::string The digest as 64 lowercase hexadecimal digits, the form the product files use.
+     */
+    std::string hexDigest();
+};
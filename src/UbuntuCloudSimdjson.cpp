@@ -0,0 +1,278 @@
+/**
+ * @file UbuntuCloudSimdjson.cpp
+ * @brief Implementation of the product file parser on the On-Demand API of simdjson.
+ *
+ * The document is walked in order, and only the paths kept by the SAX handler of UbuntuCloudParser.cpp are read:
+ * - products.<product>.{release, release_title, arch, aliases, version, supported}
+ * - products.<product>.versions.<serial>.items.<item>.{sha256, path, size}
+ *
+ * Any other value is skipped by the iteration without being decoded. As in the SAX handler, a known key holding a
+ * value of another type than expected is ignored, so both backends produce the same products.
+ */
+
+#include "UbuntuCloudParser.hpp"
+
+#include <simdjson.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace ondemand = simdjson::ondemand;
+
+/**
+ * @brief Tells whether a value has a given JSON type.
+ * @param value The value, not consumed.
+ * @param wanted The type.
+ * @return bool True if the value is of that type.
+ */
+static bool hasType(ondemand::value& value, ondemand::json_type wanted) {
+  ondemand::json_type type {};
+  return value.type().get(type) == simdjson::SUCCESS && type == wanted;
+}
+
+/**
+ * @brief Reads the string of a value into an arena.
+ * @param value The value. Values of another type are left to the iteration to skip.
+ * @param strings The arena receiving the string.
+ * @param[out] target Receives the stored string, untouched if the value is not a string.
+ * @return simdjson::error_code SUCCESS, or the error of an invalid string.
+ */
+static simdjson::error_code readString(ondemand::value& value, UbuntuCloudArena& strings, std::string_view& target) {
+  if (!hasType(value, ondemand::json_type::string)) {
+    return simdjson::SUCCESS;
+  }
+  std::string_view text {};
+  if (simdjson::error_code code { value.get_string().get(text) }; code != simdjson::SUCCESS) {
+    return code;
+  }
+  target = strings.store(text);
+  return simdjson::SUCCESS;
+}
+
+/**
+ * @brief Reads the string of a value.
+ * @param value The value. Values of another type are left to the iteration to skip.
+ * @param[out] target Receives the string, untouched if the value is not a string.
+ * @return simdjson::error_code SUCCESS, or the error of an invalid string.
+ */
+static simdjson::error_code readString(ondemand::value& value, std::string& target) {
+  if (!hasType(value, ondemand::json_type::string)) {
+    return simdjson::SUCCESS;
+  }
+  std::string_view text {};
+  if (simdjson::error_code code { value.get_string().get(text) }; code != simdjson::SUCCESS) {
+    return code;
+  }
+  target.assign(text);
+  return simdjson::SUCCESS;
+}
+
+/**
+ * @brief Reads the items of a serial.
+ * @param items The "items" object.
+ * @param product The product, whose arena receives the strings.
+ * @param version The serial receiving the items.
+ * @return simdjson::error_code SUCCESS, or the first error of the document.
+ */
+static simdjson::error_code readItems(ondemand::object& items, UbuntuProduct& product, UbuntuProductVersion& version) {
+  for (auto item_result : items) {
+    ondemand::field  item_field {};
+    std::string_view name {};
+    if (simdjson::error_code code { std::move(item_result).get(item_field) }; code != simdjson::SUCCESS) {
+      return code;
+    }
+    if (simdjson::error_code code { item_field.unescaped_key().get(name) }; code != simdjson::SUCCESS) {
+      return code;
+    }
+    ondemand::object item_object {};
+    if (!hasType(item_field.value(), ondemand::json_type::object) || item_field.value().get_object().get(item_object) != simdjson::SUCCESS) {
+      continue;  // Not an item
+    }
+    UbuntuProductItem& item { version.items.emplace_back() };
+    item.name = product.strings->store(name);
+    for (auto field_result : item_object) {
+      ondemand::field  field {};
+      std::string_view key {};
+      if (simdjson::error_code code { std::move(field_result).get(field) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+      if (simdjson::error_code code { field.unescaped_key().get(key) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+      simdjson::error_code code { simdjson::SUCCESS };
+      if (key == "sha256") {
+        code = readString(field.value(), *product.strings, item.sha256);
+      } else if (key == "path") {
+        code = readString(field.value(), *product.strings, item.path);
+      } else if (key == "size") {
+        std::uint64_t size {};
+        if (field.value().get_uint64().get(size) == simdjson::SUCCESS) {
+          item.size = size;  // Negative and fractional sizes are ignored, as by the SAX handler
+        }
+      }
+      if (code != simdjson::SUCCESS) {
+        return code;
+      }
+    }
+  }
+  return simdjson::SUCCESS;
+}
+
+/**
+ * @brief Reads the serials of a product.
+ * @param versions The "versions" object.
+ * @param product The product receiving the serials.
+ * @return simdjson::error_code SUCCESS, or the first error of the document.
+ */
+static simdjson::error_code readVersions(ondemand::object& versions, UbuntuProduct& product) {
+  for (auto version_result : versions) {
+    ondemand::field  version_field {};
+    std::string_view serial {};
+    if (simdjson::error_code code { std::move(version_result).get(version_field) }; code != simdjson::SUCCESS) {
+      return code;
+    }
+    if (simdjson::error_code code { version_field.unescaped_key().get(serial) }; code != simdjson::SUCCESS) {
+      return code;
+    }
+    ondemand::object version_object {};
+    if (!hasType(version_field.value(), ondemand::json_type::object) ||
+        version_field.value().get_object().get(version_object) != simdjson::SUCCESS) {
+      continue;  // Not a serial
+    }
+    UbuntuProductVersion& version { product.versions.emplace_back() };
+    version.serial = std::string(serial);
+    for (auto field_result : version_object) {
+      ondemand::field  field {};
+      std::string_view key {};
+      if (simdjson::error_code code { std::move(field_result).get(field) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+      if (simdjson::error_code code { field.unescaped_key().get(key) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+      ondemand::object items {};
+      if (key != "items" || !hasType(field.value(), ondemand::json_type::object) || field.value().get_object().get(items) != simdjson::SUCCESS) {
+        continue;
+      }
+      if (simdjson::error_code code { readItems(items, product, version) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+    }
+  }
+  // Versions are kept from the oldest to the most recent serial, the order the catalog stores them in
+  std::sort(product.versions.begin(), product.versions.end(), versionPrecedes);
+  return simdjson::SUCCESS;
+}
+
+/**
+ * @brief Reads the products of a product file.
+ * @param products_object The "products" object.
+ * @param[out] products Receives the products.
+ * @return simdjson::error_code SUCCESS, or the first error of the document.
+ */
+static simdjson::error_code readProducts(ondemand::object& products_object, std::vector<UbuntuProduct>& products) {
+  for (auto product_result : products_object) {
+    ondemand::field  product_field {};
+    std::string_view name {};
+    if (simdjson::error_code code { std::move(product_result).get(product_field) }; code != simdjson::SUCCESS) {
+      return code;
+    }
+    if (simdjson::error_code code { product_field.unescaped_key().get(name) }; code != simdjson::SUCCESS) {
+      return code;
+    }
+    ondemand::object product_object {};
+    if (!hasType(product_field.value(), ondemand::json_type::object) ||
+        product_field.value().get_object().get(product_object) != simdjson::SUCCESS) {
+      continue;  // Not a product
+    }
+    UbuntuProduct& product { products.emplace_back() };
+    product.name    = std::string(name);
+    product.strings = std::make_unique<UbuntuCloudArena>();
+    for (auto field_result : product_object) {
+      ondemand::field  field {};
+      std::string_view key {};
+      if (simdjson::error_code code { std::move(field_result).get(field) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+      if (simdjson::error_code code { field.unescaped_key().get(key) }; code != simdjson::SUCCESS) {
+        return code;
+      }
+      simdjson::error_code code { simdjson::SUCCESS };
+      if (key == "release") {
+        code = readString(field.value(), product.release);
+      } else if (key == "release_title") {
+        code = readString(field.value(), product.release_title);
+      } else if (key == "arch") {
+        code = readString(field.value(), product.arch);
+      } else if (key == "aliases") {
+        code = readString(field.value(), product.aliases);
+      } else if (key == "version") {
+        code = readString(field.value(), product.version);
+      } else if (key == "supported") {
+        bool supported {};
+        if (field.value().get_bool().get(supported) == simdjson::SUCCESS) {
+          product.supported = supported;
+        }
+      } else if (key == "versions") {
+        ondemand::object versions {};
+        if (hasType(field.value(), ondemand::json_type::object) && field.value().get_object().get(versions) == simdjson::SUCCESS) {
+          code = readVersions(versions, product);
+        }
+      }
+      if (code != simdjson::SUCCESS) {
+        return code;
+      }
+    }
+  }
+  return simdjson::SUCCESS;
+}
+
+bool parseProductStreamSimdjson(std::istream& input, std::vector<UbuntuProduct>& products, std::string& error) {
+  // On-Demand parses a complete buffer, followed by SIMDJSON_PADDING readable bytes
+  std::string body {};
+  char        buffer[64 * 1024];
+  while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+    body.append(buffer, static_cast<std::size_t>(input.gcount()));
+  }
+  body.reserve(body.size() + simdjson::SIMDJSON_PADDING);
+
+  ondemand::parser     parser {};
+  ondemand::document   document {};
+  ondemand::object     root {};
+  bool                 found_products { false };
+  simdjson::error_code code { parser.iterate(simdjson::padded_string_view(body.data(), body.size(), body.capacity())).get(document) };
+  if (code == simdjson::SUCCESS) {
+    code = document.get_object().get(root);
+  }
+  if (code == simdjson::SUCCESS) {
+    for (auto field_result : root) {
+      ondemand::field  field {};
+      std::string_view key {};
+      if ((code = std::move(field_result).get(field)) != simdjson::SUCCESS || (code = field.unescaped_key().get(key)) != simdjson::SUCCESS) {
+        break;
+      }
+      ondemand::object products_object {};
+      if (key != "products" || !hasType(field.value(), ondemand::json_type::object) ||
+          field.value().get_object().get(products_object) != simdjson::SUCCESS) {
+        continue;
+      }
+      found_products = true;
+      if ((code = readProducts(products_object, products)) != simdjson::SUCCESS) {
+        break;
+      }
+    }
+  }
+  if (code == simdjson::SUCCESS && !document.at_end()) {
+    code = simdjson::TRAILING_CONTENT;
+  }
+  if (code != simdjson::SUCCESS) {
+    error = std::string("JSON parsing error: ") + simdjson::error_message(code);
+    return false;
+  }
+  if (!found_products) {
+    // Problem with data content, this key contains our data of interest
+    error = "Data not found on curl request";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file UbuntuCloudSnapshot.cpp
+ * @brief Implementation of the UbuntuCloudSnapshot class.
+ */
+
+#include "UbuntuCloudSnapshot.hpp"
+
+#include <iostream>
+
+UbuntuCloudSnapshot::UbuntuCloudSnapshot(const std::filesystem::path& path): _path(path), _initialized(false), _catalog() {
+  std::string                       error {};
+  std::optional<UbuntuCloudCatalog> catalog { UbuntuCloudCatalog::openSnapshot(this->_path, error) };
+  if (!catalog) {
+    std::cerr << error << std::endl;
+    this->setLoaded(false);
+    return;
+  }
+  this->_catalog     = std::move(*catalog);
+  this->_initialized = true;
+  this->setLoaded(true);
+}
+
+std::vector<UbuntuRelease> UbuntuCloudSnapshot::getSupportedReleases() const {
+  return this->_catalog.supportedReleases();
+}
+
+std::optional<UbuntuRelease> UbuntuCloudSnapshot::getCurrentLTS() const {
+  return this->_catalog.currentLTS();
+}
+
+std::optional<std::string> UbuntuCloudSnapshot::getSha256ForRelease(const std::string& release_name) const {
+  return this->_catalog.sha256ForRelease(release_name);
+}
+
+std::optional<UbuntuCloudImage> UbuntuCloudSnapshot::getDiskImageForRelease(const std::string& release_name) const {
+  return this->_catalog.diskImageForRelease(release_name);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file UbuntuCloudSnapshot.hpp
+ * @brief Provides an implementation of UbuntuCloudInterface backed by a catalog snapshot on disk.
+ *
+ * The UbuntuCloudSnapshot class answers the queries from a snapshot written by a previous successful fetch
+ * (see UbuntuCloudCatalog::writeSnapshot()). The snapshot is memory-mapped, so construction involves neither
+ * network access nor parsing, and concurrent processes share the same page-cache copy of the file.
+ */
+
+#pragma once
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudInterface.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Implementation of UbuntuCloudInterface that reads Ubuntu release data from a local snapshot.
+ */
+class UbuntuCloudSnapshot : public UbuntuCloudInterface {
+  private:
+    /// Path of the snapshot file.
+    const std::filesystem::path _path;
+    /// Whether the snapshot was opened and validated.
+    bool _initialized;
+    /// Catalog mapped from the snapshot.
+    UbuntuCloudCatalog _catalog;
+
+    /**
+     * @brief Nothing to load, the constructor maps the snapshot.
+     * @return bool Whether the snapshot was opened.
+     */
+    bool load() override { return this->_initialized; }
+
+  public:
+    /**
+     * @brief Constructor that opens the snapshot.
+     *
+     * Errors are reported on std::cerr, and leave the instance uninitialized.
+     * @param path The snapshot file.
+     */
+    UbuntuCloudSnapshot(const std::filesystem::path& path);
+
+    /**
+     * @brief Checks if the snapshot was opened successfully.
+     * @return bool True if initialized, false otherwise.
+     */
+    bool isInitialized() const override { return _initialized; }
+
+    /**
+     * @brief Returns the mapped catalog, e.g. to go through every item.
+     * @return const UbuntuCloudCatalog& The catalog, empty if the snapshot could not be opened.
+     */
+    const UbuntuCloudCatalog& getCatalog() const override { return this->_catalog; }
+
+    /**
+     * @brief Returns a list of all currently supported Ubuntu releases.
+     * @return std::vector<UbuntuRelease> List of supported releases.
+     */
+    std::vector<UbuntuRelease> getSupportedReleases() const override;
+
+    /**
+     * @brief Retrieves the current Long Term Support (LTS) Ubuntu release, if available.
+     * @return An optional UbuntuRelease object containing the current LTS release information, or std::nullopt if none found.
+     */
+    std::optional<UbuntuRelease> getCurrentLTS() const override;
+
+    /**
+     * @brief Retrieves the SHA256 checksum for a given Ubuntu release for amd64, if available.
+     * @param release The name or title of the release to search for.
+     * @return An optional string containing the SHA256 checksum, or std::nullopt if no match is found.
+     */
+    std::optional<std::string> getSha256ForRelease(const std::string& release) const override;
+
+    /**
+     * @brief Retrieves the URL, checksum and size of the disk1.img whose checksum getSha256ForRelease() returns.
+     * @param release The name or title of the release to search for.
+     * @return An optional UbuntuCloudImage, or std::nullopt if no match is found.
+     */
+    std::optional<UbuntuCloudImage> getDiskImageForRelease(const std::string& release) const override;
+};
@@ -0,0 +1,167 @@
+/**
+ * @file UbuntuCloudStats.cpp
+ * @brief Implementation of the statistics renderings.
+ *
+ * Metric names of the Prometheus output all start with "ubuntu_version_fetcher_". Transfer metrics carry the URL
+ * as a label, and the network phases a "phase" label, so that a dashboard can stack them.
+ */
+
+#include "UbuntuCloudStats.hpp"
+
+#include "UbuntuCloudFile.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <sstream>
+#include <system_error>
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+std::uint64_t peakMemoryBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters {};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return static_cast<std::uint64_t>(counters.PeakWorkingSetSize);
+#else
+  rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  #ifdef __APPLE__
+  return static_cast<std::uint64_t>(usage.ru_maxrss);  // Bytes on macOS
+  #else
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;  // Kilobytes elsewhere
+  #endif
+#endif
+}
+
+std::string formatStatsJson(const UbuntuCloudStats& stats) {
+  nlohmann::json transfers = nlohmann::json::array();
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    transfers.push_back({
+        {               "url",               transfer.url },
+        {            "source",            transfer.source },
+        {     "response_code",     transfer.response_code },
+        {       "dns_seconds",       transfer.dns_seconds },
+        {   "connect_seconds",   transfer.connect_seconds },
+        {       "tls_seconds",       transfer.tls_seconds },
+        {      "wait_seconds",      transfer.wait_seconds },
+        {   "receive_seconds",   transfer.receive_seconds },
+        {     "total_seconds",     transfer.total_seconds },
+        {     "parse_seconds",     transfer.parse_seconds },
+        {    "bytes_received",    transfer.bytes_received },
+        {          "encoding",          transfer.encoding },
+        {          "requests",          transfer.requests },
+        { "reused_connection", transfer.reused_connection }
+    });
+  }
+  nlohmann::json object = {
+    {      "load_seconds",      stats.load_seconds },
+    {     "index_seconds",     stats.index_seconds },
+    {  "snapshot_seconds",  stats.snapshot_seconds },
+    {     "query_seconds",     stats.query_seconds },
+    {           "queries",           stats.queries },
+    { "peak_memory_bytes", stats.peak_memory_bytes },
+    {         "transfers",               transfers }
+  };
+  return object.dump();
+}
+
+/**
+ * @brief Escapes a Prometheus label value.
+ * @param value The raw value.
+ * @return std::string The value with backslashes, quotes and newlines escaped.
+ */
+static std::string escapeLabel(const std::string& value) {
+  std::string escaped {};
+  escaped.reserve(value.size());
+  for (char character : value) {
+    if (character == '\\' || character == '"') {
+      escaped += '\\';
+      escaped += character;
+    } else if (character == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += character;
+    }
+  }
+  return escaped;
+}
+
+/**
+ * @brief Writes the HELP and TYPE lines of a gauge.
+ * @param output The exposition being written.
+ * @param name The metric name, without the common prefix.
+ * @param help The description of the metric.
+ */
+static void writeGaugeHeader(std::ostringstream& output, const char* name, const char* help) {
+  output << "# HELP ubuntu_version_fetcher_" << name << ' ' << help << '\n';
+  output << "# TYPE ubuntu_version_fetcher_" << name << " gauge\n";
+}
+
+bool writeStatsPrometheus(const UbuntuCloudStats& stats, const std::filesystem::path& path) {
+  std::ostringstream output {};
+  output.precision(9);
+  writeGaugeHeader(output, "load_seconds", "Time to load the catalog.");
+  output << "ubuntu_version_fetcher_load_seconds " << stats.load_seconds << '\n';
+  writeGaugeHeader(output, "index_seconds", "Time to build the indexed catalog.");
+  output << "ubuntu_version_fetcher_index_seconds " << stats.index_seconds << '\n';
+  writeGaugeHeader(output, "snapshot_seconds", "Time to write the catalog snapshot.");
+  output << "ubuntu_version_fetcher_snapshot_seconds " << stats.snapshot_seconds << '\n';
+  writeGaugeHeader(output, "query_seconds", "Time to answer every query.");
+  output << "ubuntu_version_fetcher_query_seconds " << stats.query_seconds << '\n';
+  writeGaugeHeader(output, "queries", "Number of queries answered.");
+  output << "ubuntu_version_fetcher_queries " << stats.queries << '\n';
+  writeGaugeHeader(output, "peak_memory_bytes", "Peak resident memory of the process.");
+  output << "ubuntu_version_fetcher_peak_memory_bytes " << stats.peak_memory_bytes << '\n';
+
+  writeGaugeHeader(output, "transfer_phase_seconds", "Duration of each network phase of a transfer.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    std::string labels { "url=\"" + escapeLabel(transfer.url) + "\",source=\"" + transfer.source + "\"" };
+    const std::pair<const char*, double> phases[] { { "dns", transfer.dns_seconds },   { "connect", transfer.connect_seconds },
+                                                    { "tls", transfer.tls_seconds },   { "wait", transfer.wait_seconds },
+                                                    { "receive", transfer.receive_seconds } };
+    for (const auto& [phase, seconds] : phases) {
+      output << "ubuntu_version_fetcher_transfer_phase_seconds{" << labels << ",phase=\"" << phase << "\"} " << seconds << '\n';
+    }
+  }
+  writeGaugeHeader(output, "transfer_seconds", "Total duration of a transfer.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    output << "ubuntu_version_fetcher_transfer_seconds{url=\"" << escapeLabel(transfer.url) << "\"} " << transfer.total_seconds << '\n';
+  }
+  writeGaugeHeader(output, "parse_seconds", "Time to parse a transferred or cached file.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    output << "ubuntu_version_fetcher_parse_seconds{url=\"" << escapeLabel(transfer.url) << "\"} " << transfer.parse_seconds << '\n';
+  }
+  writeGaugeHeader(output, "transfer_bytes", "Body bytes received over the network, as encoded on the wire.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    output << "ubuntu_version_fetcher_transfer_bytes{url=\"" << escapeLabel(transfer.url) << "\",encoding=\"" << transfer.encoding << "\"} "
+           << transfer.bytes_received << '\n';
+  }
+  writeGaugeHeader(output, "transfer_requests", "Requests started for a transfer, races, hedges and retries included.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    output << "ubuntu_version_fetcher_transfer_requests{url=\"" << escapeLabel(transfer.url) << "\"} " << transfer.requests << '\n';
+  }
+  writeGaugeHeader(output, "transfer_reused_connection", "1 if a transfer reused the connection of an earlier request, 0 otherwise.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    output << "ubuntu_version_fetcher_transfer_reused_connection{url=\"" << escapeLabel(transfer.url) << "\"} " << (transfer.reused_connection ? 1 : 0)
+           << '\n';
+  }
+  writeGaugeHeader(output, "transfer_response_code", "HTTP status code of a transfer, 0 without a request.");
+  for (const UbuntuCloudTransferStats& transfer : stats.transfers) {
+    output << "ubuntu_version_fetcher_transfer_response_code{url=\"" << escapeLabel(transfer.url) << "\"} " << transfer.response_code << '\n';
+  }
+
+  // Replaced atomically, so a collector never reads a partial file
+  return replaceFile(path, output.str());
+}
@@ -0,0 +1,74 @@
+/**
+ * @file UbuntuCloudStats.hpp
+ * @brief Declares the per-phase timings of a run and their JSON and Prometheus renderings.
+ *
+ * The fetcher records, for every downloaded or cached file, the network phases reported by libcurl (name lookup,
+ * TCP connect, TLS handshake, time to first byte, transfer), the bytes received and the parse time. The catalog
+ * build and the queries are timed with std::chrono::steady_clock. Together with the peak resident memory of the
+ * process, this tells where the time of a slow run went.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @struct UbuntuCloudTransferStats
+ * @brief Timings of one file, downloaded or read from the cache. All durations are in seconds.
+ */
+struct UbuntuCloudTransferStats {
+    std::string   url;                 ///< The URL of the file, on the mirror that served it.
+    std::string   source;              ///< "network" for a downloaded body, "not-modified" for a 304, "cache" without any request.
+    long          response_code {};    ///< HTTP status code, 0 without a request or for non-HTTP URLs.
+    double        dns_seconds {};      ///< Name lookup.
+    double        connect_seconds {};  ///< TCP connect, after the name lookup.
+    double        tls_seconds {};      ///< TLS handshake, after the connect. 0 for plain HTTP.
+    double        wait_seconds {};     ///< From the end of the handshake (or connect) to the first byte of the response.
+    double        receive_seconds {};  ///< From the first byte to the end of the response.
+    double        total_seconds {};    ///< Whole request as measured by libcurl.
+    double        parse_seconds {};    ///< Parse of the body, overlapping the receive phase for downloaded bodies.
+    std::uint64_t bytes_received {};   ///< Body bytes received over the network, compressed if the body was.
+    std::string   encoding { "identity" };  ///< Compression of the body on the wire: "identity", "gzip" or "zstd".
+    std::uint64_t requests {};         ///< Requests started for the file: 1 normally, more with races, hedges and retries.
+    bool          reused_connection {};  ///< Whether the response came over a connection opened by an earlier request.
+};
+
+/**
+ * @struct UbuntuCloudStats
+ * @brief Timings of one run of the tool. All durations are in seconds.
+ */
+struct UbuntuCloudStats {
+    std::vector<UbuntuCloudTransferStats> transfers;             ///< Stream indexes and product files, in completion order.
+    double                                load_seconds {};       ///< Loading the catalog, from the start of the fetch to a queryable catalog.
+    double                                index_seconds {};      ///< Building the indexed catalog from the parsed products.
+    double                                snapshot_seconds {};   ///< Writing the snapshot, 0 without one.
+    double                                query_seconds {};      ///< Answering every query, output included.
+    std::uint64_t                         queries {};            ///< Number of queries answered.
+    std::uint64_t                         peak_memory_bytes {};  ///< Peak resident memory of the process, 0 where unknown.
+};
+
+/**
+ * @brief Returns the peak resident memory of the process so far.
+ * @return std::uint64_t The peak in bytes, 0 on systems where it is not available.
+ */
+std::uint64_t peakMemoryBytes();
+
+/**
+ * @brief Renders statistics as a single-line JSON object.
+ * @param stats The statistics.
+ * @return std::string The JSON text, without a trailing newline.
+ */
+std::string formatStatsJson(const UbuntuCloudStats& stats);
+
+/**
+ * @brief Writes statistics in the Prometheus text exposition format, e.g. for the node exporter's textfile collector.
+ *
+ * The file is replaced atomically, so a collector never reads a partial file.
+ * @param stats The statistics.
+ * @param path The file to write, conventionally ending in ".prom".
+ * @return bool True if the file was written.
+ */
+bool writeStatsPrometheus(const UbuntuCloudStats& stats, const std::filesystem::path& path);
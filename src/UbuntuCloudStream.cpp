@@ -0,0 +1,73 @@
+/**
+ * @file UbuntuCloudStream.cpp
+ * @brief Implementation of the UbuntuCloudStreamBuffer class.
+ */
+
+#include "UbuntuCloudStream.hpp"
+
+UbuntuCloudStreamBuffer::UbuntuCloudStreamBuffer(std::size_t max_chunks):
+    _maxChunks(max_chunks), _chunks(), _current(), _finished(false), _closed(false), _roomCallback() { }
+
+UbuntuCloudStreamBuffer::int_type UbuntuCloudStreamBuffer::underflow() {
+  if (this->gptr() < this->egptr()) {
+    // Data left in the current chunk
+    return traits_type::to_int_type(*this->gptr());
+  }
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  this->_condition.wait(lock, [this] { return !this->_chunks.empty() || this->_finished || this->_closed; });
+  if (this->_chunks.empty()) {
+    return traits_type::eof();  // Producer finished and everything has been read
+  }
+  // Swap instead of copying, the previous chunk's storage is released with the popped element
+  bool was_full { this->_chunks.size() >= this->_maxChunks };
+  this->_current.swap(this->_chunks.front());
+  this->_chunks.pop_front();
+  lock.unlock();
+  this->_condition.notify_all();  // Wake a producer waiting for room
+  if (was_full && this->_roomCallback) {
+    this->_roomCallback();  // Or tell one that returned instead of waiting
+  }
+  this->setg(this->_current.data(), this->_current.data(), this->_current.data() + this->_current.size());
+  return traits_type::to_int_type(*this->gptr());
+}
+
+bool UbuntuCloudStreamBuffer::push(const char* data, std::size_t size) {
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  this->_condition.wait(lock, [this] { return this->_chunks.size() < this->_maxChunks || this->_closed; });
+  if (this->_closed) {
+    return false;  // Nobody is reading anymore
+  }
+  this->_chunks.emplace_back(data, size);
+  lock.unlock();
+  this->_condition.notify_all();
+  return true;
+}
+
+bool UbuntuCloudStreamBuffer::writable() {
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  return this->_chunks.size() < this->_maxChunks || this->_closed;
+}
+
+void UbuntuCloudStreamBuffer::onRoom(std::function<void()> callback) {
+  this->_roomCallback = std::move(callback);
+}
+
+void UbuntuCloudStreamBuffer::finish() {
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_finished = true;
+  }
+  this->_condition.notify_all();
+}
+
+void UbuntuCloudStreamBuffer::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_closed = true;
+    this->_chunks.clear();
+  }
+  this->_condition.notify_all();
+  if (this->_roomCallback) {
+    this->_roomCallback();
+  }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file UbuntuCloudStream.hpp
+ * @brief Declares UbuntuCloudStreamBuffer, a bounded producer/consumer stream buffer.
+ *
+ * The curl write callback runs on the thread performing the transfer and hands every received chunk to this buffer,
+ * while a parser thread reads it as an ordinary std::istream. Parsing therefore overlaps with the download, and only a
+ * bounded number of chunks is ever held in memory, whatever the size of the response.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+/**
+ * @class UbuntuCloudStreamBuffer
+ * @brief std::streambuf fed chunk by chunk from another thread.
+ *
+ * The producer calls push() for each chunk and finish() at the end of the data. The consumer reads through an
+ * std::istream constructed on this buffer and calls close() once it stops reading, so a blocked producer is released.
+ * A producer that must not block checks writable() first and is told through onRoom() when it can push again.
+ */
+class UbuntuCloudStreamBuffer : public std::streambuf {
+  private:
+    /// Maximum number of chunks waiting for the consumer before push() blocks.
+    const std::size_t _maxChunks;
+    /// Chunks received and not yet handed to the get area.
+    std::deque<std::string> _chunks;
+    /// Chunk currently exposed through the get area.
+    std::string _current;
+    /// Set by the producer when no more data will arrive.
+    bool _finished;
+    /// Set by the consumer when it stops reading, remaining and future data is dropped.
+    bool _closed;
+    /// Protects the chunk queue and the flags.
+    std::mutex _mutex;
+    /// Signalled when a chunk is queued, consumed, or either side finishes.
+    std::condition_variable _condition;
+    /// Called by the consumer when a full queue gets room, or when it closes the stream. Empty for none.
+    std::function<void()> _roomCallback;
+
+  protected:
+    /**
+     * @brief Refills the get area with the next chunk, blocking until one is available.
+     * @return int_type The next character, or traits_type::eof() once the producer has finished and the queue is empty.
+     */
+    int_type underflow() override;
+
+  public:
+    /**
+     * @brief Constructs an empty buffer.
+     * @param max_chunks Maximum number of queued chunks. Bounds memory to max_chunks times the transfer chunk size.
+     */
+    explicit UbuntuCloudStreamBuffer(std::size_t max_chunks = 64);
+
+    /**
+     * @brief Queues a chunk for the consumer, blocking while the queue is full.
+     * @param data Pointer to the chunk.
+     * @param size Size of the chunk in bytes.
+     * @return bool True if the chunk was queued, false if the consumer has closed the stream.
+     */
+    bool push(const char* data, std::size_t size);
+
+    /**
+     * @brief Tells whether push() would return right away: the queue has room, or the consumer has closed the stream.
+     * @return bool True if push() does not block.
+     */
+    bool writable();
+
+    /**
+     * @brief Sets the function called, on the consumer thread, once a full queue gets room or the stream is closed.
+     *
+     * Set before the consumer starts. Lets a producer that returned instead of blocking on a full queue resume.
+     * @param callback The function, which must not call back into this buffer.
+     */
+    void onRoom(std::function<void()> callback);
+
+    /**
+     * @brief Signals the end of the data. The consumer sees end-of-file after the queued chunks.
+     */
+    void finish();
+
+    /**
+     * @brief Signals that the consumer stopped reading. Pending and future chunks are discarded.
+     */
+    void close();
+};
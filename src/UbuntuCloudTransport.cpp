@@ -0,0 +1,352 @@
+/**
+ * @file UbuntuCloudTransport.cpp
+ * @brief Implementation of the shared transport and of its state file.
+ *
+ * The state file is a small JSON object:
+ * - `addresses`: `{ "host": "<name>:<port>", "address": "<ip>", "expires_at": <unix time> }` for every host reached.
+ * - `sessions`: `{ "key": "<curl session key>", "shmac": "<hex>", "data": "<hex>", "expires_at": <unix time> }` as
+ *   exported by curl_easy_ssls_export().
+ *
+ * Loaded addresses are handed to curl as "+host:port:address" CURLOPT_RESOLVE entries, which go into the shared DNS
+ * cache and age out of it like the addresses curl resolves itself.
+ */
+
+#include "UbuntuCloudTransport.hpp"
+
+#include "UbuntuCloudFile.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <system_error>
+#include <tuple>
+
+#if LIBCURL_VERSION_NUM >= 0x074b00
+/**
+ * @brief Returns a list of entries of the state file.
+ * @param state The state file, an object.
+ * @param name The list, "addresses" or "sessions".
+ * @return const nlohmann::json& The list, or an empty one if it is missing or not a list.
+ */
+static const nlohmann::json& stateEntries(const nlohmann::json& state, const char* name) {
+  static const nlohmann::json no_entries = nlohmann::json::array();
+  auto                        entries { state.find(name) };
+  return entries != state.end() && entries->is_array() ? *entries : no_entries;
+}
+
+/**
+ * @brief Tells whether an entry of the state file has a string field.
+ * @param entry The entry.
+ * @param name The field.
+ * @return bool True if the entry is an object whose field is a string.
+ */
+static bool hasString(const nlohmann::json& entry, const char* name) { return entry.is_object() && entry.contains(name) && entry[name].is_string(); }
+
+/**
+ * @brief Tells whether an entry of the state file has an integer field.
+ * @param entry The entry.
+ * @param name The field.
+ * @return bool True if the entry is an object whose field is an integer.
+ */
+static bool hasInteger(const nlohmann::json& entry, const char* name) {
+  return entry.is_object() && entry.contains(name) && entry[name].is_number_integer();
+}
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+/**
+ * @brief Encodes bytes as lowercase hexadecimal digits.
+ * @param data The bytes.
+ * @param size Number of bytes.
+ * @return std::string The digits, two per byte.
+ */
+static std::string toHex(const unsigned char* data, std::size_t size) {
+  constexpr const char* digits { "0123456789abcdef" };
+  std::string           text {};
+  text.reserve(size * 2);
+  for (std::size_t idx = 0; idx < size; idx++) {
+    text += digits[data[idx] >> 4];
+    text += digits[data[idx] & 0x0f];
+  }
+  return text;
+}
+
+/**
+ * @brief Decodes hexadecimal digits.
+ * @param text The digits, two per byte.
+ * @param[out] bytes Receives the bytes.
+ * @return bool False if the text is not an even number of hexadecimal digits.
+ */
+static bool fromHex(const std::string& text, std::string& bytes) {
+  auto value { [](char digit) {
+    if (digit >= '0' && digit <= '9') {
+      return digit - '0';
+    }
+    if (digit >= 'a' && digit <= 'f') {
+      return digit - 'a' + 10;
+    }
+    return digit >= 'A' && digit <= 'F' ? digit - 'A' + 10 : -1;
+  } };
+  if (text.size() % 2 != 0) {
+    return false;
+  }
+  bytes.clear();
+  bytes.reserve(text.size() / 2);
+  for (std::size_t idx = 0; idx < text.size(); idx += 2) {
+    int high { value(text[idx]) };
+    int low { value(text[idx + 1]) };
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    bytes += static_cast<char>(high * 16 + low);
+  }
+  return true;
+}
+
+/// What the session export callback needs to build the entries of the state file.
+struct UbuntuCloudSessionExport {
+    nlohmann::json*                            sessions;  ///< Receives the entries.
+    const std::map<std::string, std::int64_t>* loaded;    ///< Expiry of the sessions loaded from the state file, by session data.
+    std::int64_t                               now;       ///< Current Unix time.
+    std::int64_t                               expiry;    ///< Expiry of a session established by this process.
+};
+
+/**
+ * @brief Receives one TLS session from curl_easy_ssls_export().
+ * @return CURLcode Always CURLE_OK, to receive the next session.
+ */
+static CURLcode exportSession(CURL*, void* export_ptr, const char* session_key, const unsigned char* shmac, std::size_t shmac_len,
+                              const unsigned char* sdata, std::size_t sdata_len, curl_off_t valid_until, int, const char*, std::size_t) {
+  UbuntuCloudSessionExport* state { static_cast<UbuntuCloudSessionExport*>(export_ptr) };
+  std::string               data { toHex(sdata, sdata_len) };
+  // A loaded session keeps the expiry it was loaded with, saving it again does not extend its life
+  auto         loaded { state->loaded->find(data) };
+  std::int64_t expires_at { loaded != state->loaded->end() ? loaded->second : state->expiry };
+  if (valid_until > 0) {
+    expires_at = std::min<std::int64_t>(expires_at, valid_until);  // The server's ticket lifetime
+  }
+  if (session_key != nullptr && expires_at > state->now) {
+    state->sessions->push_back({
+        {        "key",                 session_key },
+        {      "shmac", toHex(shmac, shmac_len) },
+        {       "data",             std::move(data) },
+        { "expires_at",                  expires_at }
+    });
+  }
+  return CURLE_OK;
+}
+#endif
+
+UbuntuCloudTransport::UbuntuCloudTransport(): UbuntuCloudTransport(std::filesystem::path {}, std::chrono::seconds(0)) { }
+
+UbuntuCloudTransport::UbuntuCloudTransport(std::filesystem::path path, std::chrono::seconds ttl):
+    _share(curl_share_init()), _sessions(nullptr), _locks(), _path(std::move(path)), _ttl(ttl), _addresses(), _loadedHosts(),
+    _loadedSessions(), _pendingResolve(nullptr), _usedResolves(), _savedState(), _mutex() {
+  if (this->_share) {
+    curl_share_setopt(this->_share, CURLSHOPT_LOCKFUNC, lockShare);        // Static member function
+    curl_share_setopt(this->_share, CURLSHOPT_UNLOCKFUNC, unlockShare);    // Static member function
+    curl_share_setopt(this->_share, CURLSHOPT_USERDATA, this);             // Data pointer for both
+    curl_share_setopt(this->_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);  // Resolved addresses
+    curl_share_setopt(this->_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);  // TLS session tickets
+    curl_share_setopt(this->_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);      // Open connections, reused by later transfers
+  }
+  if (this->_path.empty() || this->_ttl.count() <= 0) {
+    this->_path.clear();
+    return;  // Nothing persisted
+  }
+  this->_sessions = curl_easy_init();
+  if (this->_sessions && this->_share) {
+    curl_easy_setopt(this->_sessions, CURLOPT_SHARE, this->_share);
+  }
+  this->load();
+}
+
+UbuntuCloudTransport::~UbuntuCloudTransport() {
+  // The share can only be released once no easy handle uses it anymore
+  if (this->_sessions) {
+    curl_easy_cleanup(this->_sessions);
+  }
+  if (this->_share) {
+    curl_share_cleanup(this->_share);
+  }
+  curl_slist_free_all(this->_pendingResolve);
+  for (curl_slist* list : this->_usedResolves) {
+    curl_slist_free_all(list);
+  }
+}
+
+void UbuntuCloudTransport::lockShare(CURL*, curl_lock_data data, curl_lock_access, void* transport_ptr) {
+  static_cast<UbuntuCloudTransport*>(transport_ptr)->_locks[static_cast<std::size_t>(data)].lock();
+}
+
+void UbuntuCloudTransport::unlockShare(CURL*, curl_lock_data data, void* transport_ptr) {
+  static_cast<UbuntuCloudTransport*>(transport_ptr)->_locks[static_cast<std::size_t>(data)].unlock();
+}
+
+void UbuntuCloudTransport::load() {
+  std::ifstream input(this->_path, std::ios::binary);
+  if (!input) {
+    return;  // First invocation, or the state was never written
+  }
+  nlohmann::json state = nlohmann::json::parse(input, nullptr, false);
+  if (!state.is_object()) {
+    return;  // A corrupted state file is ignored, it is overwritten on the next save
+  }
+  this->_savedState = state.dump();
+  std::int64_t now { nowSeconds() };
+#if LIBCURL_VERSION_NUM >= 0x074b00
+  for (const nlohmann::json& entry : stateEntries(state, "addresses")) {
+    if (!hasString(entry, "host") || !hasString(entry, "address") || !hasInteger(entry, "expires_at")) {
+      continue;  // Each entry stands alone, a malformed one does not cost the others
+    }
+    std::string  host { entry["host"].template get<std::string>() };
+    std::string  address { entry["address"].template get<std::string>() };
+    std::int64_t expires_at { entry["expires_at"].template get<std::int64_t>() };
+    if (expires_at <= now || expires_at - now > this->_ttl.count() || host.find(':') == std::string::npos) {
+      continue;  // Expired, or written with a longer TTL than the current one
+    }
+    this->_addresses[host] = { address, expires_at };
+    this->_loadedHosts.insert(host);
+    // IPv6 addresses are bracketed. "+" lets the entry age out of the DNS cache like a resolved address
+    std::string resolve { "+" + host + ":" + (address.find(':') != std::string::npos ? "[" + address + "]" : address) };
+    this->_pendingResolve = curl_slist_append(this->_pendingResolve, resolve.c_str());
+  }
+#endif
+#if LIBCURL_VERSION_NUM >= 0x080c00
+  for (const nlohmann::json& entry : stateEntries(state, "sessions")) {
+    if (!hasString(entry, "key") || !hasString(entry, "shmac") || !hasString(entry, "data") || !hasInteger(entry, "expires_at")) {
+      continue;
+    }
+    std::string  key { entry["key"].template get<std::string>() };
+    std::string  shmac {};
+    std::string  data {};
+    std::int64_t expires_at { entry["expires_at"].template get<std::int64_t>() };
+    if (expires_at <= now || !this->_sessions || !fromHex(entry["shmac"].template get<std::string>(), shmac) ||
+        !fromHex(entry["data"].template get<std::string>(), data)) {
+      continue;
+    }
+    // Fails with CURLE_NOT_BUILT_IN on a libcurl without session export, the session is then established again
+    if (curl_easy_ssls_import(this->_sessions, key.c_str(), reinterpret_cast<const unsigned char*>(shmac.data()), shmac.size(),
+                              reinterpret_cast<const unsigned char*>(data.data()), data.size()) == CURLE_OK) {
+      this->_loadedSessions[entry["data"].template get<std::string>()] = expires_at;
+    }
+  }
+#endif
+}
+
+void UbuntuCloudTransport::configure(CURL* handle) {
+  curl_easy_setopt(handle, CURLOPT_SHARE, this->_share);                   // DNS cache, TLS sessions and connections of the process
+  curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);  // HTTP/2 over TLS, HTTP/1.1 for plain HTTP
+  curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);                          // Multiplex over a connection being set up rather than open another
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  if (this->_pendingResolve) {
+    // The entries go into the shared DNS cache when this request starts, later requests find them there
+    curl_easy_setopt(handle, CURLOPT_RESOLVE, this->_pendingResolve);
+    this->_usedResolves.push_back(this->_pendingResolve);
+    this->_pendingResolve = nullptr;
+  }
+}
+
+void UbuntuCloudTransport::finished(CURL* handle, CURLcode result_code) {
+  if (this->_path.empty()) {
+    return;  // Nothing persisted, the shared DNS cache keeps the addresses for the process
+  }
+  char*      effective_url { nullptr };
+  char*      primary_ip { nullptr };
+  long       primary_port { 0 };
+  curl_off_t connect_time { 0 };
+  curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &effective_url);
+  curl_easy_getinfo(handle, CURLINFO_PRIMARY_IP, &primary_ip);
+  curl_easy_getinfo(handle, CURLINFO_PRIMARY_PORT, &primary_port);
+  curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect_time);
+  // The host the request ended on, after redirects
+  CURLU* url { curl_url() };
+  char*  host_part { nullptr };
+  char*  port_part { nullptr };
+  if (effective_url == nullptr || url == nullptr || curl_url_set(url, CURLUPART_URL, effective_url, 0) != CURLUE_OK ||
+      curl_url_get(url, CURLUPART_HOST, &host_part, 0) != CURLUE_OK || curl_url_get(url, CURLUPART_PORT, &port_part, CURLU_DEFAULT_PORT) != CURLUE_OK) {
+    curl_free(host_part);
+    curl_url_cleanup(url);
+    return;  // Non-network URL
+  }
+  std::string host { host_part };
+  std::string key { host + ":" + port_part };
+  std::string port { port_part };
+  curl_free(host_part);
+  curl_free(port_part);
+  curl_url_cleanup(url);
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  if (result_code == CURLE_COULDNT_CONNECT || (result_code == CURLE_OPERATION_TIMEDOUT && connect_time == 0)) {
+    if (this->_loadedHosts.erase(key) > 0) {
+      // The loaded address is gone, drop it from the shared DNS cache so that the next request resolves the name again
+      this->_addresses.erase(key);
+      this->_pendingResolve = curl_slist_append(this->_pendingResolve, ("-" + key).c_str());
+    }
+    return;
+  }
+  if (primary_ip == nullptr || *primary_ip == '\0' || host.empty() || host.front() == '[' || host == primary_ip ||
+      port != std::to_string(primary_port)) {
+    return;  // No address reached, or an address literal with nothing to resolve. Another port means a proxy
+  }
+#if LIBCURL_VERSION_NUM >= 0x080700
+  long used_proxy { 0 };
+  curl_easy_getinfo(handle, CURLINFO_USED_PROXY, &used_proxy);
+  if (used_proxy) {
+    return;  // The address is the proxy's, not the host's
+  }
+#endif
+  auto known { this->_addresses.find(key) };
+  if (known != this->_addresses.end() && known->second.address == primary_ip && this->_loadedHosts.count(key) > 0) {
+    return;  // Still the loaded address, reaching it again does not extend its life
+  }
+  this->_addresses[key] = { primary_ip, nowSeconds() + this->_ttl.count() };
+  this->_loadedHosts.erase(key);
+}
+
+bool UbuntuCloudTransport::save() {
+  if (this->_path.empty()) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  std::int64_t                now { nowSeconds() };
+  nlohmann::json              addresses = nlohmann::json::array();
+  nlohmann::json              sessions  = nlohmann::json::array();
+  for (const auto& [host, resolved] : this->_addresses) {
+    if (resolved.expires_at > now) {
+      addresses.push_back({
+          {       "host",               host },
+          {    "address",   resolved.address },
+          { "expires_at", resolved.expires_at }
+      });
+    }
+  }
+#if LIBCURL_VERSION_NUM >= 0x080c00
+  if (this->_sessions) {
+    UbuntuCloudSessionExport exported { &sessions, &this->_loadedSessions, now, now + this->_ttl.count() };
+    curl_easy_ssls_export(this->_sessions, exportSession, &exported);  // CURLE_NOT_BUILT_IN leaves the list empty
+    // The cache order is not stable, the file is only rewritten when its contents change
+    std::sort(sessions.begin(), sessions.end(), [](const nlohmann::json& first, const nlohmann::json& second) {
+      return std::tie(first["key"], first["data"]) < std::tie(second["key"], second["data"]);
+    });
+  }
+#endif
+  nlohmann::json state = {
+    { "addresses", addresses },
+    {  "sessions",  sessions }
+  };
+  std::string contents { state.dump() };
+  if (contents == this->_savedState) {
+    return true;
+  }
+  std::error_code error {};
+  if (this->_path.has_parent_path()) {
+    std::filesystem::create_directories(this->_path.parent_path(), error);
+  }
+  // Replaced atomically, so a concurrent invocation never reads a partial file. The sessions are secrets, the file is its owner's only
+  if (!replaceFile(this->_path, contents, true)) {
+    return false;
+  }
+  this->_savedState = std::move(contents);
+  return true;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file UbuntuCloudTransport.hpp
+ * @brief Declares UbuntuCloudTransport, the connections, TLS sessions and resolved addresses the requests of a process share.
+ *
+ * Without it, every request starts from a fresh easy handle in a fresh multi handle, so the stream indexes, then the
+ * product files, then every refresh of the daemon pay a name lookup, a TCP connect and a full TLS handshake to the
+ * mirror. The transport holds a curl share handle with the DNS cache, the TLS session cache and the connection pool,
+ * and asks for HTTP/2, so the requests of a process go out on one connection per mirror and multiplex over it.
+ *
+ * Connections end with the process, the resolved addresses and the TLS session tickets need not: with a state file,
+ * they are written there after the transfers and loaded by the next invocation, which skips the name lookup and
+ * resumes the TLS session instead of a full handshake. Entries expire after a TTL, and a persisted address that
+ * refuses connections is forgotten and resolved again. Session tickets need a libcurl built with SSL session export
+ * (8.12 or later, "SSLS-EXPORT" in curl --version); with another build only the addresses are persisted.
+ */
+
+#pragma once
+
+#include <curl/curl.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @class UbuntuCloudTransport
+ * @brief Share handle the easy handles of a process are attached to, with its persisted state.
+ *
+ * The requests of one transfer loop run on one thread. Transfer loops on several threads may share a transport, but
+ * libcurl does not support using one connection from concurrent threads, so they should not overlap.
+ */
+class UbuntuCloudTransport {
+  private:
+    /// An address a host name resolved to, and when it stops being used.
+    struct ResolvedAddress {
+        std::string  address;     ///< The IPv4 or IPv6 address.
+        std::int64_t expires_at;  ///< Unix time (seconds) after which the name is resolved again.
+    };
+
+    /// Share handle holding the DNS cache, the TLS session cache and the connection pool.
+    CURLSH* _share;
+    /// Easy handle attached to the share, through which the TLS sessions are imported and exported. Null without a state file.
+    CURL* _sessions;
+    /// One lock per kind of shared data, for transfer loops on different threads.
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> _locks;
+    /// State file, empty to keep everything in memory.
+    std::filesystem::path _path;
+    /// Lifetime of a persisted address or session.
+    std::chrono::seconds _ttl;
+    /// Addresses to persist, by "host:port".
+    std::map<std::string, ResolvedAddress> _addresses;
+    /// Hosts whose address was loaded from the state file, by "host:port".
+    std::set<std::string> _loadedHosts;
+    /// Expiry of the TLS sessions loaded from the state file, by session data, so that saving does not extend it.
+    std::map<std::string, std::int64_t> _loadedSessions;
+    /// CURLOPT_RESOLVE entries for the next request: the loaded addresses, and the removal of those that failed.
+    curl_slist* _pendingResolve;
+    /// Lists handed to requests already, freed with the transport since curl reads them when the request starts.
+    std::vector<curl_slist*> _usedResolves;
+    /// Contents of the state file as last read or written, so that an unchanged state is not rewritten.
+    std::string _savedState;
+    /// Guards everything but the share handle, which the locks protect.
+    std::mutex _mutex;
+
+    /**
+     * @brief Reads the state file and loads the entries that have not expired.
+     */
+    void load();
+
+    /**
+     * @brief Static callback through which libcurl locks a kind of shared data.
+     * @param handle The easy handle, unused.
+     * @param data The kind of data.
+     * @param access Shared or exclusive, unused: every access is exclusive.
+     * @param transport_ptr Pointer to the UbuntuCloudTransport.
+     */
+    static void lockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* transport_ptr);
+
+    /**
+     * @brief Static callback through which libcurl unlocks a kind of shared data.
+     * @param handle The easy handle, unused.
+     * @param data The kind of data.
+     * @param transport_ptr Pointer to the UbuntuCloudTransport.
+     */
+    static void unlockShare(CURL* handle, curl_lock_data data, void* transport_ptr);
+
+  public:
+    /**
+     * @brief Constructs a transport whose state lives as long as it does.
+     */
+    UbuntuCloudTransport();
+
+    /**
+     * @brief Constructs a transport that persists the resolved addresses and TLS sessions in a state file.
+     * @param path The state file, loaded now if it exists. Its directory is created by save().
+     * @param ttl Lifetime of the persisted entries. A TLS session also expires when its ticket does.
+     */
+    UbuntuCloudTransport(std::filesystem::path path, std::chrono::seconds ttl);
+
+    UbuntuCloudTransport(const UbuntuCloudTransport&)            = delete;
+    UbuntuCloudTransport& operator=(const UbuntuCloudTransport&) = delete;
+
+    /**
+     * @brief Releases the shared connections and sessions. Call save() first to keep them for the next invocation.
+     */
+    ~UbuntuCloudTransport();
+
+    /**
+     * @brief Attaches an easy handle to the shared caches and connection pool, and asks for HTTP/2.
+     *
+     * The handle waits for an existing connection to the same host to confirm multiplexing rather than opening
+     * another one. The first handle also carries the addresses loaded from the state file.
+     * @param handle The easy handle, before it is added to a multi handle.
+     */
+    void configure(CURL* handle);
+
+    /**
+     * @brief Records the outcome of a finished request: the address its host resolved to, or the failure of a persisted one.
+     * @param handle The easy handle, before its clean-up.
+     * @param result_code Result of the request reported by curl.
+     */
+    void finished(CURL* handle, CURLcode result_code);
+
+    /**
+     * @brief Writes the addresses and TLS sessions that have not expired to the state file, if they changed.
+     *
+     * The file is replaced atomically and readable by its owner only, it holds session secrets. Best-effort: a state
+     * file that cannot be written only costs the next invocation a lookup and a full handshake.
+     * @return bool True if the file is up to date, or there is no state file.
+     */
+    bool save();
+};
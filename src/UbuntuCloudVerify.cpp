@@ -0,0 +1,181 @@
+/**
+ * @file UbuntuCloudVerify.cpp
+ * @brief Implementation of the bulk directory verification.
+ */
+
+#include "UbuntuCloudVerify.hpp"
+
+#include "UbuntuCloudIO.hpp"
+#include "UbuntuCloudMappedFile.hpp"
+#include "UbuntuCloudSha256.hpp"
+#include "UbuntuCloudWorkers.hpp"
+
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @brief Returns the last component of a slash-separated path.
+ * @param path The path.
+ * @return std::string_view The file name.
+ */
+static std::string_view fileName(std::string_view path) {
+  std::size_t slash { path.rfind('/') };
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+/**
+ * @brief Tells whether a path ends with a relative path, on a component boundary.
+ * @param path The item path.
+ * @param suffix The relative path of the local file, with forward slashes.
+ * @return bool True if path is suffix or ends with "/" followed by suffix.
+ */
+static bool endsWithPath(std::string_view path, std::string_view suffix) {
+  if (path.size() < suffix.size() || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+    return false;
+  }
+  return path.size() == suffix.size() || path[path.size() - suffix.size() - 1] == '/';
+}
+
+bool hashFile(const std::filesystem::path& path, std::uint64_t size, std::string& digest) {
+  UbuntuCloudSha256 hash {};
+  if (size > 0) {
+    std::string           error {};
+    UbuntuCloudMappedFile mapped_file(path, error);
+    if (!mapped_file.isMapped()) {
+      return false;
+    }
+    // One pass over the page cache, without copying the file into a buffer first
+    mapped_file.adviseSequential();
+    hash.update(mapped_file.data(), mapped_file.size());
+  }
+  digest = hash.hexDigest();
+  return true;
+}
+
+std::vector<UbuntuCloudVerifyResult> verifyDirectory(const UbuntuCloudCatalog& catalog, const std::filesystem::path& directory, std::size_t threads,
+                                                     std::string& error) {
+  // Items by file name, the paths live in the catalog image
+  std::unordered_map<std::string_view, std::vector<std::uint32_t>> items_by_name {};
+  std::size_t                                                      item_count { catalog.itemCount() };
+  for (std::uint32_t item = 0; item < item_count; item++) {
+    std::string_view path { catalog.itemPath(item) };
+    if (!path.empty()) {
+      items_by_name[fileName(path)].push_back(item);
+    }
+  }
+
+  std::vector<UbuntuCloudVerifyResult> results {};
+  std::error_code                      list_error {};
+  std::filesystem::recursive_directory_iterator iterator(directory, list_error);
+  if (list_error) {
+    error = "Could not list " + directory.string() + ": " + list_error.message();
+    return {};
+  }
+  for (; iterator != std::filesystem::recursive_directory_iterator(); iterator.increment(list_error)) {
+    if (list_error) {
+      error = "Could not list " + directory.string() + ": " + list_error.message();
+      return {};
+    }
+    std::error_code entry_error {};
+    if (!iterator->is_regular_file(entry_error)) {
+      continue;
+    }
+    UbuntuCloudVerifyResult result {};
+    result.file = iterator->path().lexically_relative(directory);
+    result.size = iterator->file_size(entry_error);
+    if (entry_error) {
+      result.status = UbuntuCloudVerifyResult::Status::Unreadable;
+      results.push_back(std::move(result));
+      continue;
+    }
+    std::string relative_path { result.file.generic_string() };
+    auto        found { items_by_name.find(fileName(relative_path)) };
+    if (found == items_by_name.end()) {
+      result.status = UbuntuCloudVerifyResult::Status::Unknown;
+      results.push_back(std::move(result));
+      continue;
+    }
+    // A relative path found at the end of item paths narrows the candidates, e.g. in a copy of the mirror tree
+    for (std::uint32_t item : found->second) {
+      if (endsWithPath(catalog.itemPath(item), relative_path)) {
+        result.candidates.push_back(item);
+      }
+    }
+    if (result.candidates.empty()) {
+      result.candidates = found->second;
+    }
+    result.item = result.candidates.front();
+    bool size_matches { std::any_of(result.candidates.begin(), result.candidates.end(), [&catalog, &result](std::uint32_t item) {
+      return catalog.itemSize(item) == 0 || catalog.itemSize(item) == result.size;
+    }) };
+    result.status = size_matches ? UbuntuCloudVerifyResult::Status::Mismatch : UbuntuCloudVerifyResult::Status::SizeMismatch;
+    results.push_back(std::move(result));
+  }
+
+  // Largest files first, so that a big file started last does not leave the other threads idle
+  std::vector<UbuntuCloudVerifyResult*> pending {};
+  for (UbuntuCloudVerifyResult& result : results) {
+    if (result.status == UbuntuCloudVerifyResult::Status::Mismatch) {
+      pending.push_back(&result);
+    }
+  }
+  std::sort(pending.begin(), pending.end(), [](const auto* first, const auto* second) { return first->size > second->size; });
+  runTasks(pending.size(), threads, [&catalog, &directory, &pending](std::size_t idx) {
+    UbuntuCloudVerifyResult& result { *pending[idx] };
+    if (!hashFile(directory / result.file, result.size, result.sha256)) {
+      result.status = UbuntuCloudVerifyResult::Status::Unreadable;
+      return;
+    }
+    for (std::uint32_t item : result.candidates) {
+      if (catalog.itemSha256(item) == result.sha256) {
+        result.status = UbuntuCloudVerifyResult::Status::Match;
+        result.item   = item;
+        break;
+      }
+    }
+  });
+  std::sort(results.begin(), results.end(), [](const auto& first, const auto& second) { return first.file < second.file; });
+  return results;
+}
+
+int printDirectoryVerification(const UbuntuCloudCatalog& catalog, const std::filesystem::path& directory, std::size_t threads,
+                               std::ostream& output, std::ostream& errors) {
+  std::string                          error {};
+  std::vector<UbuntuCloudVerifyResult> results { verifyDirectory(catalog, directory, threads, error) };
+  if (!error.empty()) {
+    errors << error << "\n";
+    return 1;
+  }
+  std::size_t counts[5] {};
+  output << '\n';
+  for (const UbuntuCloudVerifyResult& result : results) {
+    counts[static_cast<std::size_t>(result.status)]++;
+    switch (result.status) {
+      case UbuntuCloudVerifyResult::Status::Mismatch:
+        output << indentation(0) << "SHA256 mismatch: " << result.file.generic_string() << '\n'
+               << indentation(1) << "expected " << catalog.itemSha256(result.item) << " (" << catalog.itemPath(result.item) << ")\n"
+               << indentation(1) << "got      " << result.sha256 << '\n';
+        break;
+      case UbuntuCloudVerifyResult::Status::SizeMismatch:
+        output << indentation(0) << "Size mismatch: " << result.file.generic_string() << '\n'
+               << indentation(1) << "expected " << catalog.itemSize(result.item) << " bytes (" << catalog.itemPath(result.item) << ")\n"
+               << indentation(1) << "got      " << result.size << " bytes\n";
+        break;
+      case UbuntuCloudVerifyResult::Status::Unreadable:
+        output << indentation(0) << "Unreadable: " << result.file.generic_string() << '\n';
+        break;
+      default:
+        break;
+    }
+  }
+  using Status = UbuntuCloudVerifyResult::Status;
+  output << indentation(0) << "Verified " << results.size() << " files in " << directory.string() << ": "
+         << counts[static_cast<std::size_t>(Status::Match)] << " match, "
+         << counts[static_cast<std::size_t>(Status::Mismatch)] + counts[static_cast<std::size_t>(Status::SizeMismatch)] << " do not match, "
+         << counts[static_cast<std::size_t>(Status::Unreadable)] << " unreadable, " << counts[static_cast<std::size_t>(Status::Unknown)]
+         << " not in the catalog\n";
+  bool failed { counts[static_cast<std::size_t>(Status::Mismatch)] + counts[static_cast<std::size_t>(Status::SizeMismatch)] +
+                    counts[static_cast<std::size_t>(Status::Unreadable)] > 0 };
+  return failed ? 1 : 0;
+}
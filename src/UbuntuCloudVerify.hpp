@@ -0,0 +1,74 @@
+/**
+ * @file UbuntuCloudVerify.hpp
+ * @brief Declares the bulk verification of a directory of images against the sha256 of the catalog items.
+ *
+ * Every regular file under the directory is matched to the catalog items published under the same file name.
+ * When the file's path relative to the directory is also the end of some item paths (e.g. a directory laid out
+ * like the mirror), only those items are kept. A file whose size differs from every candidate is reported without
+ * being read. The others are hashed on a pool of threads, the largest first, each file read once through a
+ * sequential memory mapping, and the digest is compared with the candidates' sha256.
+ */
+
+#pragma once
+
+#include "UbuntuCloudCatalog.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @struct UbuntuCloudVerifyResult
+ * @brief Outcome of the verification of one local file.
+ */
+struct UbuntuCloudVerifyResult {
+    /// How the file compares with the catalog.
+    enum class Status {
+      Match,         ///< The file's sha256 is the one of a matching item.
+      Mismatch,      ///< The file's sha256 is not the one of any matching item.
+      SizeMismatch,  ///< The file's size is not the one of any matching item, it was not hashed.
+      Unknown,       ///< No item has the file's name.
+      Unreadable     ///< The file could not be read.
+    };
+    std::filesystem::path      file;          ///< Path of the file, relative to the verified directory.
+    std::uint64_t              size {};       ///< Size of the file in bytes.
+    std::vector<std::uint32_t> candidates;    ///< The matching items, in item order.
+    Status                     status {};     ///< The outcome.
+    std::string                sha256;        ///< The file's sha256, empty if it was not hashed.
+    std::uint32_t              item {};       ///< The matched item for Match, the first candidate otherwise.
+};
+
+/**
+ * @brief Hashes a whole file through a sequential memory mapping.
+ * @param path The file.
+ * @param size Its size, an empty file is not mapped.
+ * @param[out] digest Receives the sha256 as lowercase hexadecimal digits.
+ * @return bool False if the file could not be read.
+ */
+bool hashFile(const std::filesystem::path& path, std::uint64_t size, std::string& digest);
+
+/**
+ * @brief Verifies every file under a directory against the catalog.
+ * @param catalog The catalog holding the item paths and sha256.
+ * @param directory The directory, searched recursively.
+ * @param threads Number of hashing threads, 0 for one per hardware thread.
+ * @param[out] error Receives a description of the problem if the directory cannot be listed.
+ * @return std::vector<UbuntuCloudVerifyResult> One result per file, sorted by path. Empty on error.
+ */
+std::vector<UbuntuCloudVerifyResult> verifyDirectory(const UbuntuCloudCatalog& catalog, const std::filesystem::path& directory, std::size_t threads,
+                                                     std::string& error);
+
+/**
+ * @brief Verifies a directory and prints the files that do not match, followed by a summary.
+ * @param catalog The catalog holding the item paths and sha256.
+ * @param directory The directory, searched recursively.
+ * @param threads Number of hashing threads, 0 for one per hardware thread.
+ * @param output Stream receiving the report.
+ * @param errors Stream receiving the errors.
+ * @return int 0 if every file known to the catalog matches, 1 otherwise.
+ */
+int printDirectoryVerification(const UbuntuCloudCatalog& catalog, const std::filesystem::path& directory, std::size_t threads,
+                               std::ostream& output = std::cout, std::ostream& errors = std::cerr);
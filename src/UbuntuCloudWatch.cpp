@@ -0,0 +1,76 @@
+/**
+ * @file UbuntuCloudWatch.cpp
+ * @brief Implementation of the watch mode.
+ */
+
+#include "UbuntuCloudWatch.hpp"
+
+#include <ctime>
+#include <thread>
+
+std::string formatCatalogChange(const UbuntuCatalogChange& change) {
+  const char* kind { "" };
+  switch (change.kind) {
+    case UbuntuCatalogChange::Kind::NewProduct:
+      kind = "new-product";
+      break;
+    case UbuntuCatalogChange::Kind::RemovedProduct:
+      kind = "removed-product";
+      break;
+    case UbuntuCatalogChange::Kind::NewSerial:
+      kind = "new-serial";
+      break;
+    case UbuntuCatalogChange::Kind::Unsupported:
+      kind = "unsupported";
+      break;
+    case UbuntuCatalogChange::Kind::Supported:
+      kind = "supported";
+      break;
+    case UbuntuCatalogChange::Kind::NewLTS:
+      kind = "new-lts";
+      break;
+  }
+  // Fixed columns, so that the lines can be split on spaces
+  return std::string(kind) + " " + change.release + " " + change.arch + " " + (change.serial.empty() ? "-" : change.serial) + " " + change.product;
+}
+
+/**
+ * @brief Formats the current time as an ISO 8601 UTC timestamp.
+ * @return std::string The timestamp, e.g. "2024-04-23T12:00:00Z".
+ */
+static std::string currentTimestamp() {
+  std::time_t now { std::time(nullptr) };
+  std::tm     utc {};
+#ifdef _WIN32
+  gmtime_s(&utc, &now);
+#else
+  gmtime_r(&now, &utc);
+#endif
+  char buffer[32] {};
+  std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  return buffer;
+}
+
+int watchCatalog(UbuntuCloudFetcher& fetcher, std::chrono::seconds interval, std::ostream& output, std::ostream& errors) {
+  if (!fetcher.isInitialized()) {
+    return 1;  // Early return, no baseline to compare with
+  }
+  while (true) {
+    std::this_thread::sleep_for(interval);
+    // The copy shares the image with the fetcher, and keeps it alive once the refresh replaces the fetcher's catalog
+    UbuntuCloudCatalog previous { fetcher.getCatalog() };
+    if (!fetcher.fetchData()) {
+      // The fetch has reported the problem, try again on the next refresh
+      errors << "Refresh failed, keeping the previous catalog" << std::endl;
+      continue;
+    }
+    if (!fetcher.catalogChanged()) {
+      continue;  // Nothing published, nothing parsed
+    }
+    std::string timestamp { currentTimestamp() };
+    for (const UbuntuCatalogChange& change : fetcher.getCatalog().changesSince(previous)) {
+      output << timestamp << ' ' << formatCatalogChange(change) << '\n';
+    }
+    output.flush();  // One write per refresh, visible at once to a pipe
+  }
+}
@@ -0,0 +1,41 @@
+/**
+ * @file UbuntuCloudWatch.hpp
+ * @brief Declares the watch mode, which revalidates the catalog on a timer and prints only what changed.
+ *
+ * Each refresh is a conditional request per product file. When nothing was published, every file answers 304 (or
+ * is still fresh in the cache) and the refresh ends there: nothing is parsed, indexed or compared. When a file did
+ * change, the new catalog is compared with the previous one product by product, see UbuntuCloudCatalog::changesSince().
+ *
+ * Every change is printed on its own line:
+ * "<UTC time> <kind> <release> <arch> <serial or -> <product>", where kind is one of new-product, removed-product,
+ * new-serial, unsupported, supported and new-lts.
+ */
+
+#pragma once
+
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudFetcher.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/**
+ * @brief Formats one change as a watch output line, without the time and the trailing newline.
+ * @param change The change.
+ * @return std::string The line, e.g. "new-serial noble amd64 20240423 com.ubuntu.cloud:server:24.04:amd64".
+ */
+std::string formatCatalogChange(const UbuntuCatalogChange& change);
+
+/**
+ * @brief Refreshes the catalog of a fetcher every interval and prints the changes, until the process is stopped.
+ *
+ * The loaded catalog is the baseline, nothing is printed for it. A failed refresh is reported on errors and the
+ * previous catalog stays the baseline. Between two refreshes the thread sleeps, without any network or CPU use.
+ * @param fetcher A fetcher holding the baseline catalog.
+ * @param interval Time between two refreshes.
+ * @param output Stream receiving the changes, flushed after each refresh.
+ * @param errors Stream receiving the failed refreshes.
+ * @return int 1 if the fetcher holds no catalog. Does not return otherwise.
+ */
+int watchCatalog(UbuntuCloudFetcher& fetcher, std::chrono::seconds interval, std::ostream& output = std::cout, std::ostream& errors = std::cerr);
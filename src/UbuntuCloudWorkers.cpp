@@ -0,0 +1,130 @@
+/**
+ * @file UbuntuCloudWorkers.cpp
+ * @brief Implementation of the shared worker loop and of the UbuntuCloudWorkerPool class.
+ */
+
+#include "UbuntuCloudWorkers.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+std::size_t workerThreads(std::size_t threads) {
+  return threads == 0 ? std::max<std::size_t>(std::thread::hardware_concurrency(), 1) : threads;
+}
+
+void runTasks(std::size_t count, std::size_t threads, const std::function<void(std::size_t)>& task) {
+  std::atomic<std::size_t> next { 0 };
+  auto                     run_tasks { [count, &task, &next]() {
+    for (std::size_t idx = next++; idx < count; idx = next++) {
+      task(idx);
+    }
+  } };
+  std::vector<std::thread> workers {};
+  for (std::size_t idx = 1; idx < std::min(workerThreads(threads), count); idx++) {
+    workers.emplace_back(run_tasks);
+  }
+  run_tasks();  // The calling thread runs tasks too
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+UbuntuCloudWorkerPool::UbuntuCloudWorkerPool(std::size_t threads):
+    _workers(), _slices(std::make_unique<Slice[]>(std::max<std::size_t>(threads, 1))), _task(nullptr), _batch(0), _busy(0), _stopping(false) {
+  for (std::size_t idx = 0; idx + 1 < threads; idx++) {
+    this->_workers.emplace_back(&UbuntuCloudWorkerPool::work, this, idx);
+  }
+}
+
+UbuntuCloudWorkerPool::~UbuntuCloudWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_start.notify_all();
+  for (std::thread& worker : this->_workers) {
+    worker.join();
+  }
+}
+
+std::size_t UbuntuCloudWorkerPool::threads() const { return this->_workers.size() + 1; }
+
+bool UbuntuCloudWorkerPool::claim(std::size_t self, std::size_t& task) {
+  {
+    Slice&                      own { this->_slices[self] };
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.begin < own.end) {
+      task = own.begin++;
+      return true;
+    }
+  }
+  // Steal from the back, the tasks the owner would reach last
+  std::size_t slice_count { this->threads() };
+  for (std::size_t offset = 1; offset < slice_count; offset++) {
+    Slice&                      victim { this->_slices[(self + offset) % slice_count] };
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (victim.begin < victim.end) {
+      task = --victim.end;
+      return true;
+    }
+  }
+  return false;
+}
+
+void UbuntuCloudWorkerPool::drain(std::size_t self, const std::function<void(std::size_t)>& task) {
+  std::size_t idx { 0 };
+  while (this->claim(self, idx)) {
+    task(idx);
+  }
+}
+
+void UbuntuCloudWorkerPool::work(std::size_t self) {
+  std::uint64_t                last_batch { 0 };
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while (true) {
+    this->_start.wait(lock, [this, last_batch] { return this->_batch != last_batch || this->_stopping; });
+    if (this->_stopping) {
+      return;
+    }
+    last_batch = this->_batch;
+    const std::function<void(std::size_t)>& task { *this->_task };
+    lock.unlock();
+    this->drain(self, task);
+    lock.lock();
+    if (--this->_busy == 0) {
+      this->_finish.notify_one();
+    }
+  }
+}
+
+void UbuntuCloudWorkerPool::run(std::size_t count, const std::function<void(std::size_t)>& task) {
+  std::unique_lock<std::mutex> batch_lock(this->_batchMutex, std::try_to_lock);
+  if (count < 2 || this->_workers.empty() || !batch_lock.owns_lock()) {
+    // Nothing to share, or the threads are taken by another batch
+    for (std::size_t idx = 0; idx < count; idx++) {
+      task(idx);
+    }
+    return;
+  }
+  std::size_t slice_count { this->threads() };
+  for (std::size_t idx = 0; idx < slice_count; idx++) {
+    std::lock_guard<std::mutex> lock(this->_slices[idx].mutex);
+    this->_slices[idx].begin = count * idx / slice_count;
+    this->_slices[idx].end   = count * (idx + 1) / slice_count;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_task = &task;
+    this->_busy = this->_workers.size();
+    this->_batch++;
+  }
+  this->_start.notify_all();
+  this->drain(slice_count - 1, task);  // The calling thread owns the last slice
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  this->_finish.wait(lock, [this] { return this->_busy == 0; });
+}
+
+UbuntuCloudWorkerPool& sharedWorkerPool() {
+  static UbuntuCloudWorkerPool pool(workerThreads(0));
+  return pool;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file UbuntuCloudWorkers.hpp
+ * @brief Declares the worker loop shared by the bulk operations that spread independent tasks over threads, and the
+ * resident work-stealing pool of the catalog queries.
+ *
+ * runTasks() starts its threads for one bulk operation (a manifest export, a directory verification): the tasks are
+ * numbered, and every thread takes the next unclaimed one from a shared counter until none is left, so a thread given
+ * slow tasks does not hold back the others. The calling thread runs tasks too, and no more threads than tasks are
+ * started.
+ *
+ * The catalog queries run far more often and far shorter, a thread start would cost as much as the query. They run on
+ * UbuntuCloudWorkerPool instead, whose threads are started once and sleep between batches.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Resolves a requested thread count.
+ * @param threads The requested count, 0 for one per hardware thread.
+ * @return std::size_t The count, at least 1.
+ */
+std::size_t workerThreads(std::size_t threads);
+
+/**
+ * @brief Runs tasks 0 to count - 1 on up to threads threads, the calling thread included, and waits for all of them.
+ * @param count Number of tasks.
+ * @param threads Threads to run them on, 0 for one per hardware thread.
+ * @param task Runs one task. Called concurrently, with distinct task numbers.
+ */
+void runTasks(std::size_t count, std::size_t threads, const std::function<void(std::size_t)>& task);
+
+/**
+ * @class UbuntuCloudWorkerPool
+ * @brief Resident threads running batches of numbered tasks, with work stealing.
+ *
+ * A batch is dealt out as one contiguous slice of task numbers per thread, the calling thread included. A thread runs
+ * its slice from the front, and once it is empty steals from the back of the others' slices, so the threads given the
+ * slow tasks are helped by those that finished first and neighbouring tasks mostly run on the same thread. One batch
+ * runs at a time: a batch submitted while another runs is run by its calling thread alone, instead of waiting.
+ */
+class UbuntuCloudWorkerPool {
+  private:
+    /**
+     * @struct Slice
+     * @brief Task numbers not yet claimed from one thread's share of the batch.
+     */
+    struct Slice {
+        std::mutex  mutex;  ///< Guards the bounds, taken by the owner and the thieves.
+        std::size_t begin;  ///< Next task the owner runs.
+        std::size_t end;    ///< One past the task the next thief takes.
+    };
+
+    /// The resident threads, the calling thread of a batch being the extra one.
+    std::vector<std::thread> _workers;
+    /// One slice per resident thread, then the calling thread's.
+    std::unique_ptr<Slice[]> _slices;
+    /// Held by the calling thread of the running batch.
+    std::mutex _batchMutex;
+    /// Guards everything below.
+    std::mutex _mutex;
+    /// Signalled when a batch starts or the pool stops.
+    std::condition_variable _start;
+    /// Signalled when the last resident thread leaves a batch.
+    std::condition_variable _finish;
+    /// Task of the running batch.
+    const std::function<void(std::size_t)>* _task;
+    /// Number of the running batch, each resident thread joins every batch once.
+    std::uint64_t _batch;
+    /// Resident threads still running tasks of the batch.
+    std::size_t _busy;
+    /// Set by the destructor.
+    bool _stopping;
+
+    /**
+     * @brief Claims a task: the front of a thread's own slice, or else the back of another's.
+     * @param self Index of the thread's slice.
+     * @param[out] task Receives the task number.
+     * @return bool False once every slice is empty.
+     */
+    bool claim(std::size_t self, std::size_t& task);
+
+    /**
+     * @brief Runs tasks until none is left to claim.
+     * @param self Index of the thread's slice.
+     * @param task Runs one task.
+     */
+    void drain(std::size_t self, const std::function<void(std::size_t)>& task);
+
+    /**
+     * @brief Body of a resident thread: joins every batch until the pool stops.
+     * @param self Index of the thread's slice.
+     */
+    void work(std::size_t self);
+
+  public:
+    /**
+     * @brief Starts the resident threads.
+     * @param threads Threads running a batch, the calling thread included, so threads - 1 are started.
+     */
+    explicit UbuntuCloudWorkerPool(std::size_t threads);
+
+    UbuntuCloudWorkerPool(const UbuntuCloudWorkerPool&)            = delete;
+    UbuntuCloudWorkerPool& operator=(const UbuntuCloudWorkerPool&) = delete;
+
+    /**
+     * @brief Stops and joins the resident threads. No batch may be running.
+     */
+    ~UbuntuCloudWorkerPool();
+
+    /**
+     * @brief Returns the number of threads running a batch.
+     * @return std::size_t The resident threads plus the calling thread.
+     */
+    std::size_t threads() const;
+
+    /**
+     * @brief Runs tasks 0 to count - 1 and waits for all of them.
+     * @param count Number of tasks.
+     * @param task Runs one task. Called concurrently, with distinct task numbers, and must not throw.
+     */
+    void run(std::size_t count, const std::function<void(std::size_t)>& task);
+};
+
+/**
+ * @brief Returns the pool of the catalog queries, one thread per hardware thread, started on the first call.
+ * @return UbuntuCloudWorkerPool& The pool, shared by every catalog of the process.
+ */
+UbuntuCloudWorkerPool& sharedWorkerPool();
@@ -10,84 +10,538 @@
  * - `--supported-releases`: Prints all supported Ubuntu releases and their architectures.
  * - `--lts-version`: Prints the current Ubuntu LTS release and associated metadata.
  * - `--sha256 <release>`: Prints the SHA256 checksum for a specific Ubuntu release (amd64 architecture).
+ * - `--query <filters>`: Lists the products, serials or items matching filters on release, architecture, support, LTS,
+ *   serial range and item name, with the chosen fields, e.g. `--query 'arch=arm64 latest item=root.tar.xz'`.
+ * - `--batch`: Reads further queries from standard input, one per line.
+ * - `--format <format>`: Writes the answers as `text` (the default), `json`, `jsonl`, `csv` or `tsv`.
+ *
+ * Any number of queries can be given, e.g. `--sha256 noble --sha256 jammy --lts-version`. They are all answered
+ * from a single download of the catalog, in the order they were given, each followed by a blank line.
+ *
+ * Download options:
+ * - `--download <release>`: Downloads the disk1.img whose SHA256 `--sha256` prints, in concurrent HTTP range requests, and
+ *   checks it against the catalog while it is written.
+ * - `--output <file>`: File to download to (defaults to the image's name on the mirror, in the working directory).
+ * - `--connections <count>`: Range requests in flight at once (defaults to 4).
+ *
+ * Verification options:
+ * - `--verify-dir <path>`: Checks every file under a directory against the sha256 of the catalog items of the same name,
+ *   and prints the files that do not match. Files are hashed in parallel, the largest first.
+ * - `--export-manifest <file>`: Writes the sha256 and path of every item of every serial of the supported products, as a
+ *   SHA256SUMS file or, with `--format`, as a table. `-` writes to standard output.
+ * - `--threads <count>`: Hashing threads of `--verify-dir`, rendering threads of `--export-manifest` (defaults to one
+ *   per hardware thread).
+ *
+ * Mirror options:
+ * - `--mirror <dir>`: Brings a local simplestreams mirror up to date: downloads the missing and stale items, `--connections`
+ *   at a time, resumes interrupted files, verifies each one against its sha256 and rewrites the mirror's product file.
+ * - `--mirror-query <filters>`: Items to mirror, as a `--query` (defaults to `supported=true latest`).
+ * - `--max-rate <bytes>`: Cap on the total download rate of `--mirror`, in bytes per second (defaults to no cap).
+ *
+ * Daemon options:
+ * - `--serve`: Keeps the catalog in memory and answers queries on a Unix domain socket, refreshing the catalog in the background.
+ * - `--client`: Forwards the queries to a running `--serve` process instead of fetching the catalog.
+ * - `--socket <path>`: Socket of the daemon (defaults to `daemon.sock` in the cache directory).
+ * - `--refresh <seconds>`: Time between two catalog refreshes of the daemon or of `--watch` (defaults to 3600).
+ *
+ * Watch options:
+ * - `--watch`: Answers the queries, if any, then revalidates the catalog every refresh interval and prints only what
+ *   changed: new serials, products that became unsupported, a new LTS release. An unchanged catalog costs one
+ *   conditional request per product file and no parsing.
+ *
+ * Stream options:
+ * - `--stream <stream[:content]>`: Adds product files of a stream to the catalog, e.g. `daily` or `releases:aws` (defaults to
+ *   `releases:download`). The stream indexes are read first, then every selected product file is downloaded concurrently.
+ * - `--endpoint <url>`: Adds a mirror of cloud-images.ubuntu.com. Every file is requested from `--race` mirrors at once, the
+ *   first response wins and the other requests are cancelled. A file still waiting for a response after `--hedge-delay`
+ *   milliseconds gets one more request on the next mirror, and failed requests are retried with exponential backoff.
+ * - `--race <count>`: Mirrors each file is requested from at once (defaults to 2).
+ * - `--hedge-delay <milliseconds>`: Wait for a response before a hedged request goes out (defaults to 1000).
+ * - `--precompressed <suffix>`: Requests the pre-compressed copy of every file first, `.gz` or `.zst` (when built with
+ *   libzstd), and the file itself from the mirrors without one. Responses are always requested gzip (or zstd) encoded,
+ *   and decompressed on a thread of their own while the download and the parse go on.
+ *
+ * Statistics options:
+ * - `--stats`: Prints the per-phase timings of the run (network phases, parse, index, queries) and its peak memory as one JSON object on std::cerr.
+ * - `--stats-file <file>`: Writes the same statistics in the Prometheus text format, e.g. for the node exporter's textfile collector.
+ *
+ * Cache options, accepted anywhere on the command line:
+ * - `--cache-dir <dir>`: Directory of the on-disk catalog cache (defaults to the per-user cache directory).
+ * - `--max-age <seconds>`: Serve the cached catalog without any network access while it is younger than this (defaults to 0).
+ * - `--no-cache`: Always download the whole catalog.
+ * - `--snapshot <file>`: Binary catalog snapshot refreshed after every fetch (defaults to `catalog.snapshot` in the cache directory).
+ * - `--transport-ttl <seconds>`: Keep the resolved addresses and TLS sessions of the mirrors in `transport.json` in the cache
+ *   directory for this long, so the next runs skip the name lookup and resume the TLS session (defaults to 300, 0 to not keep them).
+ * - `--offline`: Answer from the snapshot alone, without any network access or parsing.
  *
  * The application uses libcurl to fetch release metadata in JSON format from the Ubuntu
  * cloud image server, and delegates parsing to an instance of `UbuntuCloudFetcher`.
  *
- * @note Requires network access to retrieve remote data.
+ * @note Requires network access to retrieve remote data, unless `--offline` is given.
  * @note Uses `UbuntuCloudInterface` polymorphically to separate concerns between fetching and displaying.
  * @note Initializes and cleans up libcurl in the program's lifetime.
  */
 
+#include "UbuntuCloudDecoder.hpp"
+#include "UbuntuCloudDownload.hpp"
 #include "UbuntuCloudFactory.hpp"
 #include "UbuntuCloudIO.hpp"
+#include "UbuntuCloudManifest.hpp"
+#include "UbuntuCloudMirror.hpp"
+#include "UbuntuCloudQuery.hpp"
+#include "UbuntuCloudServer.hpp"
+#include "UbuntuCloudStats.hpp"
+#include "UbuntuCloudVerify.hpp"
+#include "UbuntuCloudWatch.hpp"
 
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
 
 int main(int argc, char* argv[]) {
   std::ios_base::sync_with_stdio(false);
   // Avoid sychronizing with the C I/O buffers for faster speed. Not very relevant here, but this should be in every program that does not
   // have multi-threaded I/O.
-  if (argc < 2) {
-    // If less than two arguments, print the help.
+  std::optional<std::filesystem::path>   cache_directory { UbuntuCloudCache::defaultDirectory() };
+  std::optional<std::filesystem::path>   snapshot_path { std::nullopt };            // Defaults to a file in the cache directory
+  std::chrono::seconds                   max_age { 0 };                             // Always revalidate unless told otherwise
+  std::chrono::seconds                   transport_ttl { 300 };                     // Lifetime of the persisted addresses and TLS sessions
+  bool                                   use_cache { true };
+  bool                                   offline { false };
+  bool                                   serve { false };                           // Run as a daemon answering queries on a socket
+  bool                                   client { false };                          // Forward the queries to a running daemon
+  std::optional<std::filesystem::path>   socket_path { std::nullopt };              // Defaults to a file in the cache directory
+  std::chrono::seconds                   refresh_interval { 3600 };                 // Time between two catalog refreshes of the daemon or of --watch
+  bool                                   watch { false };                           // Print the changes of the catalog on every refresh
+  std::vector<UbuntuCloudStreamSelector> streams {};                                // Product files to merge, the released images if empty
+  std::vector<std::string>               endpoint_urls {};                          // Alternates of the official mirror
+  UbuntuCloudEndpoints                   endpoints { UbuntuCloudFactory::createEndpoints({}) };
+  bool                                   print_stats { false };                     // Per-phase timings as JSON on std::cerr
+  std::optional<std::filesystem::path>   stats_path { std::nullopt };               // Per-phase timings as a Prometheus textfile
+  std::optional<std::string>             download_release { std::nullopt };         // Release whose disk image to download
+  std::optional<std::filesystem::path>   download_path { std::nullopt };            // Defaults to the image's name on the mirror
+  UbuntuCloudDownloadOptions             download_options {};
+  std::optional<std::filesystem::path>   verify_directory { std::nullopt };         // Directory of images to check against the catalog
+  std::optional<std::filesystem::path>   manifest_path { std::nullopt };            // Checksum manifest to export, "-" for standard output
+  std::size_t                            worker_threads { 0 };                      // One per hardware thread
+  std::optional<std::filesystem::path>   mirror_directory { std::nullopt };         // Local mirror to bring up to date
+  std::string                            mirror_query { "supported=true latest" };  // Items the mirror holds
+  UbuntuCloudMirrorOptions               mirror_options {};
+  UbuntuCloudOutputFormat                format { UbuntuCloudOutputFormat::Text };  // Format of the query answers
+  std::vector<std::string>               arguments {};  // Arguments left once the cache options are consumed
+  for (int idx = 1; idx < argc; idx++) {
+    std::string argument { argv[idx] };
+    if (argument == "--no-cache") {
+      use_cache = false;
+    } else if (argument == "--offline") {
+      offline = true;
+    } else if (argument == "--serve") {
+      serve = true;
+    } else if (argument == "--client") {
+      client = true;
+    } else if (argument == "--watch") {
+      watch = true;
+    } else if (argument == "--stats") {
+      print_stats = true;
+    } else if (argument == "--cache-dir" || argument == "--max-age" || argument == "--snapshot" || argument == "--socket" ||
+               argument == "--refresh" || argument == "--stream" || argument == "--stats-file" || argument == "--download" ||
+               argument == "--output" || argument == "--connections" || argument == "--verify-dir" || argument == "--threads" ||
+               argument == "--format" || argument == "--export-manifest" || argument == "--mirror" || argument == "--mirror-query" ||
+               argument == "--max-rate" || argument == "--endpoint" || argument == "--race" || argument == "--hedge-delay" ||
+               argument == "--precompressed" || argument == "--transport-ttl") {
+      if (idx + 1 >= argc) {
+        std::cerr << "This option requires an additional argument\n";
+        return 1;
+      }
+      std::string value { argv[++idx] };
+      if (argument == "--cache-dir") {
+        cache_directory = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--snapshot") {
+        snapshot_path = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--socket") {
+        socket_path = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--stats-file") {
+        stats_path = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--download") {
+        download_release = value;
+        continue;
+      }
+      if (argument == "--output") {
+        download_path = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--format") {
+        std::optional<UbuntuCloudOutputFormat> parsed_format { parseOutputFormat(value) };
+        if (!parsed_format) {
+          std::cerr << "Invalid format: " << value << ", use text, json, jsonl, csv or tsv\n";
+          return 1;
+        }
+        format = *parsed_format;
+        continue;
+      }
+      if (argument == "--verify-dir") {
+        verify_directory = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--export-manifest") {
+        manifest_path = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--endpoint") {
+        endpoint_urls.push_back(value);
+        continue;
+      }
+      if (argument == "--precompressed") {
+        // A copy this build cannot decode would fail every fetch instead of falling back to the plain file
+        if (!decodableSuffix(value)) {
+          std::cerr << "Invalid value for " << argument << ": " << value << ", this build decodes " << (decodableSuffix(".zst") ? ".gz and .zst" : ".gz") << " copies\n";
+          return 1;
+        }
+        endpoints.precompressed = value;
+        continue;
+      }
+      if (argument == "--race" || argument == "--hedge-delay") {
+        try {
+          long long count { std::stoll(value) };
+          if (count <= 0) {
+            throw std::out_of_range("count");
+          }
+          if (argument == "--race") {
+            endpoints.race = static_cast<std::size_t>(count);
+          } else {
+            endpoints.hedge_delay = std::chrono::milliseconds(count);
+          }
+        } catch (const std::exception&) {
+          // std::invalid_argument or std::out_of_range from std::stoll
+          std::cerr << "Invalid value for " << argument << ": " << value << "\n";
+          return 1;
+        }
+        continue;
+      }
+      if (argument == "--mirror") {
+        mirror_directory = std::filesystem::path(value);
+        continue;
+      }
+      if (argument == "--mirror-query") {
+        std::string error {};
+        if (!parseQuery(value, error)) {
+          std::cerr << error << "\n";
+          return 1;
+        }
+        mirror_query = value;
+        continue;
+      }
+      if (argument == "--max-rate") {
+        try {
+          long long rate { std::stoll(value) };
+          if (rate <= 0) {
+            throw std::out_of_range("rate");
+          }
+          mirror_options.max_bytes_per_second = static_cast<std::uint64_t>(rate);
+        } catch (const std::exception&) {
+          // std::invalid_argument or std::out_of_range from std::stoll
+          std::cerr << "Invalid download rate: " << value << "\n";
+          return 1;
+        }
+        continue;
+      }
+      if (argument == "--threads") {
+        try {
+          long long threads { std::stoll(value) };
+          if (threads <= 0) {
+            throw std::out_of_range("threads");
+          }
+          worker_threads = static_cast<std::size_t>(threads);
+        } catch (const std::exception&) {
+          // std::invalid_argument or std::out_of_range from std::stoll
+          std::cerr << "Invalid number of threads: " << value << "\n";
+          return 1;
+        }
+        continue;
+      }
+      if (argument == "--connections") {
+        try {
+          long long connections { std::stoll(value) };
+          if (connections <= 0) {
+            throw std::out_of_range("connections");
+          }
+          download_options.connections = static_cast<std::size_t>(connections);
+          mirror_options.connections   = static_cast<std::size_t>(connections);
+        } catch (const std::exception&) {
+          // std::invalid_argument or std::out_of_range from std::stoll
+          std::cerr << "Invalid number of connections: " << value << "\n";
+          return 1;
+        }
+        continue;
+      }
+      if (argument == "--stream") {
+        std::optional<UbuntuCloudStreamSelector> stream { UbuntuCloudFactory::createStreamSelector(value) };
+        if (!stream) {
+          std::cerr << "Invalid stream: " << value << "\n";
+          return 1;
+        }
+        streams.push_back(std::move(*stream));
+        continue;
+      }
+      try {
+        std::chrono::seconds seconds { std::stoll(value) };
+        if (seconds.count() < 0 || (argument == "--refresh" && seconds.count() == 0)) {
+          throw std::out_of_range("negative duration or refresh interval");
+        }
+        if (argument == "--max-age") {
+          max_age = seconds;
+        } else if (argument == "--transport-ttl") {
+          transport_ttl = seconds;
+        } else {
+          refresh_interval = seconds;
+        }
+      } catch (const std::exception&) {
+        // std::invalid_argument or std::out_of_range from std::stoll
+        std::cerr << "Invalid number of seconds for " << argument << ": " << value << "\n";
+        return 1;
+      }
+    } else {
+      arguments.push_back(argument);
+    }
+  }
+  if (arguments.empty() && !serve && !watch && !download_release && !verify_directory && !manifest_path && !mirror_directory) {
+    // If no option is given, print the help.
     printHelp();
     return 0;
   }
-  std::string option = argv[1];  // If we are here, guaranteed at least one argument.
-  if (option == "--help") {
+  if (!arguments.empty() && arguments.at(0) == "--help") {
     // Check and return early to avoid fetcher creation, print help.
     printHelp();
     return 0;
   }
-  if (option == "--sha256") {
-    if (argc < 3) {
-      // We check now to avoid wasteful download and parsing.
-      std::cerr << "This option requires an additional argument";
+  // Queries are validated before the download, so a typo does not cost a fetch and a parse.
+  std::vector<UbuntuCloudRequest> requests {};
+  bool                            batch { false };  // Read more queries from standard input
+  for (size_t idx = 0; idx < arguments.size(); idx++) {
+    const std::string& option { arguments.at(idx) };
+    if (option == "--batch") {
+      batch = true;
+      continue;
+    }
+    if (!isQueryOption(option)) {
+      // Handle any argument that does not fit.
+      std::cerr << "Unknown option: " << option << "\n";
+      // And print help.
+      printHelp();
+      return 1;
+    }
+    UbuntuCloudRequest request { option, "", format };
+    if (queryRequiresArgument(option)) {
+      if (idx + 1 >= arguments.size()) {
+        // We check now to avoid wasteful download and parsing.
+        std::cerr << "This option requires an additional argument\n";
+        return 1;
+      }
+      request.argument = arguments.at(++idx);
+    }
+    if (option == "--query") {
+      std::string error {};
+      if (!parseQuery(request.argument, error)) {
+        std::cerr << error << "\n";
+        return 1;
+      }
+    }
+    requests.push_back(std::move(request));
+  }
+  endpoints.mirrors = UbuntuCloudFactory::createEndpoints(endpoint_urls).mirrors;
+  if (!snapshot_path && cache_directory) {
+    snapshot_path = *cache_directory / "catalog.snapshot";
+  }
+  if (!socket_path && cache_directory) {
+    socket_path = *cache_directory / "daemon.sock";
+  }
+  if ((serve || client) && !socket_path) {
+    std::cerr << "No socket location, use --socket or --cache-dir\n";
+    return 1;
+  }
+  if (serve && (client || !requests.empty() || batch)) {
+    std::cerr << "--serve does not answer queries itself, run them with --client\n";
+    return 1;
+  }
+  if ((download_release || verify_directory || manifest_path || mirror_directory) && (serve || client)) {
+    std::cerr << "--download, --verify-dir, --export-manifest and --mirror run in the foreground, they cannot be combined with --serve or --client\n";
+    return 1;
+  }
+  if (watch && (serve || client || offline || batch)) {
+    std::cerr << "--watch refreshes the catalog itself, it cannot be combined with --serve, --client, --offline or --batch\n";
+    return 1;
+  }
+  if (client) {
+    // The daemon holds the catalog, nothing is downloaded, parsed or mapped here.
+    std::string       error {};
+    UbuntuCloudClient connection(*socket_path, error);
+    if (!connection.isConnected()) {
+      std::cerr << error << "\n";
       return 1;
     }
+    int return_code { 0 };
+    for (const UbuntuCloudRequest& request : requests) {
+      return_code |= connection.query(request);
+    }
+    std::string line {};
+    while (batch && std::getline(std::cin, line)) {
+      std::optional<UbuntuCloudRequest> request { parseRequestLine(line, error, format) };
+      if (request) {
+        return_code |= connection.query(*request);
+      } else if (!error.empty()) {
+        std::cerr << error << "\n";
+        return_code = 1;
+      }
+    }
+    return return_code;
   }
-  curl_global_init(CURL_GLOBAL_DEFAULT);
-  // initialize curl.
+  if (serve) {
+    if (offline) {
+      if (!snapshot_path) {
+        std::cerr << "No snapshot location, use --snapshot or --cache-dir\n";
+        return 1;
+      }
+      // Serve the snapshot, and pick up the snapshot another process rewrites on every refresh.
+      UbuntuCloudServer server(*socket_path, refresh_interval,
+                               [&snapshot_path]() { return UbuntuCloudFactory::createOfflineFetcher(*snapshot_path); });
+      return server.run();
+    }
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    // Refreshes reuse the connection of the previous one while the mirror keeps it open, and its TLS session otherwise
+    endpoints.transport = use_cache && cache_directory ? std::make_shared<UbuntuCloudTransport>(*cache_directory / "transport.json", transport_ttl)
+                                                       : std::make_shared<UbuntuCloudTransport>();
+    int return_code { 0 };
+    {
+      // Every refresh revalidates the cached copy, so an unchanged catalog costs a 304 instead of a download.
+      UbuntuCloudServer server(*socket_path, refresh_interval, [&]() {
+        std::optional<UbuntuCloudCache> cache { std::nullopt };
+        if (use_cache && cache_directory) {
+          cache.emplace(*cache_directory, max_age);
+        }
+        return UbuntuCloudFactory::createUbuntuVersionFetcher(std::move(cache), snapshot_path, streams, UbuntuCloudLoading::Eager, endpoints);
+      });
+      return_code = server.run();
+    }
+    endpoints.transport.reset();  // Closes the shared connections while libcurl is still initialized
+    curl_global_cleanup();
+    return return_code;
+  }
+  std::unique_ptr<UbuntuCloudInterface> fetcher { nullptr };
+  UbuntuCloudStats                      stats {};
+  std::chrono::steady_clock::time_point load_start { std::chrono::steady_clock::now() };
+  if (offline) {
+    if (!snapshot_path) {
+      std::cerr << "No snapshot location, use --snapshot or --cache-dir\n";
+      return 1;
+    }
+    // No curl initialization needed for the queries, the snapshot is mapped straight from disk.
+    fetcher = UbuntuCloudFactory::createOfflineFetcher(*snapshot_path);
+    if (download_release || mirror_directory) {
+      curl_global_init(CURL_GLOBAL_DEFAULT);  // The images themselves still come from the mirror
+    }
+  } else {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    // initialize curl.
 
-  std::unique_ptr<UbuntuCloudInterface> fetcher = UbuntuCloudFactory::createUbuntuVersionFetcher();
-  // The unique_ptr is passed with move semantics because only one handler function should be called per runtime.
-  // Contents are destroyed in the scope of the handler function.
+    // The stream indexes and the product files share connections, and the next run resumes the TLS sessions
+    endpoints.transport = use_cache && cache_directory ? std::make_shared<UbuntuCloudTransport>(*cache_directory / "transport.json", transport_ttl)
+                                                       : std::make_shared<UbuntuCloudTransport>();
+    std::optional<UbuntuCloudCache> cache { std::nullopt };
+    if (use_cache && cache_directory) {
+      cache.emplace(*cache_directory, max_age);
+    }
+    fetcher = UbuntuCloudFactory::createUbuntuVersionFetcher(std::move(cache), snapshot_path, streams, UbuntuCloudLoading::Eager, endpoints);
+  }
   if (fetcher == nullptr) {
     // Failure to create the fetcher.
     std::cerr << "Failed to create cloud fetcher instance." << std::endl;
     return 1;
   }
+  if (const auto* network_fetcher = dynamic_cast<const UbuntuCloudFetcher*>(fetcher.get()); network_fetcher != nullptr) {
+    stats = network_fetcher->getStats();  // Network phases, parse and index timings; a snapshot has none of these
+  }
+  stats.load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+  // Reported on every exit from here on, a failed fetch is when the timings matter most
+  auto report_stats { [&stats, print_stats, &stats_path]() {
+    stats.peak_memory_bytes = peakMemoryBytes();
+    if (print_stats) {
+      std::cerr << formatStatsJson(stats) << std::endl;
+    }
+    if (stats_path && !writeStatsPrometheus(stats, *stats_path)) {
+      std::cerr << "Could not write " << stats_path->string() << std::endl;
+    }
+  } };
   if (!fetcher->isInitialized()) {
     // Failure to retrieve and properly parse the data. std::cerr will have more information from ::fetchData().
     std::cerr << "Data could not be fetched." << std::endl;
+    report_stats();
     return 1;
   }
-  int return_code { 0 };  // To avoid code duplication in cleanup.
-  if (option == "--supported-releases") {
-    // Call handler function moving the fetcher pointer there. Fetcher pointer is null.
-    return_code = printSupportedReleases(std::move(fetcher));
-    if (return_code == 1) {
-      std::cerr << "No supported Ubuntu releases were found.\n";
-    }
-  } else if (option == "--lts-version") {
-    // Call handler function moving the fetcher pointer there. Fetcher pointer is null.
-    return_code = printCurrentLTSRelease(std::move(fetcher));
-  } else if (option == "--sha256") {
-    // From previous check, this argument is guaranteed to exist.
-    std::string releaseArg(argv[2]);
-    // Call handler function moving the fetcher pointer there. Fetcher pointer is null.
-    return_code = printReleaseSHA256(std::move(fetcher), releaseArg);
-
-  } else {
-    // Handle any argument that does not fit.
-    std::cerr << "Unknown option: " << option << "\n";
-    // And print help.
-    printHelp();
-    return_code = 1;
+  int return_code { 0 };  // To avoid code duplication in cleanup. Any failed query makes the whole run fail.
+  // Only the time spent answering is counted, not the time spent waiting for batch input
+  auto timed_request { [&fetcher, &stats](const UbuntuCloudRequest& request) {
+    std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
+    int                                   request_code { runRequest(*fetcher, request) };
+    stats.query_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.queries++;
+    return request_code;
+  } };
+  // Every query is answered from the one catalog loaded above.
+  for (const UbuntuCloudRequest& request : requests) {
+    return_code |= timed_request(request);
+  }
+  if (batch) {
+    // Queries from standard input are answered as they arrive, so a pipe gets each result without waiting for EOF.
+    std::string line {};
+    std::string error {};
+    while (std::getline(std::cin, line)) {
+      std::optional<UbuntuCloudRequest> request { parseRequestLine(line, error, format) };
+      if (request) {
+        return_code |= timed_request(*request);
+      } else if (!error.empty()) {
+        std::cerr << error << "\n";
+        return_code = 1;
+      }
+    }
+  }
+  if (download_release) {
+    // The catalog just loaded gives the image's URL and the hash it is verified against
+    return_code |= downloadReleaseImage(*fetcher, *download_release, download_path, download_options);
+  }
+  if (verify_directory) {
+    // The catalog holds the item paths, sizes and hashes the files are matched against
+    return_code |= printDirectoryVerification(fetcher->getCatalog(), *verify_directory, worker_threads);
+  }
+  if (manifest_path) {
+    // Every supported item in one pass over the catalog, rendered on worker_threads
+    return_code |= exportManifest(fetcher->getCatalog(), *manifest_path, format, worker_threads);
+  }
+  if (mirror_directory) {
+    // Only the items missing, stale or unlisted in the mirror's product file are transferred
+    return_code |= syncMirror(fetcher->getCatalog(), *mirror_directory, mirror_query, mirror_options);
+  }
+  report_stats();
+  if (watch) {
+    // The queries above were answered from the baseline, every refresh from here on only prints changes
+    std::cout.flush();
+    return_code |= watchCatalog(*dynamic_cast<UbuntuCloudFetcher*>(fetcher.get()), refresh_interval);
+  }
+  // Clean-up function. The shared connections are closed while libcurl is still initialized.
+  if (!offline || download_release || mirror_directory) {
+    fetcher.reset();
+    endpoints.transport.reset();
+    curl_global_cleanup();
   }
-  // Aesthetics newline.
-  std::cout << "\n";
-  // Clean-up function.
-  curl_global_cleanup();
   return return_code;
 }
\ No newline at end of file
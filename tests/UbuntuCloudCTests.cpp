@@ -0,0 +1,192 @@
+/**
+ * @file UbuntuCloudCTests.cpp
+ * @brief Tests of the C interface of the ubuntucloud library against the local HTTP stand-in.
+ */
+
+#include "UbuntuCloudC.h"
+#include "UbuntuCloudTestServer.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+/// Content id of the served product file, selected by the default content of a stream.
+constexpr static const char* content_id { "com.ubuntu.cloud:released:download" };
+
+/**
+ * @brief Returns the published sha256 of the disk image of a release.
+ * @param release The release codename.
+ * @return std::string Sixty-four hexadecimal digits, distinct for every release of the tests.
+ */
+static std::string diskSha256(const std::string& release) {
+  return std::string(UBUNTU_CLOUD_SHA256_LENGTH - 1, '0') + (release == "noble" ? "a" : release == "jammy" ? "b" : "c");
+}
+
+/**
+ * @brief Serves a stream with its index and a product file of three releases: noble is the LTS, focal is no longer supported.
+ * @param server The server.
+ * @return std::string The URL of the stream, as given to ubuntu_cloud_load().
+ */
+static std::string servedStream(UbuntuCloudTestServer& server) {
+  std::string product_file { R"({"format":"products:1.0","products":{)" };
+  const std::vector<std::vector<std::string>> releases { { "focal", "20.04", "false", "20.04" },
+                                                         { "jammy", "22.04", "true", "22.04" },
+                                                         { "noble", "24.04", "true", "24.04,lts" } };
+  for (const std::vector<std::string>& release : releases) {
+    for (const char* arch : { "amd64", "arm64" }) {
+      product_file += std::string(release[0] == "focal" && std::string(arch) == "amd64" ? "" : ",") + "\"com.ubuntu.cloud:server:" +
+                      release[1] + ":" + arch + "\":{\"release\":\"" + release[0] + "\",\"release_title\":\"" + release[1] +
+                      " LTS\",\"arch\":\"" + arch + "\",\"aliases\":\"" + release[3] + "\",\"version\":\"" + release[1] +
+                      "\",\"supported\":" + release[2] + ",\"versions\":{\"20240423\":{\"items\":{\"disk1.img\":{\"path\":\"server/" +
+                      release[0] + "/disk1.img\",\"size\":1,\"sha256\":\"" + diskSha256(release[0]) + "\"}}}}}";
+    }
+  }
+  product_file += "}}";
+  server.serve("/releases/streams/v1/index.json", std::string(R"({"format":"index:1.0","index":{")") + content_id +
+                                                      R"(":{"format":"products:1.0","path":"streams/v1/)" + content_id + R"(.json"}}})");
+  server.serve("/releases/streams/v1/" + std::string(content_id) + ".json", product_file);
+  return server.url("/releases");
+}
+
+/**
+ * @brief Checks the answers of a loaded handle.
+ * @param handle The handle.
+ */
+static void expectAnswers(const ubuntu_cloud* handle) {
+  ubuntu_cloud_release_list* releases { nullptr };
+  EXPECT(ubuntu_cloud_supported_releases(handle, &releases) == UBUNTU_CLOUD_OK);
+  EXPECT(ubuntu_cloud_release_count(releases) == 2);
+  EXPECT(ubuntu_cloud_release_name(releases, 0) == std::string("24.04 LTS (noble)"));
+  EXPECT(ubuntu_cloud_release_name(releases, 2) == nullptr);
+  EXPECT(ubuntu_cloud_release_architecture_count(releases, 1) == 2);
+  EXPECT(ubuntu_cloud_release_architecture(releases, 1, 1) == std::string("arm64"));
+  EXPECT(ubuntu_cloud_release_architecture(releases, 1, 2) == nullptr);
+  EXPECT(ubuntu_cloud_release_version(releases, 1, 0) == std::string(""));
+  ubuntu_cloud_release_list_free(releases);
+
+  ubuntu_cloud_release_list* lts { nullptr };
+  EXPECT(ubuntu_cloud_current_lts(handle, &lts) == UBUNTU_CLOUD_OK);
+  EXPECT(ubuntu_cloud_release_count(lts) == 1);
+  EXPECT(ubuntu_cloud_release_name(lts, 0) == std::string("24.04 (noble)"));
+  EXPECT(ubuntu_cloud_release_version(lts, 0, 0) == std::string("20240423"));
+  ubuntu_cloud_release_list_free(lts);
+
+  char sha256[UBUNTU_CLOUD_SHA256_LENGTH + 1] {};
+  EXPECT(ubuntu_cloud_sha256(handle, "noble", sha256) == UBUNTU_CLOUD_OK);
+  EXPECT(sha256 == diskSha256("noble"));
+  EXPECT(ubuntu_cloud_sha256(handle, "22.04 LTS", sha256) == UBUNTU_CLOUD_OK);
+  EXPECT(sha256 == diskSha256("jammy"));
+  EXPECT(ubuntu_cloud_sha256(handle, "warty", sha256) == UBUNTU_CLOUD_NOT_FOUND);
+}
+
+/**
+ * @brief A catalog loaded from a stream answers the three queries, and its snapshot answers the same offline.
+ * @param directory The cache directory.
+ */
+static void testLoad(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           stream { servedStream(server) };
+  ubuntu_cloud*         handle { nullptr };
+  EXPECT(ubuntu_cloud_load(directory.c_str(), stream.c_str(), 0, UBUNTU_CLOUD_DEFAULT, &handle) == UBUNTU_CLOUD_OK);
+  expectAnswers(handle);
+  ubuntu_cloud_free(handle);
+
+  ubuntu_cloud* offline { nullptr };
+  EXPECT(ubuntu_cloud_load(directory.c_str(), nullptr, 0, UBUNTU_CLOUD_OFFLINE, &offline) == UBUNTU_CLOUD_OK);
+  expectAnswers(offline);
+  ubuntu_cloud_free(offline);
+  EXPECT(server.requests().size() == 2);  // The index and the product file, nothing for the offline load
+}
+
+/**
+ * @brief An asynchronous load returns at once, and answers once waited for.
+ * @param directory The cache directory.
+ */
+static void testAsyncLoad(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           stream { servedStream(server) };
+  ubuntu_cloud*         handle { nullptr };
+  EXPECT(ubuntu_cloud_load(directory.c_str(), stream.c_str(), 0, UBUNTU_CLOUD_NO_CACHE | UBUNTU_CLOUD_ASYNC, &handle) == UBUNTU_CLOUD_OK);
+  EXPECT(handle != nullptr);
+  EXPECT(ubuntu_cloud_wait(handle) == UBUNTU_CLOUD_OK);
+  expectAnswers(handle);
+  ubuntu_cloud_free(handle);
+}
+
+/**
+ * @brief Many threads query one handle at once and all get the same answers.
+ * @param directory The cache directory.
+ */
+static void testConcurrentQueries(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           stream { servedStream(server) };
+  ubuntu_cloud*         handle { nullptr };
+  EXPECT(ubuntu_cloud_load(directory.c_str(), stream.c_str(), 0, UBUNTU_CLOUD_NO_CACHE, &handle) == UBUNTU_CLOUD_OK);
+  std::atomic<int>         failures { 0 };
+  std::vector<std::thread> threads {};
+  for (int thread = 0; thread < 8; thread++) {
+    threads.emplace_back([handle, &failures]() {
+      for (int query = 0; query < 1000; query++) {
+        char                       sha256[UBUNTU_CLOUD_SHA256_LENGTH + 1] {};
+        ubuntu_cloud_release_list* releases { nullptr };
+        if (ubuntu_cloud_sha256(handle, "noble", sha256) != UBUNTU_CLOUD_OK || sha256 != diskSha256("noble") ||
+            ubuntu_cloud_supported_releases(handle, &releases) != UBUNTU_CLOUD_OK || ubuntu_cloud_release_count(releases) != 2) {
+          failures++;
+        }
+        ubuntu_cloud_release_list_free(releases);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT(failures == 0);
+  ubuntu_cloud_free(handle);
+}
+
+/**
+ * @brief Failures are reported through the status, with a handle to free when the load itself failed.
+ * @param directory The cache directory.
+ */
+static void testFailures(const std::filesystem::path& directory) {
+  EXPECT(ubuntu_cloud_api_version() == UBUNTU_CLOUD_API_VERSION);
+  for (ubuntu_cloud_status status : { UBUNTU_CLOUD_OK, UBUNTU_CLOUD_LOAD_FAILED, UBUNTU_CLOUD_NOT_LOADED, UBUNTU_CLOUD_NOT_FOUND,
+                                      UBUNTU_CLOUD_INVALID_ARGUMENT, UBUNTU_CLOUD_INTERNAL_ERROR }) {
+    EXPECT(ubuntu_cloud_status_message(status) != nullptr);
+  }
+  EXPECT(ubuntu_cloud_load(nullptr, nullptr, 0, UBUNTU_CLOUD_DEFAULT, nullptr) == UBUNTU_CLOUD_INVALID_ARGUMENT);
+  ubuntu_cloud* handle { nullptr };
+  EXPECT(ubuntu_cloud_load(nullptr, nullptr, -1, UBUNTU_CLOUD_DEFAULT, &handle) == UBUNTU_CLOUD_INVALID_ARGUMENT);
+  EXPECT(handle == nullptr);
+
+  UbuntuCloudTestServer server {};  // Serves nothing
+  std::string           stream { server.url("/releases") };
+  EXPECT(ubuntu_cloud_load(directory.c_str(), stream.c_str(), 0, UBUNTU_CLOUD_NO_CACHE, &handle) == UBUNTU_CLOUD_LOAD_FAILED);
+  EXPECT(handle != nullptr);
+  char                       sha256[UBUNTU_CLOUD_SHA256_LENGTH + 1] {};
+  ubuntu_cloud_release_list* releases { nullptr };
+  EXPECT(ubuntu_cloud_sha256(handle, "noble", sha256) == UBUNTU_CLOUD_NOT_LOADED);
+  EXPECT(ubuntu_cloud_supported_releases(handle, &releases) == UBUNTU_CLOUD_NOT_LOADED);
+  EXPECT(releases == nullptr);
+  EXPECT(ubuntu_cloud_sha256(nullptr, "noble", sha256) == UBUNTU_CLOUD_INVALID_ARGUMENT);
+  ubuntu_cloud_free(handle);
+  ubuntu_cloud_free(nullptr);
+}
+
+int main() {
+  std::filesystem::path directory { std::filesystem::temp_directory_path() / ("ubuntu-cloud-c-tests." + std::to_string(getpid())) };
+
+  // Every load names its cache directory, the snapshot of a load without cache still goes there
+  testLoad(directory / "load");
+  testAsyncLoad(directory / "async");
+  testConcurrentQueries(directory / "concurrent");
+  testFailures(directory / "failures");
+
+  std::error_code remove_error {};
+  std::filesystem::remove_all(directory, remove_error);
+  return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file UbuntuCloudCatalogTests.cpp
+ * @brief Tests of the indexed catalog: the release indexes, the serial order, the scans of the supported-releases and current-LTS queries,
+ * the changes between two loads and the snapshot.
+ */
+
+#include "UbuntuCloudCatalog.hpp"
+#include "UbuntuCloudTest.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/// Architectures of the generated products, in the order they repeat.
+static const std::vector<std::string> test_archs { "amd64", "arm64", "armhf", "ppc64el", "riscv64", "s390x" };
+
+/**
+ * @brief Generates a catalog large enough to be scanned in parallel runs, as merged streams make it.
+ *
+ * Consecutive products belong to different releases, so every release has products in every run, and the LTS release
+ * lists some architectures several times, as merged streams do.
+ * @param count Number of products.
+ * @return std::vector<UbuntuProduct> The products.
+ */
+static std::vector<UbuntuProduct> generatedProducts(std::size_t count) {
+  std::vector<UbuntuProduct> products(count);
+  for (std::size_t idx = 0; idx < count; idx++) {
+    UbuntuProduct& product { products[idx] };
+    std::size_t    release { idx * 7 % 97 };
+    product.name          = "com.ubuntu.cloud:stream" + std::to_string(idx);
+    product.release       = "codename" + std::to_string(release);
+    product.release_title = std::to_string(release + 4) + ".04" + (release % 10 == 0 ? " LTS" : "");
+    product.arch          = test_archs[(idx / 97 + idx / 1000) % test_archs.size()];
+    product.aliases       = release == 40 ? "lts" : "";
+    product.version       = std::to_string(release + 4) + ".04";
+    product.supported     = release % 3 != 0;
+    product.versions.push_back({ std::to_string(20240000 + idx), {} });
+  }
+  return products;
+}
+
+/**
+ * @brief The supported releases and the current LTS of a catalog split in runs are those a single pass finds.
+ */
+static void testParallelScans() {
+  std::vector<UbuntuProduct> products { generatedProducts(100000) };
+  UbuntuCloudCatalog         catalog { products };
+
+  std::map<std::string, std::vector<std::string>, std::greater<>> expected_releases {};
+  UbuntuRelease                                                   expected_lts {};
+  for (const UbuntuProduct& product : products) {
+    if (product.supported) {
+      std::vector<std::string>& archs { expected_releases[product.release_title + " (" + product.release + ")"] };
+      if (std::find(archs.begin(), archs.end(), product.arch) == archs.end()) {
+        archs.push_back(product.arch);
+      }
+    }
+    if (product.aliases == "lts") {
+      expected_lts.release_name = product.version + " (" + product.release + ")";
+      if (std::find(expected_lts.architectures.begin(), expected_lts.architectures.end(), product.arch) == expected_lts.architectures.end()) {
+        expected_lts.architectures.push_back(product.arch);
+        expected_lts.latest_versions.push_back(product.versions.back().serial);
+      }
+    }
+  }
+
+  std::vector<UbuntuRelease> releases { catalog.supportedReleases() };
+  EXPECT(releases.size() == expected_releases.size());
+  auto expected { expected_releases.begin() };
+  for (std::size_t idx = 0; idx < releases.size() && expected != expected_releases.end(); idx++, expected++) {
+    EXPECT(releases[idx].release_name == expected->first);
+    EXPECT(releases[idx].architectures == expected->second);
+  }
+
+  std::optional<UbuntuRelease> lts { catalog.currentLTS() };
+  EXPECT(lts);
+  EXPECT(lts && lts->release_name == expected_lts.release_name);
+  EXPECT(lts && lts->architectures == expected_lts.architectures);
+  EXPECT(lts && lts->latest_versions == expected_lts.latest_versions);
+}
+
+/**
+ * @brief Builds a few products of two releases, with the items the queries read.
+ * @return std::vector<UbuntuProduct> The products, noble being the current LTS and focal no longer supported.
+ */
+static std::vector<UbuntuProduct> releasedProducts() {
+  std::vector<UbuntuProduct> products {};
+  for (const char* release : { "focal", "noble" }) {
+    for (const char* arch : { "amd64", "arm64" }) {
+      UbuntuProduct& product { products.emplace_back() };
+      bool           noble { std::strcmp(release, "noble") == 0 };
+      product.name          = std::string("com.ubuntu.cloud:server:") + (noble ? "24.04:" : "20.04:") + arch;
+      product.release       = release;
+      product.release_title = noble ? "24.04 LTS" : "20.04 LTS";
+      product.arch          = arch;
+      product.aliases       = noble ? "24.04,lts,noble" : "20.04,focal";
+      product.version       = noble ? "24.04" : "20.04";
+      product.mirror        = "https://cloud-images.ubuntu.com/releases/";
+      product.supported     = noble;
+      product.versions.push_back({ "20240423", { { "disk1.img", "sha-old", "server/old/disk1.img", 100 } } });
+      product.versions.push_back({ "20240501", { { "disk1.img", "sha-new", "server/new/disk1.img", 200 },
+                                                 { "root.tar.xz", "sha-root", "server/new/root.tar.xz", 0 } } });
+    }
+  }
+  return products;
+}
+
+/**
+ * @brief The release indexes find the products of a codename or a title, as a scan of every product does.
+ */
+static void testReleaseIndex() {
+  std::vector<UbuntuProduct> products { generatedProducts(100000) };
+  // A title equal to a codename lists the products of both, each once, even a product with the same codename and title
+  products.front().release_title = products.front().release;
+  products.back().release_title  = "codename1";
+  UbuntuCloudCatalog             catalog { products };
+  const std::vector<std::string> releases { "codename0", "codename1", "codename40", "14.04 LTS", "100.04" };
+  for (const std::string& release : releases) {
+    std::vector<std::uint32_t> expected {};
+    for (std::uint32_t product = 0; product < catalog.productCount(); product++) {
+      if (catalog.productRelease(product) == release || catalog.productReleaseTitle(product) == release) {
+        expected.push_back(product);
+      }
+    }
+    EXPECT(!expected.empty());
+    EXPECT(catalog.productsForRelease(release) == expected);
+  }
+  EXPECT(catalog.productsForRelease("codename97").empty());
+  EXPECT(catalog.productsForRelease("").empty());
+
+  UbuntuCloudCatalog released { releasedProducts() };
+  EXPECT(released.sha256ForRelease("noble") == std::optional<std::string>("sha-new"));
+  EXPECT(released.sha256ForRelease("24.04 LTS") == std::optional<std::string>("sha-new"));
+  EXPECT(!released.sha256ForRelease("jammy"));
+  EXPECT(!UbuntuCloudCatalog().sha256ForRelease("noble"));
+}
+
+/**
+ * @brief Serials compare as numbers, date first, then point release, whatever their length.
+ */
+static void testSerialKeys() {
+  EXPECT(serialSortKey("20240423") < serialSortKey("20240423.1"));
+  EXPECT(serialSortKey("20240423.1") < serialSortKey("20240423.2"));
+  EXPECT(serialSortKey("20240423.9") < serialSortKey("20240423.10"));
+  EXPECT(serialSortKey("20240423.10") < serialSortKey("20240424"));
+  EXPECT(serialSortKey("2024042") < serialSortKey("20240423"));  // Not equal because one is a prefix of the other
+  EXPECT(serialSortKey("20240423") == serialSortKey("20240423.0"));
+  EXPECT(versionPrecedes({ "20240423", {} }, { "20240423.0", {} }));  // Equal keys, ordered by text
+}
+
+/**
+ * @brief The versions of a product are sorted whatever the order they were published in, and found with a binary search.
+ */
+static void testSortedVersions() {
+  std::vector<UbuntuProduct>         products { releasedProducts() };
+  std::vector<UbuntuProductVersion>& versions { products.front().versions };
+  versions.clear();
+  // Hundreds of historical serials, given newest first with the point releases first
+  for (std::size_t day = 0; day < 300; day++) {
+    std::string serial { std::to_string(20300000 - day * 10) };
+    versions.push_back({ serial + ".1", {} });
+    versions.push_back({ serial, {} });
+  }
+  std::vector<std::string> serials {};
+  for (auto version = versions.rbegin(); version != versions.rend(); version += 2) {
+    serials.push_back(version->serial);
+    serials.push_back((version + 1)->serial);
+  }
+  UbuntuCloudCatalog catalog { products };
+  std::uint32_t      product { 0 };
+  auto [first, last] { catalog.versionRange(product) };
+  EXPECT(last - first == serials.size());
+  for (std::uint32_t version = first; version < last; version++) {
+    EXPECT(catalog.versionSerial(version) == serials[version - first]);
+    EXPECT(catalog.findVersion(product, serials[version - first]) == version);
+  }
+  EXPECT(catalog.latestVersion(product) == last - 1);
+  EXPECT(catalog.versionSerial(catalog.latestVersion(product)) == "20300000.1");
+  EXPECT(catalog.findVersion(product, "20300000.2") == UbuntuCloudCatalog::npos);
+  EXPECT(catalog.findVersion(product, "20240423") == UbuntuCloudCatalog::npos);
+}
+
+/**
+ * @brief The changes between two loads are listed product by product, with the new LTS reported once for its release.
+ */
+static void testChangesSince() {
+  UbuntuCloudCatalog previous { releasedProducts() };
+  EXPECT(UbuntuCloudCatalog { releasedProducts() }.changesSince(previous).empty());
+
+  std::vector<UbuntuProduct> products { releasedProducts() };
+  for (UbuntuProduct& product : products) {
+    if (product.release == "focal") {
+      product.aliases += ",lts";
+    }
+  }
+  products[0].supported = true;
+  products[2].supported = false;
+  products[2].versions.push_back({ "20240601", {} });
+  products.pop_back();
+  UbuntuProduct& oracular { products.emplace_back() };
+  oracular.name    = "com.ubuntu.cloud:server:24.10:amd64";
+  oracular.release = "oracular";
+  oracular.arch    = "amd64";
+  oracular.versions.push_back({ "20241010", {} });
+  oracular.versions.push_back({ "20241001", {} });
+
+  using Kind = UbuntuCatalogChange::Kind;
+  std::vector<UbuntuCatalogChange> changes { UbuntuCloudCatalog { products }.changesSince(previous) };
+  std::vector<std::tuple<Kind, std::string, std::string>> expected {
+    { Kind::Supported, "com.ubuntu.cloud:server:20.04:amd64", "" },      { Kind::NewLTS, "com.ubuntu.cloud:server:20.04:amd64", "" },
+    { Kind::Unsupported, "com.ubuntu.cloud:server:24.04:amd64", "" },    { Kind::NewSerial, "com.ubuntu.cloud:server:24.04:amd64", "20240601" },
+    { Kind::RemovedProduct, "com.ubuntu.cloud:server:24.04:arm64", "" }, { Kind::NewProduct, "com.ubuntu.cloud:server:24.10:amd64", "20241010" }
+  };
+  EXPECT(changes.size() == expected.size());
+  for (std::size_t idx = 0; idx < changes.size() && idx < expected.size(); idx++) {
+    EXPECT(std::make_tuple(changes[idx].kind, changes[idx].product, changes[idx].serial) == expected[idx]);
+  }
+  EXPECT(!changes.empty() && changes[1].release == "focal");
+}
+
+/**
+ * @brief Reads a whole file.
+ * @param path The file.
+ * @return std::string The contents, empty if the file cannot be read.
+ */
+static std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Writes a whole file.
+ * @param path The file.
+ * @param contents The contents.
+ */
+static void writeFile(const std::filesystem::path& path, const std::string& contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+}
+
+/**
+ * @brief A catalog read back from its snapshot holds every column and index of the catalog it was written from.
+ * @param directory Directory for the snapshot files.
+ */
+static void testSnapshotRoundTrip(const std::filesystem::path& directory) {
+  UbuntuCloudCatalog    catalog { releasedProducts() };
+  std::filesystem::path path { directory / "catalog.snapshot" };
+  EXPECT(catalog.writeSnapshot(path));
+  std::string                       error {};
+  std::optional<UbuntuCloudCatalog> snapshot { UbuntuCloudCatalog::openSnapshot(path, error) };
+  EXPECT(snapshot);
+  EXPECT(error.empty());
+  if (!snapshot) {
+    return;
+  }
+  EXPECT(snapshot->productCount() == catalog.productCount());
+  EXPECT(snapshot->itemCount() == catalog.itemCount());
+  for (std::uint32_t product = 0; product < catalog.productCount() && product < snapshot->productCount(); product++) {
+    EXPECT(snapshot->productName(product) == catalog.productName(product));
+    EXPECT(snapshot->productReleaseTitle(product) == catalog.productReleaseTitle(product));
+    EXPECT(snapshot->productArch(product) == catalog.productArch(product));
+    EXPECT(snapshot->productMirror(product) == catalog.productMirror(product));
+    EXPECT(snapshot->productSupported(product) == catalog.productSupported(product));
+    EXPECT(snapshot->productLts(product) == catalog.productLts(product));
+    EXPECT(snapshot->versionRange(product) == catalog.versionRange(product));
+  }
+  for (std::uint32_t item = 0; item < catalog.itemCount() && item < snapshot->itemCount(); item++) {
+    EXPECT(snapshot->itemName(item) == catalog.itemName(item));
+    EXPECT(snapshot->itemSha256(item) == catalog.itemSha256(item));
+    EXPECT(snapshot->itemPath(item) == catalog.itemPath(item));
+    EXPECT(snapshot->itemSize(item) == catalog.itemSize(item));
+  }
+  EXPECT(snapshot->productsForRelease("24.04 LTS") == catalog.productsForRelease("noble"));
+  EXPECT(snapshot->supportedReleases().size() == 1);
+  std::optional<UbuntuRelease> lts { snapshot->currentLTS() };
+  EXPECT(lts && lts->release_name == "24.04 (noble)");
+  EXPECT(lts && lts->latest_versions == std::vector<std::string>({ "20240501", "20240501" }));
+  EXPECT(snapshot->sha256ForRelease("noble") == std::optional<std::string>("sha-new"));
+  std::optional<UbuntuCloudImage> image { snapshot->diskImageForRelease("20.04 LTS") };
+  EXPECT(image && image->url == "https://cloud-images.ubuntu.com/releases/server/new/disk1.img");
+  EXPECT(image && image->size == 200);
+}
+
+/**
+ * @brief Damaged snapshots and snapshots of another format version are rejected with the reason, and replaced on the next write.
+ * @param directory Directory for the snapshot files.
+ */
+static void testCorruptSnapshot(const std::filesystem::path& directory) {
+  UbuntuCloudCatalog    catalog { releasedProducts() };
+  std::filesystem::path path { directory / "corrupt.snapshot" };
+  EXPECT(catalog.writeSnapshot(path));
+  std::string image { readFile(path) };
+  auto        rejected { [&path](const std::string& contents, const std::string& reason) {
+    writeFile(path, contents);
+    std::string error {};
+    bool        opened { UbuntuCloudCatalog::openSnapshot(path, error).has_value() };
+    return !opened && error.find(reason) != std::string::npos;
+  } };
+
+  EXPECT(rejected(image.substr(0, image.size() - 1), "truncated"));
+  EXPECT(rejected(image + '\0', "truncated"));
+  EXPECT(rejected(image.substr(0, 4), "file too small"));
+  std::string magic { image };
+  magic[0] = 'X';
+  EXPECT(rejected(magic, "not a catalog snapshot"));
+  std::string   version { image };
+  std::uint32_t older { 2 };
+  std::memcpy(version.data() + 8, &older, sizeof(older));  // The version follows the 8 bytes of the magic
+  EXPECT(rejected(version, "format version 2, expected 3"));
+  std::string error {};
+  EXPECT(!UbuntuCloudCatalog::openSnapshot(directory / "missing.snapshot", error));
+  EXPECT(!error.empty());
+
+  EXPECT(catalog.writeSnapshot(path));
+  error.clear();
+  EXPECT(UbuntuCloudCatalog::openSnapshot(path, error));
+}
+
+int main() {
+  // Named after the start time, the tests also run where there is no process id to tell concurrent runs apart
+  std::string           run { std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) };
+  std::filesystem::path directory { std::filesystem::temp_directory_path() / ("ubuntu-cloud-catalog-tests." + run) };
+  std::filesystem::create_directories(directory);
+
+  testReleaseIndex();
+  testSerialKeys();
+  testSortedVersions();
+  testParallelScans();
+  testChangesSince();
+  testSnapshotRoundTrip(directory);
+  testCorruptSnapshot(directory);
+
+  std::error_code remove_error {};
+  std::filesystem::remove_all(directory, remove_error);
+  return test_failures == 0 ? 0 : 1;
+}
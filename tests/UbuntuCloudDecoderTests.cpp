@@ -0,0 +1,210 @@
+/**
+ * @file UbuntuCloudDecoderTests.cpp
+ * @brief Tests of the decompression stage on gzip bodies.
+ */
+
+#include "UbuntuCloudDecoder.hpp"
+#include "UbuntuCloudTest.hpp"
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @class DeflateBitWriter
+ * @brief Packs the bits of a hand-made deflate stream, least significant bit first as RFC 1951 orders them.
+ */
+class DeflateBitWriter {
+  private:
+    /// The packed bytes, the last one possibly partial.
+    std::string _bytes;
+    /// Bits used in the last byte, 0 when it is complete.
+    int _bitCount { 0 };
+
+  public:
+    /**
+     * @brief Appends a value, its least significant bit first, as the block headers are written.
+     * @param value The value.
+     * @param count Number of bits.
+     */
+    void bits(std::uint32_t value, int count) {
+      for (int bit = 0; bit < count; bit++) {
+        if (this->_bitCount == 0) {
+          this->_bytes.push_back('\0');
+        }
+        this->_bytes.back() = static_cast<char>(static_cast<unsigned char>(this->_bytes.back()) | (((value >> bit) & 1) << this->_bitCount));
+        this->_bitCount     = (this->_bitCount + 1) % 8;
+      }
+    }
+
+    /**
+     * @brief Appends a Huffman code, its most significant bit first.
+     * @param code The code.
+     * @param length Number of bits of the code.
+     */
+    void code(std::uint32_t code, int length) {
+      for (int bit = length - 1; bit >= 0; bit--) {
+        this->bits((code >> bit) & 1, 1);
+      }
+    }
+
+    /// Appends a literal byte below 144 of the fixed Huffman code.
+    void literal(unsigned char value) { this->code(0x30 + value, 8); }
+
+    /// Appends a match of 3 bytes at distance 1 of the fixed Huffman code: length code 257, distance code 0.
+    void shortMatch() {
+      this->code(257 - 256, 7);
+      this->code(0, 5);
+    }
+
+    /// Appends a match of 258 bytes at distance 1 of the fixed Huffman code: length code 285, distance code 0.
+    void longMatch() {
+      this->code(0xc0 + (285 - 280), 8);
+      this->code(0, 5);
+    }
+
+    /// Appends the end of a block of the fixed Huffman code.
+    void endOfBlock() { this->code(256 - 256, 7); }
+
+    /**
+     * @brief Returns the packed bytes, the last one padded with zero bits.
+     * @return const std::string& The bytes.
+     */
+    const std::string& bytes() const { return this->_bytes; }
+};
+
+/**
+ * @brief Appends a 32-bit value in little-endian order, as the gzip trailer stores it.
+ * @param output The bytes.
+ * @param value The value.
+ */
+static void appendLittleEndian(std::string& output, std::uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    output.push_back(static_cast<char>((value >> shift) & 0xff));
+  }
+}
+
+/**
+ * @brief Decodes a body.
+ * @param body The body.
+ * @param[out] decoded Receives the decoded bytes.
+ * @param[out] error Receives the error of the decoder.
+ * @return bool The result of decodeStream().
+ */
+static bool decode(const std::string& body, std::string& decoded, std::string& error) {
+  std::istringstream      input { body };
+  UbuntuCloudStreamBuffer output(1024);  // Nobody reads it, room for every chunk of the bodies below
+  UbuntuCloudEncoding     encoding { UbuntuCloudEncoding::Identity };
+  bool                    result { decodeStream(input, output, encoding, error, [&decoded](const char* data, std::size_t size) {
+    decoded.append(data, size);
+  }) };
+  EXPECT(encoding == UbuntuCloudEncoding::Gzip);
+  return result;
+}
+
+/**
+ * @brief Compresses bytes as a gzip member.
+ * @param text The bytes.
+ * @return std::string The member.
+ */
+static std::string gzip(const std::string& text) {
+  z_stream stream {};
+  std::string compressed(text.size() + 1024, '\0');
+  EXPECT(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);  // Plus 16: a gzip header
+  stream.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+  stream.avail_in  = static_cast<uInt>(text.size());
+  stream.next_out  = reinterpret_cast<Bytef*>(compressed.data());
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  EXPECT(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+  return compressed;
+}
+
+/**
+ * @brief A body of several concatenated gzip members decodes to their concatenation, as gunzip reads it.
+ */
+static void testConcatenatedMembers() {
+  std::string first { R"({"products":{"com.ubuntu.cloud:server:24.04:amd64":)" };
+  std::string second(300000, ' ');
+  std::string third { R"({"release":"noble"}}})" };
+  std::string decoded {};
+  std::string error {};
+  EXPECT(decode(gzip(first) + gzip(second) + gzip(third), decoded, error));
+  EXPECT(error.empty());
+  EXPECT(decoded == first + second + third);
+
+  std::string body { gzip(second) };
+  body.resize(body.size() - 4);
+  decoded.clear();
+  EXPECT(!decode(body, decoded, error));
+  EXPECT(error == "Truncated gzip data");
+}
+
+/**
+ * @brief An input chunk that runs out exactly as the output chunk fills up is followed by the next one.
+ *
+ * zlib reports Z_BUF_ERROR when called again with neither input nor room to make progress with. The deflate stream is
+ * built by hand so that its first 16 KiB input chunk decodes to exactly one 128 KiB output chunk whatever the
+ * compressor: after the 10-byte gzip header, a block header of 3 bits, 8 literals of 8 bits, 386 matches of 258 bytes
+ * in 13 bits and 10492 matches of 3 bytes in 12 bits take 130989 of the 130992 bits left and decode to 131072 bytes.
+ * The 3 remaining bits start the next match.
+ */
+static void testOutputFilledAtChunkEnd() {
+  DeflateBitWriter deflate {};
+  deflate.bits(0, 1);  // Not the last block
+  deflate.bits(1, 2);  // Fixed Huffman codes
+  for (int literal = 0; literal < 8; literal++) {
+    deflate.literal(0);
+  }
+  for (int match = 0; match < 386; match++) {
+    deflate.longMatch();
+  }
+  for (int match = 0; match < 10492; match++) {
+    deflate.shortMatch();
+  }
+  for (int match = 0; match < 100; match++) {
+    deflate.longMatch();
+  }
+  deflate.endOfBlock();
+  deflate.bits(1, 1);  // Last block, empty
+  deflate.bits(1, 2);
+  deflate.endOfBlock();
+
+  std::size_t size { 131072 + 100 * 258 };
+  std::string expected(size, '\0');
+  std::string body { "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10 };  // gzip header, no name, unknown system
+  body += deflate.bytes();
+  appendLittleEndian(body, static_cast<std::uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(expected.data()), static_cast<uInt>(size))));
+  appendLittleEndian(body, static_cast<std::uint32_t>(size));
+
+  std::string decoded {};
+  std::string error {};
+  EXPECT(decode(body, decoded, error));
+  EXPECT(error.empty());
+  EXPECT(decoded == expected);
+}
+
+/**
+ * @brief Only the suffixes of an encoding this build decodes are accepted for the pre-compressed copies.
+ */
+static void testDecodableSuffix() {
+  EXPECT(decodableSuffix(".gz"));
+#ifdef UBUNTU_CLOUD_ZSTD
+  EXPECT(decodableSuffix(".zst"));
+#else
+  EXPECT(!decodableSuffix(".zst"));
+#endif
+  EXPECT(!decodableSuffix(".xz"));
+  EXPECT(!decodableSuffix(""));
+}
+
+int main() {
+  testConcatenatedMembers();
+  testOutputFilledAtChunkEnd();
+  testDecodableSuffix();
+  return test_failures == 0 ? 0 : 1;
+}
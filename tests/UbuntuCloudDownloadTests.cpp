@@ -0,0 +1,162 @@
+/**
+ * @file UbuntuCloudDownloadTests.cpp
+ * @brief Tests of the ranged image download against the local HTTP stand-in.
+ */
+
+#include "UbuntuCloudDownload.hpp"
+#include "UbuntuCloudTestServer.hpp"
+
+#include <curl/curl.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <unistd.h>
+
+/// Size of the served image, a few chunks of the test chunk size.
+constexpr static std::size_t image_size { 300 * 1024 };
+
+/**
+ * @brief Reads a whole file.
+ * @param path The file.
+ * @return std::string The contents, empty if the file cannot be read.
+ */
+static std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Describes the image the server serves, as the catalog would.
+ * @param server The server.
+ * @param contents The image contents.
+ * @param published_size Whether the catalog publishes the size, which enables the range requests.
+ * @return UbuntuCloudImage The image.
+ */
+static UbuntuCloudImage servedImage(UbuntuCloudTestServer& server, const std::string& contents, bool published_size = true) {
+  server.serve("/disk1.img", contents);
+  UbuntuCloudSha256 hash {};
+  hash.update(contents.data(), contents.size());
+  return { server.url("/disk1.img"), hash.hexDigest(), published_size ? contents.size() : 0 };
+}
+
+/**
+ * @brief Counts the requests that carried a Range header.
+ * @param server The server.
+ * @return std::size_t The number of ranged requests.
+ */
+static std::size_t rangedRequests(const UbuntuCloudTestServer& server) {
+  std::size_t count { 0 };
+  for (const UbuntuCloudTestRequest& request : server.requests()) {
+    count += request.range.empty() ? 0 : 1;
+  }
+  return count;
+}
+
+/**
+ * @brief The file is split into range requests and reassembled in order.
+ * @param directory Directory for the downloaded files.
+ */
+static void testRangedDownload(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           contents { testFileContents(image_size) };
+  std::filesystem::path destination { directory / "ranged.img" };
+  std::string           error {};
+  UbuntuCloudDownload   download(servedImage(server, contents), destination, { 3, 64 * 1024, 3 });
+  EXPECT(download.run(error));
+  EXPECT(error.empty());
+  EXPECT(readFile(destination) == contents);
+  EXPECT(rangedRequests(server) == 5);  // 300 KiB in 64 KiB chunks
+  EXPECT(!std::filesystem::exists(directory / "ranged.img.part"));
+}
+
+/**
+ * @brief A chunk cut short is resumed from the byte it stopped at.
+ * @param directory Directory for the downloaded files.
+ */
+static void testRetriedChunk(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           contents { testFileContents(image_size, 1) };
+  std::filesystem::path destination { directory / "retried.img" };
+  std::string           error {};
+  server.truncateResponses(1);
+  UbuntuCloudDownload download(servedImage(server, contents), destination, { 1, 64 * 1024, 3 });
+  EXPECT(download.run(error));
+  EXPECT(readFile(destination) == contents);
+  EXPECT(server.requests().size() == 6);  // One more request for the rest of the cut chunk
+}
+
+/**
+ * @brief A server that answers range requests with the whole file gets a single transfer instead.
+ * @param directory Directory for the downloaded files.
+ */
+static void testIgnoredRanges(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           contents { testFileContents(image_size, 2) };
+  std::filesystem::path destination { directory / "ignored.img" };
+  std::string           error {};
+  server.ignoreRanges(true);
+  UbuntuCloudDownload download(servedImage(server, contents), destination, { 3, 64 * 1024, 3 });
+  EXPECT(download.run(error));
+  EXPECT(readFile(destination) == contents);
+  EXPECT(server.requests().back().range.empty());
+}
+
+/**
+ * @brief A whole-file chunk cut short, whose resume the server answers with the whole file, starts over.
+ * @param directory Directory for the downloaded files.
+ * @param published_size Whether the size is known, a single range, or unknown, a single transfer resumed from an offset.
+ */
+static void testIgnoredResume(const std::filesystem::path& directory, bool published_size) {
+  UbuntuCloudTestServer server {};
+  std::string           contents { testFileContents(image_size, 3) };
+  std::filesystem::path destination { directory / "resumed.img" };
+  std::string           error {};
+  server.ignoreRanges(true);
+  server.truncateResponses(1);
+  UbuntuCloudDownload download(servedImage(server, contents, published_size), destination, { 2, 1024 * 1024, 3 });
+  EXPECT(download.run(error));
+  EXPECT(error.empty());
+  EXPECT(readFile(destination) == contents);
+  std::vector<UbuntuCloudTestRequest> requests { server.requests() };
+  EXPECT(requests.size() == 2);
+  EXPECT(requests.size() == 2 && !requests.back().range.empty());  // The resume asked for the rest only
+}
+
+/**
+ * @brief A file whose digest does not match is not left at the destination.
+ * @param directory Directory for the downloaded files.
+ */
+static void testDigestMismatch(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           contents { testFileContents(image_size, 4) };
+  std::filesystem::path destination { directory / "mismatch.img" };
+  std::string           error {};
+  UbuntuCloudImage      image { servedImage(server, contents) };
+  server.serve("/disk1.img", testFileContents(image_size, 5));  // Changed upstream after the catalog was published
+  UbuntuCloudDownload download(image, destination, { 3, 64 * 1024, 3 });
+  EXPECT(!download.run(error));
+  EXPECT(error.find("SHA256 mismatch") != std::string::npos);
+  EXPECT(!std::filesystem::exists(destination));
+  EXPECT(!std::filesystem::exists(directory / "mismatch.img.part"));
+}
+
+int main() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  std::filesystem::path directory { std::filesystem::temp_directory_path() / ("ubuntu-cloud-download-tests." + std::to_string(getpid())) };
+  std::filesystem::create_directories(directory);
+
+  testRangedDownload(directory);
+  testRetriedChunk(directory);
+  testIgnoredRanges(directory);
+  testIgnoredResume(directory, true);
+  testIgnoredResume(directory, false);
+  testDigestMismatch(directory);
+
+  std::error_code remove_error {};
+  std::filesystem::remove_all(directory, remove_error);
+  curl_global_cleanup();
+  return test_failures == 0 ? 0 : 1;
+}
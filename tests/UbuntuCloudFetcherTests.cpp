@@ -0,0 +1,226 @@
+/**
+ * @file UbuntuCloudFetcherTests.cpp
+ * @brief Tests of the fetcher against the local HTTP stand-in: backpressure, time budget, the on-disk cache and the refreshes.
+ */
+
+#include "UbuntuCloudFetcher.hpp"
+#include "UbuntuCloudTestServer.hpp"
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @brief Builds a product file with one supported amd64 product per release, each with a few serials of a few items.
+ * @param releases Number of releases, named "r0", "r1", ...
+ * @return std::string The product file.
+ */
+static std::string productFile(std::size_t releases) {
+  const std::vector<std::string> item_names { "disk1.img", "root.tar.xz", "manifest", "vmlinuz" };
+  std::ostringstream product_file {};
+  product_file << R"({"format":"products:1.0","products":{)";
+  for (std::size_t release = 0; release < releases; release++) {
+    std::string codename { "r" + std::to_string(release) };
+    product_file << (release == 0 ? "" : ",") << "\"com.ubuntu.cloud:server:" << codename << ":amd64\":{\"release\":\"" << codename
+                 << "\",\"release_title\":\"" << codename << "\",\"arch\":\"amd64\",\"version\":\"" << codename
+                 << "\",\"supported\":true,\"versions\":{";
+    for (std::size_t serial = 0; serial < 4; serial++) {
+      product_file << (serial == 0 ? "" : ",") << "\"2024010" << serial << "\":{\"items\":{";
+      for (std::size_t item = 0; item < item_names.size(); item++) {
+        std::string location { "server/releases/" + codename + "/2024010" + std::to_string(serial) + "/" + item_names[item] };
+        product_file << (item == 0 ? "" : ",") << "\"" << item_names[item] << "\":{\"path\":\"" << location << "\",\"size\":1,\"sha256\":\"sha-"
+                     << location << "\"}";
+      }
+      product_file << "}}";
+    }
+    product_file << "}}";
+  }
+  product_file << "}}";
+  return product_file.str();
+}
+
+/**
+ * @brief A full stream tells a producer that returned instead of blocking once it has room again, or once it is closed.
+ */
+static void testStreamRoom() {
+  UbuntuCloudStreamBuffer stream(2);
+  int                     calls { 0 };
+  stream.onRoom([&calls]() { calls++; });
+  EXPECT(stream.push("ab", 2));
+  EXPECT(stream.writable());
+  EXPECT(stream.push("cd", 2));
+  EXPECT(!stream.writable());
+  std::istream input(&stream);
+  EXPECT(input.get() == 'a');
+  EXPECT(calls == 1);
+  EXPECT(stream.writable());
+  EXPECT(input.get() == 'b');
+  EXPECT(input.get() == 'c');  // Taking the next chunk off a queue that is not full does not call back
+  EXPECT(calls == 1);
+  stream.close();
+  EXPECT(calls == 2);
+  EXPECT(stream.writable());
+  EXPECT(!stream.push("ef", 2));
+}
+
+/**
+ * @brief A body far larger than the stream buffer arrives whole: the paused request resumes where it stopped.
+ */
+static void testLargeBody() {
+  UbuntuCloudTestServer server {};
+  std::string           contents { productFile(8000) };  // Megabytes, hundreds of chunks of the write callback
+  server.serve("/streams/v1/products.json", contents);
+  EXPECT(contents.size() > 64 * CURL_MAX_WRITE_SIZE);
+  UbuntuCloudFetcher fetcher(server.url("/streams/v1/products.json"));
+  EXPECT(fetcher.isInitialized());
+  std::vector<UbuntuRelease> releases { fetcher.getSupportedReleases() };
+  EXPECT(releases.size() == 8000);
+  EXPECT(fetcher.getSha256ForRelease("r7999").has_value());
+}
+
+/**
+ * @brief Every request of a file gets what is left of its time budget, so a server that never answers fails the file in time.
+ */
+static void testTimeBudget() {
+  // Connections complete in the backlog of a socket that never accepts them, and never get an answer
+  int         listener { socket(AF_INET, SOCK_STREAM, 0) };
+  sockaddr_in address {};
+  address.sin_family      = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port        = 0;
+  socklen_t length { sizeof(address) };
+  EXPECT(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+  EXPECT(listen(listener, 16) == 0);
+  EXPECT(getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == 0);
+  std::string url { "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/streams/v1/products.json" };
+
+  UbuntuCloudEndpoints endpoints {};
+  endpoints.race        = 1;
+  endpoints.hedge_delay = std::chrono::milliseconds(100);
+  endpoints.backoff     = std::chrono::milliseconds(10);
+  endpoints.timeout     = std::chrono::milliseconds(500);
+  std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
+  UbuntuCloudFetcher                    fetcher(url, std::nullopt, std::nullopt, UbuntuCloudLoading::Eager, endpoints);
+  std::chrono::steady_clock::duration   elapsed { std::chrono::steady_clock::now() - start };
+  EXPECT(!fetcher.isInitialized());
+  EXPECT(elapsed >= std::chrono::milliseconds(400));
+  EXPECT(elapsed < std::chrono::milliseconds(1500));  // Not a full budget per request and hedge
+  close(listener);
+}
+
+/**
+ * @brief Returns where the single file of a fetch came from.
+ * @param fetcher The fetcher, after a fetch.
+ * @return std::string "network", "not-modified" or "cache", empty if nothing was transferred.
+ */
+static std::string transferSource(const UbuntuCloudFetcher& fetcher) {
+  const std::vector<UbuntuCloudTransferStats>& transfers { fetcher.getStats().transfers };
+  return transfers.size() == 1 ? transfers.front().source : "";
+}
+
+/**
+ * @brief Without a freshness window, a cached file is revalidated: a 304 answers from the cache, a changed file is downloaded.
+ * @param directory The cache directory.
+ */
+static void testConditionalRequest(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  UbuntuCloudCache      cache(directory, std::chrono::seconds(0));
+  std::string           url { server.url("/streams/v1/products.json") };
+  server.serve("/streams/v1/products.json", productFile(3));
+  {
+    UbuntuCloudFetcher fetcher(url, cache);
+    EXPECT(fetcher.isInitialized());
+    EXPECT(transferSource(fetcher) == "network");
+  }
+  {
+    UbuntuCloudFetcher fetcher(url, cache);
+    EXPECT(fetcher.isInitialized());
+    EXPECT(transferSource(fetcher) == "not-modified");
+    EXPECT(fetcher.getSupportedReleases().size() == 3);
+  }
+  std::vector<UbuntuCloudTestRequest> requests { server.requests() };
+  EXPECT(requests.size() == 2);
+  EXPECT(requests.size() == 2 && requests[0].if_none_match.empty() && !requests[1].if_none_match.empty());
+
+  server.serve("/streams/v1/products.json", productFile(4));
+  UbuntuCloudFetcher fetcher(url, cache);
+  EXPECT(fetcher.isInitialized());
+  EXPECT(transferSource(fetcher) == "network");
+  EXPECT(fetcher.getSupportedReleases().size() == 4);
+}
+
+/**
+ * @brief Inside the --max-age window, a cached file is read from the disk without any request.
+ * @param directory The cache directory.
+ */
+static void testFreshCache(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           url { server.url("/streams/v1/products.json") };
+  server.serve("/streams/v1/products.json", productFile(3));
+  {
+    UbuntuCloudFetcher fetcher(url, UbuntuCloudCache(directory, std::chrono::seconds(3600)));
+    EXPECT(transferSource(fetcher) == "network");
+  }
+  server.serve("/streams/v1/products.json", productFile(4));  // Not seen until the entry gets stale
+  UbuntuCloudFetcher fetcher(url, UbuntuCloudCache(directory, std::chrono::seconds(3600)));
+  EXPECT(fetcher.isInitialized());
+  EXPECT(transferSource(fetcher) == "cache");
+  EXPECT(fetcher.getSupportedReleases().size() == 3);
+  EXPECT(server.requests().size() == 1);
+
+  UbuntuCloudFetcher revalidated(url, UbuntuCloudCache(directory, std::chrono::seconds(0)));
+  EXPECT(transferSource(revalidated) == "network");
+  EXPECT(revalidated.getSupportedReleases().size() == 4);
+}
+
+/**
+ * @brief A refresh that finds the file unchanged keeps the catalog without parsing it, a changed file replaces it.
+ * @param directory The cache directory.
+ */
+static void testRefresh(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  std::string           url { server.url("/streams/v1/products.json") };
+  server.serve("/streams/v1/products.json", productFile(3));
+  UbuntuCloudFetcher fetcher(url, UbuntuCloudCache(directory, std::chrono::seconds(0)));
+  EXPECT(fetcher.catalogChanged());
+  UbuntuCloudCatalog previous { fetcher.getCatalog() };
+
+  EXPECT(fetcher.fetchData());
+  EXPECT(!fetcher.catalogChanged());
+  EXPECT(transferSource(fetcher) == "not-modified");
+  EXPECT(fetcher.getCatalog().changesSince(previous).empty());
+
+  server.serve("/streams/v1/products.json", productFile(4));
+  EXPECT(fetcher.fetchData());
+  EXPECT(fetcher.catalogChanged());
+  std::vector<UbuntuCatalogChange> changes { fetcher.getCatalog().changesSince(previous) };
+  EXPECT(changes.size() == 1);
+  EXPECT(!changes.empty() && changes.front().kind == UbuntuCatalogChange::Kind::NewProduct && changes.front().release == "r3");
+}
+
+int main() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  std::filesystem::path directory { std::filesystem::temp_directory_path() / ("ubuntu-cloud-fetcher-tests." + std::to_string(getpid())) };
+
+  testStreamRoom();
+  testLargeBody();
+  testTimeBudget();
+  testConditionalRequest(directory / "conditional");
+  testFreshCache(directory / "fresh");
+  testRefresh(directory / "refresh");
+
+  std::error_code remove_error {};
+  std::filesystem::remove_all(directory, remove_error);
+
+  curl_global_cleanup();
+  return test_failures == 0 ? 0 : 1;
+}
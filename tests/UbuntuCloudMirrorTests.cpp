@@ -0,0 +1,171 @@
+/**
+ * @file UbuntuCloudMirrorTests.cpp
+ * @brief Tests of the mirror sync against the local HTTP stand-in: resumed, corrupt and up-to-date files.
+ */
+
+#include "UbuntuCloudMirror.hpp"
+#include "UbuntuCloudParser.hpp"
+#include "UbuntuCloudTestServer.hpp"
+
+#include <curl/curl.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+/// Directory of the served serial, relative to the mirror root.
+constexpr static const char* release_directory { "server/releases/noble/release-20240423/" };
+
+/**
+ * @brief Reads a whole file.
+ * @param path The file.
+ * @return std::string The contents, empty if the file cannot be read.
+ */
+static std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Writes a whole file, creating its directory.
+ * @param path The file.
+ * @param contents The contents.
+ */
+static void writeFile(const std::filesystem::path& path, const std::string& contents) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+/**
+ * @brief Serves the items of one serial and builds the catalog publishing them.
+ * @param server The server.
+ * @param items The item names and contents, served under release_directory.
+ * @return UbuntuCloudCatalog The catalog, whose mirror is the server.
+ */
+static UbuntuCloudCatalog servedCatalog(UbuntuCloudTestServer& server, const std::vector<std::pair<std::string, std::string>>& items) {
+  std::ostringstream product_file {};
+  product_file << R"({"format":"products:1.0","products":{"com.ubuntu.cloud:server:24.04:amd64":{"release":"noble",)"
+               << R"("release_title":"24.04 LTS","arch":"amd64","aliases":"24.04,noble,lts","version":"24.04","supported":true,)"
+               << R"("versions":{"20240423":{"items":{)";
+  for (std::size_t idx = 0; idx < items.size(); idx++) {
+    const auto& [name, contents] { items[idx] };
+    server.serve(std::string("/") + release_directory + name, contents);
+    UbuntuCloudSha256 hash {};
+    hash.update(contents.data(), contents.size());
+    product_file << (idx == 0 ? "" : ",") << "\"" << name << "\":{\"path\":\"" << release_directory << name << "\",\"size\":" << contents.size()
+                 << ",\"sha256\":\"" << hash.hexDigest() << "\"}";
+  }
+  product_file << "}}}}}}";
+  std::istringstream         input { product_file.str() };
+  std::vector<UbuntuProduct> products {};
+  std::string                error {};
+  EXPECT(parseProductStream(input, products, error));
+  for (UbuntuProduct& product : products) {
+    product.mirror = server.url("/");
+  }
+  return UbuntuCloudCatalog(products);
+}
+
+/**
+ * @brief Runs a sync of every item of a catalog.
+ * @param catalog The catalog.
+ * @param root The mirror directory.
+ * @param[out] report Receives the outcome.
+ * @return bool Whether the sync ran.
+ */
+static bool sync(const UbuntuCloudCatalog& catalog, const std::filesystem::path& root, UbuntuCloudMirrorReport& report) {
+  std::string                     error {};
+  std::optional<UbuntuCloudQuery> query { parseQuery("release=noble", error) };
+  EXPECT(query);
+  UbuntuCloudMirror mirror(catalog, root, { 2, 0, 3 });
+  return query && mirror.run(*query, report, error);
+}
+
+/**
+ * @brief An interrupted transfer resumes from the end of its ".part" file, and a second sync transfers nothing.
+ * @param root The mirror directory.
+ */
+static void testResume(const std::filesystem::path& root) {
+  UbuntuCloudTestServer server {};
+  std::string           image { testFileContents(200 * 1024) };
+  std::string           tarball { testFileContents(150 * 1024, 1) };
+  UbuntuCloudCatalog    catalog { servedCatalog(server, { { "disk1.img", image }, { "root.tar.xz", tarball } }) };
+  writeFile(root / release_directory / "disk1.img.part", image.substr(0, 100 * 1024));
+
+  UbuntuCloudMirrorReport report {};
+  EXPECT(sync(catalog, root, report));
+  EXPECT(report.failures.empty());
+  EXPECT(report.downloaded == 2);
+  EXPECT(report.bytes_downloaded == image.size() - 100 * 1024 + tarball.size());
+  EXPECT(readFile(root / release_directory / "disk1.img") == image);
+  EXPECT(readFile(root / release_directory / "root.tar.xz") == tarball);
+  EXPECT(!std::filesystem::exists(root / release_directory / "disk1.img.part"));
+  bool resumed { false };
+  for (const UbuntuCloudTestRequest& request : server.requests()) {
+    resumed = resumed || (request.path.find("disk1.img") != std::string::npos && request.range == "bytes=102400-");
+  }
+  EXPECT(resumed);
+
+  std::size_t requests { server.requests().size() };
+  EXPECT(sync(catalog, root, report));
+  EXPECT(report.up_to_date == 2);
+  EXPECT(report.downloaded == 0);
+  EXPECT(server.requests().size() == requests);
+}
+
+/**
+ * @brief A ".part" file whose bytes are not a prefix of the file fails the digest, and the file is fetched again whole.
+ * @param root The mirror directory.
+ */
+static void testCorruptPart(const std::filesystem::path& root) {
+  UbuntuCloudTestServer server {};
+  std::string           image { testFileContents(200 * 1024, 2) };
+  UbuntuCloudCatalog    catalog { servedCatalog(server, { { "disk1.img", image } }) };
+  writeFile(root / release_directory / "disk1.img.part", testFileContents(100 * 1024, 3));
+
+  UbuntuCloudMirrorReport report {};
+  EXPECT(sync(catalog, root, report));
+  EXPECT(report.failures.empty());
+  EXPECT(report.downloaded == 1);
+  EXPECT(readFile(root / release_directory / "disk1.img") == image);
+  std::vector<UbuntuCloudTestRequest> requests { server.requests() };
+  EXPECT(requests.size() == 2);  // The resume, then the whole file
+  EXPECT(requests.size() == 2 && !requests.front().range.empty() && requests.back().range.empty());
+}
+
+/**
+ * @brief A resume the server answers with the whole file restarts the file instead of appending to the ".part" file.
+ * @param root The mirror directory.
+ */
+static void testIgnoredResume(const std::filesystem::path& root) {
+  UbuntuCloudTestServer server {};
+  std::string           image { testFileContents(200 * 1024, 4) };
+  UbuntuCloudCatalog    catalog { servedCatalog(server, { { "disk1.img", image } }) };
+  writeFile(root / release_directory / "disk1.img.part", image.substr(0, 100 * 1024));
+  server.ignoreRanges(true);
+
+  UbuntuCloudMirrorReport report {};
+  EXPECT(sync(catalog, root, report));
+  EXPECT(report.failures.empty());
+  EXPECT(report.downloaded == 1);
+  EXPECT(readFile(root / release_directory / "disk1.img") == image);
+}
+
+int main() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  std::filesystem::path directory { std::filesystem::temp_directory_path() / ("ubuntu-cloud-mirror-tests." + std::to_string(getpid())) };
+
+  testResume(directory / "resume");
+  testCorruptPart(directory / "corrupt");
+  testIgnoredResume(directory / "ignored");
+
+  std::error_code remove_error {};
+  std::filesystem::remove_all(directory, remove_error);
+  curl_global_cleanup();
+  return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file UbuntuCloudParserTests.cpp
+ * @brief Tests of the product file and stream index parsers, and of the merge of the products of several product files.
+ */
+
+#include "UbuntuCloudParser.hpp"
+#include "UbuntuCloudQuery.hpp"
+#include "UbuntuCloudStream.hpp"
+#include "UbuntuCloudTest.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Product file with the fields the parser keeps, surrounded by fields, arrays and objects it skips.
+static const std::string annotated_product_file { R"({
+  "content_id": "com.ubuntu.cloud:released:download",
+  "format": "products:1.0",
+  "license": { "name": "ubuntu", "products": { "ignored": {} } },
+  "products": {
+    "com.ubuntu.cloud:server:24.04:arm64": {
+      "release": "noble", "release_title": "24.04 LTS", "arch": "arm64", "aliases": "24.04,lts,noble", "version": "24.04",
+      "supported": true, "support_eol": "2029-05-31", "ftype": ["disk1.img", { "versions": {} }], "os": "ubuntu",
+      "versions": {
+        "20240501": { "label": "release", "items": {
+          "disk1.img": { "path": "server/noble/20240501/disk1.img", "size": 2048, "sha256": "sha-501", "md5": "md5-501", "ftype": "disk1.img" } } },
+        "20240423.1": { "items": { "root.tar.xz": { "ftype": "tar.xz", "sha256": "sha-423.1", "path": "server/noble/20240423.1/root.tar.xz" } } },
+        "20240423": { "pubname": "noble-24.04", "items": {
+          "disk1.img": { "size": 1024, "sha256": "sha-423", "path": "server/noble/20240423/disk1.img", "extra": { "size": 1, "sha256": "x" } } } }
+      }
+    },
+    "com.ubuntu.cloud:server:22.04:amd64": {
+      "arch": "amd64", "release": "jammy", "release_title": "22.04 LTS", "version": "22.04", "supported": false, "size": -1,
+      "versions": { "20240101": { "items": {} } }
+    }
+  },
+  "updated": "Thu, 02 May 2024 10:00:00 +0000"
+})" };
+
+/**
+ * @brief Builds a product file with one product per release, whose serials each hold the given items.
+ * @param releases The codenames, e.g. "noble".
+ * @param serials The serials of every product.
+ * @param items The item names of every serial.
+ * @param tag Distinguishes the sha256 and paths of one product file from another's.
+ * @return std::vector<UbuntuProduct> The parsed products.
+ */
+static std::vector<UbuntuProduct> parsedProducts(const std::vector<std::string>& releases, const std::vector<std::string>& serials,
+                                                 const std::vector<std::string>& items, const std::string& tag) {
+  std::ostringstream product_file {};
+  product_file << R"({"format":"products:1.0","products":{)";
+  for (std::size_t release = 0; release < releases.size(); release++) {
+    const std::string& codename { releases[release] };
+    product_file << (release == 0 ? "" : ",") << "\"com.ubuntu.cloud:server:" << codename << ":amd64\":{\"release\":\"" << codename
+                 << "\",\"release_title\":\"" << codename << "\",\"arch\":\"amd64\",\"version\":\"" << codename
+                 << "\",\"supported\":true,\"versions\":{";
+    for (std::size_t serial = 0; serial < serials.size(); serial++) {
+      product_file << (serial == 0 ? "" : ",") << "\"" << serials[serial] << "\":{\"items\":{";
+      for (std::size_t item = 0; item < items.size(); item++) {
+        std::string location { tag + "/" + codename + "/" + serials[serial] + "/" + items[item] };
+        product_file << (item == 0 ? "" : ",") << "\"" << items[item] << "\":{\"path\":\"" << location << "\",\"size\":1,\"sha256\":\"sha-"
+                     << location << "\"}";
+      }
+      product_file << "}}";
+    }
+    product_file << "}}";
+  }
+  product_file << "}}";
+  std::istringstream         input { product_file.str() };
+  std::vector<UbuntuProduct> products {};
+  std::string                error {};
+  EXPECT(parseProductStream(input, products, error));
+  return products;
+}
+
+/**
+ * @brief Looks up the sha256 of an item in a catalog.
+ * @param catalog The catalog.
+ * @param release The release codename.
+ * @param serial The serial.
+ * @param item The item name.
+ * @return std::string The sha256, empty if the item is not in the catalog.
+ */
+static std::string itemSha256(const UbuntuCloudCatalog& catalog, const std::string& release, const std::string& serial, const std::string& item) {
+  std::string                     error {};
+  std::optional<UbuntuCloudQuery> query { parseQuery("release=" + release + " serial=" + serial + " item=" + item, error) };
+  if (!query) {
+    return "";
+  }
+  std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, *query) };
+  return matches.size() == 1 ? std::string(catalog.itemSha256(matches.front().item)) : std::string();
+}
+
+/**
+ * @brief Products of the same name are merged: new serials are taken over whole, known serials gain the missing items.
+ *
+ * The items taken over from the lower-priority list must outlive its products, which mergeProducts() releases.
+ */
+static void testOverlappingProducts() {
+  std::vector<std::vector<UbuntuProduct>> lists {};
+  lists.push_back(parsedProducts({ "jammy", "noble" }, { "20240423" }, { "disk1.img" }, "first"));
+  lists.push_back(parsedProducts({ "noble", "oracular" }, { "20240423", "20240501" }, { "disk1.img", "root.tar.xz" }, "second"));
+  std::vector<UbuntuProduct> merged { mergeProducts(std::move(lists)) };
+  // Reuses the memory the released products held, so that strings still pointing into it would read the new contents
+  std::vector<UbuntuProduct> unrelated { parsedProducts({ "focal", "lunar", "mantic" }, { "20230101", "20230202" }, { "disk1.img", "root.tar.xz" }, "other") };
+
+  EXPECT(merged.size() == 3);
+  if (merged.size() != 3) {
+    return;
+  }
+  EXPECT(merged[1].name == "com.ubuntu.cloud:server:noble:amd64");
+  EXPECT(merged[1].versions.size() == 2);
+  UbuntuCloudCatalog catalog { merged };
+  // The serial both lists publish keeps the item of the first one, and gains the item only the second one has
+  EXPECT(itemSha256(catalog, "noble", "20240423", "disk1.img") == "sha-first/noble/20240423/disk1.img");
+  EXPECT(itemSha256(catalog, "noble", "20240423", "root.tar.xz") == "sha-second/noble/20240423/root.tar.xz");
+  // The serial only the second list publishes is taken over with every item
+  EXPECT(itemSha256(catalog, "noble", "20240501", "disk1.img") == "sha-second/noble/20240501/disk1.img");
+  EXPECT(itemSha256(catalog, "noble", "20240501", "root.tar.xz") == "sha-second/noble/20240501/root.tar.xz");
+  // Products of a single list are unchanged
+  EXPECT(itemSha256(catalog, "jammy", "20240423", "disk1.img") == "sha-first/jammy/20240423/disk1.img");
+  EXPECT(itemSha256(catalog, "oracular", "20240501", "root.tar.xz") == "sha-second/oracular/20240501/root.tar.xz");
+}
+
+/**
+ * @brief Every backend keeps the product, version and item fields, skips everything else, and sorts products and serials.
+ */
+static void testProductFile() {
+  for (UbuntuCloudParserBackend backend : availableParserBackends()) {
+    std::istringstream         input { annotated_product_file };
+    std::vector<UbuntuProduct> products {};
+    std::string                error {};
+    EXPECT(parseProductStream(input, products, error, backend));
+    EXPECT(products.size() == 2);
+    if (products.size() != 2) {
+      continue;
+    }
+    const UbuntuProduct& jammy { products[0] };
+    EXPECT(jammy.name == "com.ubuntu.cloud:server:22.04:amd64");
+    EXPECT(jammy.release == "jammy" && jammy.arch == "amd64" && jammy.aliases.empty() && !jammy.supported);
+    EXPECT(jammy.versions.size() == 1 && jammy.versions.front().items.empty());
+
+    const UbuntuProduct& noble { products[1] };
+    EXPECT(noble.release == "noble" && noble.release_title == "24.04 LTS" && noble.arch == "arm64" && noble.version == "24.04");
+    EXPECT(noble.aliases == "24.04,lts,noble" && noble.supported);
+    EXPECT(noble.versions.size() == 3);
+    if (noble.versions.size() != 3) {
+      continue;
+    }
+    EXPECT(noble.versions[0].serial == "20240423" && noble.versions[1].serial == "20240423.1" && noble.versions[2].serial == "20240501");
+    EXPECT(noble.versions[0].items.size() == 1);
+    if (!noble.versions[0].items.empty()) {
+      // The object nested in the item does not overwrite its fields
+      const UbuntuProductItem& item { noble.versions[0].items.front() };
+      EXPECT(item.name == "disk1.img" && item.sha256 == "sha-423" && item.path == "server/noble/20240423/disk1.img" && item.size == 1024);
+    }
+    EXPECT(noble.versions[1].items.size() == 1 && noble.versions[1].items.front().size == 0);
+    EXPECT(noble.versions[2].items.size() == 1 && noble.versions[2].items.front().sha256 == "sha-501");
+  }
+}
+
+/**
+ * @brief A product file pushed in small chunks through the stream buffer, as the write callback does, parses while it arrives.
+ */
+static void testChunkedProductFile() {
+  UbuntuCloudStreamBuffer stream(2);  // The producer blocks until the parser took the chunks off the queue
+  std::thread             producer([&stream]() {
+    for (std::size_t offset = 0; offset < annotated_product_file.size(); offset += 7) {
+      stream.push(annotated_product_file.data() + offset, std::min<std::size_t>(7, annotated_product_file.size() - offset));
+    }
+    stream.finish();
+  });
+  std::istream               input(&stream);
+  std::vector<UbuntuProduct> products {};
+  std::string                error {};
+  EXPECT(parseProductStream(input, products, error, UbuntuCloudParserBackend::Nlohmann));
+  producer.join();
+  EXPECT(products.size() == 2 && products[1].versions.size() == 3);
+}
+
+/**
+ * @brief Invalid JSON and documents without products are rejected with a reason and no products.
+ */
+static void testInvalidProductFile() {
+  std::string truncated { annotated_product_file.substr(0, annotated_product_file.size() / 2) };
+  for (UbuntuCloudParserBackend backend : availableParserBackends()) {
+    for (const std::string& text : { truncated, std::string(R"({"format":"products:1.0","license":{"products":{}}})"), std::string("") }) {
+      std::istringstream         input { text };
+      std::vector<UbuntuProduct> products {};
+      std::string                error {};
+      EXPECT(!parseProductStream(input, products, error, backend));
+      EXPECT(!error.empty());
+      EXPECT(products.empty());
+    }
+  }
+}
+
+/**
+ * @brief The stream index lists the product files, other formats and malformed entries are skipped.
+ */
+static void testStreamIndex() {
+  std::istringstream input { R"({"format":"index:1.0","index":{
+    "com.ubuntu.cloud:released:download":{"format":"products:1.0","path":"streams/v1/com.ubuntu.cloud:released:download.json"},
+    "com.ubuntu.cloud:released:aws":{"format":"products:1.0","path":"streams/v1/com.ubuntu.cloud:released:aws.json"},
+    "com.ubuntu.cloud:released:sums":{"format":"sums:1.0","path":"streams/v1/sums.json"},
+    "com.ubuntu.cloud:released:broken":{"format":"products:1.0","path":7}}})" };
+  std::vector<UbuntuStreamIndexEntry> entries {};
+  std::string                         error {};
+  EXPECT(parseStreamIndex(input, entries, error));
+  EXPECT(entries.size() == 2);
+  if (entries.size() == 2) {
+    EXPECT(entries[0].content_id == "com.ubuntu.cloud:released:aws" && entries[0].path == "streams/v1/com.ubuntu.cloud:released:aws.json");
+    EXPECT(entries[1].content_id == "com.ubuntu.cloud:released:download");
+  }
+  for (const char* text : { R"({"format":"index:1.0","index":)", R"({"format":"index:1.0","index":[]})" }) {
+    std::istringstream invalid { text };
+    error.clear();
+    EXPECT(!parseStreamIndex(invalid, entries, error));
+    EXPECT(!error.empty());
+  }
+}
+
+int main() {
+  testProductFile();
+  testChunkedProductFile();
+  testInvalidProductFile();
+  testStreamIndex();
+  testOverlappingProducts();
+  return test_failures == 0 ? 0 : 1;
+}
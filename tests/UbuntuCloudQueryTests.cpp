@@ -0,0 +1,241 @@
+/**
+ * @file UbuntuCloudQueryTests.cpp
+ * @brief Tests of the query layer: the text form of a query, and filters pushed down to the catalog layout.
+ */
+
+#include "UbuntuCloudArena.hpp"
+#include "UbuntuCloudQuery.hpp"
+#include "UbuntuCloudTest.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// Release codenames of the generated catalog, focal being unsupported and noble the LTS.
+static const std::vector<std::string> test_releases { "focal", "jammy", "noble", "oracular" };
+
+/// Architectures of the generated catalog.
+static const std::vector<std::string> test_archs { "amd64", "arm64", "s390x" };
+
+/**
+ * @brief Generates a catalog with every release on every architecture, each with dozens of serials.
+ *
+ * Every serial has a disk1.img; every other one a root.tar.xz, and every third one is a point release.
+ * @return UbuntuCloudCatalog The catalog.
+ */
+static UbuntuCloudCatalog generatedCatalog() {
+  std::vector<UbuntuProduct> products {};
+  for (std::size_t release = 0; release < test_releases.size(); release++) {
+    for (const std::string& arch : test_archs) {
+      UbuntuProduct& product { products.emplace_back() };
+      std::string    version { std::to_string(20 + release * 2) + ".04" };
+      product.name          = "com.ubuntu.cloud:server:" + version + ":" + arch;
+      product.release       = test_releases[release];
+      product.release_title = version + " LTS";
+      product.arch          = arch;
+      product.aliases       = product.release == "noble" ? "lts" : "";
+      product.version       = version;
+      product.mirror        = "https://cloud-images.ubuntu.com/releases/";
+      product.supported     = product.release != "focal";
+      product.strings       = std::make_unique<UbuntuCloudArena>();
+      for (std::size_t day = 0; day < 39; day++) {
+        std::string           serial { std::to_string(20240101 + day) + (day % 3 == 0 ? ".1" : "") };
+        UbuntuProductVersion& product_version { product.versions.emplace_back() };
+        product_version.serial = serial;
+        for (const char* name : { "disk1.img", "root.tar.xz" }) {
+          if (std::string_view(name) == "root.tar.xz" && day % 2 == 1) {
+            continue;
+          }
+          std::string path { "server/releases/" + product.release + "/" + serial + "/" + name };
+          product_version.items.push_back({ name, product.strings->store("sha-" + path), product.strings->store(path), day + 1 });
+        }
+      }
+    }
+  }
+  std::sort(products.begin(), products.end(), [](const UbuntuProduct& first, const UbuntuProduct& second) { return first.name < second.name; });
+  return UbuntuCloudCatalog { products };
+}
+
+/**
+ * @brief Runs a query the slow way: every product, version and item of the catalog is checked against every filter.
+ * @param catalog The catalog.
+ * @param query The query.
+ * @return std::vector<UbuntuCloudQueryMatch> The matching rows, ordered by product, then serial, then item.
+ */
+static std::vector<UbuntuCloudQueryMatch> scannedQuery(const UbuntuCloudCatalog& catalog, const UbuntuCloudQuery& query) {
+  constexpr std::uint32_t            npos { UbuntuCloudCatalog::npos };
+  std::vector<UbuntuCloudQueryField> fields { queryFields(query) };
+  auto has_field { [&fields](UbuntuCloudQueryField field) { return std::find(fields.begin(), fields.end(), field) != fields.end(); } };
+  bool item_rows { !query.items.empty() || has_field(UbuntuCloudQueryField::Item) || has_field(UbuntuCloudQueryField::Sha256) ||
+                   has_field(UbuntuCloudQueryField::Path) || has_field(UbuntuCloudQueryField::Size) || has_field(UbuntuCloudQueryField::Url) };
+  bool version_rows { item_rows || query.serial_from || query.serial_to || query.latest || has_field(UbuntuCloudQueryField::Serial) };
+  auto listed { [](const std::vector<std::string>& values, std::string_view value) {
+    return values.empty() || std::find(values.begin(), values.end(), value) != values.end();
+  } };
+
+  std::vector<UbuntuCloudQueryMatch> matches {};
+  for (std::uint32_t product = 0; product < catalog.productCount(); product++) {
+    bool release { query.releases.empty() || listed(query.releases, catalog.productRelease(product)) ||
+                   listed(query.releases, catalog.productReleaseTitle(product)) };
+    if (!release || !listed(query.archs, catalog.productArch(product)) ||
+        (query.supported && catalog.productSupported(product) != *query.supported) || (query.lts && catalog.productLts(product) != *query.lts)) {
+      continue;
+    }
+    if (!version_rows) {
+      matches.push_back({ product, npos, npos });
+      continue;
+    }
+    std::vector<std::uint32_t> versions {};
+    auto [first, last] { catalog.versionRange(product) };
+    for (std::uint32_t version = first; version < last; version++) {
+      std::uint64_t key { catalog.versionKey(version) };
+      if ((!query.serial_from || key >= serialSortKey(*query.serial_from)) && (!query.serial_to || key <= serialSortKey(*query.serial_to))) {
+        versions.push_back(version);
+      }
+    }
+    if (query.latest && !versions.empty()) {
+      versions.erase(versions.begin(), versions.end() - 1);
+    }
+    for (std::uint32_t version : versions) {
+      if (!item_rows) {
+        matches.push_back({ product, version, npos });
+        continue;
+      }
+      auto [item_first, item_last] { catalog.itemRange(version) };
+      for (std::uint32_t item = item_first; item < item_last; item++) {
+        if (listed(query.items, catalog.itemName(item))) {
+          matches.push_back({ product, version, item });
+        }
+      }
+    }
+  }
+  return matches;
+}
+
+/**
+ * @brief Parses a query that must be valid.
+ * @param text The query.
+ * @return UbuntuCloudQuery The query, empty if it was rejected.
+ */
+static UbuntuCloudQuery validQuery(const std::string& text) {
+  std::string                     error {};
+  std::optional<UbuntuCloudQuery> query { parseQuery(text, error) };
+  EXPECT(query);
+  EXPECT(error.empty());
+  return query.value_or(UbuntuCloudQuery {});
+}
+
+/**
+ * @brief The terms of the text form fill the filters and fields, and invalid terms are rejected with a reason.
+ */
+static void testParseQuery() {
+  UbuntuCloudQuery query { validQuery(R"(  release=noble,"22.04 LTS" arch=arm64,  supported=yes lts=0 serial=20240101..20240301 latest item=root.tar.xz)") };
+  EXPECT(query.releases == std::vector<std::string>({ "noble", "22.04 LTS" }));
+  EXPECT(query.archs == std::vector<std::string>({ "arm64" }));
+  EXPECT(query.items == std::vector<std::string>({ "root.tar.xz" }));
+  EXPECT(query.supported == std::optional<bool>(true));
+  EXPECT(query.lts == std::optional<bool>(false));
+  EXPECT(query.serial_from == std::optional<std::string>("20240101"));
+  EXPECT(query.serial_to == std::optional<std::string>("20240301"));
+  EXPECT(query.latest);
+
+  query = validQuery("serial=20240105");
+  EXPECT(query.serial_from == std::optional<std::string>("20240105") && query.serial_to == query.serial_from);
+  query = validQuery("serial=..20240105 latest=false");
+  EXPECT(!query.serial_from && query.serial_to == std::optional<std::string>("20240105") && !query.latest);
+  query = validQuery("fields=url,release,size");
+  EXPECT(query.fields == std::vector<UbuntuCloudQueryField>({ UbuntuCloudQueryField::Url, UbuntuCloudQueryField::Release, UbuntuCloudQueryField::Size }));
+  EXPECT(validQuery("").fields.empty());
+
+  for (const char* invalid : { "release=", "arch", "supported=maybe", "latest=2", "fields=release,colour", "color=red", "release=\"22.04 LTS" }) {
+    std::string error {};
+    EXPECT(!parseQuery(invalid, error));
+    EXPECT(!error.empty());
+  }
+}
+
+/**
+ * @brief The rows are products, versions or items depending on the filters and fields, each level with its default fields.
+ */
+static void testQueryFields() {
+  using Field = UbuntuCloudQueryField;
+  EXPECT(queryFields(validQuery("arch=amd64")) == std::vector<Field>({ Field::Product, Field::Release, Field::Arch, Field::Supported }));
+  EXPECT(queryFields(validQuery("latest")) == std::vector<Field>({ Field::Product, Field::Release, Field::Arch, Field::Supported, Field::Serial }));
+  EXPECT(queryFields(validQuery("item=disk1.img")) ==
+         std::vector<Field>({ Field::Product, Field::Release, Field::Arch, Field::Serial, Field::Item, Field::Sha256 }));
+  EXPECT(queryFields(validQuery("latest fields=sha256")) == std::vector<Field>({ Field::Sha256 }));
+  EXPECT(queryFieldName(Field::Sha256) == "sha256");
+
+  UbuntuCloudCatalog                 catalog { generatedCatalog() };
+  std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, validQuery("release=noble arch=arm64 latest item=root.tar.xz fields=url")) };
+  EXPECT(matches.size() == 1);
+  if (matches.size() == 1) {
+    const UbuntuCloudQueryMatch& match { matches.front() };
+    EXPECT(queryFieldText(catalog, match, Field::Url) == "https://cloud-images.ubuntu.com/releases/server/releases/noble/20240139/root.tar.xz");
+    EXPECT(queryFieldText(catalog, match, Field::Sha256) == "sha-server/releases/noble/20240139/root.tar.xz");
+    EXPECT(queryFieldText(catalog, match, Field::Serial) == "20240139");
+    EXPECT(queryFieldText(catalog, match, Field::Size) == "39");
+    EXPECT(queryFieldText(catalog, match, Field::Lts) == "true");
+    EXPECT(queryFieldText(catalog, match, Field::Title) == "24.04 LTS");
+  }
+  // A product row has no serial or item to show
+  matches = runQuery(catalog, validQuery("release=focal arch=s390x"));
+  EXPECT(matches.size() == 1);
+  EXPECT(!matches.empty() && queryFieldText(catalog, matches.front(), Field::Serial).empty());
+  EXPECT(!matches.empty() && queryFieldText(catalog, matches.front(), Field::Supported) == "false");
+}
+
+/**
+ * @brief Filters pushed down to the release indexes, the flags, the sorted serials and the item names give the rows a full scan gives.
+ */
+static void testPushdown() {
+  UbuntuCloudCatalog catalog { generatedCatalog() };
+  const std::vector<std::string> queries {
+    "",
+    "release=noble",
+    "release=jammy,\"24.04 LTS\",noble arch=arm64,s390x",
+    "release=impish",
+    "supported=false",
+    "lts=true latest",
+    "supported=true lts=false item=disk1.img",
+    "serial=20240105..20240110",
+    "serial=20240105.1..20240110 latest",
+    "serial=20240104.1",
+    "serial=20240104",
+    "serial=..20240103 item=root.tar.xz",
+    "serial=20240130.. arch=amd64 fields=product,path",
+    "serial=20250101..",
+    "latest item=root.tar.xz,disk1.img",
+    "latest item=vmlinuz",
+    "arch=arm64 supported=true latest item=root.tar.xz fields=release,serial,sha256",
+    "fields=title",
+    "fields=serial release=focal",
+  };
+  for (const std::string& text : queries) {
+    UbuntuCloudQuery                   query { validQuery(text) };
+    std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, query) };
+    std::vector<UbuntuCloudQueryMatch> expected { scannedQuery(catalog, query) };
+    bool same { matches.size() == expected.size() && std::equal(matches.begin(), matches.end(), expected.begin(),
+                                                                 [](const UbuntuCloudQueryMatch& first, const UbuntuCloudQueryMatch& second) {
+                                                                   return first.product == second.product && first.version == second.version &&
+                                                                          first.item == second.item;
+                                                                 }) };
+    if (!same) {
+      std::cerr << "query: " << text << "\n";
+    }
+    EXPECT(same);
+  }
+  // A point release sorts after the plain serial of its day, so a range ending at it includes it
+  std::vector<UbuntuCloudQueryMatch> matches { runQuery(catalog, validQuery("release=noble arch=amd64 serial=20240104..20240104.1")) };
+  EXPECT(matches.size() == 1);
+  EXPECT(!matches.empty() && catalog.versionSerial(matches.front().version) == "20240104.1");
+}
+
+int main() {
+  testParseQuery();
+  testQueryFields();
+  testPushdown();
+  return test_failures == 0 ? 0 : 1;
+}
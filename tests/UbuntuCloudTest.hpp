@@ -0,0 +1,31 @@
+/**
+ * @file UbuntuCloudTest.hpp
+ * @brief Declares the check helper the test executables share.
+ *
+ * Each test executable runs its tests in turn, reports every failed check on the error stream and exits with 1 if
+ * any failed, which is what ctest looks at.
+ */
+
+#pragma once
+
+#include <iostream>
+
+/// Checks failed so far by the test executable.
+inline int test_failures { 0 };
+
+/**
+ * @brief Reports a failed check, and counts it.
+ * @param passed Whether the check passed.
+ * @param expression The checked expression.
+ * @param file The source file of the check.
+ * @param line The line of the check.
+ */
+inline void expectThat(bool passed, const char* expression, const char* file, int line) {
+  if (!passed) {
+    std::cerr << file << ":" << line << ": check failed: " << expression << "\n";
+    test_failures++;
+  }
+}
+
+/// Checks a condition, the test goes on when it fails.
+#define EXPECT(condition) expectThat(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
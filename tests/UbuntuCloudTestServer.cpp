@@ -0,0 +1,214 @@
+/**
+ * @file UbuntuCloudTestServer.cpp
+ * @brief Implementation of the local HTTP stand-in of a mirror.
+ */
+
+#include "UbuntuCloudTestServer.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+/**
+ * @brief Sends bytes on a socket, without raising SIGPIPE if the client went away.
+ * @param connection The connected socket.
+ * @param data First byte.
+ * @param size Number of bytes.
+ * @return bool False if the client closed the connection.
+ */
+static bool sendAll(int connection, const char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t sent { send(connection, data, size, MSG_NOSIGNAL) };
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= static_cast<std::size_t>(sent);
+  }
+  return true;
+}
+
+/**
+ * @brief Reads a header of a request.
+ * @param request The request line and headers.
+ * @param name The header name, as the client writes it, e.g. "Range".
+ * @return std::string The value, empty without the header.
+ */
+static std::string requestHeader(const std::string& request, std::string_view name) {
+  std::string header { "\r\n" + std::string(name) + ": " };
+  std::size_t value_begin { request.find(header) };
+  if (value_begin == std::string::npos) {
+    return "";
+  }
+  value_begin += header.size();
+  return request.substr(value_begin, request.find("\r\n", value_begin) - value_begin);
+}
+
+/**
+ * @brief Returns the ETag of file contents, which changes when they do.
+ * @param contents The contents.
+ * @return std::string The quoted entity tag.
+ */
+static std::string entityTag(const std::string& contents) {
+  return "\"" + std::to_string(std::hash<std::string> {}(contents)) + "\"";
+}
+
+/**
+ * @brief Parses a single range of a Range header.
+ * @param header The header value, e.g. "bytes=100-199" or "bytes=100-".
+ * @param size Size of the file.
+ * @param[out] first Receives the first byte of the range.
+ * @param[out] last Receives the last byte of the range, clamped to the file.
+ * @return bool False for a header this server does not support, or a range starting past the end of the file.
+ */
+static bool parseRange(const std::string& header, std::size_t size, std::size_t& first, std::size_t& last) {
+  constexpr static std::string_view unit { "bytes=" };
+  std::size_t                       dash { header.find('-') };
+  if (header.compare(0, unit.size(), unit) != 0 || dash == std::string::npos || dash == unit.size()) {
+    return false;
+  }
+  first = std::strtoull(header.c_str() + unit.size(), nullptr, 10);
+  last  = dash + 1 < header.size() ? std::strtoull(header.c_str() + dash + 1, nullptr, 10) : size - 1;
+  last  = std::min(last, size - 1);
+  return first < size && first <= last;
+}
+
+UbuntuCloudTestServer::UbuntuCloudTestServer():
+    _listener(socket(AF_INET, SOCK_STREAM, 0)), _port(0), _stopping(false), _acceptor(), _connections(), _mutex(), _files(),
+    _ignoreRanges(false), _truncatedResponses(0), _requests() {
+  sockaddr_in address {};
+  address.sin_family      = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port        = 0;  // Any free port
+  socklen_t length { sizeof(address) };
+  if (this->_listener < 0 || bind(this->_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(this->_listener, 16) != 0 || getsockname(this->_listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    std::cerr << "Could not start the test server: " << std::strerror(errno) << "\n";
+    std::exit(1);
+  }
+  this->_port     = ntohs(address.sin_port);
+  this->_acceptor = std::thread(&UbuntuCloudTestServer::acceptConnections, this);
+}
+
+UbuntuCloudTestServer::~UbuntuCloudTestServer() {
+  this->_stopping = true;
+  this->_acceptor.join();
+  close(this->_listener);
+  // No new connection threads once the acceptor is gone
+  for (std::thread& connection : this->_connections) {
+    connection.join();
+  }
+}
+
+void UbuntuCloudTestServer::acceptConnections() {
+  while (!this->_stopping) {
+    pollfd listener { this->_listener, POLLIN, 0 };
+    if (poll(&listener, 1, 50) <= 0) {
+      continue;  // Checks for the stop every 50 ms
+    }
+    int connection { accept(this->_listener, nullptr, nullptr) };
+    if (connection < 0) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_connections.emplace_back(&UbuntuCloudTestServer::answer, this, connection);
+  }
+}
+
+void UbuntuCloudTestServer::answer(int connection) {
+  std::string request {};
+  char        buffer[4096];
+  while (request.find("\r\n\r\n") == std::string::npos) {
+    ssize_t received { recv(connection, buffer, sizeof(buffer), 0) };
+    if (received <= 0) {
+      close(connection);
+      return;
+    }
+    request.append(buffer, static_cast<std::size_t>(received));
+  }
+  // "GET <target> HTTP/1.1", then the headers, of which only Range and If-None-Match matter
+  std::size_t            target_begin { request.find(' ') + 1 };
+  UbuntuCloudTestRequest received { request.substr(target_begin, request.find(' ', target_begin) - target_begin),
+                                    requestHeader(request, "Range"), requestHeader(request, "If-None-Match") };
+
+  std::string response {};
+  std::string body {};
+  bool        truncated { false };
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_requests.push_back(received);
+    auto file { this->_files.find(received.path) };
+    std::size_t first { 0 };
+    std::size_t last { 0 };
+    if (file == this->_files.end()) {
+      response = "HTTP/1.1 404 Not Found\r\n";
+    } else if (received.range.empty() && received.if_none_match == entityTag(file->second)) {
+      response = "HTTP/1.1 304 Not Modified\r\nETag: " + received.if_none_match + "\r\n";
+    } else if (received.range.empty() || this->_ignoreRanges || file->second.empty()) {
+      response = "HTTP/1.1 200 OK\r\nETag: " + entityTag(file->second) + "\r\n";
+      body     = file->second;
+    } else if (parseRange(received.range, file->second.size(), first, last)) {
+      response = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                 std::to_string(file->second.size()) + "\r\n";
+      body     = file->second.substr(first, last - first + 1);
+    } else {
+      response = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(file->second.size()) + "\r\n";
+    }
+    if (!body.empty() && this->_truncatedResponses > 0) {
+      this->_truncatedResponses--;
+      truncated = true;
+    }
+  }
+  response += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+  // A cut response announces the whole body, the client sees the connection drop before its end
+  if (sendAll(connection, response.data(), response.size())) {
+    sendAll(connection, body.data(), truncated ? body.size() / 2 : body.size());
+  }
+  close(connection);
+}
+
+void UbuntuCloudTestServer::serve(const std::string& path, std::string contents) {
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  this->_files[path] = std::move(contents);
+}
+
+void UbuntuCloudTestServer::ignoreRanges(bool ignore) {
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  this->_ignoreRanges = ignore;
+}
+
+void UbuntuCloudTestServer::truncateResponses(std::size_t count) {
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  this->_truncatedResponses = count;
+}
+
+std::vector<UbuntuCloudTestRequest> UbuntuCloudTestServer::requests() const {
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  return this->_requests;
+}
+
+std::string UbuntuCloudTestServer::url(const std::string& path) const {
+  return "http://127.0.0.1:" + std::to_string(this->_port) + path;
+}
+
+std::uint16_t UbuntuCloudTestServer::port() const { return this->_port; }
+
+std::string testFileContents(std::size_t size, unsigned seed) {
+  std::string   contents(size, '\0');
+  std::uint32_t state { 2166136261u ^ seed };
+  for (char& byte : contents) {
+    // Linear congruential steps, enough to make every offset differ from its neighbours
+    state = state * 1664525u + 1013904223u;
+    byte  = static_cast<char>(state >> 24);
+  }
+  return contents;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file UbuntuCloudTestServer.hpp
+ * @brief Declares UbuntuCloudTestServer, a local HTTP stand-in of a mirror for the tests.
+ *
+ * The server listens on an ephemeral port of 127.0.0.1 and answers GET requests for the files it was given, with
+ * single byte ranges honoured unless told otherwise. It can also cut responses short, which the transfers see as a
+ * connection dropped mid-file, and records every request so that the tests can check what was asked for. One thread
+ * per connection, every response closes its connection. POSIX only.
+ */
+
+#pragma once
+
+#include "UbuntuCloudTest.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @struct UbuntuCloudTestRequest
+ * @brief One request the server received.
+ */
+struct UbuntuCloudTestRequest {
+    std::string path;   ///< The request target, e.g. "/releases/disk1.img".
+    std::string range;          ///< The Range header, empty without one.
+    std::string if_none_match;  ///< The If-None-Match header, empty without one.
+};
+
+/**
+ * @class UbuntuCloudTestServer
+ * @brief HTTP/1.1 server on the loopback interface, serving files from memory.
+ *
+ * Whole files are served with an ETag derived from their contents, and a request whose If-None-Match carries the
+ * current one is answered with a 304.
+ */
+class UbuntuCloudTestServer {
+  private:
+    /// The listening socket.
+    int _listener;
+    /// The port it is bound to.
+    std::uint16_t _port;
+    /// Set by the destructor to stop accepting connections.
+    std::atomic<bool> _stopping;
+    /// Thread accepting the connections.
+    std::thread _acceptor;
+    /// Threads answering the connections, joined by the destructor.
+    std::vector<std::thread> _connections;
+    /// Guards everything below, and the connection threads.
+    mutable std::mutex _mutex;
+    /// The served files, by request target.
+    std::map<std::string, std::string> _files;
+    /// Whether Range headers are answered with the whole file.
+    bool _ignoreRanges;
+    /// Responses still to cut short, after half of their body.
+    std::size_t _truncatedResponses;
+    /// Requests received, in order.
+    std::vector<UbuntuCloudTestRequest> _requests;
+
+    /**
+     * @brief Accepts connections until the server stops.
+     */
+    void acceptConnections();
+
+    /**
+     * @brief Reads one request from a connection, answers it and closes the connection.
+     * @param connection The connected socket.
+     */
+    void answer(int connection);
+
+  public:
+    /**
+     * @brief Starts a server with no files. Aborts the test executable if no socket can be bound.
+     */
+    UbuntuCloudTestServer();
+
+    UbuntuCloudTestServer(const UbuntuCloudTestServer&)            = delete;
+    UbuntuCloudTestServer& operator=(const UbuntuCloudTestServer&) = delete;
+
+    /**
+     * @brief Stops the server and waits for the connections being answered.
+     */
+    ~UbuntuCloudTestServer();
+
+    /**
+     * @brief Serves a file.
+     * @param path The request target, starting with '/'.
+     * @param contents The file contents.
+     */
+    void serve(const std::string& path, std::string contents);
+
+    /**
+     * @brief Makes the server answer requests with a Range header with the whole file, as a 200.
+     * @param ignore Whether ranges are ignored.
+     */
+    void ignoreRanges(bool ignore);
+
+    /**
+     * @brief Cuts the next responses short: half of the body is sent, then the connection closes.
+     * @param count Number of responses to cut.
+     */
+    void truncateResponses(std::size_t count);
+
+    /**
+     * @brief Returns the requests received so far.
+     * @return std::vector<UbuntuCloudTestRequest> The requests, in order.
+     */
+    std::vector<UbuntuCloudTestRequest> requests() const;
+
+    /**
+     * @brief Returns the URL of a request target on this server.
+     * @param path The request target, starting with '/'.
+     * @return std::string The URL, e.g. "http://127.0.0.1:40123/releases/disk1.img".
+     */
+    std::string url(const std::string& path) const;
+
+    /**
+     * @brief Returns the port the server listens on, on 127.0.0.1.
+     * @return std::uint16_t The port.
+     */
+    std::uint16_t port() const;
+};
+
+/**
+ * @brief Builds file contents that differ at every offset, so that a misplaced byte changes the digest.
+ * @param size Size of the contents.
+ * @param seed Distinguishes the contents of several files.
+ * @return std::string The contents.
+ */
+std::string testFileContents(std::size_t size, unsigned seed = 0);
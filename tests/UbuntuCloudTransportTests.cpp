@@ -0,0 +1,222 @@
+/**
+ * @file UbuntuCloudTransportTests.cpp
+ * @brief Tests of the persisted transport state against the local HTTP stand-in: loaded, expired, malformed and dead
+ * addresses, and the state file rewrites.
+ *
+ * The host names end in ".invalid", which never resolves, so a request to one only reaches the server through an
+ * address of the state file. The stand-in speaks plain HTTP/1.1, the TLS sessions are not covered.
+ */
+
+#include "UbuntuCloudFile.hpp"
+#include "UbuntuCloudTestServer.hpp"
+#include "UbuntuCloudTransport.hpp"
+
+#include <curl/curl.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <unistd.h>
+
+/// Lifetime of the persisted entries in the tests.
+constexpr static std::chrono::seconds test_ttl { 300 };
+
+/**
+ * @brief Reads a whole file.
+ * @param path The file.
+ * @return std::string The contents, empty if the file cannot be read.
+ */
+static std::string readFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Writes a whole file.
+ * @param path The file.
+ * @param contents The contents.
+ */
+static void writeFile(const std::filesystem::path& path, const std::string& contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+/**
+ * @brief Builds an address entry of the state file.
+ * @param host The "host:port" key.
+ * @param address The address.
+ * @param expires_at Unix time the entry expires at.
+ * @return std::string The entry, a JSON object.
+ */
+static std::string addressEntry(const std::string& host, const std::string& address, std::int64_t expires_at) {
+  return "{ \"host\": \"" + host + "\", \"address\": \"" + address + "\", \"expires_at\": " + std::to_string(expires_at) + " }";
+}
+
+/**
+ * @brief Receives the body of a test request.
+ * @return std::size_t The size, all of it is taken.
+ */
+static std::size_t appendBody(char* data, std::size_t size, std::size_t count, void* body_ptr) {
+  static_cast<std::string*>(body_ptr)->append(data, size * count);
+  return size * count;
+}
+
+/**
+ * @brief Runs one request through a transport, as the fetcher does, and reports its outcome to the transport.
+ * @param transport The transport.
+ * @param url The URL.
+ * @param[out] body Receives the body.
+ * @return CURLcode The result of the request.
+ */
+static CURLcode fetch(UbuntuCloudTransport& transport, const std::string& url, std::string& body) {
+  CURL* handle { curl_easy_init() };
+  transport.configure(handle);
+  curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(handle, CURLOPT_PROXY, "");  // The stand-in is reached directly, whatever the environment says
+  curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 10L);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, appendBody);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, &body);
+  body.clear();
+  CURLcode result_code { curl_easy_perform(handle) };
+  transport.finished(handle, result_code);
+  curl_easy_cleanup(handle);
+  return result_code;
+}
+
+/**
+ * @brief A persisted address seeds the DNS cache, and a state the run did not change is not rewritten.
+ * @param directory Directory for the state files.
+ */
+static void testLoadedAddress(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  server.serve("/index.json", "{}");
+  std::string           host { "mirror.invalid:" + std::to_string(server.port()) };
+  std::filesystem::path path { directory / "loaded.json" };
+  // Indented as nothing in the transport writes it, so a rewrite shows
+  std::string state { "{\n  \"addresses\": [ " + addressEntry(host, "127.0.0.1", nowSeconds() + 100) + " ],\n  \"sessions\": []\n}\n" };
+  writeFile(path, state);
+
+  UbuntuCloudTransport transport(path, test_ttl);
+  std::string          body {};
+  EXPECT(fetch(transport, "http://" + host + "/index.json", body) == CURLE_OK);
+  EXPECT(body == "{}");
+  EXPECT(fetch(transport, "http://" + host + "/index.json", body) == CURLE_OK);  // From the shared DNS cache now
+  EXPECT(transport.save());
+  EXPECT(readFile(path) == state);
+}
+
+/**
+ * @brief A malformed entry is skipped alone, the entries after it are still loaded.
+ * @param directory Directory for the state files.
+ */
+static void testMalformedEntries(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  server.serve("/index.json", "{}");
+  std::string           host { "mirror.invalid:" + std::to_string(server.port()) };
+  std::int64_t          expires_at { nowSeconds() + 100 };
+  std::filesystem::path path { directory / "malformed.json" };
+  writeFile(path, "{\"addresses\":[{\"host\":\"broken.invalid:80\"},{\"host\":\"typed.invalid:80\",\"address\":\"127.0.0.1\",\"expires_at\":\"soon\"},7," +
+                      addressEntry(host, "127.0.0.1", expires_at) + "],\"sessions\":[{\"key\":1}]}");
+
+  UbuntuCloudTransport transport(path, test_ttl);
+  std::string          body {};
+  EXPECT(fetch(transport, "http://" + host + "/index.json", body) == CURLE_OK);
+  EXPECT(transport.save());
+  std::string saved { readFile(path) };
+  EXPECT(saved.find("broken") == std::string::npos && saved.find("typed") == std::string::npos);
+  EXPECT(saved.find("\"expires_at\":" + std::to_string(expires_at)) != std::string::npos);  // Reaching it again does not extend it
+}
+
+/**
+ * @brief Expired entries, and entries written with a longer TTL than the current one, are not loaded.
+ * @param directory Directory for the state files.
+ */
+static void testExpiredEntries(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  server.serve("/index.json", "{}");
+  std::string           port { std::to_string(server.port()) };
+  std::int64_t          now { nowSeconds() };
+  std::filesystem::path path { directory / "expired.json" };
+  writeFile(path, "{\"addresses\":[" + addressEntry("expired.invalid:" + port, "127.0.0.1", now - 1) + "," +
+                      addressEntry("longer.invalid:" + port, "127.0.0.1", now + 2 * test_ttl.count()) + "]}");
+
+  UbuntuCloudTransport transport(path, test_ttl);
+  std::string          body {};
+  EXPECT(fetch(transport, "http://expired.invalid:" + port + "/index.json", body) == CURLE_COULDNT_RESOLVE_HOST);
+  EXPECT(fetch(transport, "http://longer.invalid:" + port + "/index.json", body) == CURLE_COULDNT_RESOLVE_HOST);
+  EXPECT(transport.save());
+  EXPECT(readFile(path).find(".invalid") == std::string::npos);
+}
+
+/**
+ * @brief A persisted address that refuses connections is dropped from the DNS cache and from the state file.
+ * @param directory Directory for the state files.
+ */
+static void testDeadAddress(const std::filesystem::path& directory) {
+  std::uint16_t closed_port { 0 };
+  {
+    UbuntuCloudTestServer server {};
+    closed_port = server.port();  // Nothing listens on it once the server is gone
+  }
+  std::string           host { "mirror.invalid:" + std::to_string(closed_port) };
+  std::filesystem::path path { directory / "dead.json" };
+  writeFile(path, "{\"addresses\":[" + addressEntry(host, "127.0.0.1", nowSeconds() + 100) + "]}");
+
+  UbuntuCloudTransport transport(path, test_ttl);
+  std::string          body {};
+  EXPECT(fetch(transport, "http://" + host + "/index.json", body) == CURLE_COULDNT_CONNECT);
+  // The next request resolves the name again instead of trying the dead address
+  EXPECT(fetch(transport, "http://" + host + "/index.json", body) == CURLE_COULDNT_RESOLVE_HOST);
+  EXPECT(transport.save());
+  EXPECT(readFile(path).find(host) == std::string::npos);
+}
+
+/**
+ * @brief The address a name resolved to is persisted for the TTL, in a file only its owner reads; a TTL of 0 persists nothing.
+ * @param directory Directory for the state files.
+ */
+static void testResolvedAddress(const std::filesystem::path& directory) {
+  UbuntuCloudTestServer server {};
+  server.serve("/index.json", "{}");
+  std::string           host { "localhost:" + std::to_string(server.port()) };
+  std::filesystem::path path { directory / "state" / "transport.json" };
+
+  UbuntuCloudTransport transport(path, test_ttl);
+  std::string          body {};
+  std::int64_t         before { nowSeconds() };
+  EXPECT(fetch(transport, "http://" + host + "/index.json", body) == CURLE_OK);
+  EXPECT(transport.save());
+  std::string saved { readFile(path) };
+  EXPECT(saved.find("\"host\":\"" + host + "\"") != std::string::npos);
+  EXPECT(saved.find("\"address\":\"127.0.0.1\"") != std::string::npos);
+  std::size_t  expiry { saved.find("\"expires_at\":") };
+  std::int64_t expires_at { expiry == std::string::npos ? 0 : std::stoll(saved.substr(expiry + 13)) };
+  EXPECT(expires_at >= before + test_ttl.count() && expires_at <= nowSeconds() + test_ttl.count());
+  std::filesystem::perms permissions { std::filesystem::status(path).permissions() };
+  EXPECT((permissions & (std::filesystem::perms::group_all | std::filesystem::perms::others_all)) == std::filesystem::perms::none);
+
+  std::filesystem::path unused_path { directory / "disabled.json" };
+  UbuntuCloudTransport  disabled(unused_path, std::chrono::seconds(0));
+  EXPECT(fetch(disabled, "http://" + host + "/index.json", body) == CURLE_OK);
+  EXPECT(disabled.save());
+  EXPECT(!std::filesystem::exists(unused_path));
+}
+
+int main() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  std::filesystem::path directory { std::filesystem::temp_directory_path() / ("ubuntu-cloud-transport-tests." + std::to_string(getpid())) };
+  std::filesystem::create_directories(directory);
+
+  testLoadedAddress(directory);
+  testMalformedEntries(directory);
+  testExpiredEntries(directory);
+  testDeadAddress(directory);
+  testResolvedAddress(directory);
+
+  std::error_code remove_error {};
+  std::filesystem::remove_all(directory, remove_error);
+  curl_global_cleanup();
+  return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file UbuntuCloudWorkersTests.cpp
+ * @brief Tests of the shared worker loop and of the work-stealing pool.
+ */
+
+#include "UbuntuCloudTest.hpp"
+#include "UbuntuCloudWorkers.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Every task of a batch runs exactly once, batch after batch, whatever the tasks per thread.
+ */
+static void testEveryTaskOnce() {
+  UbuntuCloudWorkerPool pool(4);
+  EXPECT(pool.threads() == 4);
+  for (std::size_t count : { 0, 1, 2, 3, 5, 64, 1000 }) {
+    for (int batch = 0; batch < 20; batch++) {
+      std::vector<std::atomic<int>> runs(count);
+      pool.run(count, [&runs](std::size_t idx) { runs[idx]++; });
+      bool once { true };
+      for (const std::atomic<int>& run : runs) {
+        once = once && run == 1;
+      }
+      EXPECT(once);
+    }
+  }
+}
+
+/**
+ * @brief The tasks dealt to a thread held up by one of them are stolen by the others.
+ *
+ * The first task waits for all the others to be done, so the batch only completes if the rest of its slice is stolen.
+ */
+static void testStealing() {
+  UbuntuCloudWorkerPool pool(2);
+  std::atomic<int>      done { 0 };
+  bool                  others_done { false };
+  pool.run(16, [&done, &others_done](std::size_t idx) {
+    if (idx != 0) {
+      done++;
+      return;
+    }
+    std::chrono::steady_clock::time_point deadline { std::chrono::steady_clock::now() + std::chrono::seconds(10) };
+    while (done < 15 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    others_done = done == 15;
+  });
+  EXPECT(others_done);
+}
+
+/**
+ * @brief A batch submitted while another one runs is run by its calling thread, and both complete.
+ */
+static void testConcurrentBatches() {
+  UbuntuCloudWorkerPool         pool(3);
+  std::vector<std::atomic<int>> first(200);
+  std::vector<std::atomic<int>> second(200);
+  std::thread other([&pool, &second] {
+    for (int batch = 0; batch < 50; batch++) {
+      pool.run(second.size(), [&second](std::size_t idx) { second[idx]++; });
+    }
+  });
+  for (int batch = 0; batch < 50; batch++) {
+    pool.run(first.size(), [&first](std::size_t idx) { first[idx]++; });
+  }
+  other.join();
+  bool all_ran { true };
+  for (std::size_t idx = 0; idx < first.size(); idx++) {
+    all_ran = all_ran && first[idx] == 50 && second[idx] == 50;
+  }
+  EXPECT(all_ran);
+}
+
+/**
+ * @brief runTasks() runs every task once, on no more threads than asked for.
+ */
+static void testRunTasks() {
+  std::vector<std::atomic<int>> runs(100);
+  std::atomic<int>              running { 0 };
+  std::atomic<int>              most_running { 0 };
+  runTasks(runs.size(), 3, [&](std::size_t idx) {
+    int now { ++running };
+    for (int seen = most_running; now > seen && !most_running.compare_exchange_weak(seen, now);) { }
+    runs[idx]++;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    running--;
+  });
+  bool once { true };
+  for (const std::atomic<int>& run : runs) {
+    once = once && run == 1;
+  }
+  EXPECT(once);
+  EXPECT(most_running <= 3);
+  EXPECT(workerThreads(0) >= 1);
+  EXPECT(workerThreads(5) == 5);
+}
+
+int main() {
+  testEveryTaskOnce();
+  testStealing();
+  testConcurrentBatches();
+  testRunTasks();
+  return test_failures == 0 ? 0 : 1;
+}